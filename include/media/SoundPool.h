@@ -21,6 +21,7 @@
 #include <utils/List.h>
 #include <utils/Vector.h>
 #include <utils/KeyedVector.h>
+#include <utils/String8.h>
 #include <media/AudioTrack.h>
 #include <binder/MemoryHeapBase.h>
 #include <binder/MemoryBase.h>
@@ -88,6 +89,7 @@ private:
     char*               mUrl;
     sp<IMemory>         mData;
     sp<MemoryHeapBase>  mHeap;
+    String8             mCacheKey;  // source of mData in SoundPoolCache, empty if not cached
 };
 
 // stores pending events for stolen channels
@@ -288,7 +288,8 @@ private:
     void clearWaveGens();
     tone_type getToneForRegion(tone_type toneType);
 
-    // WaveGenerator generates a single sine wave
+    // WaveGenerator generates a single sine wave, read from a table of one period
+    // precomputed at the amplitude of the wave
     class WaveGenerator {
     public:
         enum gen_command {
@@ -306,14 +307,14 @@ private:
 
     private:
         static constexpr short GEN_AMP = 32000;  // amplitude of generator
-        static constexpr short S_Q14 = 14;  // shift for Q14
         static constexpr short S_Q15 = 15;  // shift for Q15
+        static constexpr unsigned int TABLE_BITS = 9;  // log2 of the number of samples in the table
+        static constexpr unsigned int TABLE_SIZE = 1 << TABLE_BITS;
+        static constexpr unsigned int BLOCK_SIZE = 128;  // samples rendered before being accumulated
 
-        short mA1_Q14;  // Q14 coefficient
-        // delay line of full amplitude generator
-        short mS1, mS2;  // delay line S2 oldest
-        short mS2_0;  // saved value for reinitialisation
-        short mAmplitude_Q15;  // Q15 amplitude
+        short mTable[TABLE_SIZE + 1];  // one period of the wave, first sample repeated at the end
+        uint32_t mPhase;  // phase of the next sample, 2^32 is a full period
+        uint32_t mPhaseInc;  // phase increment per sample
     };
 
     KeyedVector<unsigned short, WaveGenerator *> mWaveGens;  // list of active wave generators.
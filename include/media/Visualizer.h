@@ -21,6 +21,14 @@
 #include <audio_effects/effect_visualizer.h>
 #include <utils/Thread.h>
 
+// Not in audio_effects/effect_visualizer.h yet, must match the visualizer effect.
+// With MEASUREMENT_MODE_FFT, the effect computes the spectrum of the capture once per buffer it
+// processes, and getFft() and getIntMeasurements() return it instead of computing their own.
+#ifndef MEASUREMENT_MODE_FFT
+#define MEASUREMENT_MODE_FFT 0x2
+#define VISUALIZER_CMD_FFT (EFFECT_CMD_FIRST_PROPRIETARY + 2)
+#endif
+
 /**
  * The Visualizer class enables application to retrieve part of the currently playing audio for
  * visualization purpose. It is not an audio recording interface and only returns partial and low
@@ -115,11 +123,13 @@ public:
     uint32_t getScalingMode() { return mScalingMode; }
 
     // set which measurements are done on the audio buffers processed by the effect.
-    // valid measurements (mask): MEASUREMENT_MODE_PEAK_RMS
+    // valid measurements (mask): MEASUREMENT_MODE_PEAK_RMS, MEASUREMENT_MODE_FFT
     status_t setMeasurementMode(uint32_t mode);
     uint32_t getMeasurementMode() { return mMeasurementMode; }
 
-    // return a set of int32_t measurements
+    // return a set of int32_t measurements: for MEASUREMENT_MODE_PEAK_RMS, the peak and RMS
+    // levels in mB; for MEASUREMENT_MODE_FFT, the magnitude of each of the getCaptureSize() / 2 + 1
+    // bins of the spectrum in mB, 0 being a full scale sine
     status_t getIntMeasurements(uint32_t type, uint32_t number, int32_t *measurements);
 
     // return a capture in PCM 8 bit unsigned format. The size of the capture is equal to
@@ -156,6 +166,7 @@ private:
     };
 
     status_t doFft(uint8_t *fft, uint8_t *waveform);
+    status_t getEffectFft(uint8_t *fft);
     void periodicCapture();
     uint32_t initCaptureSize();
 
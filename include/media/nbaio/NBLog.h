@@ -32,12 +32,32 @@ public:
 class Writer;
 class Reader;
 
+// Identifiers of typed events, see Writer::logEvent().  They are part of the shared memory
+// format, so only append new identifiers, and add their names to eventName().
+enum EventId {
+    EVENT_ID_NONE,
+    EVENT_ID_WRITE_BLOCKED,     // playback thread write() took too long: duration in us,
+                                //      number of delayed writes
+    EVENT_ID_FAST_UNDERRUN,     // fast mixer cycle took too long: duration in us
+    EVENT_ID_FAST_OVERRUN,      // fast mixer cycle was too short: duration in us
+    EVENT_ID_RECORD_OVERFLOW,   // record thread client not reading: number of retries
+    EVENT_ID_RECORD_READ_ERROR, // record thread read() failed: status
+    EVENT_ID_COUNT
+};
+
+// maximum number of int32_t arguments of a typed event
+static const size_t kMaxEventArgs = 8;
+
+// returns the name of a typed event, or NULL if unknown
+static const char *eventName(EventId id);
+
 private:
 
 enum Event {
     EVENT_RESERVED,
     EVENT_STRING,               // ASCII string, not NUL-terminated
     EVENT_TIMESTAMP,            // clock_gettime(CLOCK_MONOTONIC)
+    EVENT_TYPED,                // typed event, see TypedEvent
 };
 
 // ---------------------------------------------------------------------------
@@ -48,8 +68,6 @@ struct Entry {
         : mEvent(event), mLength(length), mData(data) { }
     /*virtual*/ ~Entry() { }
 
-    int     readAt(size_t offset) const;
-
 private:
     friend class Writer;
     Event       mEvent;     // event type
@@ -68,6 +86,12 @@ private:
 //  byte[2+mLength]     duplicate copy of mLength to permit reverse scan
 //  byte[3+mLength]     start of next log entry
 
+// data of an EVENT_TYPED entry, packed and not aligned in shared memory
+//  int64_t             CLOCK_MONOTONIC timestamp in nanoseconds
+//  uint16_t            EventId
+//  int32_t[]           0 to kMaxEventArgs arguments
+static const size_t kTypedEventHeaderSize = sizeof(int64_t) + sizeof(uint16_t);
+
 // located in shared memory
 struct Shared {
     Shared() : mRear(0) { }
@@ -126,6 +150,16 @@ public:
     virtual void    logTimestamp();
     virtual void    logTimestamp(const struct timespec& ts);
 
+    // Log a typed event with up to kMaxEventArgs arguments, stamped with 'ts' if non-NULL,
+    // otherwise with the current CLOCK_MONOTONIC time.  There is no formatting: the reader
+    // prints the event name and arguments, so this is cheap enough for every cycle of a
+    // real-time thread.  Each thread should log to its own Writer, which Reader::dumpMerged()
+    // can then interleave with the others.
+    virtual void    logEvent(EventId id, size_t argc, const int32_t *argv,
+                             const struct timespec *ts = NULL);
+            void    logEvent(EventId id, int32_t arg0, const struct timespec *ts = NULL)
+                            { logEvent(id, 1, &arg0, ts); }
+
     virtual bool    isEnabled() const;
 
     // return value for all of these is the previous isEnabled()
@@ -138,6 +172,8 @@ public:
 private:
     void    log(Event event, const void *data, size_t length);
     void    log(const Entry *entry, bool trusted = false);
+    // copy to the circular buffer at offset, with wraparound
+    void    copyToShared(size_t offset, const void *data, size_t length);
 
     const size_t    mSize;      // circular buffer size in bytes, must be a power of 2
     Shared* const   mShared;    // raw pointer to shared memory
@@ -159,6 +195,9 @@ public:
     virtual void    logvf(const char *fmt, va_list ap);
     virtual void    logTimestamp();
     virtual void    logTimestamp(const struct timespec& ts);
+    using Writer::logEvent;
+    virtual void    logEvent(EventId id, size_t argc, const int32_t *argv,
+                             const struct timespec *ts = NULL);
 
     virtual bool    isEnabled() const;
     virtual bool    setEnabled(bool enabled);
@@ -182,7 +221,20 @@ public:
     void    dump(int fd, size_t indent = 0);
     bool    isIMemory(const sp<IMemory>& iMemory) const;
 
+    // Dump the new entries of several logs, typically one per writing thread, as a single log
+    // in timestamp order.  Each line is prefixed with the name of its log.  Typed events carry
+    // their own time; strings take the time of the most recent timestamp in the same log, and
+    // are printed first if there is none.  Like dump(), this consumes the entries.
+    static void dumpMerged(int fd, size_t count, const sp<Reader> readers[],
+                           const char * const names[], size_t indent = 0);
+
 private:
+    // Copy the entries written since the last read, and advance past them.  Returns the copy,
+    // to be deleted by the caller, or NULL if there are no new entries.  On return 'avail' is
+    // the size of the copy, and 'first' the offset of its oldest complete entry; 'lost' is the
+    // number of bytes overwritten or incomplete, and 'maxSec' the largest timestamp second.
+    uint8_t *readEntries(size_t& avail, size_t& first, size_t& lost, time_t& maxSec);
+
     const size_t    mSize;      // circular buffer size in bytes, must be a power of 2
     const Shared* const mShared; // raw pointer to shared memory
     const sp<IMemory> mIMemory; // ref-counted version
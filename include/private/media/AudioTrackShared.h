@@ -23,6 +23,7 @@
 #include <utils/threads.h>
 #include <utils/Log.h>
 #include <utils/RefBase.h>
+#include <utils/Timers.h>
 #include <media/nbaio/roundup.h>
 #include <media/SingleStateQueue.h>
 #include <private/media/StaticAudioTrackState.h>
@@ -105,6 +106,9 @@ struct audio_track_cblk_t
     volatile    int32_t     mFutex;     // event flag: down (P) by client,
                                         // up (V) by server or binderDied() or interrupt()
 #define CBLK_FUTEX_WAKE 1               // if event flag bit is set, then a deferred wake is pending
+#define CBLK_FUTEX_WAIT_SHIFT 1         // the bits above CBLK_FUTEX_WAKE are the number of frames
+                                        // a client blocked in obtainBuffer() is waiting for,
+                                        // or 0 if the client is not blocked
 
 private:
 
@@ -171,6 +175,18 @@ protected:
     const bool      mClientInServer;    // true for OutputTrack, false for AudioTrack & AudioRecord
     bool            mIsShutdown;        // latch set to true when shared memory corruption detected
     size_t          mUnreleased;        // unreleased frames remaining from most recent obtainBuffer
+
+public:
+    // Number of futex wakeups issued by the server, or received by the client while blocked
+    // in obtainBuffer().  Updated without a barrier, for dumpsys only.
+    uint32_t        getWakeups() const { return mWakeups; }
+
+    // Average of getWakeups() per second since the proxy was created
+    float           getWakeupsPerSecond() const;
+
+protected:
+    uint32_t        mWakeups;
+    const nsecs_t   mCreatedNs;         // systemTime() when the proxy was created
 };
 
 // ----------------------------------------------------------------------------
@@ -192,7 +208,8 @@ public:
     // sets or extends the unreleased frame count.
     // On entry:
     //  buffer->mFrameCount should be initialized to maximum number of desired frames,
-    //      which must be > 0.
+    //      which must be > 0.  While blocked, an AudioRecord client is not woken until
+    //      this many frames, up to half the buffer, are available.
     //  buffer->mNonContig is unused.
     //  buffer->mRaw is unused.
     //  requested is the requested timeout in local monotonic delta time units:
@@ -383,8 +400,13 @@ public:
     //  buffer->mRaw is NULL.
     virtual void        releaseBuffer(Buffer* buffer);
 
+    // Number of releaseBuffer() calls that would have woken the client, but did not because
+    // it was not blocked, or was blocked waiting for more frames than were available.
+    uint32_t            getCoalescedWakeups() const { return mCoalescedWakeups; }
+
 protected:
     size_t      mAvailToClient; // estimated frames available to client prior to releaseBuffer()
+    uint32_t    mCoalescedWakeups;
     int32_t     mFlush;         // our copy of cblk->u.mStreaming.mFlush, for streaming output only
 };
 
@@ -20,35 +20,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <math.h>
 #include "EffectDownmix.h"
 
-// Do not submit with DOWNMIX_TEST_CHANNEL_INDEX defined, strictly for testing
-//#define DOWNMIX_TEST_CHANNEL_INDEX 0
-// Do not submit with DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER defined, strictly for testing
-//#define DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER 0
-
-#define MINUS_3_DB_IN_Q19_12 2896 // -3dB = 0.707 * 2^12 = 2896
-
-typedef enum {
-    CHANNEL_MASK_SURROUND = AUDIO_CHANNEL_OUT_SURROUND,
-    CHANNEL_MASK_QUAD_BACK = AUDIO_CHANNEL_OUT_QUAD,
-    // like AUDIO_CHANNEL_OUT_QUAD with *_SIDE_* instead of *_BACK_*, same channel order
-    CHANNEL_MASK_QUAD_SIDE =
-            AUDIO_CHANNEL_OUT_FRONT_LEFT |
-            AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-            AUDIO_CHANNEL_OUT_SIDE_LEFT |
-            AUDIO_CHANNEL_OUT_SIDE_RIGHT,
-    CHANNEL_MASK_5POINT1_BACK = AUDIO_CHANNEL_OUT_5POINT1,
-    // like AUDIO_CHANNEL_OUT_5POINT1 with *_SIDE_* instead of *_BACK_*, same channel order
-    CHANNEL_MASK_5POINT1_SIDE =
-            AUDIO_CHANNEL_OUT_FRONT_LEFT |
-            AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-            AUDIO_CHANNEL_OUT_FRONT_CENTER |
-            AUDIO_CHANNEL_OUT_LOW_FREQUENCY |
-            AUDIO_CHANNEL_OUT_SIDE_LEFT |
-            AUDIO_CHANNEL_OUT_SIDE_RIGHT,
-    CHANNEL_MASK_7POINT1_SIDE_BACK = AUDIO_CHANNEL_OUT_7POINT1,
-} downmix_input_channel_mask_t;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON (true)
+#else
+#define USE_NEON (false)
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2 (true)
+#else
+#define USE_SSE2 (false)
+#endif
+
+// Do not submit with DOWNMIX_TEST_MATRIX defined, strictly for testing
+//#define DOWNMIX_TEST_MATRIX 0
+
+#define UNITY_GAIN_IN_Q19_12 4096   // 1.0 * 2^12
+#define MINUS_3_DB_IN_Q19_12 2896   // -3dB = 0.707 * 2^12 = 2896
 
 // effect_handle_t interface implementation for downmix effect
 const struct effect_interface_s gDownmixInterface = {
@@ -95,60 +88,20 @@ const int kNbEffects = sizeof(gDescriptors) / sizeof(const effect_descriptor_t *
 /*----------------------------------------------------------------------------
  * Test code
  *--------------------------------------------------------------------------*/
-#ifdef DOWNMIX_TEST_CHANNEL_INDEX
-// strictly for testing, logs the indices of the channels for a given mask,
-// uses the same code as Downmix_foldGeneric()
-void Downmix_testIndexComputation(uint32_t mask) {
-    ALOGI("Testing index computation for 0x%x:", mask);
-    // check against unsupported channels
-    if (mask & kUnsupported) {
-        ALOGE("Unsupported channels (top or front left/right of center)");
+#ifdef DOWNMIX_TEST_MATRIX
+// strictly for testing, logs the downmix matrix for a given mask
+void Downmix_testMatrix(uint32_t mask) {
+    downmix_object_t downmixer;
+    int c;
+    ALOGI("Testing downmix matrix for 0x%x:", mask);
+    if (!Downmix_setMatrix(&downmixer, mask)) {
         return;
     }
-    // verify has FL/FR
-    if ((mask & AUDIO_CHANNEL_OUT_STEREO) != AUDIO_CHANNEL_OUT_STEREO) {
-        ALOGE("Front channels must be present");
-        return;
+    ALOGI("  channel  left   right  (Q19.12)");
+    for (c = 0; c < downmixer.input_channel_count; c++) {
+        const int index = (c >> 2) * 8 + (c & 3);
+        ALOGI("  %7d  %5d  %5d", c, downmixer.matrix_q12[index], downmixer.matrix_q12[index + 4]);
     }
-    // verify uses SIDE as a pair (ok if not using SIDE at all)
-    bool hasSides = false;
-    if ((mask & kSides) != 0) {
-        if ((mask & kSides) != kSides) {
-            ALOGE("Side channels must be used as a pair");
-            return;
-        }
-        hasSides = true;
-    }
-    // verify uses BACK as a pair (ok if not using BACK at all)
-    bool hasBacks = false;
-    if ((mask & kBacks) != 0) {
-        if ((mask & kBacks) != kBacks) {
-            ALOGE("Back channels must be used as a pair");
-            return;
-        }
-        hasBacks = true;
-    }
-
-    const int numChan = popcount(mask);
-    const bool hasFC = ((mask & AUDIO_CHANNEL_OUT_FRONT_CENTER) == AUDIO_CHANNEL_OUT_FRONT_CENTER);
-    const bool hasLFE =
-            ((mask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY) == AUDIO_CHANNEL_OUT_LOW_FREQUENCY);
-    const bool hasBC = ((mask & AUDIO_CHANNEL_OUT_BACK_CENTER) == AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // compute at what index each channel is: samples will be in the following order:
-    //   FL FR FC LFE BL BR BC SL SR
-    // when a channel is not present, its index is set to the same as the index of the preceding
-    // channel
-    const int indexFC  = hasFC    ? 2            : 1;        // front center
-    const int indexLFE = hasLFE   ? indexFC + 1  : indexFC;  // low frequency
-    const int indexBL  = hasBacks ? indexLFE + 1 : indexLFE; // back left
-    const int indexBR  = hasBacks ? indexBL + 1  : indexBL;  // back right
-    const int indexBC  = hasBC    ? indexBR + 1  : indexBR;  // back center
-    const int indexSL  = hasSides ? indexBC + 1  : indexBC;  // side left
-    const int indexSR  = hasSides ? indexSL + 1  : indexSL;  // side right
-
-    ALOGI("  FL FR FC LFE BL BR BC SL SR");
-    ALOGI("   %d  %d  %d   %d  %d  %d  %d  %d  %d",
-            0, 1, indexFC, indexLFE, indexBL, indexBR, indexBC, indexSL, indexSR);
 }
 #endif
 
@@ -170,24 +123,20 @@ int32_t DownmixLib_Create(const effect_uuid_t *uuid,
 
     ALOGV("DownmixLib_Create()");
 
-#ifdef DOWNMIX_TEST_CHANNEL_INDEX
+#ifdef DOWNMIX_TEST_MATRIX
     // should work (won't log an error)
-    ALOGI("DOWNMIX_TEST_CHANNEL_INDEX: should work:");
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
+    ALOGI("DOWNMIX_TEST_MATRIX: should work:");
+    Downmix_testMatrix(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
                     AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_BACK_CENTER);
-    Downmix_testIndexComputation(CHANNEL_MASK_QUAD_SIDE | CHANNEL_MASK_QUAD_BACK);
-    Downmix_testIndexComputation(CHANNEL_MASK_5POINT1_SIDE | AUDIO_CHANNEL_OUT_BACK_CENTER);
-    Downmix_testIndexComputation(CHANNEL_MASK_5POINT1_BACK | AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // shouldn't work (will log an error, won't display channel indices)
-    ALOGI("DOWNMIX_TEST_CHANNEL_INDEX: should NOT work:");
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-                        AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_BACK_LEFT);
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-                            AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_SIDE_LEFT);
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT |
-                        AUDIO_CHANNEL_OUT_BACK_LEFT | AUDIO_CHANNEL_OUT_BACK_RIGHT);
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT |
-                            AUDIO_CHANNEL_OUT_SIDE_LEFT | AUDIO_CHANNEL_OUT_SIDE_RIGHT);
+    Downmix_testMatrix(AUDIO_CHANNEL_OUT_5POINT1 | AUDIO_CHANNEL_OUT_BACK_CENTER);
+    Downmix_testMatrix(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
+                        AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_SIDE_LEFT);
+    Downmix_testMatrix(AUDIO_CHANNEL_OUT_7POINT1 | AUDIO_CHANNEL_OUT_TOP_FRONT_LEFT |
+                        AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT);
+    // shouldn't work (will log an error, won't display the matrix)
+    ALOGI("DOWNMIX_TEST_MATRIX: should NOT work:");
+    Downmix_testMatrix(AUDIO_CHANNEL_OUT_FRONT_LEFT);
+    Downmix_testMatrix(AUDIO_CHANNEL_OUT_STEREO | 0x80000000);
 #endif
 
     if (pHandle == NULL || uuid == NULL) {
@@ -293,17 +242,29 @@ static int Downmix_Process(effect_handle_t self,
         return -ENODATA;
     }
 
-    pSrc = inBuffer->s16;
-    pDst = outBuffer->s16;
     size_t numFrames = outBuffer->frameCount;
 
     const bool accumulate =
             (pDwmModule->config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE);
-    const uint32_t downmixInputChannelMask = pDwmModule->config.inputCfg.channels;
+    const bool isFloat = (pDwmModule->config.inputCfg.format == DOWNMIX_FORMAT_PCM_FLOAT);
 
     switch(pDownmixer->type) {
 
       case DOWNMIX_TYPE_STRIP:
+          if (isFloat) {
+              const float *pSrcF = inBuffer->f32;
+              float *pDstF = outBuffer->f32;
+              while (numFrames) {
+                  pDstF[0] = accumulate ? pDstF[0] + pSrcF[0] : pSrcF[0];
+                  pDstF[1] = accumulate ? pDstF[1] + pSrcF[1] : pSrcF[1];
+                  pSrcF += pDownmixer->input_channel_count;
+                  pDstF += 2;
+                  numFrames--;
+              }
+              break;
+          }
+          pSrc = inBuffer->s16;
+          pDst = outBuffer->s16;
           if (accumulate) {
               while (numFrames) {
                   pDst[0] = clamp16(pDst[0] + pSrc[0]);
@@ -324,40 +285,13 @@ static int Downmix_Process(effect_handle_t self,
           break;
 
       case DOWNMIX_TYPE_FOLD:
-#ifdef DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER
-          // bypass the optimized downmix routines for the common formats
-          if (!Downmix_foldGeneric(
-                  downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-              ALOGE("Multichannel configuration 0x%x is not supported", downmixInputChannelMask);
-              return -EINVAL;
+          // the matrix of the input channel mask was set by Downmix_Configure()
+          if (isFloat) {
+              Downmix_foldFloat(pDownmixer, inBuffer->f32, outBuffer->f32, numFrames, accumulate);
+          } else {
+              Downmix_foldInt16(pDownmixer, inBuffer->s16, outBuffer->s16, numFrames, accumulate);
           }
           break;
-#endif
-        // optimize for the common formats
-        switch((downmix_input_channel_mask_t)downmixInputChannelMask) {
-        case CHANNEL_MASK_QUAD_BACK:
-        case CHANNEL_MASK_QUAD_SIDE:
-            Downmix_foldFromQuad(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_SURROUND:
-            Downmix_foldFromSurround(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_5POINT1_BACK:
-        case CHANNEL_MASK_5POINT1_SIDE:
-            Downmix_foldFrom5Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_7POINT1_SIDE_BACK:
-            Downmix_foldFrom7Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        default:
-            if (!Downmix_foldGeneric(
-                    downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-                ALOGE("Multichannel configuration 0x%x is not supported", downmixInputChannelMask);
-                return -EINVAL;
-            }
-            break;
-        }
-        break;
 
       default:
         return -EINVAL;
@@ -625,27 +559,32 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
     // Check configuration compatibility with build options, and effect capabilities
     if (pConfig->inputCfg.samplingRate != pConfig->outputCfg.samplingRate
         || pConfig->outputCfg.channels != DOWNMIX_OUTPUT_CHANNELS
-        || pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT
-        || pConfig->outputCfg.format != AUDIO_FORMAT_PCM_16_BIT) {
+        || pConfig->inputCfg.format != pConfig->outputCfg.format
+        || (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT
+            && pConfig->inputCfg.format != DOWNMIX_FORMAT_PCM_FLOAT)) {
         ALOGE("Downmix_Configure error: invalid config");
         return -EINVAL;
     }
 
-    memmove(&pDwmModule->config, pConfig, sizeof(effect_config_t));
-
     if (init) {
         pDownmixer->type = DOWNMIX_TYPE_FOLD;
         pDownmixer->apply_volume_correction = false;
-        pDownmixer->input_channel_count = 8; // matches default input of AUDIO_CHANNEL_OUT_7POINT1
     } else {
         // when configuring the effect, do not allow a blank channel mask
         if (pConfig->inputCfg.channels == 0) {
             ALOGE("Downmix_Configure error: input channel mask can't be 0");
             return -EINVAL;
         }
-        pDownmixer->input_channel_count = popcount(pConfig->inputCfg.channels);
+    }
+    // also sets input_channel_count
+    if (!Downmix_setMatrix(pDownmixer, pConfig->inputCfg.channels)) {
+        ALOGE("Downmix_Configure error: multichannel configuration 0x%x is not supported",
+                pConfig->inputCfg.channels);
+        return -EINVAL;
     }
 
+    memmove(&pDwmModule->config, pConfig, sizeof(effect_config_t));
+
     Downmix_Reset(pDownmixer, init);
 
     return 0;
@@ -781,373 +720,259 @@ int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, size_t *pS
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFromQuad()
+ * Downmix_setMatrix()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix a quad signal to stereo
+ * Set the stereo downmix matrix of a multichannel format:
+ *  - the left channels (see kLeftChannels) are folded into the left output at unity gain
+ *  - the right channels (see kRightChannels) are folded into the right output at unity gain
+ *  - the other channels (centers and LFE) are folded into both outputs at -3dB
+ * The matrix is the same as the one of the per-format downmixers it replaces, so the 16-bit
+ * output is unchanged for the formats they supported.
  *
  * Inputs:
- *  pSrc       quad audio samples to downmix
- *  numFrames  the number of quad frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
+ *  pDownmixer  pointer to downmix context
+ *  mask        the channel mask of the input
  *
  * Outputs:
- *  pDst       downmixed stereo audio samples
+ *  pDownmixer->input_channel_count, pDownmixer->matrix_q12 and pDownmixer->matrix
+ *
+ * Returns: false if the multichannel format is not supported, in which case pDownmixer is not
+ *  modified
  *
  *----------------------------------------------------------------------------
  */
-void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is RL
-    // sample at index 3 is RR
-    if (accumulate) {
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp16(pDst[0] + ((pSrc[0] + pSrc[2]) >> 1));
-            // FR + RR
-            pDst[1] = clamp16(pDst[1] + ((pSrc[1] + pSrc[3]) >> 1));
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
-        }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp16((pSrc[0] + pSrc[2]) >> 1);
-            // FR + RR
-            pDst[1] = clamp16((pSrc[1] + pSrc[3]) >> 1);
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
-        }
+bool Downmix_setMatrix(downmix_object_t *pDownmixer, uint32_t mask) {
+    // channels are interleaved in the order of their bit in the mask, so channels without a
+    // position can't be placed
+    if (mask & ~AUDIO_CHANNEL_OUT_ALL) {
+        ALOGE("Unsupported channels 0x%x", mask & ~AUDIO_CHANNEL_OUT_ALL);
+        return false;
+    }
+    // downmixing is done in place, so there must be at least as many input as output channels
+    const int numChan = popcount(mask);
+    if (numChan < 2) {
+        ALOGE("At least 2 channels are needed");
+        return false;
     }
-}
-
 
-/*----------------------------------------------------------------------------
- * Downmix_foldFromSurround()
- *----------------------------------------------------------------------------
- * Purpose:
- * downmix a "surround sound" (mono rear) signal to stereo
- *
- * Inputs:
- *  pSrc       surround signal to downmix
- *  numFrames  the number of surround frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
- *
- * Outputs:
- *  pDst       downmixed stereo audio samples
- *
- *----------------------------------------------------------------------------
- */
-void Downmix_foldFromSurround(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    int32_t lt, rt, centerPlusRearContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is RC
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusRearContrib = FC(-3dB) + RC(-3dB)
-            centerPlusRearContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12) + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusRearContrib
-            lt = (pSrc[0] << 12) + centerPlusRearContrib;
-            // FR + centerPlusRearContrib
-            rt = (pSrc[1] << 12) + centerPlusRearContrib;
-            // accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
+    // The largest sum of coefficients is 6 unity and 6 -3dB channels, about 2^15.4 in Q19.12
+    // format, so the 32-bit sums of 16-bit samples can't overflow.
+    memset(pDownmixer->matrix_q12, 0, sizeof(pDownmixer->matrix_q12));
+    memset(pDownmixer->matrix, 0, sizeof(pDownmixer->matrix));
+    int c = 0;
+    int bit;
+    for (bit = 0; bit < DOWNMIX_MAX_INPUT_CHANNELS; bit++) {
+        const uint32_t channel = 1u << bit;
+        if (!(mask & channel)) {
+            continue;
         }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusRearContrib = FC(-3dB) + RC(-3dB)
-            centerPlusRearContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12) + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusRearContrib
-            lt = (pSrc[0] << 12) + centerPlusRearContrib;
-            // FR + centerPlusRearContrib
-            rt = (pSrc[1] << 12) + centerPlusRearContrib;
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
+        const int left = (c >> 2) * 8 + (c & 3);
+        const int right = left + 4;
+        if (channel & kLeftChannels) {
+            pDownmixer->matrix_q12[left] = UNITY_GAIN_IN_Q19_12;
+            pDownmixer->matrix[left] = 1.0f;
+        } else if (channel & kRightChannels) {
+            pDownmixer->matrix_q12[right] = UNITY_GAIN_IN_Q19_12;
+            pDownmixer->matrix[right] = 1.0f;
+        } else {
+            pDownmixer->matrix_q12[left] = MINUS_3_DB_IN_Q19_12;
+            pDownmixer->matrix_q12[right] = MINUS_3_DB_IN_Q19_12;
+            pDownmixer->matrix[left] = (float) M_SQRT1_2;
+            pDownmixer->matrix[right] = (float) M_SQRT1_2;
         }
+        c++;
     }
+    pDownmixer->input_channel_count = numChan;
+    return true;
 }
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFrom5Point1()
+ * Downmix_foldInt16()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix a 5.1 signal to stereo
+ * downmix 16-bit multichannel audio to stereo with the matrix set by Downmix_setMatrix().
+ * Each output is the sum of the input channels weighted in Q19.12 format, scaled by 1/2 and
+ * clamped; all the formats are folded by the same code.
  *
  * Inputs:
- *  pSrc       5.1 audio samples to downmix
- *  numFrames  the number of 5.1 frames to downmix
+ *  pDownmixer multichannel format and its matrix
+ *  pSrc       multichannel audio samples to downmix
+ *  numFrames  the number of multichannel frames to downmix
  *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
  *               or overwrite pDst (when false)
  *
  * Outputs:
- *  pDst       downmixed stereo audio samples
+ *  pDst       downmixed stereo audio samples, can be pSrc
  *
  *----------------------------------------------------------------------------
  */
-void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[5] << 12);
-            // accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += 6;
-            pDst += 2;
-            numFrames--;
+void Downmix_foldInt16(const downmix_object_t *pDownmixer,
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, bool accumulate) {
+    const int numChan = pDownmixer->input_channel_count;
+    const int16_t *matrix = pDownmixer->matrix_q12;
+    int32_t lt, rt; // samples in Q19.12 format
+    int c;
+
+#if USE_NEON || USE_SSE2
+    const int numGroups = (numChan + 3) >> 2;
+    int g;
+    // The vector loop reads whole groups of 4 samples, so the last group of a frame reads the
+    // first samples of the next frame, weighted by the zero padding of the matrix.  The frames
+    // whose group would read past the end of pSrc are left to the scalar loop.  When downmixing
+    // in place, the next frame has not been written yet as it is further in the buffer.
+    const size_t overread = (numGroups << 2) - numChan;
+    const size_t scalarFrames = (overread + numChan - 1) / numChan;
+    while (numFrames > scalarFrames) {
+#if USE_NEON
+        int32x4_t accL = vdupq_n_s32(0);
+        int32x4_t accR = vdupq_n_s32(0);
+        for (g = 0; g < numGroups; g++) {
+            const int16x4_t x = vld1_s16(pSrc + (g << 2));
+            const int16x8_t coefs = vld1q_s16(matrix + (g << 3));
+            accL = vmlal_s16(accL, x, vget_low_s16(coefs));
+            accR = vmlal_s16(accR, x, vget_high_s16(coefs));
+        }
+        // [lt, rt] >> 13
+        int32x2_t out = vpadd_s32(
+                vpadd_s32(vget_low_s32(accL), vget_high_s32(accL)),
+                vpadd_s32(vget_low_s32(accR), vget_high_s32(accR)));
+        out = vshr_n_s32(out, 13);
+        if (accumulate) {
+            const int16x4_t dst = vreinterpret_s16_s32(vld1_dup_s32((const int32_t *) pDst));
+            out = vadd_s32(out, vget_low_s32(vmovl_s16(dst)));
+        }
+        // clamp16 both
+        vst1_lane_s32((int32_t *) pDst, vreinterpret_s32_s16(vqmovn_s32(vcombine_s32(out, out))),
+                0);
+#else
+        __m128i acc = _mm_setzero_si128();
+        for (g = 0; g < numGroups; g++) {
+            __m128i x = _mm_loadl_epi64((const __m128i *) (pSrc + (g << 2)));
+            x = _mm_unpacklo_epi64(x, x);
+            // [lt of channels 0 and 1, lt of 2 and 3, rt of 0 and 1, rt of 2 and 3]
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(x,
+                    _mm_loadu_si128((const __m128i *) (matrix + (g << 3)))));
         }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[5] << 12);
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += 6;
-            pDst += 2;
-            numFrames--;
+        acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+        __m128i out = _mm_srai_epi32(_mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 2, 2, 0)), 13);
+        if (accumulate) {
+            const __m128i dst = _mm_cvtsi32_si128(*(const int32_t *) pDst);
+            out = _mm_add_epi32(out, _mm_srai_epi32(_mm_unpacklo_epi16(dst, dst), 16));
         }
+        // clamp16 both
+        *(int32_t *) pDst = _mm_cvtsi128_si32(_mm_packs_epi32(out, out));
+#endif
+        pSrc += numChan;
+        pDst += 2;
+        numFrames--;
     }
-}
-
+#endif
 
-/*----------------------------------------------------------------------------
- * Downmix_foldFrom7Point1()
- *----------------------------------------------------------------------------
- * Purpose:
- * downmix a 7.1 signal to stereo
- *
- * Inputs:
- *  pSrc       7.1 audio samples to downmix
- *  numFrames  the number of 7.1 frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
- *
- * Outputs:
- *  pDst       downmixed stereo audio samples
- *
- *----------------------------------------------------------------------------
- */
-void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // sample at index 6 is SL
-    // sample at index 7 is SR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[6] << 12) + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[7] << 12) + (pSrc[5] << 12);
-            //accumulate in destination
+    while (numFrames) {
+        lt = 0;
+        rt = 0;
+        for (c = 0; c < numChan; c++) {
+            const int index = (c >> 2) * 8 + (c & 3);
+            lt += pSrc[c] * matrix[index];
+            rt += pSrc[c] * matrix[index + 4];
+        }
+        if (accumulate) {
             pDst[0] = clamp16(pDst[0] + (lt >> 13));
             pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
-    }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[6] << 12) + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[7] << 12) + (pSrc[5] << 12);
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
+        } else {
+            pDst[0] = clamp16(lt >> 13);
+            pDst[1] = clamp16(rt >> 13);
         }
+        pSrc += numChan;
+        pDst += 2;
+        numFrames--;
     }
 }
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldGeneric()
+ * Downmix_foldFloat()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix to stereo a multichannel signal whose format is:
- *  - has FL/FR
- *  - if using AUDIO_CHANNEL_OUT_SIDE*, it contains both left and right
- *  - if using AUDIO_CHANNEL_OUT_BACK*, it contains both left and right
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_TOP* channels
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_FRONT_*_OF_CENTER channels
- * Only handles channel masks not enumerated in downmix_input_channel_mask_t
+ * downmix float multichannel audio to stereo with the matrix set by Downmix_setMatrix().
+ * As in the 16-bit downmix the output is scaled by 1/2, but it is not clamped.
  *
  * Inputs:
- *  mask       the channel mask of pSrc
- *  pSrc       multichannel audio buffer to downmix
+ *  pDownmixer multichannel format and its matrix
+ *  pSrc       multichannel audio samples to downmix
  *  numFrames  the number of multichannel frames to downmix
  *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
  *               or overwrite pDst (when false)
  *
  * Outputs:
- *  pDst       downmixed stereo audio samples
- *
- * Returns: false if multichannel format is not supported
+ *  pDst       downmixed stereo audio samples, can be pSrc
  *
  *----------------------------------------------------------------------------
  */
-bool Downmix_foldGeneric(
-        uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    // check against unsupported channels
-    if (mask & kUnsupported) {
-        ALOGE("Unsupported channels (top or front left/right of center)");
-        return false;
-    }
-    // verify has FL/FR
-    if ((mask & AUDIO_CHANNEL_OUT_STEREO) != AUDIO_CHANNEL_OUT_STEREO) {
-        ALOGE("Front channels must be present");
-        return false;
-    }
-    // verify uses SIDE as a pair (ok if not using SIDE at all)
-    bool hasSides = false;
-    if ((mask & kSides) != 0) {
-        if ((mask & kSides) != kSides) {
-            ALOGE("Side channels must be used as a pair");
-            return false;
+void Downmix_foldFloat(const downmix_object_t *pDownmixer,
+        const float *pSrc, float *pDst, size_t numFrames, bool accumulate) {
+    const int numChan = pDownmixer->input_channel_count;
+    // groups of 4 channels within the frame, zero padding weighs 0 * sample and so would turn
+    // an infinite sample of the next frame into NaN
+    const int numFullGroups = numChan >> 2;
+    const float *matrix = pDownmixer->matrix;
+    float lt, rt;
+    int g, c;
+
+    while (numFrames) {
+#if USE_NEON
+        float32x4_t accL = vdupq_n_f32(0.0f);
+        float32x4_t accR = vdupq_n_f32(0.0f);
+        for (g = 0; g < numFullGroups; g++) {
+            const float32x4_t x = vld1q_f32(pSrc + (g << 2));
+            accL = vmlaq_f32(accL, x, vld1q_f32(matrix + (g << 3)));
+            accR = vmlaq_f32(accR, x, vld1q_f32(matrix + (g << 3) + 4));
         }
-        hasSides = true;
-    }
-    // verify uses BACK as a pair (ok if not using BACK at all)
-    bool hasBacks = false;
-    if ((mask & kBacks) != 0) {
-        if ((mask & kBacks) != kBacks) {
-            ALOGE("Back channels must be used as a pair");
-            return false;
+        const float32x2_t sum = vpadd_f32(
+                vpadd_f32(vget_low_f32(accL), vget_high_f32(accL)),
+                vpadd_f32(vget_low_f32(accR), vget_high_f32(accR)));
+        lt = vget_lane_f32(sum, 0);
+        rt = vget_lane_f32(sum, 1);
+#elif USE_SSE2
+        __m128 accL = _mm_setzero_ps();
+        __m128 accR = _mm_setzero_ps();
+        for (g = 0; g < numFullGroups; g++) {
+            const __m128 x = _mm_loadu_ps(pSrc + (g << 2));
+            accL = _mm_add_ps(accL, _mm_mul_ps(x, _mm_loadu_ps(matrix + (g << 3))));
+            accR = _mm_add_ps(accR, _mm_mul_ps(x, _mm_loadu_ps(matrix + (g << 3) + 4)));
         }
-        hasBacks = true;
-    }
-
-    const int numChan = popcount(mask);
-    const bool hasFC = ((mask & AUDIO_CHANNEL_OUT_FRONT_CENTER) == AUDIO_CHANNEL_OUT_FRONT_CENTER);
-    const bool hasLFE =
-            ((mask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY) == AUDIO_CHANNEL_OUT_LOW_FREQUENCY);
-    const bool hasBC = ((mask & AUDIO_CHANNEL_OUT_BACK_CENTER) == AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // compute at what index each channel is: samples will be in the following order:
-    //   FL FR FC LFE BL BR BC SL SR
-    // when a channel is not present, its index is set to the same as the index of the preceding
-    // channel
-    const int indexFC  = hasFC    ? 2            : 1;        // front center
-    const int indexLFE = hasLFE   ? indexFC + 1  : indexFC;  // low frequency
-    const int indexBL  = hasBacks ? indexLFE + 1 : indexLFE; // back left
-    const int indexBR  = hasBacks ? indexBL + 1  : indexBL;  // back right
-    const int indexBC  = hasBC    ? indexBR + 1  : indexBR;  // back center
-    const int indexSL  = hasSides ? indexBC + 1  : indexBC;  // side left
-    const int indexSR  = hasSides ? indexSL + 1  : indexSL;  // side right
-
-    int32_t lt, rt, centersLfeContrib; // samples in Q19.12 format
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_Q19_12;
-            // always has FL/FR
-            lt = (pSrc[0] << 12);
-            rt = (pSrc[1] << 12);
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL] << 12;
-                rt += pSrc[indexSR] << 12;
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL] << 12;
-                rt += pSrc[indexBR] << 12;
+        // [lt of channels 0 and 2, rt of 0 and 2, lt of 1 and 3, rt of 1 and 3]
+        __m128 sum = _mm_add_ps(_mm_unpacklo_ps(accL, accR), _mm_unpackhi_ps(accL, accR));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        lt = _mm_cvtss_f32(sum);
+        rt = _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+#else
+        lt = 0.0f;
+        rt = 0.0f;
+        for (g = 0; g < numFullGroups; g++) {
+            for (c = 0; c < 4; c++) {
+                lt += pSrc[(g << 2) + c] * matrix[(g << 3) + c];
+                rt += pSrc[(g << 2) + c] * matrix[(g << 3) + c + 4];
             }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
         }
-    } else {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_Q19_12;
-            // always has FL/FR
-            lt = (pSrc[0] << 12);
-            rt = (pSrc[1] << 12);
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL] << 12;
-                rt += pSrc[indexSR] << 12;
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL] << 12;
-                rt += pSrc[indexBR] << 12;
-            }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
+#endif
+        // channels of the last partial group
+        for (c = numFullGroups << 2; c < numChan; c++) {
+            const int index = (c >> 2) * 8 + (c & 3);
+            lt += pSrc[c] * matrix[index];
+            rt += pSrc[c] * matrix[index + 4];
         }
+        if (accumulate) {
+            pDst[0] += lt * 0.5f;
+            pDst[1] += rt * 0.5f;
+        } else {
+            pDst[0] = lt * 0.5f;
+            pDst[1] = rt * 0.5f;
+        }
+        pSrc += numChan;
+        pDst += 2;
+        numFrames--;
     }
-    return true;
 }
@@ -43,6 +43,9 @@ const effect_descriptor_t gLEDescriptor = {
         "The Android Open Source Project",
 };
 
+// number of frames converted to float and compressed at a time by LE_process()
+#define LE_BLOCK_FRAMES 256
+
 enum le_state_e {
     LOUDNESS_ENHANCER_STATE_UNINITIALIZED,
     LOUDNESS_ENHANCER_STATE_INITIALIZED,
@@ -180,6 +183,7 @@ int LE_init(LoudnessEnhancerContext *pContext)
     }
 
     LE_setConfig(pContext, &pContext->mConfig);
+    pContext->mCompressor->ClearLookahead();
 
     return 0;
 }
@@ -280,16 +284,23 @@ int LE_process(
     }
 
     //ALOGV("LE about to process %d samples", inBuffer->frameCount);
-    uint16_t inIdx;
     float inputAmp = pow(10, pContext->mTargetGainmB/2000.0f);
-    float leftSample, rightSample;
-    for (inIdx = 0 ; inIdx < inBuffer->frameCount ; inIdx++) {
+    float block[2 * LE_BLOCK_FRAMES];
+    for (size_t done = 0; done < inBuffer->frameCount; done += LE_BLOCK_FRAMES) {
+        size_t frames = inBuffer->frameCount - done;
+        if (frames > LE_BLOCK_FRAMES) {
+            frames = LE_BLOCK_FRAMES;
+        }
+        int16_t *samples = inBuffer->s16 + 2 * done;
         // makeup gain is applied on the input of the compressor
-        leftSample  = inputAmp * (float)inBuffer->s16[2*inIdx];
-        rightSample = inputAmp * (float)inBuffer->s16[2*inIdx +1];
-        pContext->mCompressor->Compress(&leftSample, &rightSample);
-        inBuffer->s16[2*inIdx]    = (int16_t) leftSample;
-        inBuffer->s16[2*inIdx +1] = (int16_t) rightSample;
+        for (size_t i = 0; i < frames * 2; i++) {
+            block[i] = inputAmp * (float)samples[i];
+        }
+        // the compressor works on whole blocks, and delays its output by its lookahead
+        pContext->mCompressor->Compress(block, frames);
+        for (size_t i = 0; i < frames * 2; i++) {
+            samples[i] = (int16_t) block[i];
+        }
     }
 
     if (inBuffer->raw != outBuffer->raw) {
@@ -342,6 +353,10 @@ int LE_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
         break;
     case EFFECT_CMD_RESET:
         LE_reset(pContext);
+        // a parameter update keeps the audio in the lookahead, a reset drops it
+        if (pContext->mCompressor != NULL) {
+            pContext->mCompressor->ClearLookahead();
+        }
         break;
     case EFFECT_CMD_ENABLE:
         if (pReplyData == NULL || *replySize != sizeof(int)) {
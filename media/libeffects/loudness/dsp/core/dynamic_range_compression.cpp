@@ -15,6 +15,7 @@
  */
 
 #include <cmath>
+#include <string.h>
 
 #include "common/core/math.h"
 #include "common/core/types.h"
@@ -25,6 +26,20 @@
 //#define LOG_NDEBUG 0
 #include <cutils/log.h>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON (true)
+#else
+#define USE_NEON (false)
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2 (true)
+#else
+#define USE_SSE2 (false)
+#endif
+
 
 namespace le_fx {
 
@@ -41,8 +56,12 @@ const float AdaptiveDynamicRangeCompression::kDefaultKneeThresholdInDecibel =
 const float AdaptiveDynamicRangeCompression::kCompressionRatio = 7.0f;
 const float AdaptiveDynamicRangeCompression::kTauAttack = 0.001f;
 const float AdaptiveDynamicRangeCompression::kTauRelease = 0.015f;
+const float AdaptiveDynamicRangeCompression::kLookaheadTime = 0.001f;
+const int AdaptiveDynamicRangeCompression::kBlockFrames;
 
-AdaptiveDynamicRangeCompression::AdaptiveDynamicRangeCompression() {
+AdaptiveDynamicRangeCompression::AdaptiveDynamicRangeCompression()
+    : lookahead_(NULL),
+      lookahead_frames_(0) {
   static const float kTargetGain[] = {
       1.0f, 2.0f, 3.0f, 4.0f, 5.0f };
   static const float kKneeThreshold[] = {
@@ -52,9 +71,15 @@ AdaptiveDynamicRangeCompression::AdaptiveDynamicRangeCompression() {
       sizeof(kTargetGain) / sizeof(kTargetGain[0]));
 }
 
+AdaptiveDynamicRangeCompression::~AdaptiveDynamicRangeCompression() {
+  delete[] lookahead_;
+}
+
 bool AdaptiveDynamicRangeCompression::Initialize(
         float target_gain, float sampling_rate) {
   set_knee_threshold_via_target_gain(target_gain);
+  // The held input is only valid at the sampling rate it was received at
+  const bool rate_changed = lookahead_ == NULL || sampling_rate != sampling_rate_;
   sampling_rate_ = sampling_rate;
   state_ = 0.0f;
   compressor_gain_ = 1.0f;
@@ -72,9 +97,23 @@ bool AdaptiveDynamicRangeCompression::Initialize(
   }
   // Feed-forward topology
   slope_ = 1.0f / kCompressionRatio - 1.0f;
+  if (rate_changed) {
+    const int lookahead_frames =
+        static_cast<int>(kLookaheadTime * sampling_rate_ + 0.5f);
+    if (lookahead_ == NULL || lookahead_frames != lookahead_frames_) {
+      delete[] lookahead_;
+      lookahead_frames_ = lookahead_frames;
+      lookahead_ = new float[2 * (lookahead_frames_ + kBlockFrames)];
+    }
+    ClearLookahead();
+  }
   return true;
 }
 
+void AdaptiveDynamicRangeCompression::ClearLookahead() {
+  memset(lookahead_, 0, 2 * lookahead_frames_ * sizeof(float));
+}
+
 float AdaptiveDynamicRangeCompression::Compress(float x) {
   const float max_abs_x = std::max(std::fabs(x), kMinLogAbsValue);
   const float max_abs_x_dB = math::fast_log(max_abs_x);
@@ -137,5 +176,155 @@ void AdaptiveDynamicRangeCompression::Compress(float *x1, float *x2) {
   }
 }
 
-}  // namespace le_fx
+void AdaptiveDynamicRangeCompression::Compress(float *x, size_t frames) {
+  float cv[kBlockFrames];
+  float gain[kBlockFrames];
+  float *const delayed = lookahead_;
+  float *const input = lookahead_ + 2 * lookahead_frames_;
+  while (frames > 0) {
+    const int n = frames < static_cast<size_t>(kBlockFrames) ?
+        static_cast<int>(frames) : kBlockFrames;
+    memcpy(input, x, 2 * n * sizeof(float));
 
+    // Control values of the block: the same computation as Compress(x1, x2),
+    // with math::fast_log() inlined, 4 frames at a time
+    int i = 0;
+#if USE_NEON
+    {
+      const float32x4_t min_abs = vdupq_n_f32(kMinLogAbsValue);
+      const int32x4_t exponent_mask = vdupq_n_s32(255);
+      const int32x4_t exponent_bias = vdupq_n_s32(128);
+      const int32x4_t mantissa_mask = vdupq_n_s32(~(255 << 23));
+      const int32x4_t mantissa_exponent = vdupq_n_s32(127 << 23);
+      const float32x4_t c1 = vdupq_n_f32(-1.0f / 3);
+      const float32x4_t c2 = vdupq_n_f32(2.0f);
+      const float32x4_t c3 = vdupq_n_f32(2.0f / 3);
+      const float32x4_t ln2 = vdupq_n_f32(
+          0.693147180559945286226763982995180413126945495605468750f);
+      const float32x4_t knee = vdupq_n_f32(knee_threshold_);
+      const float32x4_t zero = vdupq_n_f32(0.0f);
+      const float32x4_t slope = vdupq_n_f32(slope_);
+      for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t lr = vld2q_f32(input + 2 * i);
+        const float32x4_t abs_x = vmaxq_f32(
+            vabsq_f32(lr.val[0]), vmaxq_f32(vabsq_f32(lr.val[1]), min_abs));
+        int32x4_t bits = vreinterpretq_s32_f32(abs_x);
+        const int32x4_t log_2 = vsubq_s32(
+            vandq_s32(vshrq_n_s32(bits, 23), exponent_mask), exponent_bias);
+        bits = vaddq_s32(vandq_s32(bits, mantissa_mask), mantissa_exponent);
+        float32x4_t val = vreinterpretq_f32_s32(bits);
+        val = vsubq_f32(vmulq_f32(vaddq_f32(vmulq_f32(c1, val), c2), val), c3);
+        val = vmulq_f32(vaddq_f32(val, vcvtq_f32_s32(log_2)), ln2);
+        vst1q_f32(cv + i, vmulq_f32(vmaxq_f32(vsubq_f32(val, knee), zero),
+                                    slope));
+      }
+    }
+#elif USE_SSE2
+    {
+      const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+      const __m128 min_abs = _mm_set1_ps(kMinLogAbsValue);
+      const __m128i exponent_mask = _mm_set1_epi32(255);
+      const __m128i exponent_bias = _mm_set1_epi32(128);
+      const __m128i mantissa_mask = _mm_set1_epi32(~(255 << 23));
+      const __m128i mantissa_exponent = _mm_set1_epi32(127 << 23);
+      const __m128 c1 = _mm_set1_ps(-1.0f / 3);
+      const __m128 c2 = _mm_set1_ps(2.0f);
+      const __m128 c3 = _mm_set1_ps(2.0f / 3);
+      const __m128 ln2 = _mm_set1_ps(
+          0.693147180559945286226763982995180413126945495605468750f);
+      const __m128 knee = _mm_set1_ps(knee_threshold_);
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 slope = _mm_set1_ps(slope_);
+      for (; i + 4 <= n; i += 4) {
+        const __m128 a = _mm_loadu_ps(input + 2 * i);
+        const __m128 b = _mm_loadu_ps(input + 2 * i + 4);
+        const __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m128 abs_x = _mm_max_ps(
+            _mm_and_ps(left, abs_mask),
+            _mm_max_ps(_mm_and_ps(right, abs_mask), min_abs));
+        __m128i bits = _mm_castps_si128(abs_x);
+        const __m128i log_2 = _mm_sub_epi32(
+            _mm_and_si128(_mm_srai_epi32(bits, 23), exponent_mask),
+            exponent_bias);
+        bits = _mm_add_epi32(_mm_and_si128(bits, mantissa_mask),
+                             mantissa_exponent);
+        __m128 val = _mm_castsi128_ps(bits);
+        val = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c1, val), c2), val),
+                         c3);
+        val = _mm_mul_ps(_mm_add_ps(val, _mm_cvtepi32_ps(log_2)), ln2);
+        _mm_storeu_ps(cv + i, _mm_mul_ps(_mm_max_ps(_mm_sub_ps(val, knee),
+                                                    zero), slope));
+      }
+    }
+#endif
+    for (; i < n; ++i) {
+      const float max_abs_x = std::max(std::fabs(input[2 * i]),
+        std::max(std::fabs(input[2 * i + 1]), kMinLogAbsValue));
+      const float overshoot = math::fast_log(max_abs_x) - knee_threshold_;
+      cv[i] = std::max(overshoot, 0.0f) * slope_;
+    }
+
+    // Envelope detector, with the choice between attack and release made by a
+    // select rather than a branch
+    float state = state_;
+    float compressor_gain = compressor_gain_;
+    for (i = 0; i < n; ++i) {
+      const float alpha = cv[i] <= state ? alpha_attack_ : alpha_release_;
+      const float prev_state = state;
+      state = alpha * state + (1.0f - alpha) * cv[i];
+      compressor_gain *=
+          math::ExpApproximationViaTaylorExpansionOrder5(state - prev_state);
+      gain[i] = compressor_gain;
+    }
+    state_ = state;
+    compressor_gain_ = compressor_gain;
+
+    // Gains applied to the delayed input, 4 frames at a time
+    i = 0;
+#if USE_NEON
+    {
+      const float32x4_t max_x = vdupq_n_f32(kFixedPointLimit);
+      const float32x4_t min_x = vdupq_n_f32(-kFixedPointLimit);
+      for (; i + 4 <= n; i += 4) {
+        const float32x4_t g = vld1q_f32(gain + i);
+        const float32x4x2_t gg = vzipq_f32(g, g);
+        const float32x4_t a = vmulq_f32(vld1q_f32(delayed + 2 * i), gg.val[0]);
+        const float32x4_t b =
+            vmulq_f32(vld1q_f32(delayed + 2 * i + 4), gg.val[1]);
+        vst1q_f32(x + 2 * i, vmaxq_f32(vminq_f32(a, max_x), min_x));
+        vst1q_f32(x + 2 * i + 4, vmaxq_f32(vminq_f32(b, max_x), min_x));
+      }
+    }
+#elif USE_SSE2
+    {
+      const __m128 max_x = _mm_set1_ps(kFixedPointLimit);
+      const __m128 min_x = _mm_set1_ps(-kFixedPointLimit);
+      for (; i + 4 <= n; i += 4) {
+        const __m128 g = _mm_loadu_ps(gain + i);
+        const __m128 a = _mm_mul_ps(_mm_loadu_ps(delayed + 2 * i),
+                                    _mm_unpacklo_ps(g, g));
+        const __m128 b = _mm_mul_ps(_mm_loadu_ps(delayed + 2 * i + 4),
+                                    _mm_unpackhi_ps(g, g));
+        _mm_storeu_ps(x + 2 * i, _mm_max_ps(_mm_min_ps(a, max_x), min_x));
+        _mm_storeu_ps(x + 2 * i + 4, _mm_max_ps(_mm_min_ps(b, max_x), min_x));
+      }
+    }
+#endif
+    for (; i < n; ++i) {
+      x[2 * i] = std::max(std::min(delayed[2 * i] * gain[i], kFixedPointLimit),
+                          -kFixedPointLimit);
+      x[2 * i + 1] = std::max(
+          std::min(delayed[2 * i + 1] * gain[i], kFixedPointLimit),
+          -kFixedPointLimit);
+    }
+
+    // Keeps the last lookahead_frames_ frames of input for the next block
+    memmove(lookahead_, lookahead_ + 2 * n,
+            2 * lookahead_frames_ * sizeof(float));
+    x += 2 * n;
+    frames -= n;
+  }
+}
+
+}  // namespace le_fx
@@ -33,6 +33,7 @@ namespace le_fx {
 class AdaptiveDynamicRangeCompression {
  public:
     AdaptiveDynamicRangeCompression();
+    ~AdaptiveDynamicRangeCompression();
 
     // Initializes the compressor using prior information. It assumes that the
     // input signal is speech from high-quality recordings that is scaled and then
@@ -49,8 +50,15 @@ class AdaptiveDynamicRangeCompression {
     //
     // If nothing is known regarding the input, a `target_gain` of 1.0f is a
     // relatively safe choice for many signals.
+    //
+    // The input held by the lookahead of the block version is kept, so that a
+    // new target gain does not drop audio, unless the sampling rate changes.
     bool Initialize(float target_gain, float sampling_rate);
 
+  // Drops the input held by the lookahead of the block version, which then
+  // outputs lookahead_frames() frames of silence first.
+  void ClearLookahead();
+
   // A fast version of the algorithm that uses approximate computations for the
   // log(.) and exp(.).
   float Compress(float x);
@@ -58,6 +66,18 @@ class AdaptiveDynamicRangeCompression {
   // Stereo channel version of the compressor
   void Compress(float *x1, float *x2);
 
+  // Block version of the stereo compressor, processing `frames` interleaved
+  // stereo frames in place. The control values of a block are computed and the
+  // gains applied to it with SIMD, so only the envelope detector runs sample by
+  // sample. The output is delayed by L = lookahead_frames(): output frame i is
+  // input frame i - L times the gain the detector reached on input frame i.
+  // The gain applied to a frame thus already reacts to the L frames after it,
+  // and is reduced by the time a peak reaches the output.
+  void Compress(float *x, size_t frames);
+
+  // The delay introduced by the block version, in frames
+  int lookahead_frames() const { return lookahead_frames_; }
+
   // This version is slower than Compress(.) but faster than CompressSlow(.)
   float CompressNormalSpeed(float x);
 
@@ -91,6 +111,11 @@ class AdaptiveDynamicRangeCompression {
   static const float kTauAttack;
   // The release time of the envelope detector
   static const float kTauRelease;
+  // The lookahead of the block version, in seconds. It matches the attack time
+  // so the gain has mostly settled when the peak that triggered it is output.
+  static const float kLookaheadTime;
+  // The number of frames the block version processes at a time
+  static const int kBlockFrames = 64;
 
   float sampling_rate_;
   // the internal state of the envelope detector
@@ -108,6 +133,10 @@ class AdaptiveDynamicRangeCompression {
   // This interpolator provides the function that relates target gain to knee
   // threshold.
   sigmod::InterpolatorLinear<float> target_gain_to_knee_threshold_;
+  // The input of the block version not output yet: lookahead_frames_ stereo
+  // frames, followed by room for one block
+  float *lookahead_;
+  int lookahead_frames_;
 
   LE_FX_DISALLOW_COPY_AND_ASSIGN(AdaptiveDynamicRangeCompression);
 };
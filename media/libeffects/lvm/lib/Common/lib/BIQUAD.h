@@ -308,6 +308,17 @@ void PK_2I_D32F32C14G11_TRC_WRA_01 (        Biquad_Instance_t       *pInstance,
                                             LVM_INT32                    *pDataOut,
                                             LVM_INT16                    NrSamples);
 
+/* Cascade of PK_2I_D32F32C14G11 (pShifts[k] = 14) and PK_2I_D32F32C30G11 (pShifts[k] = 30)
+   sections, filtered in one pass with both channels in parallel */
+#define PK_CASCADE_MAX_SECTIONS     8
+
+void PK_2I_D32F32CxxG11_Cascade_TRC_WRA_01 ( Biquad_Instance_t      **ppInstances,
+                                            const LVM_INT16              *pShifts,
+                                            LVM_INT16                    NrSections,
+                                            LVM_INT32                    *pDataIn,
+                                            LVM_INT32                    *pDataOut,
+                                            LVM_INT16                    NrSamples);
+
 
 /**********************************************************************************
    FUNCTION PROTOTYPES: DC REMOVAL FILTERS
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2004-2010 NXP Software
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BIQUAD.h"
+#include "PK_2I_D32F32CssGss_TRC_WRA_01_Private.h"
+#include "LVM_Macros.h"
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/**************************************************************************
+ ASSUMPTIONS:
+ Each section is a peaking filter initialised by either
+ PK_2I_D32F32CssGss_TRC_WRA_01_Init (pShifts[k] is 14) or
+ PK_2I_D32F32CllGss_TRC_WRA_01_Init (pShifts[k] is 30), so it has the
+ coefficient and delay layout of PK_2I_D32F32C14G11_TRC_WRA_01 and
+ PK_2I_D32F32C30G11_TRC_WRA_01 respectively:
+
+ COEFS-
+ pBiquadState->coefs[0] is A0,
+ pBiquadState->coefs[1] is -B2,
+ pBiquadState->coefs[2] is -B1, these are in Q14 or Q30 format
+ pBiquadState->coefs[3] is Gain, in Q11 format
+
+ DELAYS-
+ pBiquadState->pDelays[0] is x(n-1)L in Q0 format
+ pBiquadState->pDelays[1] is x(n-1)R in Q0 format
+ pBiquadState->pDelays[2] is x(n-2)L in Q0 format
+ pBiquadState->pDelays[3] is x(n-2)R in Q0 format
+ pBiquadState->pDelays[4] is y(n-1)L in Q0 format
+ pBiquadState->pDelays[5] is y(n-1)R in Q0 format
+ pBiquadState->pDelays[6] is y(n-2)L in Q0 format
+ pBiquadState->pDelays[7] is y(n-2)R in Q0 format
+
+ The output of section k is the input of section k+1.  Each sample goes
+ through all the sections before the next one is read, with the delays
+ held in registers for the whole block, and the left and right channels
+ are filtered in parallel on NEON.  The output is bit-exact with calling
+ the single section functions one after the other.
+
+ NrSections must not exceed PK_CASCADE_MAX_SECTIONS.
+***************************************************************************/
+
+#if defined(__ARM_NEON__)
+
+/* ((A (Q0) * Coef) >> Shift) of both channels, truncated to 32 bits as MUL32x16INTO32 and
+   MUL32x32INTO32 do */
+#define PK_CASCADE_MUL(A, Coef, Shift) \
+        vmovn_s64(vshlq_s64(vmull_n_s32((A), (Coef)), (Shift)))
+
+void PK_2I_D32F32CxxG11_Cascade_TRC_WRA_01 ( Biquad_Instance_t       **ppInstances,
+                                             const LVM_INT16         *pShifts,
+                                             LVM_INT16               NrSections,
+                                             LVM_INT32               *pDataIn,
+                                             LVM_INT32               *pDataOut,
+                                             LVM_INT16               NrSamples)
+    {
+        int32x2_t   x1[PK_CASCADE_MAX_SECTIONS], x2[PK_CASCADE_MAX_SECTIONS];
+        int32x2_t   y1[PK_CASCADE_MAX_SECTIONS], y2[PK_CASCADE_MAX_SECTIONS];
+        int64x2_t   shift[PK_CASCADE_MAX_SECTIONS];
+        int32_t     a0[PK_CASCADE_MAX_SECTIONS], b2[PK_CASCADE_MAX_SECTIONS];
+        int32_t     b1[PK_CASCADE_MAX_SECTIONS], gain[PK_CASCADE_MAX_SECTIONS];
+        const int64x2_t gainShift = vdupq_n_s64(-11);
+        int32x2_t   xn, yn, ynO;
+        LVM_INT16   ii, k;
+
+        for (k = 0; k < NrSections; k++)
+        {
+            PFilter_State pBiquadState = (PFilter_State) ppInstances[k];
+            x1[k] = vld1_s32((const int32_t *) &pBiquadState->pDelays[0]);
+            x2[k] = vld1_s32((const int32_t *) &pBiquadState->pDelays[2]);
+            y1[k] = vld1_s32((const int32_t *) &pBiquadState->pDelays[4]);
+            y2[k] = vld1_s32((const int32_t *) &pBiquadState->pDelays[6]);
+            a0[k] = pBiquadState->coefs[0];
+            b2[k] = pBiquadState->coefs[1];
+            b1[k] = pBiquadState->coefs[2];
+            gain[k] = pBiquadState->coefs[3];
+            shift[k] = vdupq_n_s64(-pShifts[k]);
+        }
+
+        for (ii = NrSamples; ii != 0; ii--)
+        {
+            /* x(n)L and x(n)R */
+            xn = vld1_s32((const int32_t *) pDataIn);
+            pDataIn += 2;
+
+            for (k = 0; k < NrSections; k++)
+            {
+                /* yn= (A0 * (x(n) - x(n-2)) >>Shift) + (-B2 * y(n-2) >>Shift)
+                       + (-B1 * y(n-1) >>Shift) in Q0 */
+                yn = PK_CASCADE_MUL(vsub_s32(xn, x2[k]), a0[k], shift[k]);
+                yn = vadd_s32(yn, PK_CASCADE_MUL(y2[k], b2[k], shift[k]));
+                yn = vadd_s32(yn, PK_CASCADE_MUL(y1[k], b1[k], shift[k]));
+
+                /* ynO= ((Gain (Q11) * yn (Q0))>>11) + x(n) in Q0 */
+                ynO = vadd_s32(PK_CASCADE_MUL(yn, gain[k], gainShift), xn);
+
+                /* Update the delays */
+                y2[k] = y1[k];
+                x2[k] = x1[k];
+                y1[k] = yn;
+                x1[k] = xn;
+
+                /* The output of this section is the input of the next */
+                xn = ynO;
+            }
+
+            vst1_s32((int32_t *) pDataOut, xn);
+            pDataOut += 2;
+        }
+
+        for (k = 0; k < NrSections; k++)
+        {
+            PFilter_State pBiquadState = (PFilter_State) ppInstances[k];
+            vst1_s32((int32_t *) &pBiquadState->pDelays[0], x1[k]);
+            vst1_s32((int32_t *) &pBiquadState->pDelays[2], x2[k]);
+            vst1_s32((int32_t *) &pBiquadState->pDelays[4], y1[k]);
+            vst1_s32((int32_t *) &pBiquadState->pDelays[6], y2[k]);
+        }
+    }
+
+#else /* __ARM_NEON__ */
+
+void PK_2I_D32F32CxxG11_Cascade_TRC_WRA_01 ( Biquad_Instance_t       **ppInstances,
+                                             const LVM_INT16         *pShifts,
+                                             LVM_INT16               NrSections,
+                                             LVM_INT32               *pDataIn,
+                                             LVM_INT32               *pDataOut,
+                                             LVM_INT16               NrSamples)
+    {
+        LVM_INT32   Delays[PK_CASCADE_MAX_SECTIONS][8];
+        LVM_INT32   xnL, xnR, ynL, ynR, templ;
+        LVM_INT16   ii, k;
+
+        for (k = 0; k < NrSections; k++)
+        {
+            PFilter_State pBiquadState = (PFilter_State) ppInstances[k];
+            for (ii = 0; ii < 8; ii++)
+            {
+                Delays[k][ii] = pBiquadState->pDelays[ii];
+            }
+        }
+
+        for (ii = NrSamples; ii != 0; ii--)
+        {
+            xnL = *pDataIn++;
+            xnR = *pDataIn++;
+
+            for (k = 0; k < NrSections; k++)
+            {
+                PFilter_State pBiquadState = (PFilter_State) ppInstances[k];
+                LVM_INT32 *pDelays = Delays[k];
+
+                if (pShifts[k] == 14)
+                {
+                    /* ynL= (A0 (Q14) * (x(n)L (Q0) - x(n-2)L (Q0) ) >>14)  in Q0*/
+                    templ = xnL - pDelays[2];
+                    MUL32x16INTO32(templ,pBiquadState->coefs[0],ynL,14)
+                    MUL32x16INTO32(pDelays[6],pBiquadState->coefs[1],templ,14)
+                    ynL += templ;
+                    MUL32x16INTO32(pDelays[4],pBiquadState->coefs[2],templ,14)
+                    ynL += templ;
+
+                    templ = xnR - pDelays[3];
+                    MUL32x16INTO32(templ,pBiquadState->coefs[0],ynR,14)
+                    MUL32x16INTO32(pDelays[7],pBiquadState->coefs[1],templ,14)
+                    ynR += templ;
+                    MUL32x16INTO32(pDelays[5],pBiquadState->coefs[2],templ,14)
+                    ynR += templ;
+                }
+                else
+                {
+                    /* ynL= (A0 (Q30) * (x(n)L (Q0) - x(n-2)L (Q0) ) >>30)  in Q0*/
+                    templ = xnL - pDelays[2];
+                    MUL32x32INTO32(templ,pBiquadState->coefs[0],ynL,30)
+                    MUL32x32INTO32(pDelays[6],pBiquadState->coefs[1],templ,30)
+                    ynL += templ;
+                    MUL32x32INTO32(pDelays[4],pBiquadState->coefs[2],templ,30)
+                    ynL += templ;
+
+                    templ = xnR - pDelays[3];
+                    MUL32x32INTO32(templ,pBiquadState->coefs[0],ynR,30)
+                    MUL32x32INTO32(pDelays[7],pBiquadState->coefs[1],templ,30)
+                    ynR += templ;
+                    MUL32x32INTO32(pDelays[5],pBiquadState->coefs[2],templ,30)
+                    ynR += templ;
+                }
+
+                /* Update the delays */
+                pDelays[7] = pDelays[5];
+                pDelays[6] = pDelays[4];
+                pDelays[3] = pDelays[1];
+                pDelays[2] = pDelays[0];
+                pDelays[5] = ynR;
+                pDelays[4] = ynL;
+                pDelays[1] = xnR;
+                pDelays[0] = xnL;
+
+                /* ynO= ((Gain (Q11) * yn (Q0))>>11) + x(n) in Q0, the input of the next section */
+                MUL32x16INTO32(ynL,pBiquadState->coefs[3],templ,11)
+                xnL += templ;
+                MUL32x16INTO32(ynR,pBiquadState->coefs[3],templ,11)
+                xnR += templ;
+            }
+
+            *pDataOut++ = xnL;
+            *pDataOut++ = xnR;
+        }
+
+        for (k = 0; k < NrSections; k++)
+        {
+            PFilter_State pBiquadState = (PFilter_State) ppInstances[k];
+            for (ii = 0; ii < 8; ii++)
+            {
+                pBiquadState->pDelays[ii] = Delays[k][ii];
+            }
+        }
+    }
+
+#endif /* __ARM_NEON__ */
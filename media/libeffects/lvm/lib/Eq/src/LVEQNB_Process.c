@@ -65,7 +65,9 @@ LVEQNB_ReturnStatus_en LVEQNB_Process(LVEQNB_Handle_t       hInstance,
 {
 
     LVM_UINT16          i;
-    Biquad_Instance_t   *pBiquad;
+    Biquad_Instance_t   *pBiquads[PK_CASCADE_MAX_SECTIONS];
+    LVM_INT16           Shifts[PK_CASCADE_MAX_SECTIONS];
+    LVM_INT16           NrSections;
     LVEQNB_Instance_t   *pInstance = (LVEQNB_Instance_t  *)hInstance;
     LVM_INT32           *pScratch;
 
@@ -103,51 +105,58 @@ LVEQNB_ReturnStatus_en LVEQNB_Process(LVEQNB_Handle_t       hInstance,
                                  SHIFT);                    /* Scaling shift */
 
         /*
-         * For each section execte the filter unless the gain is 0dB
+         * Execute the filters of the bands with a non-zero dB gain, up to
+         * PK_CASCADE_MAX_SECTIONS of them at a time in one cascade
          */
-        if (pInstance->NBands != 0)
+        NrSections = 0;
+        for (i=0; i<pInstance->NBands; i++)
         {
-            for (i=0; i<pInstance->NBands; i++)
+            /*
+             * Check if band is non-zero dB gain
+             */
+            if (pInstance->pBandDefinitions[i].Gain == 0)
             {
-                /*
-                 * Check if band is non-zero dB gain
-                 */
-                if (pInstance->pBandDefinitions[i].Gain != 0)
-                {
-                    /*
-                     * Get the address of the biquad instance
-                     */
-                    pBiquad = &pInstance->pEQNB_FilterState[i];
-
-
-                    /*
-                     * Select single or double precision as required
-                     */
-                    switch (pInstance->pBiquadType[i])
-                    {
-                        case LVEQNB_SinglePrecision:
-                        {
-                            PK_2I_D32F32C14G11_TRC_WRA_01(pBiquad,
-                                                          (LVM_INT32 *)pScratch,
-                                                          (LVM_INT32 *)pScratch,
-                                                          (LVM_INT16)NumSamples);
-                            break;
-                        }
-
-                        case LVEQNB_DoublePrecision:
-                        {
-                            PK_2I_D32F32C30G11_TRC_WRA_01(pBiquad,
-                                                          (LVM_INT32 *)pScratch,
-                                                          (LVM_INT32 *)pScratch,
-                                                          (LVM_INT16)NumSamples);
-                            break;
-                        }
-                        default:
-                            break;
-                    }
-                }
+                continue;
+            }
+
+            /*
+             * Select single or double precision as required
+             */
+            switch (pInstance->pBiquadType[i])
+            {
+                case LVEQNB_SinglePrecision:
+                    Shifts[NrSections] = 14;
+                    break;
+
+                case LVEQNB_DoublePrecision:
+                    Shifts[NrSections] = 30;
+                    break;
+
+                default:
+                    continue;
+            }
+            pBiquads[NrSections++] = &pInstance->pEQNB_FilterState[i];
+
+            if (NrSections == PK_CASCADE_MAX_SECTIONS)
+            {
+                PK_2I_D32F32CxxG11_Cascade_TRC_WRA_01(pBiquads,
+                                                      Shifts,
+                                                      NrSections,
+                                                      (LVM_INT32 *)pScratch,
+                                                      (LVM_INT32 *)pScratch,
+                                                      (LVM_INT16)NumSamples);
+                NrSections = 0;
             }
         }
+        if (NrSections != 0)
+        {
+            PK_2I_D32F32CxxG11_Cascade_TRC_WRA_01(pBiquads,
+                                                  Shifts,
+                                                  NrSections,
+                                                  (LVM_INT32 *)pScratch,
+                                                  (LVM_INT32 *)pScratch,
+                                                  (LVM_INT16)NumSamples);
+        }
 
 
         if(pInstance->bInOperatingModeTransition == LVM_TRUE){
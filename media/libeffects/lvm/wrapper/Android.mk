@@ -36,7 +36,8 @@ include $(CLEAR_VARS)
 LOCAL_ARM_MODE := arm
 
 LOCAL_SRC_FILES:= \
-    Reverb/EffectReverb.cpp
+    Reverb/EffectReverb.cpp \
+    Reverb/ConvolutionReverb.cpp
 
 LOCAL_CFLAGS += -fvisibility=hidden -fno-strict-aliasing
 
@@ -48,6 +49,7 @@ LOCAL_STATIC_LIBRARIES += libreverb
 
 LOCAL_SHARED_LIBRARIES := \
      libcutils \
+     libutils \
      libdl
 
 LOCAL_C_INCLUDES += \
@@ -57,3 +59,23 @@ LOCAL_C_INCLUDES += \
     $(call include-path-for, audio-effects)
 
 include $(BUILD_SHARED_LIBRARY)
+
+# test tool of the reverb convolution engine, checks it against direct convolution
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    Reverb/test-convolution.cpp \
+    Reverb/ConvolutionReverb.cpp
+
+LOCAL_STATIC_LIBRARIES := \
+    libcutils \
+    liblog
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/Reverb
+
+LOCAL_MODULE:= test-convolution
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
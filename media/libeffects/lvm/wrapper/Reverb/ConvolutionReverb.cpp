@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ConvolutionReverb"
+//#define LOG_NDEBUG 0
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ConvolutionReverb.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON (true)
+#else
+#define USE_NEON (false)
+#endif
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#define USE_SSE (true)
+#else
+#define USE_SSE (false)
+#endif
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+RealFft::RealFft(uint32_t size)
+    : mSize(size), mHalf(size / 2)
+{
+    mBitReverse = (uint32_t *) malloc(mHalf * sizeof(uint32_t));
+    mCos = (float *) malloc((mHalf / 2 + 1) * sizeof(float));
+    mSin = (float *) malloc((mHalf / 2 + 1) * sizeof(float));
+    mSplitCos = (float *) malloc((mHalf + 1) * sizeof(float));
+    mSplitSin = (float *) malloc((mHalf + 1) * sizeof(float));
+    mRe = (float *) malloc(mHalf * sizeof(float));
+    mIm = (float *) malloc(mHalf * sizeof(float));
+    LOG_ALWAYS_FATAL_IF(mBitReverse == NULL || mCos == NULL || mSin == NULL ||
+            mSplitCos == NULL || mSplitSin == NULL || mRe == NULL || mIm == NULL,
+            "RealFft(%u) out of memory", size);
+
+    uint32_t bits = 0;
+    while ((1u << bits) < mHalf) {
+        bits++;
+    }
+    for (uint32_t i = 0; i < mHalf; i++) {
+        uint32_t reversed = 0;
+        for (uint32_t b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        mBitReverse[i] = reversed;
+    }
+    // e^(-2 pi i k / n) in double precision, so the twiddles are exact to float precision
+    for (uint32_t k = 0; k <= mHalf / 2; k++) {
+        double phase = 2 * M_PI * k / mHalf;
+        mCos[k] = (float) cos(phase);
+        mSin[k] = (float) -sin(phase);
+    }
+    for (uint32_t k = 0; k <= mHalf; k++) {
+        double phase = 2 * M_PI * k / mSize;
+        mSplitCos[k] = (float) cos(phase);
+        mSplitSin[k] = (float) -sin(phase);
+    }
+}
+
+RealFft::~RealFft()
+{
+    free(mBitReverse);
+    free(mCos);
+    free(mSin);
+    free(mSplitCos);
+    free(mSplitSin);
+    free(mRe);
+    free(mIm);
+}
+
+// In place radix-2 decimation in time, with the conjugate twiddles for the inverse
+void RealFft::complexFft(float *re, float *im, bool inverse) const
+{
+    const uint32_t n = mHalf;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t j = mBitReverse[i];
+        if (j > i) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    const float sign = inverse ? -1.0f : 1.0f;
+    for (uint32_t len = 2; len <= n; len <<= 1) {
+        const uint32_t half = len >> 1;
+        const uint32_t step = n / len;
+        for (uint32_t i = 0; i < n; i += len) {
+            for (uint32_t j = 0; j < half; j++) {
+                const float wr = mCos[j * step];
+                const float wi = sign * mSin[j * step];
+                const uint32_t a = i + j;
+                const uint32_t b = a + half;
+                const float tr = re[b] * wr - im[b] * wi;
+                const float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+// The even samples are packed in the real part and the odd samples in the imaginary part of a
+// complex sequence of half the size, whose spectrum Z gives the spectra of the even and odd
+// samples: E[k] = (Z[k] + conj(Z[m-k])) / 2 and O[k] = (Z[k] - conj(Z[m-k])) / 2i, so
+// X[k] = E[k] + W^k O[k] with W = e^(-2 pi i / n).
+void RealFft::forward(const float *in, float *re, float *im)
+{
+    const uint32_t m = mHalf;
+    for (uint32_t k = 0; k < m; k++) {
+        mRe[k] = in[2 * k];
+        mIm[k] = in[2 * k + 1];
+    }
+    complexFft(mRe, mIm, false);
+    for (uint32_t k = 0; k <= m; k++) {
+        const uint32_t a = k == m ? 0 : k;
+        const uint32_t b = k == 0 ? 0 : m - k;
+        const float er = 0.5f * (mRe[a] + mRe[b]);
+        const float ei = 0.5f * (mIm[a] - mIm[b]);
+        const float or_ = 0.5f * (mIm[a] + mIm[b]);
+        const float oi = 0.5f * (mRe[b] - mRe[a]);
+        const float wr = mSplitCos[k];
+        const float wi = mSplitSin[k];
+        re[k] = er + or_ * wr - oi * wi;
+        im[k] = ei + or_ * wi + oi * wr;
+    }
+}
+
+// Inverse of forward(): E[k] = (X[k] + conj(X[m-k])) / 2, O[k] = (X[k] - conj(X[m-k])) / 2 W^-k
+// and Z[k] = E[k] + i O[k], whose inverse complex FFT is m times the interleaved samples.
+void RealFft::inverse(const float *re, const float *im, float *out)
+{
+    const uint32_t m = mHalf;
+    for (uint32_t k = 0; k < m; k++) {
+        const float er = 0.5f * (re[k] + re[m - k]);
+        const float ei = 0.5f * (im[k] - im[m - k]);
+        const float dr = 0.5f * (re[k] - re[m - k]);
+        const float di = 0.5f * (im[k] + im[m - k]);
+        // multiply by W^-k, the conjugate of the forward twiddle
+        const float wr = mSplitCos[k];
+        const float wi = -mSplitSin[k];
+        const float or_ = dr * wr - di * wi;
+        const float oi = dr * wi + di * wr;
+        mRe[k] = er - oi;
+        mIm[k] = ei + or_;
+    }
+    complexFft(mRe, mIm, true);
+    for (uint32_t k = 0; k < m; k++) {
+        out[2 * k] = mRe[k];
+        out[2 * k + 1] = mIm[k];
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+// sum += x * h over n complex bins held as separate real and imaginary arrays.  This is where
+// the time goes for long impulse responses.
+static void complexMultiplyAccumulate(const float *xRe, const float *xIm, const float *hRe,
+        const float *hIm, float *sumRe, float *sumIm, uint32_t n)
+{
+    uint32_t i = 0;
+#if USE_NEON
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t xr = vld1q_f32(xRe + i);
+        float32x4_t xi = vld1q_f32(xIm + i);
+        float32x4_t hr = vld1q_f32(hRe + i);
+        float32x4_t hi = vld1q_f32(hIm + i);
+        float32x4_t sr = vld1q_f32(sumRe + i);
+        float32x4_t si = vld1q_f32(sumIm + i);
+        sr = vmlaq_f32(sr, xr, hr);
+        sr = vmlsq_f32(sr, xi, hi);
+        si = vmlaq_f32(si, xr, hi);
+        si = vmlaq_f32(si, xi, hr);
+        vst1q_f32(sumRe + i, sr);
+        vst1q_f32(sumIm + i, si);
+    }
+#elif USE_SSE
+    for (; i + 4 <= n; i += 4) {
+        __m128 xr = _mm_loadu_ps(xRe + i);
+        __m128 xi = _mm_loadu_ps(xIm + i);
+        __m128 hr = _mm_loadu_ps(hRe + i);
+        __m128 hi = _mm_loadu_ps(hIm + i);
+        __m128 sr = _mm_loadu_ps(sumRe + i);
+        __m128 si = _mm_loadu_ps(sumIm + i);
+        sr = _mm_add_ps(sr, _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi)));
+        si = _mm_add_ps(si, _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr)));
+        _mm_storeu_ps(sumRe + i, sr);
+        _mm_storeu_ps(sumIm + i, si);
+    }
+#endif
+    for (; i < n; i++) {
+        sumRe[i] += xRe[i] * hRe[i] - xIm[i] * hIm[i];
+        sumIm[i] += xRe[i] * hIm[i] + xIm[i] * hRe[i];
+    }
+}
+
+ConvolutionImpulseResponse::ConvolutionImpulseResponse()
+    : mFrames(0), mPartitions(0)
+{
+    for (int c = 0; c < 2; c++) {
+        mRe[c] = NULL;
+        mIm[c] = NULL;
+    }
+}
+
+ConvolutionImpulseResponse::~ConvolutionImpulseResponse()
+{
+    for (int c = 0; c < 2; c++) {
+        // a mono impulse response shares its spectra between the outputs
+        if (c == 0 || mRe[1] != mRe[0]) {
+            free(mRe[c]);
+            free(mIm[c]);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+ConvolutionReverb::ConvolutionReverb(uint32_t blockSize, uint32_t inChannels, uint32_t maxFrames)
+    : mBlockSize(blockSize), mBins(blockSize + 1), mInChannels(inChannels),
+      mMaxPartitions((maxFrames + blockSize - 1) / blockSize),
+      mFft(2 * blockSize), mControlFft(2 * blockSize), mPending(-1), mRetired(-1), mActive(-1),
+      mFdlHead(0), mFill(0)
+{
+    LOG_ALWAYS_FATAL_IF(inChannels != 1 && inChannels != 2,
+            "ConvolutionReverb %u input channels", inChannels);
+    for (int i = 0; i < 3; i++) {
+        mIr[i] = NULL;
+    }
+    // the delay line holds the longest impulse response, so it survives impulse response changes
+    const size_t fdlSize = (size_t) mMaxPartitions * mBins * sizeof(float);
+    for (int c = 0; c < 2; c++) {
+        mFdlRe[c] = NULL;
+        mFdlIm[c] = NULL;
+        if ((uint32_t) c < inChannels) {
+            mFdlRe[c] = (float *) calloc(1, fdlSize);
+            mFdlIm[c] = (float *) calloc(1, fdlSize);
+        }
+        mInput[c] = (float *) calloc(2 * blockSize, sizeof(float));
+        mOutput[c] = (float *) calloc(blockSize, sizeof(float));
+    }
+    mSumRe = (float *) malloc(mBins * sizeof(float));
+    mSumIm = (float *) malloc(mBins * sizeof(float));
+    mWork = (float *) malloc(2 * blockSize * sizeof(float));
+    mControlWork = (float *) malloc(2 * blockSize * sizeof(float));
+    LOG_ALWAYS_FATAL_IF(mFdlRe[0] == NULL || mFdlIm[0] == NULL ||
+            (inChannels == 2 && (mFdlRe[1] == NULL || mFdlIm[1] == NULL)) ||
+            mInput[0] == NULL || mInput[1] == NULL || mOutput[0] == NULL ||
+            mOutput[1] == NULL || mSumRe == NULL || mSumIm == NULL || mWork == NULL ||
+            mControlWork == NULL, "ConvolutionReverb(%u, %u) out of memory", blockSize, maxFrames);
+}
+
+ConvolutionReverb::~ConvolutionReverb()
+{
+    for (int i = 0; i < 3; i++) {
+        delete mIr[i];
+    }
+    for (int c = 0; c < 2; c++) {
+        free(mFdlRe[c]);
+        free(mFdlIm[c]);
+        free(mInput[c]);
+        free(mOutput[c]);
+    }
+    free(mSumRe);
+    free(mSumIm);
+    free(mWork);
+    free(mControlWork);
+}
+
+ConvolutionImpulseResponse *ConvolutionReverb::createImpulseResponse(const float *ir,
+        uint32_t frames, uint32_t channels)
+{
+    ConvolutionImpulseResponse *response = new ConvolutionImpulseResponse();
+    if (frames == 0) {
+        return response;
+    }
+    LOG_ALWAYS_FATAL_IF(channels != 1 && channels != 2, "impulse response of %u channels",
+            channels);
+    if (frames > mMaxPartitions * mBlockSize) {
+        ALOGW("impulse response of %u frames truncated to %u", frames,
+                mMaxPartitions * mBlockSize);
+        frames = mMaxPartitions * mBlockSize;
+    }
+
+    const uint32_t partitions = (frames + mBlockSize - 1) / mBlockSize;
+    const size_t spectrumSize = (size_t) partitions * mBins * sizeof(float);
+    bool ok = true;
+    for (uint32_t c = 0; c < channels; c++) {
+        response->mRe[c] = (float *) malloc(spectrumSize);
+        response->mIm[c] = (float *) malloc(spectrumSize);
+        ok = ok && response->mRe[c] != NULL && response->mIm[c] != NULL;
+    }
+    if (channels == 1) {
+        response->mRe[1] = response->mRe[0];
+        response->mIm[1] = response->mIm[0];
+    }
+    if (!ok) {
+        ALOGE("no memory for an impulse response of %u frames", frames);
+        delete response;
+        return NULL;
+    }
+
+    // each partition is zero padded to 2 blocks, the inverse FFT scale is folded in
+    const float scale = 1.0f / mBlockSize;
+    for (uint32_t c = 0; c < channels; c++) {
+        for (uint32_t p = 0; p < partitions; p++) {
+            const uint32_t first = p * mBlockSize;
+            const uint32_t count = frames - first < mBlockSize ? frames - first : mBlockSize;
+            for (uint32_t i = 0; i < count; i++) {
+                mControlWork[i] = ir[(first + i) * channels + c] * scale;
+            }
+            memset(mControlWork + count, 0, (2 * mBlockSize - count) * sizeof(float));
+            mControlFft.forward(mControlWork, response->mRe[c] + p * mBins,
+                    response->mIm[c] + p * mBins);
+        }
+    }
+    response->mFrames = frames;
+    response->mPartitions = partitions;
+    ALOGV("impulse response of %u frames, %u channels, in %u partitions", frames, channels,
+            partitions);
+    return response;
+}
+
+void ConvolutionReverb::setImpulseResponse(ConvolutionImpulseResponse *ir)
+{
+    if (ir == NULL) {
+        ir = new ConvolutionImpulseResponse();
+    }
+
+    // delete what process() is done with
+    deleteRetired();
+    // and the previous impulse response, if process() has not taken it yet
+    int32_t slot = android_atomic_acquire_load(&mPending);
+    if (slot >= 0 && android_atomic_acquire_cas(slot, -1, &mPending) == 0) {
+        delete mIr[slot];
+        mIr[slot] = NULL;
+    }
+
+    // the active and maybe a newly retired impulse response leave at least one slot free
+    for (slot = 0; mIr[slot] != NULL; slot++) {
+    }
+    mIr[slot] = ir;
+    android_atomic_release_store(slot, &mPending);
+    // process() may have taken the previous impulse response since deleteRetired() above, and
+    // does not take this one until the one it retired then is deleted
+    deleteRetired();
+}
+
+void ConvolutionReverb::deleteRetired()
+{
+    const int32_t slot = android_atomic_acquire_load(&mRetired);
+    if (slot >= 0) {
+        delete mIr[slot];
+        mIr[slot] = NULL;
+        android_atomic_release_store(-1, &mRetired);
+    }
+}
+
+void ConvolutionReverb::reset()
+{
+    for (int c = 0; c < 2; c++) {
+        memset(mInput[c], 0, 2 * mBlockSize * sizeof(float));
+        memset(mOutput[c], 0, mBlockSize * sizeof(float));
+    }
+    for (uint32_t c = 0; c < mInChannels; c++) {
+        memset(mFdlRe[c], 0, (size_t) mMaxPartitions * mBins * sizeof(float));
+        memset(mFdlIm[c], 0, (size_t) mMaxPartitions * mBins * sizeof(float));
+    }
+    mFdlHead = 0;
+    mFill = 0;
+}
+
+void ConvolutionReverb::process(const float *in, float *out, uint32_t frames)
+{
+    while (frames > 0) {
+        uint32_t count = mBlockSize - mFill;
+        if (count > frames) {
+            count = frames;
+        }
+        // the current block is the second half of mInput, the output lags by one block
+        if (mInChannels == 1) {
+            memcpy(mInput[0] + mBlockSize + mFill, in, count * sizeof(float));
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                mInput[0][mBlockSize + mFill + i] = in[2 * i];
+                mInput[1][mBlockSize + mFill + i] = in[2 * i + 1];
+            }
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            out[2 * i] = mOutput[0][mFill + i];
+            out[2 * i + 1] = mOutput[1][mFill + i];
+        }
+        in += count * mInChannels;
+        out += count * 2;
+        frames -= count;
+        mFill += count;
+        if (mFill == mBlockSize) {
+            processBlock();
+            mFill = 0;
+        }
+    }
+}
+
+// Overlap-save: the spectrum of the last 2 input blocks goes into the delay line, each partition
+// of the impulse response is applied to the block as old as its position, and the second half
+// of the inverse FFT is the convolution of the current block, free of circular aliasing.
+void ConvolutionReverb::processBlock()
+{
+    // take a new impulse response once the control thread has deleted the last one replaced
+    if (android_atomic_acquire_load(&mRetired) < 0) {
+        const int32_t slot = android_atomic_acquire_load(&mPending);
+        if (slot >= 0 && android_atomic_acquire_cas(slot, -1, &mPending) == 0) {
+            if (mActive >= 0) {
+                android_atomic_release_store(mActive, &mRetired);
+            }
+            mActive = slot;
+        }
+    }
+
+    // the delay line is fed even when silent, so a new impulse response applies to past input
+    mFdlHead = mFdlHead == 0 ? mMaxPartitions - 1 : mFdlHead - 1;
+    for (uint32_t c = 0; c < mInChannels; c++) {
+        mFft.forward(mInput[c], mFdlRe[c] + mFdlHead * mBins, mFdlIm[c] + mFdlHead * mBins);
+        memmove(mInput[c], mInput[c] + mBlockSize, mBlockSize * sizeof(float));
+    }
+
+    const ConvolutionImpulseResponse *ir = mActive >= 0 ? mIr[mActive] : NULL;
+    if (ir == NULL || ir->mPartitions == 0) {
+        for (int c = 0; c < 2; c++) {
+            memset(mOutput[c], 0, mBlockSize * sizeof(float));
+        }
+        return;
+    }
+
+    for (uint32_t c = 0; c < 2; c++) {
+        const uint32_t inChannel = mInChannels == 1 ? 0 : c;
+        memset(mSumRe, 0, mBins * sizeof(float));
+        memset(mSumIm, 0, mBins * sizeof(float));
+        uint32_t slot = mFdlHead;
+        for (uint32_t p = 0; p < ir->mPartitions; p++) {
+            complexMultiplyAccumulate(mFdlRe[inChannel] + slot * mBins,
+                    mFdlIm[inChannel] + slot * mBins, ir->mRe[c] + p * mBins,
+                    ir->mIm[c] + p * mBins, mSumRe, mSumIm, mBins);
+            if (++slot == mMaxPartitions) {
+                slot = 0;
+            }
+        }
+        mFft.inverse(mSumRe, mSumIm, mWork);
+        memcpy(mOutput[c], mWork + mBlockSize, mBlockSize * sizeof(float));
+    }
+}
+
+}   // namespace android
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CONVOLUTION_REVERB_H_
+#define ANDROID_CONVOLUTION_REVERB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace android {
+
+// Real FFT of a power of 2 size, through a complex FFT of half the size.  The spectrum of n
+// samples is held as n/2 + 1 bins in separate real and imaginary arrays.  Neither direction is
+// normalized: inverse(forward(x)) is n/2 * x.
+class RealFft {
+public:
+    explicit RealFft(uint32_t size);
+    ~RealFft();
+
+    uint32_t size() const { return mSize; }
+    void forward(const float *in, float *re, float *im);
+    void inverse(const float *re, const float *im, float *out);
+
+private:
+    void complexFft(float *re, float *im, bool inverse) const;
+
+    const uint32_t  mSize;
+    const uint32_t  mHalf;          // size of the complex FFT
+    uint32_t       *mBitReverse;
+    float          *mCos;           // twiddles of the complex FFT, mHalf / 2 of them
+    float          *mSin;
+    float          *mSplitCos;      // twiddles splitting the real spectrum, mHalf + 1 of them
+    float          *mSplitSin;
+    float          *mRe;            // work buffers of the complex FFT
+    float          *mIm;
+};
+
+// Spectra of the partitions of an impulse response, built by
+// ConvolutionReverb::createImpulseResponse() and used by ConvolutionReverb::process().
+struct ConvolutionImpulseResponse {
+    ConvolutionImpulseResponse();
+    ~ConvolutionImpulseResponse();
+
+    uint32_t        mFrames;
+    uint32_t        mPartitions;
+    // per output channel: mPartitions spectra of blockSize + 1 bins each, scaled by 1 / blockSize
+    // for the inverse FFT.  A mono impulse response shares its spectra between the outputs.
+    float          *mRe[2];
+    float          *mIm[2];
+};
+
+// Uniformly partitioned overlap-save convolution of 1 or 2 input channels with a 1 or 2 channel
+// impulse response, producing stereo.  The impulse response is cut into partitions of one block,
+// and the spectra of the past input blocks are kept in a frequency domain delay line, so each
+// block costs one forward and one inverse FFT per channel plus one complex multiply-add per bin
+// and partition.  The cost per frame is thus fixed by the block size and the maximum impulse
+// response length, whatever the impulse response.  The output is delayed by one block.
+//
+// The impulse response is transformed by createImpulseResponse() and handed over with
+// setImpulseResponse(), both on the control thread.  process() picks it up at the next block
+// boundary without locking or allocating, and the delay line is kept, so the reverb tail of
+// the past input carries on with the new impulse response.
+class ConvolutionReverb {
+public:
+    // blockSize must be a power of 2, maxFrames is the longest impulse response
+    ConvolutionReverb(uint32_t blockSize, uint32_t inChannels, uint32_t maxFrames);
+    ~ConvolutionReverb();
+
+    // Transforms the impulse response, 'frames' frames of 'channels' (1 or 2) interleaved
+    // samples, at most maxFrames.  A mono impulse response is used for both outputs.  Returns
+    // NULL if memory could not be allocated.  Control thread only.
+    ConvolutionImpulseResponse *createImpulseResponse(const float *ir, uint32_t frames,
+            uint32_t channels);
+
+    // Hands the impulse response over to process(), which uses it from its next block.  NULL
+    // silences the output.  The impulse response is owned by this object from now on, and
+    // deleted on the control thread once replaced.  Control thread only.
+    void setImpulseResponse(ConvolutionImpulseResponse *ir);
+
+    uint32_t latency() const { return mBlockSize; }
+
+    // Clears the delay lines, so the reverb tail of the previous input is dropped
+    void reset();
+
+    // in holds 'frames' frames of inChannels samples, out receives 'frames' stereo frames
+    void process(const float *in, float *out, uint32_t frames);
+
+private:
+    // deletes the impulse response process() retired, if any.  Control thread only.
+    void deleteRetired();
+    void processBlock();
+
+    const uint32_t  mBlockSize;
+    const uint32_t  mBins;          // mBlockSize + 1
+    const uint32_t  mInChannels;
+    const uint32_t  mMaxPartitions;
+    RealFft         mFft;           // of 2 * mBlockSize, used by process()
+    RealFft         mControlFft;    // same, used by createImpulseResponse()
+    float          *mControlWork;   // 2 * mBlockSize samples for createImpulseResponse()
+
+    // Impulse response handoff, by index in mIr so it can go through 32 bit atomics: the control
+    // thread publishes a slot in mPending, process() takes it as mActive and publishes the
+    // previous one in mRetired, which the control thread then deletes.  -1 is none.  A slot is
+    // free when its pointer is NULL; at most two are in use when the control thread fills one.
+    ConvolutionImpulseResponse *mIr[3];
+    volatile int32_t mPending;
+    volatile int32_t mRetired;
+    int32_t         mActive;        // process() only
+
+    // frequency domain delay line of the input blocks, per input channel: mMaxPartitions * mBins
+    // each, mFdlHead is the partition of the most recent block
+    float          *mFdlRe[2];
+    float          *mFdlIm[2];
+    uint32_t        mFdlHead;
+
+    // time domain input of the last 2 blocks and output of the last block, per channel
+    float          *mInput[2];
+    float          *mOutput[2];
+    uint32_t        mFill;          // frames of the current block read and written
+
+    float          *mSumRe;         // spectrum accumulated for one output block
+    float          *mSumIm;
+    float          *mWork;          // 2 * mBlockSize samples
+};
+
+}   // namespace android
+
+#endif // ANDROID_CONVOLUTION_REVERB_H_
@@ -23,8 +23,11 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <new>
+#include <utils/threads.h>
 #include "EffectReverb.h"
+#include "ConvolutionReverb.h"
 // from Reverb/lib
 #include "LVREV.h"
 
@@ -130,6 +133,98 @@ static const effect_descriptor_t * const gDescriptors[] = {
         &gInsertPresetReverbDescriptor
 };
 
+// What the impulse response of the convolution engine is built from: a copy of the one set by
+// the client, or the properties to synthesize it from, or nothing for silence
+struct ReverbIrRequest{
+    bool                            silent;
+    float                           *pIr;               // malloc()ed copy, or NULL to
+    uint32_t                        IrFrames;           // synthesize it from the properties
+    uint32_t                        IrChannels;
+    uint32_t                        samplingRate;
+    int16_t                         roomLevel;
+    int16_t                         hfLevel;
+    int16_t                         decayTime;
+    int16_t                         decayHfRatio;
+    int16_t                         reverbLevel;
+};
+
+void ReverbApplyIr(ConvolutionReverb *pConvolution, ReverbIrRequest *pRequest);
+
+// Builds and hands over the impulse responses of the convolution engine on its own thread.
+// The effect commands run under the lock that AudioFlinger also holds around process(), and
+// a synthesized impulse response costs up to CONVOLUTION_MAX_IR_FRAMES of noise plus two FFTs
+// per partition and channel, which would stall the mixer.  Requests are coalesced: the thread
+// builds the latest one, so a batch of property changes costs one build.  It is the only user
+// of the control side of the ConvolutionReverb.
+class ReverbIrLoader : public Thread {
+public:
+    explicit ReverbIrLoader(ConvolutionReverb *pConvolution);
+    virtual ~ReverbIrLoader();
+
+    // Replaces the request not started yet, if any.  Takes ownership of request.pIr.
+    void load(const ReverbIrRequest& request);
+    // Stops the thread, after the build in progress
+    void stop();
+
+private:
+    virtual bool threadLoop();
+
+    ConvolutionReverb * const mConvolution;
+    Mutex               mLock;          // protects the fields below
+    Condition           mWorkCond;      // signaled when a request is handed over, or on stop()
+    bool                mPending;       // mRequest is to be built
+    ReverbIrRequest     mRequest;
+};
+
+ReverbIrLoader::ReverbIrLoader(ConvolutionReverb *pConvolution)
+    : Thread(false /*canCallJava*/), mConvolution(pConvolution), mPending(false)
+{
+    mRequest.pIr = NULL;
+}
+
+ReverbIrLoader::~ReverbIrLoader()
+{
+    free(mRequest.pIr);
+}
+
+void ReverbIrLoader::load(const ReverbIrRequest& request)
+{
+    Mutex::Autolock _l(mLock);
+    free(mRequest.pIr);
+    mRequest = request;
+    mPending = true;
+    mWorkCond.signal();
+}
+
+void ReverbIrLoader::stop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        requestExit();
+        mWorkCond.signal();
+    }
+    requestExitAndWait();
+}
+
+bool ReverbIrLoader::threadLoop()
+{
+    ReverbIrRequest request;
+    {
+        Mutex::Autolock _l(mLock);
+        while (!mPending) {
+            if (exitPending()) {
+                return false;
+            }
+            mWorkCond.wait(mLock);
+        }
+        request = mRequest;
+        mRequest.pIr = NULL;
+        mPending = false;
+    }
+    ReverbApplyIr(mConvolution, &request);
+    return true;
+}
+
 struct ReverbContext{
     const struct effect_interface_s *itfe;
     effect_config_t                 config;
@@ -159,6 +254,12 @@ struct ReverbContext{
     LVM_INT16                       prevLeftVolume;
     LVM_INT16                       prevRightVolume;
     int                             volumeMode;
+    ConvolutionReverb               *pConvolution;      // NULL until first selected
+    sp<ReverbIrLoader>              irLoader;           // builds its impulse responses, or NULL
+    bool                            convolution;        // replaces LVREV when true
+    float                           *pIr;               // loaded impulse response, or NULL to
+    uint32_t                        IrFrames;           // synthesize it from the properties
+    uint32_t                        IrChannels;
 };
 
 enum {
@@ -178,7 +279,8 @@ int  Reverb_init            (ReverbContext *pContext);
 void Reverb_free            (ReverbContext *pContext);
 int  Reverb_setConfig       (ReverbContext *pContext, effect_config_t *pConfig);
 void Reverb_getConfig       (ReverbContext *pContext, effect_config_t *pConfig);
-int  Reverb_setParameter    (ReverbContext *pContext, void *pParam, void *pValue);
+int  Reverb_setParameter    (ReverbContext *pContext, void *pParam, void *pValue,
+                             size_t        valueSize);
 int  Reverb_getParameter    (ReverbContext *pContext,
                              void          *pParam,
                              size_t        *pValueSize,
@@ -221,6 +323,12 @@ extern "C" int EffectCreate(const effect_uuid_t *uuid,
     pContext->itfe      = &gReverbInterface;
     pContext->hInstance = NULL;
 
+    pContext->pConvolution = NULL;
+    pContext->convolution  = false;
+    pContext->pIr          = NULL;
+    pContext->IrFrames     = 0;
+    pContext->IrChannels   = 0;
+
     pContext->auxiliary = false;
     if ((desc->flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY){
         pContext->auxiliary = true;
@@ -289,6 +397,12 @@ extern "C" int EffectRelease(effect_handle_t handle){
     #endif
     free(pContext->InFrames32);
     free(pContext->OutFrames32);
+    if (pContext->irLoader != 0) {
+        pContext->irLoader->stop();
+        pContext->irLoader.clear();
+    }
+    delete pContext->pConvolution;
+    free(pContext->pIr);
     Reverb_free(pContext);
     delete pContext;
     return 0;
@@ -390,6 +504,213 @@ static inline int16_t clamp16(int32_t sample)
     return sample;
 }
 
+//----------------------------------------------------------------------------
+// ReverbSynthesizedIrFrames()
+//----------------------------------------------------------------------------
+// Purpose:
+// Length of the impulse response synthesized from the reverb properties: the decay time,
+// limited to what the convolution engine supports.
+//
+// Inputs:
+//  decayTime:      in ms
+//  samplingRate:   in Hz
+//
+//----------------------------------------------------------------------------
+
+uint32_t ReverbSynthesizedIrFrames(int16_t decayTime, uint32_t samplingRate){
+    uint32_t frames = ((uint32_t)decayTime * samplingRate) / 1000;
+    if (frames < CONVOLUTION_BLOCK_SIZE) {
+        frames = CONVOLUTION_BLOCK_SIZE;
+    }
+    if (frames > CONVOLUTION_MAX_IR_FRAMES) {
+        frames = CONVOLUTION_MAX_IR_FRAMES;
+    }
+    return frames;
+}
+
+//----------------------------------------------------------------------------
+// ReverbSynthesizeIr()
+//----------------------------------------------------------------------------
+// Purpose:
+// Build a stereo impulse response from the reverb properties: two decorrelated noises, split
+// at 5 kHz, with the low band decaying by 60 dB over the decay time and the high band over the
+// decay time scaled by the decay HF ratio.  The high band is attenuated by the room HF level,
+// and the energy of each channel is the room level plus the reverb level, so that the wet
+// level matches the algorithmic reverb for the same properties.
+//
+// Inputs:
+//  pRequest:   reverb properties and sampling rate
+//  pIr:        pointer to frames stereo samples
+//  frames:     length of the impulse response
+//
+//----------------------------------------------------------------------------
+
+void ReverbSynthesizeIr(const ReverbIrRequest *pRequest, float *pIr, uint32_t frames){
+    const float fs = (float)pRequest->samplingRate;
+    const float decayTime = pRequest->decayTime < 100 ?
+            0.1f : pRequest->decayTime / 1000.0f;
+    const float hfDecayTime = decayTime * pRequest->decayHfRatio / 1000.0f;
+    // amplitude decay per sample, ln(1000) is 60 dB
+    const float lfDecay = expf(-6.9077553f / (decayTime * fs));
+    const float hfDecay = hfDecayTime > 0 ? expf(-6.9077553f / (hfDecayTime * fs)) : 0.0f;
+    const float hfGain = powf(10.0f, pRequest->hfLevel / 2000.0f);
+    const float split = expf(-2.0f * (float)M_PI * 5000.0f / fs);
+    const float level = powf(10.0f,
+            (pRequest->roomLevel + pRequest->reverbLevel) / 2000.0f);
+
+    for (int c = 0; c < 2; c++) {
+        uint32_t seed = c == 0 ? 0x1234567 : 0x89abcdef;
+        float lfEnvelope = 1.0f;
+        float hfEnvelope = hfGain;
+        float lowpass = 0.0f;
+        double energy = 0.0;
+
+        for (uint32_t i = 0; i < frames; i++) {
+            seed = seed * 1664525 + 1013904223;
+            const float noise = (int32_t)seed * (1.0f / 2147483648.0f);
+            lowpass += (1.0f - split) * (noise - lowpass);
+            const float sample = lowpass * lfEnvelope + (noise - lowpass) * hfEnvelope;
+            pIr[2*i + c] = sample;
+            energy += (double)sample * sample;
+            lfEnvelope *= lfDecay;
+            hfEnvelope *= hfDecay;
+        }
+
+        const float scale = energy > 0 ? level / sqrtf((float)energy) : 0.0f;
+        for (uint32_t i = 0; i < frames; i++) {
+            pIr[2*i + c] *= scale;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+// ReverbApplyIr()
+//----------------------------------------------------------------------------
+// Purpose:
+// Build the impulse response of a request, synthesizing it if needed, and hand it over to the
+// convolution engine.  Runs on the ReverbIrLoader thread.
+//
+// Inputs:
+//  pConvolution:   convolution engine
+//  pRequest:       what to build, its pIr is freed
+//
+//----------------------------------------------------------------------------
+
+void ReverbApplyIr(ConvolutionReverb *pConvolution, ReverbIrRequest *pRequest){
+    float *pIr = pRequest->pIr;
+    uint32_t frames = pRequest->IrFrames;
+    uint32_t channels = pRequest->IrChannels;
+    pRequest->pIr = NULL;
+    if (pRequest->silent) {
+        free(pIr);
+        pConvolution->setImpulseResponse(NULL);
+        return;
+    }
+    if (pIr == NULL) {
+        frames = ReverbSynthesizedIrFrames(pRequest->decayTime, pRequest->samplingRate);
+        channels = 2;
+        pIr = (float *)malloc(frames * 2 * sizeof(float));
+        if (pIr == NULL) {
+            ALOGE("ReverbApplyIr no memory for %u frames", frames);
+            pConvolution->setImpulseResponse(NULL);
+            return;
+        }
+        ReverbSynthesizeIr(pRequest, pIr, frames);
+    }
+    pConvolution->setImpulseResponse(pConvolution->createImpulseResponse(pIr, frames, channels));
+    free(pIr);
+}
+
+//----------------------------------------------------------------------------
+// ReverbLoadIr()
+//----------------------------------------------------------------------------
+// Purpose:
+// Request a new impulse response for the convolution engine: the one set by the client, silence
+// while the client has not set it all, or one synthesized from the current properties.  Called
+// from the command path whenever one of these changes.  Only the client impulse response is
+// copied here; it is built on the ReverbIrLoader thread, and process() picks it up once done.
+// Does nothing while the convolution engine is not selected.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  irComplete: false while the impulse response set by the client is being loaded
+//
+//----------------------------------------------------------------------------
+
+void ReverbLoadIr(ReverbContext *pContext, bool irComplete = true){
+    if (!pContext->convolution) {
+        return;
+    }
+    ReverbIrRequest request;
+    request.silent       = pContext->pIr != NULL && !irComplete;
+    request.pIr          = NULL;
+    request.IrFrames     = pContext->IrFrames;
+    request.IrChannels   = pContext->IrChannels;
+    request.samplingRate = pContext->config.inputCfg.samplingRate;
+    request.roomLevel    = pContext->SavedRoomLevel;
+    request.hfLevel      = pContext->SavedHfLevel;
+    request.decayTime    = pContext->SavedDecayTime;
+    request.decayHfRatio = pContext->SavedDecayHfRatio;
+    request.reverbLevel  = pContext->SavedReverbLevel;
+    if (pContext->pIr != NULL && irComplete) {
+        size_t size = pContext->IrFrames * pContext->IrChannels * sizeof(float);
+        request.pIr = (float *)malloc(size);
+        if (request.pIr == NULL) {
+            ALOGE("ReverbLoadIr no memory for %u frames", pContext->IrFrames);
+            request.silent = true;
+        } else {
+            memcpy(request.pIr, pContext->pIr, size);
+        }
+    }
+    if (pContext->irLoader != 0) {
+        pContext->irLoader->load(request);
+    } else {
+        ReverbApplyIr(pContext->pConvolution, &request);
+    }
+}
+
+//----------------------------------------------------------------------------
+// ReverbConvolve()
+//----------------------------------------------------------------------------
+// Purpose:
+// Apply the convolution engine in place of LVREV_Process(), with the same 32 bit input and
+// output buffers.  The samples are scaled to float so that the 16 bit full scale is 1.0.
+//
+// Inputs:
+//  pContext:        effect engine context
+//  frameCount:      Frames to process
+//  samplesPerFrame: channels of pContext->InFrames32
+//
+//----------------------------------------------------------------------------
+
+void ReverbConvolve(ReverbContext *pContext, int frameCount, int samplesPerFrame){
+    float in[MAX_CALL_SIZE * 2];
+    float out[MAX_CALL_SIZE * 2];
+    const LVM_INT32 *pIn = pContext->InFrames32;
+    LVM_INT32 *pOut = pContext->OutFrames32;
+
+    while (frameCount > 0) {
+        int count = frameCount < MAX_CALL_SIZE ? frameCount : MAX_CALL_SIZE;
+        for (int i = 0; i < count * samplesPerFrame; i++) {
+            in[i] = pIn[i] * (1.0f / (1 << 23));
+        }
+        pContext->pConvolution->process(in, out, count);
+        for (int i = 0; i < count * 2; i++) {
+            float sample = out[i] * (1 << 23);
+            // saturated by clamp16() later
+            if (sample > (float)(1 << 30)) {
+                sample = (float)(1 << 30);
+            } else if (sample < -(float)(1 << 30)) {
+                sample = -(float)(1 << 30);
+            }
+            pOut[i] = (LVM_INT32)sample;
+        }
+        pIn += count * samplesPerFrame;
+        pOut += count * 2;
+        frameCount -= count;
+    }
+}
+
 //----------------------------------------------------------------------------
 // process()
 //----------------------------------------------------------------------------
@@ -466,11 +787,15 @@ int process( LVM_INT16     *pIn,
             ALOGV("\tZeroing %d samples per frame at the end of call", samplesPerFrame);
         }
 
-        /* Process the samples, producing a stereo output */
-        LvmStatus = LVREV_Process(pContext->hInstance,      /* Instance handle */
-                                  pContext->InFrames32,     /* Input buffer */
-                                  pContext->OutFrames32,    /* Output buffer */
-                                  frameCount);              /* Number of samples to read */
+        if (pContext->convolution) {
+            ReverbConvolve(pContext, frameCount, samplesPerFrame);
+        } else {
+            /* Process the samples, producing a stereo output */
+            LvmStatus = LVREV_Process(pContext->hInstance,      /* Instance handle */
+                                      pContext->InFrames32,     /* Input buffer */
+                                      pContext->OutFrames32,    /* Output buffer */
+                                      frameCount);              /* Number of samples to read */
+        }
     }
 
     LVM_ERROR_CHECK(LvmStatus, "LVREV_Process", "process")
@@ -666,6 +991,10 @@ int Reverb_setConfig(ReverbContext *pContext, effect_config_t *pConfig){
         if(LvmStatus != LVREV_SUCCESS) return -EINVAL;
         //ALOGV("\tReverb_setConfig Succesfully called LVREV_SetControlParameters\n");
         pContext->SampleRate = SampleRate;
+        // the synthesized impulse response depends on the sampling rate
+        if (pContext->pIr == NULL) {
+            ReverbLoadIr(pContext);
+        }
     }else{
         //ALOGV("\tReverb_setConfig keep sampling rate at %d", SampleRate);
     }
@@ -1473,6 +1802,112 @@ int32_t ReverbGetDensity(ReverbContext *pContext){
     return pContext->SavedDensity;
 }
 
+//----------------------------------------------------------------------------
+// ReverbSetConvolution()
+//----------------------------------------------------------------------------
+// Purpose:
+// Select the convolution engine or the algorithmic reverb.  The convolution engine starts from
+// silence, with the current impulse response.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  enable      true to select the convolution engine
+//
+//----------------------------------------------------------------------------
+
+int ReverbSetConvolution(ReverbContext *pContext, bool enable){
+    if (enable && pContext->pConvolution == NULL) {
+        pContext->pConvolution = new ConvolutionReverb(CONVOLUTION_BLOCK_SIZE,
+                                                       pContext->auxiliary ? 1 : 2,
+                                                       CONVOLUTION_MAX_IR_FRAMES);
+        pContext->irLoader = new ReverbIrLoader(pContext->pConvolution);
+        if (pContext->irLoader->run("ReverbIrLoader", ANDROID_PRIORITY_NORMAL) != NO_ERROR) {
+            // the impulse responses are then built on the command path
+            ALOGE("ReverbSetConvolution could not start the impulse response loader");
+            pContext->irLoader.clear();
+        }
+    }
+    bool load = enable && !pContext->convolution;
+    pContext->convolution = enable;
+    if (load) {
+        ReverbLoadIr(pContext);
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+// ReverbSetIrFormat()
+//----------------------------------------------------------------------------
+// Purpose:
+// Start loading an impulse response of the given size, silent until its samples are set, or
+// go back to the synthesized impulse response if frames is 0.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  frames      length of the impulse response
+//  channels    1 or 2
+//
+//----------------------------------------------------------------------------
+
+int ReverbSetIrFormat(ReverbContext *pContext, uint32_t frames, uint32_t channels){
+    if (frames > CONVOLUTION_MAX_IR_FRAMES || (frames != 0 && channels != 1 && channels != 2)) {
+        ALOGV("\tLVM_ERROR : ReverbSetIrFormat invalid %u frames %u channels", frames, channels);
+        return -EINVAL;
+    }
+    free(pContext->pIr);
+    pContext->pIr = NULL;
+    pContext->IrFrames = 0;
+    pContext->IrChannels = 0;
+    if (frames == 0) {
+        ReverbLoadIr(pContext);
+        return 0;
+    }
+
+    pContext->pIr = (float *)calloc(frames * channels, sizeof(float));
+    if (pContext->pIr == NULL) {
+        ReverbLoadIr(pContext);
+        return -ENOMEM;
+    }
+    pContext->IrFrames = frames;
+    pContext->IrChannels = channels;
+    ReverbLoadIr(pContext, false);
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+// ReverbSetIrData()
+//----------------------------------------------------------------------------
+// Purpose:
+// Set samples of the impulse response started by ReverbSetIrFormat().  The impulse response is
+// transformed and applied when its last frame is set, so loading it in many commands does not
+// transform it each time.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  frame       index of the first frame set
+//  pSamples    interleaved samples, full scale is 1.0 in the impulse response
+//  count       number of samples, a multiple of the channel count
+//
+//----------------------------------------------------------------------------
+
+int ReverbSetIrData(ReverbContext *pContext, uint32_t frame, const int16_t *pSamples,
+                    uint32_t count){
+    if (pContext->pIr == NULL || count % pContext->IrChannels != 0 ||
+            frame > pContext->IrFrames ||
+            count / pContext->IrChannels > pContext->IrFrames - frame) {
+        ALOGV("\tLVM_ERROR : ReverbSetIrData invalid frame %u count %u", frame, count);
+        return -EINVAL;
+    }
+    float *pIr = pContext->pIr + frame * pContext->IrChannels;
+    for (uint32_t i = 0; i < count; i++) {
+        pIr[i] = pSamples[i] * (1.0f / 32768);
+    }
+    if (frame + count / pContext->IrChannels == pContext->IrFrames) {
+        ReverbLoadIr(pContext);
+    }
+    return 0;
+}
+
 //----------------------------------------------------------------------------
 // Reverb_LoadPreset()
 //----------------------------------------------------------------------------
@@ -1631,6 +2066,20 @@ int Reverb_getParameter(ReverbContext *pContext,
             }
             *pValueSize = sizeof(t_reverb_settings);
             break;
+        case REVERB_PARAM_CONVOLUTION:
+            if (*pValueSize != sizeof(int32_t)){
+                ALOGV("\tLVM_ERROR : Reverb_getParameter() invalid pValueSize12 %d", *pValueSize);
+                return -EINVAL;
+            }
+            *pValueSize = sizeof(int32_t);
+            break;
+        case REVERB_PARAM_CONVOLUTION_IR_FORMAT:
+            if (*pValueSize != 2 * sizeof(uint32_t)){
+                ALOGV("\tLVM_ERROR : Reverb_getParameter() invalid pValueSize13 %d", *pValueSize);
+                return -EINVAL;
+            }
+            *pValueSize = 2 * sizeof(uint32_t);
+            break;
 
         default:
             ALOGV("\tLVM_ERROR : Reverb_getParameter() invalid param %d", param);
@@ -1723,6 +2172,13 @@ int Reverb_getParameter(ReverbContext *pContext,
         case REVERB_PARAM_REVERB_DELAY:
             *(uint32_t *)pValue = 0;
             break;
+        case REVERB_PARAM_CONVOLUTION:
+            *(int32_t *)pValue = pContext->convolution;
+            break;
+        case REVERB_PARAM_CONVOLUTION_IR_FORMAT:
+            ((uint32_t *)pValue)[0] = pContext->IrFrames;
+            ((uint32_t *)pValue)[1] = pContext->IrChannels;
+            break;
 
         default:
             ALOGV("\tLVM_ERROR : Reverb_getParameter() invalid param %d", param);
@@ -1744,12 +2200,14 @@ int Reverb_getParameter(ReverbContext *pContext,
 //  pContext         - handle to instance data
 //  pParam           - pointer to parameter
 //  pValue           - pointer to value
+//  valueSize        - size of the value
 //
 // Outputs:
 //
 //----------------------------------------------------------------------------
 
-int Reverb_setParameter (ReverbContext *pContext, void *pParam, void *pValue){
+int Reverb_setParameter (ReverbContext *pContext, void *pParam, void *pValue,
+                         size_t valueSize){
     int status = 0;
     int16_t level;
     int16_t ratio;
@@ -1839,11 +2297,29 @@ int Reverb_setParameter (ReverbContext *pContext, void *pParam, void *pValue){
         case REVERB_PARAM_REFLECTIONS_DELAY:
         case REVERB_PARAM_REVERB_DELAY:
             break;
+        case REVERB_PARAM_CONVOLUTION:
+            if (valueSize < sizeof(int32_t)) {
+                return -EINVAL;
+            }
+            return ReverbSetConvolution(pContext, *(int32_t *)pValue != 0);
+        case REVERB_PARAM_CONVOLUTION_IR_FORMAT:
+            if (valueSize < 2 * sizeof(uint32_t)) {
+                return -EINVAL;
+            }
+            return ReverbSetIrFormat(pContext, ((uint32_t *)pValue)[0], ((uint32_t *)pValue)[1]);
+        case REVERB_PARAM_CONVOLUTION_IR_DATA:
+            return ReverbSetIrData(pContext, *(uint32_t *)pParamTemp, (int16_t *)pValue,
+                                   valueSize / sizeof(int16_t));
         default:
             ALOGV("\tLVM_ERROR : Reverb_setParameter() invalid param %d", param);
             break;
     }
 
+    // the synthesized impulse response follows the reverb properties
+    if (pContext->pIr == NULL) {
+        ReverbLoadIr(pContext);
+    }
+
     //ALOGV("\tReverb_setParameter end");
     return status;
 } /* end Reverb_setParameter */
@@ -1950,6 +2426,9 @@ int Reverb_command(effect_handle_t  self,
             //ALOGV("\tReverb_command cmdCode Case: "
             //        "EFFECT_CMD_RESET start");
             Reverb_setConfig(pContext, &pContext->config);
+            if (pContext->pConvolution != NULL) {
+                pContext->pConvolution->reset();
+            }
             break;
 
         case EFFECT_CMD_GET_PARAM:{
@@ -2003,11 +2482,18 @@ int Reverb_command(effect_handle_t  self,
 
             effect_param_t *p = (effect_param_t *) pCmdData;
 
-            if (p->psize != sizeof(int32_t)){
+            // REVERB_PARAM_CONVOLUTION_IR_DATA is the only parameter with an argument
+            if (p->psize != sizeof(int32_t) *
+                    (*(int32_t *)p->data == REVERB_PARAM_CONVOLUTION_IR_DATA ? 2 : 1)){
                 ALOGV("\t4LVM_ERROR : Reverb_command cmdCode Case: "
                         "EFFECT_CMD_SET_PARAM: ERROR, psize is not sizeof(int32_t)");
                 return -EINVAL;
             }
+            if (cmdSize < sizeof(effect_param_t) + p->psize + p->vsize){
+                ALOGV("\tLVM_ERROR : Reverb_command cmdCode Case: "
+                        "EFFECT_CMD_SET_PARAM: ERROR, vsize %d too large", p->vsize);
+                return -EINVAL;
+            }
 
             //ALOGV("\tn5Reverb_command cmdSize is %d\n"
             //        "\tsizeof(effect_param_t) is  %d\n"
@@ -2018,7 +2504,8 @@ int Reverb_command(effect_handle_t  self,
 
             *(int *)pReplyData = android::Reverb_setParameter(pContext,
                                                              (void *)p->data,
-                                                              p->data + p->psize);
+                                                              p->data + p->psize,
+                                                              p->vsize);
         } break;
 
         case EFFECT_CMD_ENABLE:
@@ -2042,6 +2529,11 @@ int Reverb_command(effect_handle_t  self,
             LVM_ERROR_CHECK(LvmStatus, "LVREV_GetControlParameters", "EFFECT_CMD_ENABLE")
             pContext->SamplesToExitCount =
                     (ActiveParams.T60 * pContext->config.inputCfg.samplingRate)/1000;
+            if (pContext->convolution) {
+                pContext->SamplesToExitCount = CONVOLUTION_BLOCK_SIZE + (pContext->pIr != NULL ?
+                        pContext->IrFrames : android::ReverbSynthesizedIrFrames(
+                                pContext->SavedDecayTime, pContext->config.inputCfg.samplingRate));
+            }
             // force no volume ramp for first buffer processed after enabling the effect
             pContext->volumeMode = android::REVERB_VOLUME_FLAT;
             //ALOGV("\tEFFECT_CMD_ENABLE SamplesToExitCount = %d", pContext->SamplesToExitCount);
@@ -33,6 +33,28 @@ extern "C" {
 #define LVREV_MEM_USAGE         71+(LVREV_MAX_FRAME_SIZE>>7)     // Expressed in kB
 //#define LVM_PCM
 
+// Convolution engine of the environmental reverbs, see ConvolutionReverb.h
+#define CONVOLUTION_BLOCK_SIZE      512     // partition size and latency, in frames
+#define CONVOLUTION_MAX_IR_FRAMES   96000   // 2 s at 48 kHz
+
+// Parameters of the convolution engine, accepted by the environmental reverbs on top of
+// t_env_reverb_params
+typedef enum
+{
+    // int32_t: 1 to replace the algorithmic reverb with the convolution engine, 0 to go back
+    REVERB_PARAM_CONVOLUTION = 0x100,
+    // uint32_t[2]: frames and channels (1 or 2) of the impulse response.  Setting it starts
+    // loading a silent impulse response, whose samples are then set with
+    // REVERB_PARAM_CONVOLUTION_IR_DATA.  0 frames goes back to the impulse response synthesized
+    // from the reverb properties, which is what get returns in that case.
+    REVERB_PARAM_CONVOLUTION_IR_FORMAT,
+    // set only, the parameter is followed by a uint32_t frame index and the value is interleaved
+    // int16_t samples from that frame, so the impulse response can be loaded in as many commands
+    // as needed.  The impulse response applies once a command sets its last frame, as soon as
+    // it has been transformed in the background.
+    REVERB_PARAM_CONVOLUTION_IR_DATA
+} t_reverb_convolution_params;
+
 typedef struct _LPFPair_t
 {
     int16_t Room_HF;
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks ConvolutionReverb against direct convolution, including an impulse response change in
+// the middle of the input.  Returns non-zero on failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "ConvolutionReverb.h"
+
+using namespace android;
+
+static const uint32_t kBlockSize = 64;
+static const uint32_t kMaxIrFrames = 1000;
+static const uint32_t kFrames = 4000;
+// the FFT is single precision, so the error is relative to the output level
+static const double kTolerance = 1e-4;
+
+static uint32_t sSeed = 1;
+
+static float noise()
+{
+    sSeed = sSeed * 1664525 + 1013904223;
+    return (int32_t) sSeed * (1.0f / 2147483648.0f);
+}
+
+static float *makeNoise(uint32_t samples)
+{
+    float *buffer = new float[samples];
+    for (uint32_t i = 0; i < samples; i++) {
+        buffer[i] = noise();
+    }
+    return buffer;
+}
+
+// Output channel c at frame t of the direct convolution of the input with the impulse response
+static double convolve(const float *in, uint32_t inChannels, const float *ir, uint32_t irFrames,
+        uint32_t irChannels, uint32_t c, uint32_t t)
+{
+    const uint32_t inChannel = inChannels == 1 ? 0 : c;
+    const uint32_t irChannel = irChannels == 1 ? 0 : c;
+    double sum = 0;
+    for (uint32_t k = 0; k < irFrames && k <= t; k++) {
+        sum += (double) ir[k * irChannels + irChannel] * in[(t - k) * inChannels + inChannel];
+    }
+    return sum;
+}
+
+// Processes kFrames frames in uneven chunks with the impulse response irA, switching to irB
+// (if not NULL) after switchFrame frames, a multiple of kBlockSize.  The engine takes irB at the
+// end of the current block, and keeps the past input, so from the next block on the output is
+// the convolution of the whole input with irB.
+static bool test(uint32_t inChannels, uint32_t irFramesA, uint32_t irChannelsA,
+        uint32_t irFramesB, uint32_t irChannelsB, uint32_t switchFrame)
+{
+    float *in = makeNoise(kFrames * inChannels);
+    float *irA = makeNoise(irFramesA * irChannelsA);
+    float *irB = irFramesB > 0 ? makeNoise(irFramesB * irChannelsB) : NULL;
+    float *out = new float[kFrames * 2];
+
+    ConvolutionReverb reverb(kBlockSize, inChannels, kMaxIrFrames);
+    reverb.setImpulseResponse(reverb.createImpulseResponse(irA, irFramesA, irChannelsA));
+    uint32_t done = 0;
+    for (uint32_t chunk = 1; done < kFrames; chunk = chunk * 7 % 97 + 1) {
+        uint32_t frames = kFrames - done < chunk ? kFrames - done : chunk;
+        if (irB != NULL && done < switchFrame && done + frames > switchFrame) {
+            frames = switchFrame - done;
+        }
+        reverb.process(in + done * inChannels, out + done * 2, frames);
+        done += frames;
+        if (irB != NULL && done == switchFrame) {
+            reverb.setImpulseResponse(reverb.createImpulseResponse(irB, irFramesB, irChannelsB));
+        }
+    }
+
+    const uint32_t latency = reverb.latency();
+    const uint32_t switchOut = switchFrame + kBlockSize;
+    double maxError = 0;
+    double maxLevel = 0;
+    for (uint32_t t = 0; t < kFrames; t++) {
+        for (uint32_t c = 0; c < 2; c++) {
+            double expected = 0;
+            if (t >= latency) {
+                expected = irB != NULL && t >= switchOut ?
+                        convolve(in, inChannels, irB, irFramesB, irChannelsB, c, t - latency) :
+                        convolve(in, inChannels, irA, irFramesA, irChannelsA, c, t - latency);
+            }
+            double error = fabs(out[t * 2 + c] - expected);
+            if (error > maxError) {
+                maxError = error;
+            }
+            if (fabs(expected) > maxLevel) {
+                maxLevel = fabs(expected);
+            }
+        }
+    }
+    const bool ok = maxError <= kTolerance * maxLevel;
+    printf("%s: %u in, impulse response %u x %u", ok ? "ok" : "FAIL", inChannels, irFramesA,
+            irChannelsA);
+    if (irB != NULL) {
+        printf(" then %u x %u after %u", irFramesB, irChannelsB, switchFrame);
+    }
+    printf(": error %g, level %g\n", maxError, maxLevel);
+
+    delete[] in;
+    delete[] irA;
+    delete[] irB;
+    delete[] out;
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    ok = test(1, 1, 1, 0, 0, 0) && ok;
+    ok = test(1, 200, 2, 0, 0, 0) && ok;
+    ok = test(2, kBlockSize, 1, 0, 0, 0) && ok;
+    ok = test(2, kMaxIrFrames, 2, 0, 0, 0) && ok;
+    // the tail of the input before the change carries on with the new impulse response
+    ok = test(2, 700, 2, 300, 1, 20 * kBlockSize) && ok;
+    ok = test(1, 100, 1, kMaxIrFrames, 2, 20 * kBlockSize) && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
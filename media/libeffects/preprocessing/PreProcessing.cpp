@@ -1096,6 +1096,191 @@ void Session_SetProcEnabled(preproc_session_t *session, uint32_t procId, bool en
     }
 }
 
+// Moves up to 'frames' frames of the output left by previous 10 ms frames to 'out'.
+// Returns the number of frames moved.
+size_t Session_ReadOutput(preproc_session_t *session, int16_t *out, size_t frames)
+{
+    size_t fr = session->framesOut;
+    if (frames < fr) {
+        fr = frames;
+    }
+    if (fr == 0) {
+        return 0;
+    }
+    memcpy(out, session->outBuf, fr * session->outChannelCount * sizeof(int16_t));
+    memmove(session->outBuf,
+            session->outBuf + fr * session->outChannelCount,
+            (session->framesOut - fr) * session->outChannelCount * sizeof(int16_t));
+    session->framesOut -= fr;
+    return fr;
+}
+
+// Takes input frames until a 10 ms frame is complete: straight into the APM audio frame, or
+// into the input buffer of the resampler. Returns the number of frames taken.
+size_t Session_WriteInput(preproc_session_t *session, const int16_t *in, size_t frames)
+{
+    size_t fr = session->frameCount - session->framesIn;
+    if (frames < fr) {
+        fr = frames;
+    }
+    int16_t *dst;
+    if (session->inResampler != NULL) {
+        if (session->inBufSize < session->framesIn + fr) {
+            session->inBufSize = session->framesIn + fr;
+            session->inBuf = (int16_t *)realloc(session->inBuf,
+                             session->inBufSize * session->inChannelCount * sizeof(int16_t));
+        }
+        dst = session->inBuf;
+    } else {
+        dst = session->procFrame->_payloadData;
+    }
+    memcpy(dst + session->framesIn * session->inChannelCount,
+           in,
+           fr * session->inChannelCount * sizeof(int16_t));
+#ifdef DUAL_MIC_TEST
+    pthread_mutex_lock(&gPcmDumpLock);
+    if (gPcmDumpFh != NULL) {
+        fwrite(in, fr * session->inChannelCount * sizeof(int16_t), 1, gPcmDumpFh);
+    }
+    pthread_mutex_unlock(&gPcmDumpLock);
+#endif
+    session->framesIn += fr;
+    return fr;
+}
+
+// Processes a complete 10 ms frame: one ProcessStream() call applies all the enabled pre
+// processors to the APM audio frame in turn. The result goes to 'out' if not NULL, which must
+// have room for session->frameCount frames, and is appended to the output buffer otherwise.
+// Returns the number of frames written to 'out'.
+size_t Session_ProcessFrame(preproc_session_t *session, int16_t *out)
+{
+    if (session->inResampler != NULL) {
+        size_t frIn = session->framesIn;
+        size_t frOut = session->apmFrameCount;
+        if (session->inChannelCount == 1) {
+            speex_resampler_process_int(session->inResampler,
+                                        0,
+                                        session->inBuf,
+                                        &frIn,
+                                        session->procFrame->_payloadData,
+                                        &frOut);
+        } else {
+            speex_resampler_process_interleaved_int(session->inResampler,
+                                                    session->inBuf,
+                                                    &frIn,
+                                                    session->procFrame->_payloadData,
+                                                    &frOut);
+        }
+        memmove(session->inBuf,
+                session->inBuf + frIn * session->inChannelCount,
+                (session->framesIn - frIn) * session->inChannelCount * sizeof(int16_t));
+        session->framesIn -= frIn;
+    } else {
+        session->framesIn = 0;
+    }
+    session->procFrame->_payloadDataLengthInSamples =
+            session->apmFrameCount * session->inChannelCount;
+
+    session->apm->ProcessStream(session->procFrame);
+
+    int16_t *dst = out;
+    if (dst == NULL) {
+        if (session->outBufSize < session->framesOut + session->frameCount) {
+            session->outBufSize = session->framesOut + session->frameCount;
+            session->outBuf = (int16_t *)realloc(session->outBuf,
+                              session->outBufSize * session->outChannelCount * sizeof(int16_t));
+        }
+        dst = session->outBuf + session->framesOut * session->outChannelCount;
+    }
+    size_t frames;
+    if (session->outResampler != NULL) {
+        size_t frIn = session->apmFrameCount;
+        size_t frOut = session->frameCount;
+        if (session->inChannelCount == 1) {
+            speex_resampler_process_int(session->outResampler,
+                                        0,
+                                        session->procFrame->_payloadData,
+                                        &frIn,
+                                        dst,
+                                        &frOut);
+        } else {
+            speex_resampler_process_interleaved_int(session->outResampler,
+                                                    session->procFrame->_payloadData,
+                                                    &frIn,
+                                                    dst,
+                                                    &frOut);
+        }
+        frames = frOut;
+    } else {
+        memcpy(dst,
+               session->procFrame->_payloadData,
+               session->frameCount * session->outChannelCount * sizeof(int16_t));
+        frames = session->frameCount;
+    }
+    if (out == NULL) {
+        session->framesOut += frames;
+        return 0;
+    }
+    return frames;
+}
+
+// Same as Session_WriteInput() for the reverse stream
+size_t Session_WriteReverse(preproc_session_t *session, const int16_t *in, size_t frames)
+{
+    size_t fr = session->frameCount - session->framesRev;
+    if (frames < fr) {
+        fr = frames;
+    }
+    int16_t *dst;
+    if (session->revResampler != NULL) {
+        if (session->revBufSize < session->framesRev + fr) {
+            session->revBufSize = session->framesRev + fr;
+            session->revBuf = (int16_t *)realloc(session->revBuf,
+                              session->revBufSize * session->inChannelCount * sizeof(int16_t));
+        }
+        dst = session->revBuf;
+    } else {
+        dst = session->revFrame->_payloadData;
+    }
+    memcpy(dst + session->framesRev * session->inChannelCount,
+           in,
+           fr * session->inChannelCount * sizeof(int16_t));
+    session->framesRev += fr;
+    return fr;
+}
+
+// Passes a complete 10 ms frame of the reverse stream to the APM
+void Session_AnalyzeReverseFrame(preproc_session_t *session)
+{
+    if (session->revResampler != NULL) {
+        size_t frIn = session->framesRev;
+        size_t frOut = session->apmFrameCount;
+        if (session->inChannelCount == 1) {
+            speex_resampler_process_int(session->revResampler,
+                                        0,
+                                        session->revBuf,
+                                        &frIn,
+                                        session->revFrame->_payloadData,
+                                        &frOut);
+        } else {
+            speex_resampler_process_interleaved_int(session->revResampler,
+                                                    session->revBuf,
+                                                    &frIn,
+                                                    session->revFrame->_payloadData,
+                                                    &frOut);
+        }
+        memmove(session->revBuf,
+                session->revBuf + frIn * session->inChannelCount,
+                (session->framesRev - frIn) * session->inChannelCount * sizeof(int16_t));
+        session->framesRev -= frIn;
+    } else {
+        session->framesRev = 0;
+    }
+    session->revFrame->_payloadDataLengthInSamples =
+            session->apmFrameCount * session->inChannelCount;
+    session->apm->AnalyzeReverseStream(session->revFrame);
+}
+
 //------------------------------------------------------------------------------
 // Bundle functions
 //------------------------------------------------------------------------------
@@ -1184,147 +1369,34 @@ int PreProcessingFx_Process(effect_handle_t     self,
 
     if ((session->processedMsk & session->enabledMsk) == session->enabledMsk) {
         effect->session->processedMsk = 0;
-        size_t framesRq = outBuffer->frameCount;
-        size_t framesWr = 0;
-        if (session->framesOut) {
-            size_t fr = session->framesOut;
-            if (outBuffer->frameCount < fr) {
-                fr = outBuffer->frameCount;
-            }
-            memcpy(outBuffer->s16,
-                  session->outBuf,
-                  fr * session->outChannelCount * sizeof(int16_t));
-            memcpy(session->outBuf,
-                  session->outBuf + fr * session->outChannelCount,
-                  (session->framesOut - fr) * session->outChannelCount * sizeof(int16_t));
-            session->framesOut -= fr;
-            framesWr += fr;
-        }
-        outBuffer->frameCount = framesWr;
-        if (framesWr == framesRq) {
-            inBuffer->frameCount = 0;
-            return 0;
-        }
-
-        if (session->inResampler != NULL) {
-            size_t fr = session->frameCount - session->framesIn;
-            if (inBuffer->frameCount < fr) {
-                fr = inBuffer->frameCount;
-            }
-            if (session->inBufSize < session->framesIn + fr) {
-                session->inBufSize = session->framesIn + fr;
-                session->inBuf = (int16_t *)realloc(session->inBuf,
-                                 session->inBufSize * session->inChannelCount * sizeof(int16_t));
-            }
-            memcpy(session->inBuf + session->framesIn * session->inChannelCount,
-                   inBuffer->s16,
-                   fr * session->inChannelCount * sizeof(int16_t));
-#ifdef DUAL_MIC_TEST
-            pthread_mutex_lock(&gPcmDumpLock);
-            if (gPcmDumpFh != NULL) {
-                fwrite(inBuffer->raw,
-                       fr * session->inChannelCount * sizeof(int16_t), 1, gPcmDumpFh);
-            }
-            pthread_mutex_unlock(&gPcmDumpLock);
-#endif
-
-            session->framesIn += fr;
-            inBuffer->frameCount = fr;
+        const size_t framesRq = outBuffer->frameCount;
+        size_t framesRd = 0;
+        size_t framesWr = Session_ReadOutput(session, outBuffer->s16, framesRq);
+        // In place, the output of a 10 ms frame could overwrite input not read yet, so only
+        // one is processed per call. Otherwise all those the input holds and the output has
+        // room for are processed in this call.
+        const bool inPlace = inBuffer->raw == outBuffer->raw;
+        while (framesWr < framesRq && framesRd < inBuffer->frameCount) {
+            framesRd += Session_WriteInput(session,
+                                           inBuffer->s16 + framesRd * session->inChannelCount,
+                                           inBuffer->frameCount - framesRd);
             if (session->framesIn < session->frameCount) {
-                return 0;
-            }
-            size_t frIn = session->framesIn;
-            size_t frOut = session->apmFrameCount;
-            if (session->inChannelCount == 1) {
-                speex_resampler_process_int(session->inResampler,
-                                            0,
-                                            session->inBuf,
-                                            &frIn,
-                                            session->procFrame->_payloadData,
-                                            &frOut);
-            } else {
-                speex_resampler_process_interleaved_int(session->inResampler,
-                                                        session->inBuf,
-                                                        &frIn,
-                                                        session->procFrame->_payloadData,
-                                                        &frOut);
-            }
-            memcpy(session->inBuf,
-                   session->inBuf + frIn * session->inChannelCount,
-                   (session->framesIn - frIn) * session->inChannelCount * sizeof(int16_t));
-            session->framesIn -= frIn;
-        } else {
-            size_t fr = session->frameCount - session->framesIn;
-            if (inBuffer->frameCount < fr) {
-                fr = inBuffer->frameCount;
-            }
-            memcpy(session->procFrame->_payloadData + session->framesIn * session->inChannelCount,
-                   inBuffer->s16,
-                   fr * session->inChannelCount * sizeof(int16_t));
-
-#ifdef DUAL_MIC_TEST
-            pthread_mutex_lock(&gPcmDumpLock);
-            if (gPcmDumpFh != NULL) {
-                fwrite(inBuffer->raw,
-                       fr * session->inChannelCount * sizeof(int16_t), 1, gPcmDumpFh);
+                break;
             }
-            pthread_mutex_unlock(&gPcmDumpLock);
-#endif
-
-            session->framesIn += fr;
-            inBuffer->frameCount = fr;
-            if (session->framesIn < session->frameCount) {
-                return 0;
+            int16_t *out = NULL;
+            if (session->framesOut == 0 && framesRq - framesWr >= session->frameCount) {
+                out = outBuffer->s16 + framesWr * session->outChannelCount;
             }
-            session->framesIn = 0;
-        }
-        session->procFrame->_payloadDataLengthInSamples =
-                session->apmFrameCount * session->inChannelCount;
-
-        effect->session->apm->ProcessStream(session->procFrame);
-
-        if (session->outBufSize < session->framesOut + session->frameCount) {
-            session->outBufSize = session->framesOut + session->frameCount;
-            session->outBuf = (int16_t *)realloc(session->outBuf,
-                              session->outBufSize * session->outChannelCount * sizeof(int16_t));
-        }
-
-        if (session->outResampler != NULL) {
-            size_t frIn = session->apmFrameCount;
-            size_t frOut = session->frameCount;
-            if (session->inChannelCount == 1) {
-                speex_resampler_process_int(session->outResampler,
-                                    0,
-                                    session->procFrame->_payloadData,
-                                    &frIn,
-                                    session->outBuf + session->framesOut * session->outChannelCount,
-                                    &frOut);
-            } else {
-                speex_resampler_process_interleaved_int(session->outResampler,
-                                    session->procFrame->_payloadData,
-                                    &frIn,
-                                    session->outBuf + session->framesOut * session->outChannelCount,
-                                    &frOut);
+            framesWr += Session_ProcessFrame(session, out);
+            framesWr += Session_ReadOutput(session,
+                                           outBuffer->s16 + framesWr * session->outChannelCount,
+                                           framesRq - framesWr);
+            if (inPlace) {
+                break;
             }
-            session->framesOut += frOut;
-        } else {
-            memcpy(session->outBuf + session->framesOut * session->outChannelCount,
-                   session->procFrame->_payloadData,
-                   session->frameCount * session->outChannelCount * sizeof(int16_t));
-            session->framesOut += session->frameCount;
         }
-        size_t fr = session->framesOut;
-        if (framesRq - framesWr < fr) {
-            fr = framesRq - framesWr;
-        }
-        memcpy(outBuffer->s16 + framesWr * session->outChannelCount,
-              session->outBuf,
-              fr * session->outChannelCount * sizeof(int16_t));
-        memcpy(session->outBuf,
-              session->outBuf + fr * session->outChannelCount,
-              (session->framesOut - fr) * session->outChannelCount * sizeof(int16_t));
-        session->framesOut -= fr;
-        outBuffer->frameCount += fr;
+        inBuffer->frameCount = framesRd;
+        outBuffer->frameCount = framesWr;
 
         return 0;
     } else {
@@ -1735,63 +1807,18 @@ int PreProcessingFx_ProcessReverse(effect_handle_t     self,
 
     if ((session->revProcessedMsk & session->revEnabledMsk) == session->revEnabledMsk) {
         effect->session->revProcessedMsk = 0;
-        if (session->revResampler != NULL) {
-            size_t fr = session->frameCount - session->framesRev;
-            if (inBuffer->frameCount < fr) {
-                fr = inBuffer->frameCount;
-            }
-            if (session->revBufSize < session->framesRev + fr) {
-                session->revBufSize = session->framesRev + fr;
-                session->revBuf = (int16_t *)realloc(session->revBuf,
-                                  session->revBufSize * session->inChannelCount * sizeof(int16_t));
-            }
-            memcpy(session->revBuf + session->framesRev * session->inChannelCount,
-                   inBuffer->s16,
-                   fr * session->inChannelCount * sizeof(int16_t));
-
-            session->framesRev += fr;
-            inBuffer->frameCount = fr;
-            if (session->framesRev < session->frameCount) {
-                return 0;
-            }
-            size_t frIn = session->framesRev;
-            size_t frOut = session->apmFrameCount;
-            if (session->inChannelCount == 1) {
-                speex_resampler_process_int(session->revResampler,
-                                            0,
-                                            session->revBuf,
-                                            &frIn,
-                                            session->revFrame->_payloadData,
-                                            &frOut);
-            } else {
-                speex_resampler_process_interleaved_int(session->revResampler,
-                                                        session->revBuf,
-                                                        &frIn,
-                                                        session->revFrame->_payloadData,
-                                                        &frOut);
-            }
-            memcpy(session->revBuf,
-                   session->revBuf + frIn * session->inChannelCount,
-                   (session->framesRev - frIn) * session->inChannelCount * sizeof(int16_t));
-            session->framesRev -= frIn;
-        } else {
-            size_t fr = session->frameCount - session->framesRev;
-            if (inBuffer->frameCount < fr) {
-                fr = inBuffer->frameCount;
-            }
-            memcpy(session->revFrame->_payloadData + session->framesRev * session->inChannelCount,
-                   inBuffer->s16,
-                   fr * session->inChannelCount * sizeof(int16_t));
-            session->framesRev += fr;
-            inBuffer->frameCount = fr;
+        // all the complete 10 ms frames of the input are analyzed in this call
+        size_t framesRd = 0;
+        while (framesRd < inBuffer->frameCount) {
+            framesRd += Session_WriteReverse(session,
+                                             inBuffer->s16 + framesRd * session->inChannelCount,
+                                             inBuffer->frameCount - framesRd);
             if (session->framesRev < session->frameCount) {
-                return 0;
+                break;
             }
-            session->framesRev = 0;
+            Session_AnalyzeReverseFrame(session);
         }
-        session->revFrame->_payloadDataLengthInSamples =
-                session->apmFrameCount * session->inChannelCount;
-        effect->session->apm->AnalyzeReverseStream(session->revFrame);
+        inBuffer->frameCount = framesRd;
         return 0;
     } else {
         return -ENODATA;
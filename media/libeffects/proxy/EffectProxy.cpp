@@ -23,6 +23,8 @@
 #include <string.h>
 #include <new>
 #include <EffectProxy.h>
+#include <cutils/bitops.h>
+#include <cutils/properties.h>
 #include <utils/threads.h>
 #include <media/EffectsFactoryApi.h>
 
@@ -49,6 +51,228 @@ static const effect_descriptor_t *const gDescriptors[] =
     &gProxyDescriptor,
 };
 
+// Runs the HOST sub effect on its own thread, so that its processing overlaps with the rest of
+// the caller's cycle instead of adding to it.  process() gathers the input until it holds the
+// frame count of the configuration, and only then hands it over as one job, so that the calls
+// of an effect chain processing its buffer in blocks make a single job per cycle.  The output is
+// delayed by the configured frame count: it is the output of the previous job, which the caller
+// only waits for if the worker has not finished it when it is first needed.
+class EffectProxyWorker : public Thread {
+public:
+    explicit EffectProxyWorker(effect_handle_t effect);
+    virtual ~EffectProxyWorker();
+
+    // Allocates the pipeline for the configuration of the proxy, and returns in subConfig the
+    // configuration of the sub effect: it writes into the worker buffers.  Returns false if the
+    // configuration is not supported, in which case the sub effect should be run synchronously.
+    bool configure(const effect_config_t& config, effect_config_t *subConfig);
+    // Gathers the input, and writes or accumulates the delayed output according to the
+    // configuration.  Returns the status of the sub effect for the last job.
+    int process(audio_buffer_t *inBuffer, audio_buffer_t *outBuffer);
+    // Waits for the pending job, and refills the pipeline with silence
+    void flush();
+    // Stops the thread, after the pending job
+    void stop();
+    // Held by the worker while the sub effect processes, and by the commands sent to it
+    Mutex& effectLock() { return mEffectLock; }
+
+private:
+    virtual bool threadLoop();
+    void waitIdle_l();
+    void freeBuffers_l();
+
+    const effect_handle_t mEffect;
+    Mutex       mEffectLock;
+
+    Mutex       mLock;          // protects the fields below
+    Condition   mWorkCond;      // signaled when a job is handed over, or on stop()
+    Condition   mDoneCond;      // signaled when the worker finished a job
+    bool        mPending;       // the worker owns mIn and mOut
+    int         mStatus;        // returned by the sub effect for the last job
+    size_t      mFrameCount;    // of the configuration, and the delay
+    size_t      mInFrameSize;   // in bytes
+    size_t      mOutFrameSize;
+    bool        mAccumulate;
+    int16_t    *mIn;            // input gathered for the next job, then of the pending job
+    int16_t    *mOut;           // output of the pending job
+    size_t      mInFrames;      // frames gathered in mIn
+    int16_t    *mQueue;         // delayed output not returned yet, mFrameCount frames at most
+    size_t      mQueueFrames;
+};
+
+EffectProxyWorker::EffectProxyWorker(effect_handle_t effect)
+    : Thread(false /*canCallJava*/), mEffect(effect), mPending(false), mStatus(0),
+      mFrameCount(0), mInFrameSize(0), mOutFrameSize(0), mAccumulate(false), mIn(NULL),
+      mOut(NULL), mInFrames(0), mQueue(NULL), mQueueFrames(0)
+{
+}
+
+EffectProxyWorker::~EffectProxyWorker()
+{
+    freeBuffers_l();
+}
+
+void EffectProxyWorker::freeBuffers_l()
+{
+    free(mIn);
+    free(mOut);
+    free(mQueue);
+    mIn = mOut = mQueue = NULL;
+    mInFrames = mQueueFrames = 0;
+}
+
+void EffectProxyWorker::waitIdle_l()
+{
+    while (mPending) {
+        mDoneCond.wait(mLock);
+    }
+}
+
+bool EffectProxyWorker::configure(const effect_config_t& config, effect_config_t *subConfig)
+{
+    Mutex::Autolock _l(mLock);
+    waitIdle_l();
+    freeBuffers_l();
+    if (config.inputCfg.format != AUDIO_FORMAT_PCM_16_BIT ||
+            config.outputCfg.format != AUDIO_FORMAT_PCM_16_BIT ||
+            config.inputCfg.buffer.frameCount == 0) {
+        return false;
+    }
+    mFrameCount = config.inputCfg.buffer.frameCount;
+    mInFrameSize = popcount(config.inputCfg.channels) * sizeof(int16_t);
+    mOutFrameSize = popcount(config.outputCfg.channels) * sizeof(int16_t);
+    mAccumulate = config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE;
+    mIn = (int16_t *)malloc(mFrameCount * mInFrameSize);
+    mOut = (int16_t *)malloc(mFrameCount * mOutFrameSize);
+    mQueue = (int16_t *)calloc(mFrameCount, mOutFrameSize);
+    if (mIn == NULL || mOut == NULL || mQueue == NULL) {
+        freeBuffers_l();
+        return false;
+    }
+    mQueueFrames = mFrameCount;
+    mStatus = 0;
+
+    *subConfig = config;
+    subConfig->inputCfg.buffer.frameCount = mFrameCount;
+    subConfig->inputCfg.buffer.s16 = mIn;
+    subConfig->outputCfg.buffer.frameCount = mFrameCount;
+    subConfig->outputCfg.buffer.s16 = mOut;
+    subConfig->outputCfg.accessMode = EFFECT_BUFFER_ACCESS_WRITE;
+    return true;
+}
+
+int EffectProxyWorker::process(audio_buffer_t *inBuffer, audio_buffer_t *outBuffer)
+{
+    Mutex::Autolock _l(mLock);
+    const size_t frames = inBuffer->frameCount;
+    if (mQueue == NULL || frames > mFrameCount || outBuffer->frameCount != frames) {
+        return -EINVAL;
+    }
+
+    // mInFrames + mQueueFrames is mFrameCount: each frame gathered takes one from the queue
+    size_t done = 0;
+    while (done < frames) {
+        if (mQueueFrames == 0) {
+            // the output of the job handed over when the previous buffer was complete
+            waitIdle_l();
+            memcpy(mQueue, mOut, mFrameCount * mOutFrameSize);
+            mQueueFrames = mFrameCount;
+        }
+        size_t n = frames - done;
+        if (n > mQueueFrames) {
+            n = mQueueFrames;
+        }
+
+        // take the input before writing the output, as they may be the same buffer
+        memcpy((char *)mIn + mInFrames * mInFrameSize,
+                (char *)inBuffer->raw + done * mInFrameSize, n * mInFrameSize);
+        const int16_t *queue = (int16_t *)((char *)mQueue +
+                (mFrameCount - mQueueFrames) * mOutFrameSize);
+        int16_t *out = (int16_t *)((char *)outBuffer->raw + done * mOutFrameSize);
+        const size_t samples = n * mOutFrameSize / sizeof(int16_t);
+        if (mAccumulate) {
+            for (size_t i = 0; i < samples; i++) {
+                int32_t sum = out[i] + queue[i];
+                if (sum > 32767) {
+                    sum = 32767;
+                } else if (sum < -32768) {
+                    sum = -32768;
+                }
+                out[i] = (int16_t)sum;
+            }
+        } else {
+            memcpy(out, queue, n * mOutFrameSize);
+        }
+        mQueueFrames -= n;
+        mInFrames += n;
+        done += n;
+
+        if (mInFrames == mFrameCount) {
+            mInFrames = 0;
+            mPending = true;
+            mWorkCond.signal();
+        }
+    }
+    return mStatus;
+}
+
+void EffectProxyWorker::flush()
+{
+    Mutex::Autolock _l(mLock);
+    waitIdle_l();
+    if (mQueue != NULL) {
+        memset(mQueue, 0, mFrameCount * mOutFrameSize);
+        mQueueFrames = mFrameCount;
+    }
+    mInFrames = 0;
+    mStatus = 0;
+}
+
+void EffectProxyWorker::stop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        requestExit();
+        mWorkCond.signal();
+    }
+    requestExitAndWait();
+}
+
+bool EffectProxyWorker::threadLoop()
+{
+    Mutex::Autolock _l(mLock);
+    while (!mPending) {
+        if (exitPending()) {
+            return false;
+        }
+        mWorkCond.wait(mLock);
+    }
+    audio_buffer_t in, out;
+    in.frameCount = out.frameCount = mFrameCount;
+    in.s16 = mIn;
+    out.s16 = mOut;
+    mLock.unlock();
+    int status;
+    {
+        Mutex::Autolock _e(mEffectLock);
+        status = (*mEffect)->process(mEffect, &in, &out);
+    }
+    mLock.lock();
+    mStatus = status;
+    mPending = false;
+    mDoneCond.signal();
+    return true;
+}
+
+// Returns the minimum cpuLoad of the host sub effects run by an EffectProxyWorker, 0 for none
+static uint32_t asyncLoadThreshold() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(PROXY_ASYNC_LOAD_PROPERTY, value, NULL) <= 0) {
+        return 0;
+    }
+    return (uint32_t)atoi(value);
+}
+
 
 int EffectProxyCreate(const effect_uuid_t *uuid,
                             int32_t             sessionId,
@@ -71,6 +295,8 @@ int EffectProxyCreate(const effect_uuid_t *uuid,
     // The sub effects will be created in effect_command when the first command
     // for the effect is received
     pContext->eHandle[SUB_FX_HOST] = pContext->eHandle[SUB_FX_OFFLOAD] = NULL;
+    pContext->worker = NULL;
+    pContext->async = false;
 
     // Get the HW and SW sub effect descriptors from the effects factory
     desc = new effect_descriptor_t[SUB_FX_COUNT];
@@ -131,6 +357,10 @@ int EffectProxyRelease(effect_handle_t handle) {
     delete pContext->desc;
     free(pContext->replyData);
 
+    if (pContext->worker != NULL) {
+        pContext->worker->stop();
+        pContext->worker.clear();
+    }
     if (pContext->eHandle[SUB_FX_HOST])
        EffectRelease(pContext->eHandle[SUB_FX_HOST]);
     if (pContext->eHandle[SUB_FX_OFFLOAD])
@@ -164,8 +394,12 @@ int Effect_process(effect_handle_t     self,
         int index = pContext->index;
         // if the index refers to HW , do not do anything. Just return.
         if (index == SUB_FX_HOST) {
-            ret = (*pContext->eHandle[index])->process(pContext->eHandle[index],
-                                                       inBuffer, outBuffer);
+            if (pContext->async) {
+                ret = pContext->worker->process(inBuffer, outBuffer);
+            } else {
+                ret = (*pContext->eHandle[index])->process(pContext->eHandle[index],
+                                                           inBuffer, outBuffer);
+            }
         }
     }
     return ret;
@@ -194,6 +428,17 @@ int Effect_command(effect_handle_t  self,
             ALOGV("Effect_command() Error creating SW sub effect");
             return status;
         }
+        uint32_t threshold = asyncLoadThreshold();
+        if (threshold != 0 && pContext->desc[SUB_FX_HOST].cpuLoad >= threshold) {
+            ALOGV("Effect_command() running HOST sub effect %s on a worker thread",
+                  pContext->desc[SUB_FX_HOST].name);
+            pContext->worker = new EffectProxyWorker(pContext->eHandle[SUB_FX_HOST]);
+            if (pContext->worker->run("EffectProxyWorker", ANDROID_PRIORITY_URGENT_AUDIO)
+                    != NO_ERROR) {
+                ALOGE("Effect_command() could not start the worker thread");
+                pContext->worker.clear();
+            }
+        }
     }
     if (pContext->eHandle[SUB_FX_OFFLOAD] == NULL) {
         ALOGV("Effect_command() Calling OFFLOAD EffectCreate");
@@ -272,6 +517,26 @@ int Effect_command(effect_handle_t  self,
     }
     // tmpSize is now the actual reply size for the non active sub effect
 
+    // With a worker, the HOST sub effect is configured to process the worker buffers, and
+    // its pipeline restarts with silence when the effect is reset or enabled
+    void *hostCmdData = pCmdData;
+    effect_config_t hostConfig;
+    if (pContext->worker != NULL) {
+        if (cmdCode == EFFECT_CMD_SET_CONFIG && pCmdData != NULL &&
+                cmdSize == sizeof(effect_config_t)) {
+            pContext->async = pContext->worker->configure(*(effect_config_t *)pCmdData,
+                                                          &hostConfig);
+            if (pContext->async) {
+                hostCmdData = &hostConfig;
+            } else {
+                ALOGW("Effect_command() configuration not supported by the worker, "
+                      "processing synchronously");
+            }
+        } else if (cmdCode == EFFECT_CMD_RESET || cmdCode == EFFECT_CMD_ENABLE) {
+            pContext->worker->flush();
+        }
+    }
+
     // Send command to sub effects. The command is sent to all sub effects so that their internal
     // state is kept in sync.
     // Only the reply from the active sub effect is returned to the caller. The reply from the
@@ -289,6 +554,13 @@ int Effect_command(effect_handle_t  self,
             subReplySize[i] = replySize == NULL ? NULL : &tmpSize;
             subReplyData[i] = pReplyData == NULL ? NULL : pContext->replyData;
         }
+        if (i == SUB_FX_HOST && pContext->worker != NULL) {
+            Mutex::Autolock _l(pContext->worker->effectLock());
+            *subStatus[i] = (*pContext->eHandle[i])->command(
+                                 pContext->eHandle[i], cmdCode, cmdSize,
+                                 hostCmdData, subReplySize[i], subReplyData[i]);
+            continue;
+        }
         *subStatus[i] = (*pContext->eHandle[i])->command(
                              pContext->eHandle[i], cmdCode, cmdSize,
                              pCmdData, subReplySize[i], subReplyData[i]);
@@ -16,6 +16,7 @@
 
 #include <hardware/audio.h>
 #include <hardware/audio_effect.h>
+#include <utils/StrongPointer.h>
 namespace android {
 enum {
     SUB_FX_HOST,       // Index of HOST in the descriptor and handle arrays
@@ -24,6 +25,13 @@ enum {
                        // of the Proxy context
     SUB_FX_COUNT       // The number of sub effects for a Proxy(1 HW, 1 SW)
 };
+
+class EffectProxyWorker;
+
+// Host sub effects whose descriptor cpuLoad (in 0.1 MIPS) is at least this property are run by
+// an EffectProxyWorker, one buffer behind the caller.  Unset or 0 never does.
+#define PROXY_ASYNC_LOAD_PROPERTY "ro.audio.effect_proxy_async_load"
+
 #if __cplusplus
 extern "C" {
 #endif
@@ -72,6 +80,8 @@ struct EffectContext {
   effect_uuid_t         uuid;        // UUID of the Proxy
   char*                 replyData;   // temporary buffer for non active sub effect command reply
   uint32_t              replySize;   // current size of temporary reply buffer
+  sp<EffectProxyWorker> worker;      // runs the HOST sub effect on its own thread, or NULL
+  bool                  async;       // HOST sub effect configured for the worker
 };
 
 #if __cplusplus
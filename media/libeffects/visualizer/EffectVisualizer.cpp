@@ -25,6 +25,26 @@
 #include <math.h>
 #include <audio_effects/effect_visualizer.h>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON (true)
+#else
+#define USE_NEON (false)
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2 (true)
+#else
+#define USE_SSE2 (false)
+#endif
+
+// Not in audio_effects/effect_visualizer.h yet, must match include/media/Visualizer.h
+#ifndef MEASUREMENT_MODE_FFT
+#define MEASUREMENT_MODE_FFT 0x2
+#define VISUALIZER_CMD_FFT (EFFECT_CMD_FIRST_PROPRIETARY + 2)
+#endif
+
 
 extern "C" {
 
@@ -60,6 +80,10 @@ enum visualizer_state_e {
 // maximum number of buffers for which we keep track of the measurements
 #define MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS 25 // note: buffer index is stored in uint8_t
 
+// the FFT of a capture of n samples is a complex FFT of n / 2 points, and has n / 2 + 1 bins
+#define FFT_MAX_POINTS (VISUALIZER_CAPTURE_SIZE_MAX / 2)
+#define FFT_MAX_BINS (FFT_MAX_POINTS + 1)
+
 
 struct BufferStats {
     bool mIsValid;
@@ -84,6 +108,19 @@ struct VisualizerContext {
     uint8_t mMeasurementWindowSizeInBuffers;
     uint8_t mMeasurementBufferIdx;
     BufferStats mPastMeasurements[MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS];
+    // for MEASUREMENT_MODE_FFT: the spectrum of the capture window, computed once per buffer
+    // processed and returned to all clients
+    uint32_t mFftSize; // capture size the tables are built for, 0 if it is not supported
+    bool mFftValid; // mFftRe and mFftIm hold the spectrum of the last buffer
+    uint16_t mFftBitReverse[FFT_MAX_POINTS];
+    float mFftTwiddleRe[FFT_MAX_POINTS]; // twiddles of each stage of the complex FFT, in turn
+    float mFftTwiddleIm[FFT_MAX_POINTS];
+    float mFftSplitRe[FFT_MAX_BINS]; // twiddles splitting the complex FFT into the real one
+    float mFftSplitIm[FFT_MAX_BINS];
+    float mFftWorkRe[FFT_MAX_POINTS];
+    float mFftWorkIm[FFT_MAX_POINTS];
+    float mFftRe[FFT_MAX_BINS];
+    float mFftIm[FFT_MAX_BINS];
 };
 
 //
@@ -114,6 +151,165 @@ void Visualizer_reset(VisualizerContext *pContext)
     pContext->mBufferUpdateTime.tv_sec = 0;
     pContext->mLatency = 0;
     memset(pContext->mCaptureBuf, 0x80, CAPTURE_BUF_SIZE);
+    pContext->mFftValid = false;
+}
+
+//----------------------------------------------------------------------------
+// Visualizer_initFft()
+//----------------------------------------------------------------------------
+// Purpose: Build the tables of the FFT for the current capture size.
+//
+// Inputs:
+//  pContext:   effect engine context
+//
+// Outputs:
+//  mFftSize is 0 if the capture size is not a power of 2 in the supported range
+//
+//----------------------------------------------------------------------------
+
+void Visualizer_initFft(VisualizerContext *pContext)
+{
+    const uint32_t size = pContext->mCaptureSize;
+    pContext->mFftValid = false;
+    if (size < VISUALIZER_CAPTURE_SIZE_MIN || size > VISUALIZER_CAPTURE_SIZE_MAX ||
+            (size & (size - 1)) != 0) {
+        pContext->mFftSize = 0;
+        return;
+    }
+    pContext->mFftSize = size;
+
+    const uint32_t points = size / 2;
+    uint32_t bits = 0;
+    while ((1u << bits) < points) {
+        bits++;
+    }
+    for (uint32_t i = 0; i < points; i++) {
+        uint32_t reversed = 0;
+        for (uint32_t b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        pContext->mFftBitReverse[i] = reversed;
+    }
+    // the stage combining transforms of 'half' points uses e^(-2 pi i j / (2 half)) for
+    // j < half, stored from index half - 1 so each stage reads its twiddles contiguously
+    for (uint32_t half = 1; half < points; half <<= 1) {
+        for (uint32_t j = 0; j < half; j++) {
+            double phase = M_PI * j / half;
+            pContext->mFftTwiddleRe[half - 1 + j] = (float) cos(phase);
+            pContext->mFftTwiddleIm[half - 1 + j] = (float) -sin(phase);
+        }
+    }
+    for (uint32_t k = 0; k <= points; k++) {
+        double phase = 2 * M_PI * k / size;
+        pContext->mFftSplitRe[k] = (float) cos(phase);
+        pContext->mFftSplitIm[k] = (float) -sin(phase);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Visualizer_computeFft()
+//----------------------------------------------------------------------------
+// Purpose: Compute the spectrum of the capture window ending at captureIdx, as
+//  VISUALIZER_CMD_CAPTURE would return it, into mFftRe and mFftIm.  The 8-bit samples are
+//  transformed unscaled, so bin k of a full scale sine is about 128 * size / 2.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  captureIdx: capture buffer index following the last sample
+//
+// Outputs:
+//
+//----------------------------------------------------------------------------
+
+void Visualizer_computeFft(VisualizerContext *pContext, uint32_t captureIdx)
+{
+    const uint32_t points = pContext->mFftSize / 2;
+    float *re = pContext->mFftWorkRe;
+    float *im = pContext->mFftWorkIm;
+
+    // the even samples are the real parts and the odd samples the imaginary parts of a complex
+    // sequence of half the size, loaded in bit reversed order for the in place FFT
+    // the index wraps modulo CAPTURE_BUF_SIZE, which divides 2^32
+    const uint32_t deltaSmpl =
+        pContext->mConfig.inputCfg.samplingRate * pContext->mLatency / 1000;
+    uint32_t idx = captureIdx - pContext->mFftSize - deltaSmpl;
+    for (uint32_t k = 0; k < points; k++) {
+        const uint32_t r = pContext->mFftBitReverse[k];
+        re[r] = (int8_t) (pContext->mCaptureBuf[idx % CAPTURE_BUF_SIZE] ^ 0x80);
+        im[r] = (int8_t) (pContext->mCaptureBuf[(idx + 1) % CAPTURE_BUF_SIZE] ^ 0x80);
+        idx += 2;
+    }
+
+    // radix-2 decimation in time; from 4 butterflies per group on, 4 of them at a time
+    for (uint32_t half = 1; half < points; half <<= 1) {
+        const float *wRe = pContext->mFftTwiddleRe + half - 1;
+        const float *wIm = pContext->mFftTwiddleIm + half - 1;
+        for (uint32_t i = 0; i < points; i += 2 * half) {
+            uint32_t j = 0;
+#if USE_NEON
+            for (; j + 4 <= half; j += 4) {
+                const uint32_t a = i + j;
+                const uint32_t b = a + half;
+                float32x4_t wr = vld1q_f32(wRe + j);
+                float32x4_t wi = vld1q_f32(wIm + j);
+                float32x4_t br = vld1q_f32(re + b);
+                float32x4_t bi = vld1q_f32(im + b);
+                float32x4_t tr = vmlsq_f32(vmulq_f32(br, wr), bi, wi);
+                float32x4_t ti = vmlaq_f32(vmulq_f32(br, wi), bi, wr);
+                float32x4_t ar = vld1q_f32(re + a);
+                float32x4_t ai = vld1q_f32(im + a);
+                vst1q_f32(re + b, vsubq_f32(ar, tr));
+                vst1q_f32(im + b, vsubq_f32(ai, ti));
+                vst1q_f32(re + a, vaddq_f32(ar, tr));
+                vst1q_f32(im + a, vaddq_f32(ai, ti));
+            }
+#elif USE_SSE2
+            for (; j + 4 <= half; j += 4) {
+                const uint32_t a = i + j;
+                const uint32_t b = a + half;
+                __m128 wr = _mm_loadu_ps(wRe + j);
+                __m128 wi = _mm_loadu_ps(wIm + j);
+                __m128 br = _mm_loadu_ps(re + b);
+                __m128 bi = _mm_loadu_ps(im + b);
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+                __m128 ar = _mm_loadu_ps(re + a);
+                __m128 ai = _mm_loadu_ps(im + a);
+                _mm_storeu_ps(re + b, _mm_sub_ps(ar, tr));
+                _mm_storeu_ps(im + b, _mm_sub_ps(ai, ti));
+                _mm_storeu_ps(re + a, _mm_add_ps(ar, tr));
+                _mm_storeu_ps(im + a, _mm_add_ps(ai, ti));
+            }
+#endif
+            for (; j < half; j++) {
+                const uint32_t a = i + j;
+                const uint32_t b = a + half;
+                const float tr = re[b] * wRe[j] - im[b] * wIm[j];
+                const float ti = re[b] * wIm[j] + im[b] * wRe[j];
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+
+    // with Z the complex spectrum, the even and odd samples have the spectra
+    // E[k] = (Z[k] + conj(Z[n-k])) / 2 and O[k] = (Z[k] - conj(Z[n-k])) / 2i,
+    // and X[k] = E[k] + e^(-2 pi i k / size) O[k]
+    for (uint32_t k = 0; k <= points; k++) {
+        const uint32_t a = k == points ? 0 : k;
+        const uint32_t b = k == 0 ? 0 : points - k;
+        const float er = 0.5f * (re[a] + re[b]);
+        const float ei = 0.5f * (im[a] - im[b]);
+        const float or_ = 0.5f * (im[a] + im[b]);
+        const float oi = 0.5f * (re[b] - re[a]);
+        const float wr = pContext->mFftSplitRe[k];
+        const float wi = pContext->mFftSplitIm[k];
+        pContext->mFftRe[k] = er + or_ * wr - oi * wi;
+        pContext->mFftIm[k] = ei + or_ * wi + oi * wr;
+    }
+    pContext->mFftValid = true;
 }
 
 //----------------------------------------------------------------------------
@@ -215,6 +411,7 @@ int Visualizer_init(VisualizerContext *pContext)
         pContext->mPastMeasurements[i].mPeakU16 = 0;
         pContext->mPastMeasurements[i].mRmsSquared = 0;
     }
+    Visualizer_initFft(pContext);
 
     Visualizer_setConfig(pContext, &pContext->mConfig);
 
@@ -302,6 +499,76 @@ static inline int16_t clamp16(int32_t sample)
     return sample;
 }
 
+// Finds the peak absolute value and the sum of the squares of n samples
+static void Visualizer_peakAndSumSquares(const int16_t *samples, uint32_t n,
+        int32_t *peak, int64_t *sumSquares)
+{
+    int32_t maxSample = 0;
+    int32_t minSample = 0;
+    int64_t sum = 0;
+    uint32_t i = 0;
+#if USE_NEON
+    if (n >= 8) {
+        int16x8_t maxV = vdupq_n_s16(0);
+        int16x8_t minV = vdupq_n_s16(0);
+        int64x2_t sumV = vdupq_n_s64(0);
+        for (; i + 8 <= n; i += 8) {
+            int16x8_t x = vld1q_s16(samples + i);
+            maxV = vmaxq_s16(maxV, x);
+            minV = vminq_s16(minV, x);
+            // each square is at most 2^30, so a pair of them fits before widening
+            sumV = vpadalq_s32(sumV, vmull_s16(vget_low_s16(x), vget_low_s16(x)));
+            sumV = vpadalq_s32(sumV, vmull_s16(vget_high_s16(x), vget_high_s16(x)));
+        }
+        int16_t maxs[8], mins[8];
+        vst1q_s16(maxs, maxV);
+        vst1q_s16(mins, minV);
+        for (int j = 0; j < 8; j++) {
+            if (maxs[j] > maxSample) maxSample = maxs[j];
+            if (mins[j] < minSample) minSample = mins[j];
+        }
+        sum = vgetq_lane_s64(sumV, 0) + vgetq_lane_s64(sumV, 1);
+    }
+#elif USE_SSE2
+    if (n >= 8) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i maxV = zero;
+        __m128i minV = zero;
+        __m128i sumV = zero;
+        for (; i + 8 <= n; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i *) (samples + i));
+            maxV = _mm_max_epi16(maxV, x);
+            minV = _mm_min_epi16(minV, x);
+            // a sum of 2 squares is at most 2^31, so it is widened as unsigned
+            __m128i squares = _mm_madd_epi16(x, x);
+            sumV = _mm_add_epi64(sumV, _mm_unpacklo_epi32(squares, zero));
+            sumV = _mm_add_epi64(sumV, _mm_unpackhi_epi32(squares, zero));
+        }
+        int16_t maxs[8], mins[8];
+        int64_t sums[2];
+        _mm_storeu_si128((__m128i *) maxs, maxV);
+        _mm_storeu_si128((__m128i *) mins, minV);
+        _mm_storeu_si128((__m128i *) sums, sumV);
+        for (int j = 0; j < 8; j++) {
+            if (maxs[j] > maxSample) maxSample = maxs[j];
+            if (mins[j] < minSample) minSample = mins[j];
+        }
+        sum = sums[0] + sums[1];
+    }
+#endif
+    for (; i < n; i++) {
+        const int32_t x = samples[i];
+        if (x > maxSample) {
+            maxSample = x;
+        } else if (x < minSample) {
+            minSample = x;
+        }
+        sum += x * x;
+    }
+    *peak = maxSample > -minSample ? maxSample : -minSample;
+    *sumSquares = sum;
+}
+
 int Visualizer_process(
         effect_handle_t self,audio_buffer_t *inBuffer, audio_buffer_t *outBuffer)
 {
@@ -321,21 +588,14 @@ int Visualizer_process(
     // perform measurements if needed
     if (pContext->mMeasurementMode & MEASUREMENT_MODE_PEAK_RMS) {
         // find the peak and RMS squared for the new buffer
-        uint32_t inIdx;
-        int16_t maxSample = 0;
-        float rmsSqAcc = 0;
-        for (inIdx = 0 ; inIdx < inBuffer->frameCount * pContext->mChannelCount ; inIdx++) {
-            if (inBuffer->s16[inIdx] > maxSample) {
-                maxSample = inBuffer->s16[inIdx];
-            } else if (-inBuffer->s16[inIdx] > maxSample) {
-                maxSample = -inBuffer->s16[inIdx];
-            }
-            rmsSqAcc += (inBuffer->s16[inIdx] * inBuffer->s16[inIdx]);
-        }
+        int32_t maxSample;
+        int64_t rmsSqAcc;
+        Visualizer_peakAndSumSquares(inBuffer->s16, inBuffer->frameCount * pContext->mChannelCount,
+                &maxSample, &rmsSqAcc);
         // store the measurement
         pContext->mPastMeasurements[pContext->mMeasurementBufferIdx].mPeakU16 = (uint16_t)maxSample;
         pContext->mPastMeasurements[pContext->mMeasurementBufferIdx].mRmsSquared =
-                rmsSqAcc / (inBuffer->frameCount * pContext->mChannelCount);
+                (float)rmsSqAcc / (inBuffer->frameCount * pContext->mChannelCount);
         pContext->mPastMeasurements[pContext->mMeasurementBufferIdx].mIsValid = true;
         if (++pContext->mMeasurementBufferIdx >= pContext->mMeasurementWindowSizeInBuffers) {
             pContext->mMeasurementBufferIdx = 0;
@@ -388,6 +648,9 @@ int Visualizer_process(
     // XXX the following two should really be atomic, though it probably doesn't
     // matter much for visualization purposes
     pContext->mCaptureIdx = captIdx;
+    if ((pContext->mMeasurementMode & MEASUREMENT_MODE_FFT) && pContext->mFftSize != 0) {
+        Visualizer_computeFft(pContext, captIdx);
+    }
     // update last buffer update time stamp
     if (clock_gettime(CLOCK_MONOTONIC, &pContext->mBufferUpdateTime) < 0) {
         pContext->mBufferUpdateTime.tv_sec = 0;
@@ -490,13 +753,13 @@ int Visualizer_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
         switch (data32[0]) {
         case VISUALIZER_PARAM_CAPTURE_SIZE:
             ALOGV("get mCaptureSize = %d", pContext->mCaptureSize);
-            data[1] = pContext->mCaptureSize;
+            data32[1] = pContext->mCaptureSize;
             p->vsize = sizeof(uint32_t);
             *replySize += sizeof(uint32_t);
             break;
         case VISUALIZER_PARAM_SCALING_MODE:
             ALOGV("get mScalingMode = %d", pContext->mScalingMode);
-            data[1] = pContext->mScalingMode;
+            data32[1] = pContext->mScalingMode;
             p->vsize = sizeof(uint32_t);
             *replySize += sizeof(uint32_t);
             break;
@@ -529,19 +792,21 @@ int Visualizer_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
         }
         switch (data32[0]) {
         case VISUALIZER_PARAM_CAPTURE_SIZE:
-            pContext->mCaptureSize = data[1];
+            pContext->mCaptureSize = data32[1];
             ALOGV("set mCaptureSize = %d", pContext->mCaptureSize);
+            Visualizer_initFft(pContext);
             break;
         case VISUALIZER_PARAM_SCALING_MODE:
-            pContext->mScalingMode = data[1];
+            pContext->mScalingMode = data32[1];
             ALOGV("set mScalingMode = %d", pContext->mScalingMode);
             break;
         case VISUALIZER_PARAM_LATENCY:
-            pContext->mLatency = data[1];
+            pContext->mLatency = data32[1];
             ALOGV("set mLatency = %d", pContext->mLatency);
             break;
         case VISUALIZER_PARAM_MEASUREMENT_MODE:
             pContext->mMeasurementMode = *((uint32_t *)p->data + 1);
+            pContext->mFftValid = false;
             ALOGV("set mMeasurementMode = %d", pContext->mMeasurementMode);
             break;
         default:
@@ -606,7 +871,65 @@ int Visualizer_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
 
         } break;
 
+    case VISUALIZER_CMD_FFT: {
+        // the spectrum computed by Visualizer_process(), in the layout of the 8-bit FFT of
+        // Visualizer::getFft(): the real parts of DC and Nyquist, then the real and imaginary
+        // parts of the other bins
+        const uint32_t captureSize = pContext->mFftSize;
+        if (pReplyData == NULL || captureSize == 0 || *replySize != captureSize ||
+                !(pContext->mMeasurementMode & MEASUREMENT_MODE_FFT)) {
+            ALOGV("VISUALIZER_CMD_FFT() error *replySize %d captureSize %d",
+                    *replySize, captureSize);
+            return -EINVAL;
+        }
+        int8_t *fft = (int8_t *)pReplyData;
+        if (pContext->mState != VISUALIZER_STATE_ACTIVE || !pContext->mFftValid ||
+                Visualizer_getDeltaTimeMsFromUpdatedTime(pContext) > MAX_STALL_TIME_MS) {
+            memset(fft, 0, captureSize);
+            break;
+        }
+        const uint32_t points = captureSize / 2;
+        const float scale = 8.0f / captureSize;
+        for (uint32_t i = 0; i < captureSize; i++) {
+            const uint32_t k = i >> 1;
+            float value;
+            if (k == 0) {
+                value = i == 0 ? pContext->mFftRe[0] : pContext->mFftRe[points];
+            } else {
+                value = i & 1 ? pContext->mFftIm[k] : pContext->mFftRe[k];
+            }
+            int32_t tmp = (int32_t)(value * scale);
+            while (tmp > 127 || tmp < -128) tmp >>= 1;
+            fft[i] = tmp;
+        }
+        } break;
+
     case VISUALIZER_CMD_MEASURE: {
+        if (pCmdData != NULL && cmdSize == sizeof(uint32_t) &&
+                *(uint32_t *)pCmdData == MEASUREMENT_MODE_FFT) {
+            // magnitude of each bin in mB, 0 being a full scale sine in the capture
+            const uint32_t bins = pContext->mFftSize / 2 + 1;
+            if (pReplyData == NULL || pContext->mFftSize == 0 ||
+                    *replySize != bins * sizeof(int32_t) ||
+                    !(pContext->mMeasurementMode & MEASUREMENT_MODE_FFT)) {
+                return -EINVAL;
+            }
+            int32_t* pIntReplyData = (int32_t*)pReplyData;
+            const bool valid = pContext->mState == VISUALIZER_STATE_ACTIVE &&
+                    pContext->mFftValid &&
+                    Visualizer_getDeltaTimeMsFromUpdatedTime(pContext) <= MAX_STALL_TIME_MS;
+            const float fullScale = 64.0f * pContext->mFftSize;
+            for (uint32_t k = 0; k < bins; k++) {
+                const float magnitude = valid ? hypotf(pContext->mFftRe[k], pContext->mFftIm[k])
+                        / fullScale : 0.0f;
+                if (magnitude < 0.000016f) {
+                    pIntReplyData[k] = -9600; //-96dB
+                } else {
+                    pIntReplyData[k] = (int32_t) (2000 * log10(magnitude));
+                }
+            }
+            break;
+        }
         uint16_t peakU16 = 0;
         float sumRmsSquared = 0.0f;
         uint8_t nbValidMeasurements = 0;
@@ -64,6 +64,7 @@ LOCAL_SRC_FILES:= \
     Visualizer.cpp \
     MemoryLeakTrackUtil.cpp \
     SoundPool.cpp \
+    SoundPoolCache.cpp \
     SoundPoolThread.cpp \
     StringArray.cpp
 
@@ -109,3 +110,5 @@ LOCAL_C_INCLUDES := \
     $(call include-path-for, audio-utils)
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
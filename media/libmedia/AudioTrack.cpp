@@ -1985,6 +1985,11 @@ status_t AudioTrack::dump(int fd, const Vector<String16>& args) const
     snprintf(buffer, 255, "  state(%d), latency (%d)\n", mState, mLatency);
 #endif
     result.append(buffer);
+    if (mProxy != 0) {
+        snprintf(buffer, 255, "  futex wakeups(%u), per second(%.1f)\n", mProxy->getWakeups(),
+                mProxy->getWakeupsPerSecond());
+        result.append(buffer);
+    }
     ::write(fd, result.string(), result.size());
     return NO_ERROR;
 }
@@ -38,10 +38,16 @@ Proxy::Proxy(audio_track_cblk_t* cblk, void *buffers, size_t frameCount, size_t
         bool isOut, bool clientInServer)
     : mCblk(cblk), mBuffers(buffers), mFrameCount(frameCount), mFrameSize(frameSize),
       mFrameCountP2(roundup(frameCount)), mIsOut(isOut), mClientInServer(clientInServer),
-      mIsShutdown(false), mUnreleased(0)
+      mIsShutdown(false), mUnreleased(0), mWakeups(0), mCreatedNs(systemTime())
 {
 }
 
+float Proxy::getWakeupsPerSecond() const
+{
+    nsecs_t elapsed = systemTime() - mCreatedNs;
+    return elapsed > 0 ? mWakeups * 1e9f / elapsed : 0.0f;
+}
+
 // ---------------------------------------------------------------------------
 
 ClientProxy::ClientProxy(audio_track_cblk_t* cblk, void *buffers, size_t frameCount,
@@ -93,6 +99,16 @@ status_t ClientProxy::obtainBuffer(Buffer* buffer, const struct timespec *reques
     bool beforeIsValid = false;
     audio_track_cblk_t* cblk = mCblk;
     bool ignoreInitialPendingInterrupt = true;
+    // Tell the server how many frames we are waiting for, so that it does not wake us
+    // for less.  This is only a hint: any available frames are returned after a wakeup.
+    size_t waitFrames = buffer->mFrameCount;
+    if (waitFrames > mFrameCount / 2) {
+        waitFrames = mFrameCount / 2;
+    }
+    if (waitFrames == 0) {
+        waitFrames = 1;
+    }
+    bool published = false;         // whether waitFrames may still be in mFutex
     // check for shared memory corruption
     if (mIsShutdown) {
         status = NO_INIT;
@@ -204,7 +220,15 @@ status_t ClientProxy::obtainBuffer(Buffer* buffer, const struct timespec *reques
             ts = NULL;
             break;
         }
-        int32_t old = android_atomic_and(~CBLK_FUTEX_WAKE, &cblk->mFutex);
+        // Consume a pending wake and publish waitFrames in the same atomic operation,
+        // so that a releaseBuffer() racing with us either sets CBLK_FUTEX_WAKE before it,
+        // or sees that we are blocked and wakes us.
+        int32_t old;
+        const int32_t waiting = (int32_t) (waitFrames << CBLK_FUTEX_WAIT_SHIFT);
+        do {
+            old = cblk->mFutex;
+        } while (android_atomic_acquire_cas(old, waiting, &cblk->mFutex) != 0);
+        published = true;
         if (!(old & CBLK_FUTEX_WAKE)) {
             int rc;
             if (measure && !beforeIsValid) {
@@ -212,7 +236,7 @@ status_t ClientProxy::obtainBuffer(Buffer* buffer, const struct timespec *reques
                 beforeIsValid = true;
             }
             int ret = __futex_syscall4(&cblk->mFutex,
-                    mClientInServer ? FUTEX_WAIT_PRIVATE : FUTEX_WAIT, old & ~CBLK_FUTEX_WAKE, ts);
+                    mClientInServer ? FUTEX_WAIT_PRIVATE : FUTEX_WAIT, waiting, ts);
             // update total elapsed time spent waiting
             if (measure) {
                 struct timespec after;
@@ -230,6 +254,9 @@ status_t ClientProxy::obtainBuffer(Buffer* buffer, const struct timespec *reques
                 before = after;
                 beforeIsValid = true;
             }
+            if (ret == 0) {
+                mWakeups++;
+            }
             switch (ret) {
             case 0:             // normal wakeup by server, or by binderDied()
             case -EWOULDBLOCK:  // benign race condition with server
@@ -243,9 +270,16 @@ status_t ClientProxy::obtainBuffer(Buffer* buffer, const struct timespec *reques
                 goto end;
             }
         }
+        // no longer blocked; keep any wake that arrived meanwhile
+        (void) android_atomic_and(CBLK_FUTEX_WAKE, &cblk->mFutex);
+        published = false;
     }
 
 end:
+    if (published) {
+        // an error while blocked; stop the server from waking us for the frames we waited for
+        (void) android_atomic_and(CBLK_FUTEX_WAKE, &cblk->mFutex);
+    }
     if (status != NO_ERROR) {
         buffer->mFrameCount = 0;
         buffer->mRaw = NULL;
@@ -502,7 +536,7 @@ size_t StaticAudioTrackClientProxy::getBufferPosition()
 ServerProxy::ServerProxy(audio_track_cblk_t* cblk, void *buffers, size_t frameCount,
         size_t frameSize, bool isOut, bool clientInServer)
     : Proxy(cblk, buffers, frameCount, frameSize, isOut, clientInServer),
-      mAvailToClient(0), mFlush(0)
+      mAvailToClient(0), mCoalescedWakeups(0), mFlush(0)
 {
 }
 
@@ -529,9 +563,13 @@ status_t ServerProxy::obtainBuffer(Buffer* buffer, bool ackFlush)
             android_atomic_release_store(rear, &cblk->u.mStreaming.mFront);
             if (front != rear) {
                 int32_t old = android_atomic_or(CBLK_FUTEX_WAKE, &cblk->mFutex);
-                if (!(old & CBLK_FUTEX_WAKE)) {
+                // as in releaseBuffer(), only a blocked client needs the syscall
+                if (!(old & CBLK_FUTEX_WAKE) && ((uint32_t) old >> CBLK_FUTEX_WAIT_SHIFT) != 0) {
                     (void) __futex_syscall3(&cblk->mFutex,
                             mClientInServer ? FUTEX_WAKE_PRIVATE : FUTEX_WAKE, 1);
+                    mWakeups++;
+                } else {
+                    mCoalescedWakeups++;
                 }
             }
             front = rear;
@@ -628,14 +666,29 @@ void ServerProxy::releaseBuffer(Buffer* buffer)
     } else if (minimum > half) {
         minimum = half;
     }
-    // FIXME AudioRecord wakeup needs to be optimized; it currently wakes up client every time
-    if (!mIsOut || (mAvailToClient + stepCount >= minimum)) {
+    size_t availToClient = mAvailToClient + stepCount;
+    // An AudioRecord client blocked in obtainBuffer() is only woken once the frames it is
+    // waiting for are available, rather than on every release.  The read is racy, but
+    // obtainBuffer() returns whatever is available after any wakeup, so at worst the client
+    // is woken early or late by one release.
+    size_t waitFrames = (uint32_t) cblk->mFutex >> CBLK_FUTEX_WAIT_SHIFT;
+    if (!mIsOut && waitFrames != 0) {
+        minimum = waitFrames < half ? waitFrames : half;
+    }
+    if (availToClient >= minimum) {
         ALOGV("mAvailToClient=%u stepCount=%u minimum=%u", mAvailToClient, stepCount, minimum);
         int32_t old = android_atomic_or(CBLK_FUTEX_WAKE, &cblk->mFutex);
-        if (!(old & CBLK_FUTEX_WAKE)) {
+        // The syscall is only needed if the client is blocked; otherwise it will see
+        // CBLK_FUTEX_WAKE before it blocks.
+        if (!(old & CBLK_FUTEX_WAKE) && ((uint32_t) old >> CBLK_FUTEX_WAIT_SHIFT) != 0) {
             (void) __futex_syscall3(&cblk->mFutex,
                     mClientInServer ? FUTEX_WAKE_PRIVATE : FUTEX_WAKE, 1);
+            mWakeups++;
+        } else {
+            mCoalescedWakeups++;
         }
+    } else if (!mIsOut) {
+        mCoalescedWakeups++;
     }
 
     buffer->mFrameCount = 0;
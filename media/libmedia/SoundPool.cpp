@@ -20,9 +20,13 @@
 
 #define USE_SHARED_MEM_BUFFER
 
+#include <stdlib.h>
+#include <unistd.h>
+#include <cutils/properties.h>
 #include <media/AudioTrack.h>
 #include <media/mediaplayer.h>
 #include <media/SoundPool.h>
+#include "SoundPoolCache.h"
 #include "SoundPoolThread.h"
 
 namespace android
@@ -33,6 +37,26 @@ uint32_t kMaxSampleRate = 48000;
 uint32_t kDefaultSampleRate = 44100;
 uint32_t kDefaultFrameCount = 1200;
 size_t kDefaultHeapSize = 1024 * 1024; // 1MB
+int kMaxDecodeThreads = 4;
+
+// Number of threads decoding samples in parallel, read from property
+// media.soundpool.decode_threads.  By default one per CPU, up to kMaxDecodeThreads.
+static int getDecodeThreadCount()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.soundpool.decode_threads", value, NULL) > 0) {
+        char *endptr;
+        long l = strtol(value, &endptr, 0);
+        if (*endptr == '\0' && l > 0) {
+            return l < kMaxDecodeThreads ? l : kMaxDecodeThreads;
+        }
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        return 1;
+    }
+    return cpus < kMaxDecodeThreads ? cpus : kMaxDecodeThreads;
+}
 
 
 SoundPool::SoundPool(int maxChannels, audio_stream_type_t streamType, int srcQuality)
@@ -175,7 +199,7 @@ bool SoundPool::startThreads()
 {
     createThreadEtc(beginThread, this, "SoundPool");
     if (mDecodeThread == NULL)
-        mDecodeThread = new SoundPoolThread(this);
+        mDecodeThread = new SoundPoolThread(this, getDecodeThreadCount());
     return mDecodeThread != NULL;
 }
 
@@ -202,9 +226,13 @@ SoundChannel* SoundPool::findNextChannel(int channelID)
 int SoundPool::load(const char* path, int priority)
 {
     ALOGV("load: path=%s, priority=%d", path, priority);
-    Mutex::Autolock lock(&mLock);
-    sp<Sample> sample = new Sample(++mNextSampleID, path);
-    mSamples.add(sample->sampleID(), sample);
+    sp<Sample> sample;
+    {
+        Mutex::Autolock lock(&mLock);
+        sample = new Sample(++mNextSampleID, path);
+        mSamples.add(sample->sampleID(), sample);
+        sample->startLoad();
+    }
     doLoad(sample);
     return sample->sampleID();
 }
@@ -213,17 +241,22 @@ int SoundPool::load(int fd, int64_t offset, int64_t length, int priority)
 {
     ALOGV("load: fd=%d, offset=%lld, length=%lld, priority=%d",
             fd, offset, length, priority);
-    Mutex::Autolock lock(&mLock);
-    sp<Sample> sample = new Sample(++mNextSampleID, fd, offset, length);
-    mSamples.add(sample->sampleID(), sample);
+    sp<Sample> sample;
+    {
+        Mutex::Autolock lock(&mLock);
+        sample = new Sample(++mNextSampleID, fd, offset, length);
+        mSamples.add(sample->sampleID(), sample);
+        sample->startLoad();
+    }
     doLoad(sample);
     return sample->sampleID();
 }
 
+// Called without mLock: the decode threads take it to look up the samples they pop, so
+// waiting for room in the decode queue with mLock held would deadlock.
 void SoundPool::doLoad(sp<Sample>& sample)
 {
     ALOGV("doLoad: loading sample sampleID=%d", sample->sampleID());
-    sample->startLoad();
     mDecodeThread->loadSample(sample->sampleID());
 }
 
@@ -484,6 +517,9 @@ Sample::~Sample()
         ::close(mFd);
     }
     free(mUrl);
+    if (!mCacheKey.isEmpty()) {
+        SoundPoolCache::release(mCacheKey);
+    }
 }
 
 status_t Sample::doLoad()
@@ -492,6 +528,29 @@ status_t Sample::doLoad()
     int numChannels;
     audio_format_t format;
     status_t status;
+    sp<SoundPoolCache::Pcm> pcm;
+
+    // samples of the same source share the PCM decoded for the first one
+    String8 key = mUrl ? SoundPoolCache::keyFor(mUrl) :
+            SoundPoolCache::keyFor(mFd, mOffset, mLength);
+    if (!key.isEmpty() && SoundPoolCache::lookup(key, &pcm) == NO_ERROR) {
+        ALOGV("sampleID=%d found in cache", mSampleID);
+        if (mFd >= 0) {
+            ALOGV("close(%d)", mFd);
+            ::close(mFd);
+            mFd = -1;
+        }
+        mCacheKey = key;
+        mHeap = pcm->mHeap;
+        mData = pcm->mData;
+        mSize = pcm->mSize;
+        mSampleRate = pcm->mSampleRate;
+        mNumChannels = pcm->mNumChannels;
+        mFormat = pcm->mFormat;
+        mState = READY;
+        return NO_ERROR;
+    }
+
     mHeap = new MemoryHeapBase(kDefaultHeapSize);
 
     ALOGV("Start decode");
@@ -523,14 +582,37 @@ status_t Sample::doLoad()
         goto error;
     }
 
+    // the decoder needs a kDefaultHeapSize heap, keep the PCM in a heap of its own size as it
+    // may stay in the cache
+    if (mSize > 0 && mSize < kDefaultHeapSize) {
+        sp<MemoryHeapBase> heap = new MemoryHeapBase(mSize);
+        if (heap->getHeapID() >= 0) {
+            memcpy(heap->getBase(), mHeap->getBase(), mSize);
+            mHeap = heap;
+        }
+    }
     mData = new MemoryBase(mHeap, 0, mSize);
     mSampleRate = sampleRate;
     mNumChannels = numChannels;
     mFormat = format;
+    if (!key.isEmpty()) {
+        pcm = new SoundPoolCache::Pcm();
+        pcm->mHeap = mHeap;
+        pcm->mData = mData;
+        pcm->mSize = mSize;
+        pcm->mSampleRate = sampleRate;
+        pcm->mNumChannels = numChannels;
+        pcm->mFormat = format;
+        SoundPoolCache::add(key, pcm);
+        mCacheKey = key;
+    }
     mState = READY;
     return NO_ERROR;
 
 error:
+    if (!key.isEmpty()) {
+        SoundPoolCache::abandon(key);
+    }
     mHeap.clear();
     return status;
 }
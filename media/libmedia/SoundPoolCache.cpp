@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SoundPoolCache"
+#include <utils/Log.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <cutils/properties.h>
+
+#include "SoundPoolCache.h"
+
+namespace android {
+
+static const size_t kDefaultCacheBudget = 8 * 1024 * 1024; // 8MB
+
+const size_t SoundPoolCache::kMaxIdleEntries = 16;
+
+Mutex SoundPoolCache::sLock;
+Condition SoundPoolCache::sDecoded;
+KeyedVector<String8, SoundPoolCache::Entry> SoundPoolCache::sEntries;
+size_t SoundPoolCache::sSize = 0;
+size_t SoundPoolCache::sBudget = kDefaultCacheBudget;
+bool SoundPoolCache::sBudgetRead = false;
+uint32_t SoundPoolCache::sUseCount = 0;
+
+String8 SoundPoolCache::keyFor(const char* url)
+{
+    // a file modified since it was decoded gets a new key
+    struct stat st;
+    if (stat(url, &st) == 0) {
+        return String8::format("url:%s:%ld:%lld", url, (long)st.st_mtime,
+                (long long)st.st_size);
+    }
+    return String8::format("url:%s", url);
+}
+
+String8 SoundPoolCache::keyFor(int fd, int64_t offset, int64_t length)
+{
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        return String8();
+    }
+    return String8::format("fd:%llu:%llu:%ld:%lld:%lld", (unsigned long long)st.st_dev,
+            (unsigned long long)st.st_ino, (long)st.st_mtime, (long long)offset,
+            (long long)length);
+}
+
+status_t SoundPoolCache::lookup(const String8& key, sp<Pcm>* pcm)
+{
+    Mutex::Autolock lock(&sLock);
+    for (;;) {
+        ssize_t index = sEntries.indexOfKey(key);
+        if (index < 0) {
+            // the caller decodes the source, other threads loading it wait
+            Entry entry;
+            entry.mDecoding = true;
+            sEntries.add(key, entry);
+            return NAME_NOT_FOUND;
+        }
+        Entry& entry = sEntries.editValueAt(index);
+        if (!entry.mDecoding) {
+            ALOGV("lookup: %s found, %d users", key.string(), entry.mUsers);
+            entry.mUsers++;
+            *pcm = entry.mPcm;
+            return NO_ERROR;
+        }
+        sDecoded.wait(sLock);
+    }
+}
+
+void SoundPoolCache::add(const String8& key, const sp<Pcm>& pcm)
+{
+    Mutex::Autolock lock(&sLock);
+    ssize_t index = sEntries.indexOfKey(key);
+    if (index < 0) {
+        return;
+    }
+    Entry& entry = sEntries.editValueAt(index);
+    entry.mPcm = pcm;
+    entry.mDecoding = false;
+    entry.mUsers = 1;
+    sSize += pcm->mHeap->getSize();
+    ALOGV("add: %s, %u bytes, cache size %u", key.string(), pcm->mHeap->getSize(), sSize);
+    trim_l();
+    sDecoded.broadcast();
+}
+
+void SoundPoolCache::abandon(const String8& key)
+{
+    Mutex::Autolock lock(&sLock);
+    sEntries.removeItem(key);
+    sDecoded.broadcast();
+}
+
+void SoundPoolCache::release(const String8& key)
+{
+    Mutex::Autolock lock(&sLock);
+    ssize_t index = sEntries.indexOfKey(key);
+    if (index < 0) {
+        return;
+    }
+    Entry& entry = sEntries.editValueAt(index);
+    if (--entry.mUsers == 0) {
+        entry.mLastUse = ++sUseCount;
+        trim_l();
+    }
+}
+
+// Drops the least recently used PCM no sample uses until the cache fits in its budget and
+// keeps at most kMaxIdleEntries of them
+void SoundPoolCache::trim_l()
+{
+    if (!sBudgetRead) {
+        char value[PROPERTY_VALUE_MAX];
+        if (property_get(SOUNDPOOL_CACHE_BUDGET_PROPERTY, value, NULL) > 0) {
+            char *endptr;
+            unsigned long ul = strtoul(value, &endptr, 0);
+            if (*endptr == '\0') {
+                sBudget = ul * 1024;
+            }
+        }
+        sBudgetRead = true;
+    }
+    for (;;) {
+        ssize_t oldest = -1;
+        size_t idle = 0;
+        for (size_t i = 0; i < sEntries.size(); i++) {
+            const Entry& entry = sEntries.valueAt(i);
+            if (entry.mUsers != 0 || entry.mDecoding) {
+                continue;
+            }
+            idle++;
+            // mLastUse wraps around, so compare ages
+            if (oldest < 0 || sUseCount - entry.mLastUse >
+                    sUseCount - sEntries.valueAt(oldest).mLastUse) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0 || (sSize <= sBudget && idle <= kMaxIdleEntries)) {
+            break;
+        }
+        const size_t heapSize = sEntries.valueAt(oldest).mPcm->mHeap->getSize();
+        ALOGV("trim: dropping %s, %u bytes", sEntries.keyAt(oldest).string(), heapSize);
+        sSize -= heapSize;
+        sEntries.removeItemsAt(oldest);
+    }
+}
+
+} // end namespace android
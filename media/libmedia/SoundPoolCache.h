@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SOUNDPOOLCACHE_H_
+#define SOUNDPOOLCACHE_H_
+
+#include <utils/threads.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <binder/MemoryHeapBase.h>
+#include <binder/IMemory.h>
+#include <system/audio.h>
+
+namespace android {
+
+// budget of the decoded PCM cache in KiB, see SoundPoolCache
+#define SOUNDPOOL_CACHE_BUDGET_PROPERTY "media.soundpool.cache_kb"
+
+/*
+ * Decoded PCM shared by all the SoundPools of the process.  Samples loaded from the same source
+ * share one decoded copy.  When no sample uses a copy any more, it is kept for the next load of
+ * the source, and the least recently used of those copies are dropped once the cache holds more
+ * than its budget, or more than kMaxIdleEntries of them.  The copies in use are never dropped,
+ * but count in the budget.  A copy counts for the size of its heap, which holds the file
+ * descriptor and ashmem region, so the heap should be sized to the PCM before add().
+ */
+class SoundPoolCache {
+public:
+    // copies kept with no sample using them, each holding a heap
+    static const size_t kMaxIdleEntries;
+
+    // decoded PCM of a source
+    class Pcm : public RefBase {
+    public:
+        Pcm() : mSize(0), mSampleRate(0), mNumChannels(0), mFormat(AUDIO_FORMAT_DEFAULT) {}
+        sp<MemoryHeapBase>  mHeap;
+        sp<IMemory>         mData;
+        size_t              mSize;
+        uint32_t            mSampleRate;
+        int                 mNumChannels;
+        audio_format_t      mFormat;
+    };
+
+    // Returns a key identifying the source, or an empty string if it cannot be identified
+    static String8 keyFor(const char* url);
+    static String8 keyFor(int fd, int64_t offset, int64_t length);
+
+    // Returns NO_ERROR and the decoded PCM if the source is cached, after waiting for another
+    // thread decoding it.  Otherwise returns NAME_NOT_FOUND, and the caller must decode the
+    // source and then call add(), or abandon() if it fails.  Every successful lookup() and
+    // add() must be matched by a release().
+    static status_t lookup(const String8& key, sp<Pcm>* pcm);
+    static void add(const String8& key, const sp<Pcm>& pcm);
+    static void abandon(const String8& key);
+    static void release(const String8& key);
+
+private:
+    struct Entry {
+        Entry() : mUsers(0), mDecoding(false), mLastUse(0) {}
+        sp<Pcm>     mPcm;
+        int         mUsers;         // samples using mPcm
+        bool        mDecoding;      // a thread is decoding the source, mPcm is not set yet
+        uint32_t    mLastUse;       // value of sUseCount when mUsers last dropped to 0
+    };
+
+    static void trim_l();
+
+    static Mutex                            sLock;
+    static Condition                        sDecoded;
+    static KeyedVector<String8, Entry>      sEntries;
+    static size_t                           sSize;      // bytes of the heaps of all the entries
+    static size_t                           sBudget;
+    static bool                             sBudgetRead;
+    static uint32_t                         sUseCount;
+};
+
+} // end namespace android
+
+#endif /*SOUNDPOOLCACHE_H_*/
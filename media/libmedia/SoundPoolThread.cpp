@@ -31,7 +31,7 @@ void SoundPoolThread::write(SoundPoolMsg msg) {
     // if thread is quitting, don't add to queue
     if (mRunning) {
         mMsgQueue.push(msg);
-        mCondition.signal();
+        mCondition.broadcast();
     }
 }
 
@@ -41,8 +41,11 @@ const SoundPoolMsg SoundPoolThread::read() {
         mCondition.wait(mLock);
     }
     SoundPoolMsg msg = mMsgQueue[0];
-    mMsgQueue.removeAt(0);
-    mCondition.signal();
+    // KILL stays in the queue for the other threads
+    if (msg.mMessageType != SoundPoolMsg::KILL) {
+        mMsgQueue.removeAt(0);
+    }
+    mCondition.broadcast();
     return msg;
 }
 
@@ -52,19 +55,27 @@ void SoundPoolThread::quit() {
         mRunning = false;
         mMsgQueue.clear();
         mMsgQueue.push(SoundPoolMsg(SoundPoolMsg::KILL, 0));
-        mCondition.signal();
-        mCondition.wait(mLock);
+        mCondition.broadcast();
+        while (mNumThreads > 0) {
+            mCondition.wait(mLock);
+        }
     }
     ALOGV("return from quit");
 }
 
-SoundPoolThread::SoundPoolThread(SoundPool* soundPool) :
-    mSoundPool(soundPool)
+SoundPoolThread::SoundPoolThread(SoundPool* soundPool, int numThreads) :
+    mSoundPool(soundPool), mNumThreads(0), mRunning(false)
 {
+    Mutex::Autolock lock(&mLock);
     mMsgQueue.setCapacity(maxMessages);
-    if (createThreadEtc(beginThread, this, "SoundPoolThread")) {
-        mRunning = true;
+    for (int i = 0; i < numThreads; i++) {
+        if (!createThreadEtc(beginThread, this, "SoundPoolThread")) {
+            break;
+        }
+        mNumThreads++;
     }
+    ALOGV("started %d threads", mNumThreads);
+    mRunning = mNumThreads > 0;
 }
 
 SoundPoolThread::~SoundPoolThread()
@@ -84,9 +95,13 @@ int SoundPoolThread::run() {
         SoundPoolMsg msg = read();
         ALOGV("Got message m=%d, mData=%d", msg.mMessageType, msg.mData);
         switch (msg.mMessageType) {
-        case SoundPoolMsg::KILL:
+        case SoundPoolMsg::KILL: {
             ALOGV("goodbye");
+            Mutex::Autolock lock(&mLock);
+            mNumThreads--;
+            mCondition.broadcast();
             return NO_ERROR;
+            }
         case SoundPoolMsg::LOAD_SAMPLE:
             doLoadSample(msg.mData);
             break;
@@ -103,7 +118,12 @@ void SoundPoolThread::loadSample(int sampleID) {
 }
 
 void SoundPoolThread::doLoadSample(int sampleID) {
-    sp <Sample> sample = mSoundPool->findSample(sampleID);
+    sp <Sample> sample;
+    {
+        // other threads may be adding samples
+        Mutex::Autolock lock(&mSoundPool->mLock);
+        sample = mSoundPool->findSample(sampleID);
+    }
     status_t status = -1;
     if (sample != 0) {
         status = sample->doLoad();
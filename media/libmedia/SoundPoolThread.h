@@ -36,11 +36,12 @@ public:
 };
 
 /*
- * This class handles background requests from the SoundPool
+ * This class handles background requests from the SoundPool, on one or more threads, so
+ * several samples can be decoded in parallel
  */
 class SoundPoolThread {
 public:
-    SoundPoolThread(SoundPool* SoundPool);
+    SoundPoolThread(SoundPool* SoundPool, int numThreads = 1);
     ~SoundPoolThread();
     void loadSample(int sampleID);
     void quit();
@@ -58,6 +59,7 @@ private:
     Condition               mCondition;
     Vector<SoundPoolMsg>    mMsgQueue;
     SoundPool*              mSoundPool;
+    int                     mNumThreads;    // threads not exited yet
     bool                    mRunning;
 };
 
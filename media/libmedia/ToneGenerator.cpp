@@ -22,6 +22,20 @@
 #include <cutils/properties.h>
 #include "media/ToneGenerator.h"
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON (true)
+#else
+#define USE_NEON (false)
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2 (true)
+#else
+#define USE_SSE2 (false)
+#endif
+
 
 namespace android {
 
@@ -1528,25 +1542,24 @@ ToneGenerator::WaveGenerator::WaveGenerator(unsigned short samplingRate,
         unsigned short frequency, float volume) {
     double d0;
     double F_div_Fs;  // frequency / samplingRate
+    short amplitude_Q15;
 
     F_div_Fs = frequency / (double)samplingRate;
-    d0 = - (float)GEN_AMP * sin(2 * M_PI * F_div_Fs);
-    mS2_0 = (short)d0;
-    mS1 = 0;
-    mS2 = mS2_0;
+    mPhaseInc = (uint32_t)(F_div_Fs * 4294967296.0 + 0.5);
+    mPhase = 0;
 
-    mAmplitude_Q15 = (short)(32767. * 32767. * volume / GEN_AMP);
+    amplitude_Q15 = (short)(32767. * 32767. * volume / GEN_AMP);
     // take some margin for amplitude fluctuation
-    if (mAmplitude_Q15 > 32500)
-        mAmplitude_Q15 = 32500;
+    if (amplitude_Q15 > 32500)
+        amplitude_Q15 = 32500;
 
-    d0 = 32768.0 * cos(2 * M_PI * F_div_Fs);  // Q14*2*cos()
-    if (d0 > 32767)
-        d0 = 32767;
-    mA1_Q14 = (short) d0;
+    // Same peak value as a full amplitude generator scaled by amplitude_Q15
+    d0 = (double)GEN_AMP * amplitude_Q15 / (1 << S_Q15);
+    for (unsigned int i = 0; i <= TABLE_SIZE; i++) {
+        mTable[i] = (short)floor(d0 * sin(2 * M_PI * i / TABLE_SIZE) + 0.5);
+    }
 
-    ALOGV("WaveGenerator init, mA1_Q14: %d, mS2_0: %d, mAmplitude_Q15: %d",
-            mA1_Q14, mS2_0, mAmplitude_Q15);
+    ALOGV("WaveGenerator init, mPhaseInc: %u, amplitude_Q15: %d", mPhaseInc, amplitude_Q15);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1565,12 +1578,39 @@ ToneGenerator::WaveGenerator::WaveGenerator(unsigned short samplingRate,
 ToneGenerator::WaveGenerator::~WaveGenerator() {
 }
 
+// Adds count samples of in to out, with saturation
+static void accumulateSamples(short *out, const short *in, unsigned int count) {
+    unsigned int i = 0;
+#if USE_NEON
+    for (; i + 8 <= count; i += 8) {
+        vst1q_s16(out + i, vqaddq_s16(vld1q_s16(out + i), vld1q_s16(in + i)));
+    }
+#elif USE_SSE2
+    for (; i + 8 <= count; i += 8) {
+        __m128i o = _mm_loadu_si128((const __m128i *)(out + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_adds_epi16(o, s));
+    }
+#endif
+    for (; i < count; i++) {
+        int sum = out[i] + in[i];
+        if (sum > 32767) {
+            sum = 32767;
+        } else if (sum < -32768) {
+            sum = -32768;
+        }
+        out[i] = (short)sum;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 //    Method:        WaveGenerator::getSamples()
 //
 //    Description:    Generates count samples of a sine wave and accumulates
-//        result in outBuffer.
+//        result in outBuffer. The samples are interpolated from the wave table
+//        by blocks of BLOCK_SIZE, and each block is added to outBuffer at once,
+//        so the waves of a multi-frequency tone are summed with SIMD.
 //
 //    Input:
 //        outBuffer:      Output buffer where to accumulate samples.
@@ -1583,52 +1623,54 @@ ToneGenerator::WaveGenerator::~WaveGenerator() {
 ////////////////////////////////////////////////////////////////////////////////
 void ToneGenerator::WaveGenerator::getSamples(short *outBuffer,
         unsigned int count, unsigned int command) {
-    long lS1, lS2;
-    long lA1, lAmplitude;
-    long Sample;  // current sample
+    short block[BLOCK_SIZE];
+    uint32_t phase;
+    const uint32_t phaseInc = mPhaseInc;
+    long lAmplitude = 0;
+    long dec = 0;
 
     // init local
     if (command == WAVEGEN_START) {
-        lS1 = (long)0;
-        lS2 = (long)mS2_0;
+        phase = 0;
     } else {
-        lS1 = (long)mS1;
-        lS2 = (long)mS2;
+        phase = mPhase;
     }
-    lA1 = (long)mA1_Q14;
-    lAmplitude = (long)mAmplitude_Q15;
 
     if (command == WAVEGEN_STOP) {
-        lAmplitude <<= 16;
         if (count == 0) {
             return;
         }
-        long dec = lAmplitude/count;
-        // loop generation
-        while (count--) {
-            Sample = ((lA1 * lS1) >> S_Q14) - lS2;
-            // shift delay
-            lS2 = lS1;
-            lS1 = Sample;
-            Sample = ((lAmplitude>>16) * Sample) >> S_Q15;
-            *(outBuffer++) += (short)Sample;  // put result in buffer
-            lAmplitude -= dec;
+        // ramp the amplitude down to 0 over the buffer
+        lAmplitude = 32767L << 16;
+        dec = lAmplitude/count;
+    }
+
+    while (count) {
+        const unsigned int n = count < BLOCK_SIZE ? count : BLOCK_SIZE;
+
+        // linear interpolation between the 2 table samples around the phase
+        for (unsigned int i = 0; i < n; i++) {
+            const uint32_t index = phase >> (32 - TABLE_BITS);
+            const int frac = (phase >> (32 - TABLE_BITS - S_Q15)) & 0x7FFF;
+            const int s0 = mTable[index];
+            block[i] = (short)(s0 + (((mTable[index + 1] - s0) * frac) >> S_Q15));
+            phase += phaseInc;
         }
-    } else {
-        // loop generation
-        while (count--) {
-            Sample = ((lA1 * lS1) >> S_Q14) - lS2;
-            // shift delay
-            lS2 = lS1;
-            lS1 = Sample;
-            Sample = (lAmplitude * Sample) >> S_Q15;
-            *(outBuffer++) += (short)Sample;  // put result in buffer
+
+        if (command == WAVEGEN_STOP) {
+            for (unsigned int i = 0; i < n; i++) {
+                block[i] = (short)(((lAmplitude >> 16) * block[i]) >> S_Q15);
+                lAmplitude -= dec;
+            }
         }
+
+        accumulateSamples(outBuffer, block, n);
+        outBuffer += n;
+        count -= n;
     }
 
     // save status
-    mS1 = (short)lS1;
-    mS2 = (short)lS2;
+    mPhase = phase;
 }
 
 }  // end namespace android
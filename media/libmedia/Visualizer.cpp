@@ -195,8 +195,7 @@ status_t Visualizer::setScalingMode(uint32_t mode) {
 
 status_t Visualizer::setMeasurementMode(uint32_t mode) {
     if ((mode != MEASUREMENT_MODE_NONE)
-            //Note: needs to be handled as a mask when more measurement modes are added
-            && ((mode & MEASUREMENT_MODE_PEAK_RMS) != mode)) {
+            && ((mode & (MEASUREMENT_MODE_PEAK_RMS | MEASUREMENT_MODE_FFT)) != mode)) {
         return BAD_VALUE;
     }
 
@@ -233,8 +232,14 @@ status_t Visualizer::getIntMeasurements(uint32_t type, uint32_t number, int32_t
                 type, mMeasurementMode);
         return INVALID_OPERATION;
     }
-    // only peak+RMS measurement supported
-    if ((type != MEASUREMENT_MODE_PEAK_RMS)
+    if (type == MEASUREMENT_MODE_FFT) {
+        // one int32_t value per bin
+        if (number != mCaptureSize / 2 + 1) {
+            ALOGE("Cannot retrieve int measurements, MEASUREMENT_MODE_FFT returns %u ints, not %d",
+                    mCaptureSize / 2 + 1, number);
+            return BAD_VALUE;
+        }
+    } else if ((type != MEASUREMENT_MODE_PEAK_RMS)
             // for peak+RMS measurement, the results are 2 int32_t values
             || (number != 2)) {
         ALOGE("Cannot retrieve int measurements, MEASUREMENT_MODE_PEAK_RMS returns 2 ints, not %d",
@@ -294,7 +299,9 @@ status_t Visualizer::getFft(uint8_t *fft)
     }
 
     status_t status = NO_ERROR;
-    if (mEnabled) {
+    if (mEnabled && (mMeasurementMode & MEASUREMENT_MODE_FFT)) {
+        status = getEffectFft(fft);
+    } else if (mEnabled) {
         uint8_t buf[mCaptureSize];
         status = getWaveForm(buf);
         if (status == NO_ERROR) {
@@ -334,6 +341,18 @@ status_t Visualizer::doFft(uint8_t *fft, uint8_t *waveform)
     return NO_ERROR;
 }
 
+// Returns the spectrum the effect computed for all its clients
+status_t Visualizer::getEffectFft(uint8_t *fft)
+{
+    uint32_t replySize = mCaptureSize;
+    status_t status = command(VISUALIZER_CMD_FFT, 0, NULL, &replySize, fft);
+    ALOGV("getEffectFft() command returned %d", status);
+    if ((status == NO_ERROR) && (replySize == 0)) {
+        status = NOT_ENOUGH_DATA;
+    }
+    return status;
+}
+
 void Visualizer::periodicCapture()
 {
     Mutex::Autolock _l(mCaptureLock);
@@ -349,7 +368,11 @@ void Visualizer::periodicCapture()
         }
         uint8_t fft[mCaptureSize];
         if (mCaptureFlags & CAPTURE_FFT) {
-            status = doFft(fft, waveform);
+            if (mMeasurementMode & MEASUREMENT_MODE_FFT) {
+                status = getEffectFft(fft);
+            } else {
+                status = doFft(fft, waveform);
+            }
         }
         if (status != NO_ERROR) {
             return;
@@ -0,0 +1,29 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	SoundPool_test.cpp \
+	SoundPoolCache_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libcutils \
+	libstlport \
+	libmedia \
+	libbinder
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main
+
+LOCAL_C_INCLUDES += \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	$(LOCAL_PATH)/.. \
+
+LOCAL_MODULE:= soundpool_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "SoundPoolCache.h"
+
+namespace android {
+
+// The cache is shared by the whole process, so each test uses keys of its own.
+
+static sp<SoundPoolCache::Pcm> newPcm(size_t heapSize)
+{
+    sp<SoundPoolCache::Pcm> pcm = new SoundPoolCache::Pcm();
+    pcm->mHeap = new MemoryHeapBase(heapSize);
+    pcm->mSize = heapSize;
+    pcm->mSampleRate = 44100;
+    pcm->mNumChannels = 2;
+    pcm->mFormat = AUDIO_FORMAT_PCM_16_BIT;
+    return pcm;
+}
+
+// Loads key as Sample::doLoad() does, decoding a PCM of heapSize bytes on a miss
+static sp<SoundPoolCache::Pcm> load(const String8& key, size_t heapSize, bool* decoded)
+{
+    sp<SoundPoolCache::Pcm> pcm;
+    *decoded = SoundPoolCache::lookup(key, &pcm) != NO_ERROR;
+    if (*decoded) {
+        pcm = newPcm(heapSize);
+        SoundPoolCache::add(key, pcm);
+    }
+    return pcm;
+}
+
+TEST(SoundPoolCacheTest, SamplesOfOneSourceShareThePcm) {
+    String8 key("test:share");
+    bool decoded;
+    sp<SoundPoolCache::Pcm> first = load(key, 4096, &decoded);
+    EXPECT_TRUE(decoded);
+    sp<SoundPoolCache::Pcm> second = load(key, 4096, &decoded);
+    EXPECT_FALSE(decoded);
+    EXPECT_EQ(first.get(), second.get());
+
+    // kept once no sample uses it
+    SoundPoolCache::release(key);
+    SoundPoolCache::release(key);
+    sp<SoundPoolCache::Pcm> third = load(key, 4096, &decoded);
+    EXPECT_FALSE(decoded);
+    EXPECT_EQ(first.get(), third.get());
+    SoundPoolCache::release(key);
+}
+
+TEST(SoundPoolCacheTest, LeastRecentlyUsedIdleEntriesAreDropped) {
+    const size_t count = SoundPoolCache::kMaxIdleEntries + 1;
+    bool decoded;
+    for (size_t i = 0; i < count; i++) {
+        String8 key = String8::format("test:idle:%u", i);
+        load(key, 4096, &decoded);
+        EXPECT_TRUE(decoded);
+        SoundPoolCache::release(key);
+    }
+    // the first one released is the oldest
+    for (size_t i = count; i-- > 0; ) {
+        String8 key = String8::format("test:idle:%u", i);
+        load(key, 4096, &decoded);
+        EXPECT_EQ(i == 0, decoded) << "entry " << i;
+        SoundPoolCache::release(key);
+    }
+}
+
+TEST(SoundPoolCacheTest, BudgetCountsTheHeap) {
+    // a small PCM in a heap larger than the default budget of 8 MB is dropped once idle
+    String8 key("test:heap");
+    sp<SoundPoolCache::Pcm> pcm = newPcm(9 * 1024 * 1024);
+    pcm->mSize = 4096;
+    sp<SoundPoolCache::Pcm> cached;
+    ASSERT_EQ(NAME_NOT_FOUND, SoundPoolCache::lookup(key, &cached));
+    SoundPoolCache::add(key, pcm);
+    bool decoded;
+    load(key, 4096, &decoded);
+    EXPECT_FALSE(decoded) << "entries in use are kept";
+    SoundPoolCache::release(key);
+    SoundPoolCache::release(key);
+    load(key, 4096, &decoded);
+    EXPECT_TRUE(decoded);
+    SoundPoolCache::release(key);
+}
+
+struct Waiter {
+    String8     mKey;
+    status_t    mStatus;
+};
+
+static void* lookupWhileDecoding(void* arg)
+{
+    Waiter* waiter = (Waiter*) arg;
+    sp<SoundPoolCache::Pcm> pcm;
+    waiter->mStatus = SoundPoolCache::lookup(waiter->mKey, &pcm);
+    if (waiter->mStatus != NO_ERROR) {
+        // decode it again
+        SoundPoolCache::add(waiter->mKey, newPcm(4096));
+    }
+    return NULL;
+}
+
+TEST(SoundPoolCacheTest, FailedDecodeIsRetried) {
+    String8 key("test:retry");
+    sp<SoundPoolCache::Pcm> pcm;
+    ASSERT_EQ(NAME_NOT_FOUND, SoundPoolCache::lookup(key, &pcm));
+
+    // another load of the source waits for this decode, then decodes itself when it fails
+    Waiter waiter;
+    waiter.mKey = key;
+    waiter.mStatus = NO_ERROR;
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, lookupWhileDecoding, &waiter));
+    usleep(100000);
+    SoundPoolCache::abandon(key);
+    pthread_join(thread, NULL);
+    EXPECT_EQ(NAME_NOT_FOUND, waiter.mStatus);
+
+    // its PCM is then shared
+    bool decoded;
+    load(key, 4096, &decoded);
+    EXPECT_FALSE(decoded);
+    SoundPoolCache::release(key);
+    SoundPoolCache::release(key);
+}
+
+}   // namespace android
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
+#include <media/SoundPool.h>
+
+namespace android {
+
+// More loads than the decode queue holds (SoundPoolThread::maxMessages is 5).
+static const int kNumLoads = 40;
+static const nsecs_t kTimeoutNs = 10000000000LL;   // 10 s
+
+struct LoadState {
+    LoadState() : mPool(NULL), mLoaded(0) {}
+    SoundPool*  mPool;
+    Mutex       mLock;
+    Condition   mCondition;
+    int         mLoaded;
+};
+
+static void onEvent(SoundPoolEvent event, SoundPool* soundPool, void* user)
+{
+    LoadState* state = (LoadState*) user;
+    if (event.mMsg == SoundPoolEvent::SAMPLE_LOADED) {
+        Mutex::Autolock _l(state->mLock);
+        state->mLoaded++;
+        state->mCondition.signal();
+    }
+}
+
+static void* loadAll(void* arg)
+{
+    LoadState* state = (LoadState*) arg;
+    for (int i = 0; i < kNumLoads; i++) {
+        // the file does not exist, so each decode fails quickly
+        state->mPool->load("/data/nonexistent-soundpool-test.ogg", 1 /*priority*/);
+    }
+    return NULL;
+}
+
+// load() must not wait for room in the decode queue while holding the SoundPool lock,
+// which the decode threads need.  Decoding runs on media.soundpool.decode_threads
+// threads, by default one per CPU up to 4, so run this on a multicore device.
+TEST(SoundPoolTest, LoadMoreThanQueueSize) {
+    LoadState state;
+    state.mPool = new SoundPool(1 /*maxChannels*/, AUDIO_STREAM_MUSIC, 0 /*srcQuality*/);
+    state.mPool->setCallback(onEvent, &state);
+
+    pthread_t loader;
+    ASSERT_EQ(0, pthread_create(&loader, NULL, loadAll, &state));
+
+    bool timedOut = false;
+    {
+        Mutex::Autolock _l(state.mLock);
+        while (state.mLoaded < kNumLoads && !timedOut) {
+            timedOut = state.mCondition.waitRelative(state.mLock, kTimeoutNs) != NO_ERROR;
+        }
+    }
+    // on a deadlock the loader and the decode threads never return, so leak the pool
+    ASSERT_FALSE(timedOut) << "only " << state.mLoaded << " of " << kNumLoads
+            << " loads completed";
+    pthread_join(loader, NULL);
+    state.mPool->setCallback(NULL, NULL);
+    delete state.mPool;
+}
+
+}   // namespace android
@@ -43,7 +43,7 @@ ssize_t LibsndfileSource::availableToRead()
     return !mLooping && mEstimatedFramesUntilEOF > 0 ? mEstimatedFramesUntilEOF : SSIZE_MAX;
 }
 
-ssize_t LibsndfileSource::read(void *buffer, size_t count)
+ssize_t LibsndfileSource::read(void *buffer, size_t count, int64_t readPTS)
 {
     if (!mNegotiated) {
         return (ssize_t) NEGOTIATE;
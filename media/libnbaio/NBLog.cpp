@@ -20,6 +20,7 @@
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <new>
@@ -29,19 +30,18 @@
 
 namespace android {
 
-int NBLog::Entry::readAt(size_t offset) const
+/*static*/
+const char *NBLog::eventName(EventId id)
 {
-    // FIXME This is too slow, despite the name it is used during writing
-    if (offset == 0)
-        return mEvent;
-    else if (offset == 1)
-        return mLength;
-    else if (offset < (size_t) (mLength + 2))
-        return ((char *) mData)[offset - 2];
-    else if (offset == (size_t) (mLength + 2))
-        return mLength;
-    else
-        return 0;
+    static const char * const names[EVENT_ID_COUNT] = {
+        "none",                 // EVENT_ID_NONE
+        "write blocked",        // EVENT_ID_WRITE_BLOCKED
+        "fast underrun",        // EVENT_ID_FAST_UNDERRUN
+        "fast overrun",         // EVENT_ID_FAST_OVERRUN
+        "record overflow",      // EVENT_ID_RECORD_OVERFLOW
+        "record read error",    // EVENT_ID_RECORD_READ_ERROR
+    };
+    return (unsigned) id < EVENT_ID_COUNT ? names[id] : NULL;
 }
 
 // ---------------------------------------------------------------------------
@@ -146,6 +146,31 @@ void NBLog::Writer::logTimestamp(const struct timespec& ts)
     log(EVENT_TIMESTAMP, &ts, sizeof(struct timespec));
 }
 
+void NBLog::Writer::logEvent(EventId id, size_t argc, const int32_t *argv,
+        const struct timespec *ts)
+{
+    if (!mEnabled) {
+        return;
+    }
+    if (argc > kMaxEventArgs || (argc > 0 && argv == NULL)) {
+        return;
+    }
+    struct timespec now;
+    if (ts == NULL) {
+        if (clock_gettime(CLOCK_MONOTONIC, &now)) {
+            return;
+        }
+        ts = &now;
+    }
+    uint8_t data[kTypedEventHeaderSize + kMaxEventArgs * sizeof(int32_t)];
+    int64_t ns = ts->tv_sec * 1000000000LL + ts->tv_nsec;
+    uint16_t id16 = id;
+    memcpy(data, &ns, sizeof(ns));
+    memcpy(&data[sizeof(ns)], &id16, sizeof(id16));
+    memcpy(&data[kTypedEventHeaderSize], argv, argc * sizeof(int32_t));
+    log(EVENT_TYPED, data, kTypedEventHeaderSize + argc * sizeof(int32_t));
+}
+
 void NBLog::Writer::log(Event event, const void *data, size_t length)
 {
     if (!mEnabled) {
@@ -157,6 +182,7 @@ void NBLog::Writer::log(Event event, const void *data, size_t length)
     switch (event) {
     case EVENT_STRING:
     case EVENT_TIMESTAMP:
+    case EVENT_TYPED:
         break;
     case EVENT_RESERVED:
     default:
@@ -175,26 +201,25 @@ void NBLog::Writer::log(const NBLog::Entry *entry, bool trusted)
         log(entry->mEvent, entry->mData, entry->mLength);
         return;
     }
-    size_t rear = mRear & (mSize - 1);
-    size_t written = mSize - rear;      // written = number of bytes that have been written so far
-    size_t need = entry->mLength + 3;   // mEvent, mLength, data[length], mLength
-                                        // need = number of bytes remaining to write
-    if (written > need) {
-        written = need;
-    }
-    size_t i;
-    // FIXME optimize this using memcpy for the data part of the Entry.
-    // The Entry could have a method copyTo(ptr, offset, size) to optimize the copy.
-    for (i = 0; i < written; ++i) {
-        mShared->mBuffer[rear + i] = entry->readAt(i);
-    }
-    if (rear + written == mSize && (need -= written) > 0)  {
-        for (i = 0; i < need; ++i) {
-            mShared->mBuffer[i] = entry->readAt(written + i);
-        }
-        written += need;
+    // mEvent, mLength, data[length], mLength
+    uint8_t header[2] = {(uint8_t) entry->mEvent, (uint8_t) entry->mLength};
+    copyToShared(mRear, header, sizeof(header));
+    copyToShared(mRear + 2, entry->mData, entry->mLength);
+    copyToShared(mRear + 2 + entry->mLength, &header[1], 1);
+    android_atomic_release_store(mRear += entry->mLength + 3, &mShared->mRear);
+}
+
+void NBLog::Writer::copyToShared(size_t offset, const void *data, size_t length)
+{
+    offset &= mSize - 1;
+    size_t first = mSize - offset;      // bytes before the wraparound point
+    if (first > length) {
+        first = length;
+    }
+    memcpy(&mShared->mBuffer[offset], data, first);
+    if (length > first) {
+        memcpy(mShared->mBuffer, (const char *) data + first, length - first);
     }
-    android_atomic_release_store(mRear += written, &mShared->mRear);
 }
 
 bool NBLog::Writer::isEnabled() const
@@ -257,6 +282,21 @@ void NBLog::LockedWriter::logTimestamp(const struct timespec& ts)
     Writer::logTimestamp(ts);
 }
 
+void NBLog::LockedWriter::logEvent(EventId id, size_t argc, const int32_t *argv,
+        const struct timespec *ts)
+{
+    // take the timestamp before the lock, so that it is the time of the event
+    struct timespec now;
+    if (ts == NULL) {
+        if (clock_gettime(CLOCK_MONOTONIC, &now)) {
+            return;
+        }
+        ts = &now;
+    }
+    Mutex::Autolock _l(mLock);
+    Writer::logEvent(id, argc, argv, ts);
+}
+
 bool NBLog::LockedWriter::isEnabled() const
 {
     Mutex::Autolock _l(mLock);
@@ -282,14 +322,38 @@ NBLog::Reader::Reader(size_t size, const sp<IMemory>& iMemory)
 {
 }
 
-void NBLog::Reader::dump(int fd, size_t indent)
+// Formats the name and arguments of a typed event, and returns its timestamp
+static int64_t formatTypedEvent(const uint8_t *data, size_t length, char *buffer, size_t size)
+{
+    int64_t ns;
+    uint16_t id;
+    memcpy(&ns, data, sizeof(ns));
+    memcpy(&id, &data[sizeof(ns)], sizeof(id));
+    const char *name = NBLog::eventName((NBLog::EventId) id);
+    int n = name != NULL ? snprintf(buffer, size, "%s", name) :
+            snprintf(buffer, size, "event %u", id);
+    for (size_t offset = sizeof(ns) + sizeof(id); offset + sizeof(int32_t) <= length;
+            offset += sizeof(int32_t)) {
+        if (n < 0 || (size_t) n >= size) {
+            break;
+        }
+        int32_t arg;
+        memcpy(&arg, &data[offset], sizeof(arg));
+        n += snprintf(&buffer[n], size - n, " %d", arg);
+    }
+    return ns;
+}
+
+uint8_t *NBLog::Reader::readEntries(size_t& avail, size_t& first, size_t& lost, time_t& maxSec)
 {
     int32_t rear = android_atomic_acquire_load(&mShared->mRear);
-    size_t avail = rear - mFront;
+    avail = rear - mFront;
+    first = 0;
+    lost = 0;
+    maxSec = -1;
     if (avail == 0) {
-        return;
+        return NULL;
     }
-    size_t lost = 0;
     if (avail > mSize) {
         lost = avail - mSize;
         mFront += lost;
@@ -314,11 +378,11 @@ void NBLog::Reader::dump(int fd, size_t indent)
         }
     }
     mFront += read;
+    // scan backwards from the most recent entry, to find the oldest entry that is complete
     size_t i = avail;
     Event event;
     size_t length;
     struct timespec ts;
-    time_t maxSec = -1;
     while (i >= 3) {
         length = copy[i - 1];
         if (length + 3 > i || copy[i - length - 2] != length) {
@@ -334,11 +398,38 @@ void NBLog::Reader::dump(int fd, size_t indent)
             if (ts.tv_sec > maxSec) {
                 maxSec = ts.tv_sec;
             }
+        } else if (event == EVENT_TYPED) {
+            if (length < kTypedEventHeaderSize ||
+                    length > kTypedEventHeaderSize + kMaxEventArgs * sizeof(int32_t) ||
+                    (length - kTypedEventHeaderSize) % sizeof(int32_t) != 0) {
+                // corrupt
+                break;
+            }
+            int64_t ns;
+            memcpy(&ns, &copy[i - length - 1], sizeof(ns));
+            if ((time_t) (ns / 1000000000) > maxSec) {
+                maxSec = ns / 1000000000;
+            }
         }
         i -= length + 3;
     }
+    first = i;
+    lost += i;
+    return copy;
+}
+
+void NBLog::Reader::dump(int fd, size_t indent)
+{
+    size_t avail, i, lost;
+    time_t maxSec;
+    uint8_t *copy = readEntries(avail, i, lost, maxSec);
+    if (copy == NULL) {
+        return;
+    }
+    Event event;
+    size_t length;
+    struct timespec ts;
     if (i > 0) {
-        lost += i;
         if (fd >= 0) {
             fdprintf(fd, "%*swarning: lost %u bytes worth of events\n", indent, "", lost);
         } else {
@@ -424,6 +515,18 @@ void NBLog::Reader::dump(int fd, size_t indent)
                         (int) (ts.tv_nsec / 1000000));
             }
             } break;
+        case EVENT_TYPED: {
+            // already checked the length
+            char line[256];
+            int64_t ns = formatTypedEvent((const uint8_t *) data, length, line, sizeof(line));
+            if (fd >= 0) {
+                fdprintf(fd, "%*s[%d.%03d] %s\n", indent, "", (int) (ns / 1000000000),
+                        (int) (ns % 1000000000 / 1000000), line);
+            } else {
+                ALOGI("%*s[%d.%03d] %s", indent, "", (int) (ns / 1000000000),
+                        (int) (ns % 1000000000 / 1000000), line);
+            }
+            } break;
         case EVENT_RESERVED:
         default:
             if (fd >= 0) {
@@ -444,4 +547,122 @@ bool NBLog::Reader::isIMemory(const sp<IMemory>& iMemory) const
     return iMemory.get() == mIMemory.get();
 }
 
+// an entry of one of the logs merged by dumpMerged()
+struct MergedEntry {
+    int64_t         mNs;        // time of the entry, or -1 if unknown
+    size_t          mLog;       // index of the log
+    size_t          mSequence;  // index of the entry in the log, to keep the sort stable
+    const uint8_t  *mEntry;     // the entry in the copy of the log
+};
+
+// helper function called by qsort()
+static int compareMergedEntries(const void *pa, const void *pb)
+{
+    const MergedEntry *a = (const MergedEntry *) pa;
+    const MergedEntry *b = (const MergedEntry *) pb;
+    if (a->mNs != b->mNs) {
+        return a->mNs < b->mNs ? -1 : 1;
+    }
+    if (a->mLog != b->mLog) {
+        return a->mLog < b->mLog ? -1 : 1;
+    }
+    return a->mSequence < b->mSequence ? -1 : a->mSequence > b->mSequence;
+}
+
+/*static*/
+void NBLog::Reader::dumpMerged(int fd, size_t count, const sp<Reader> readers[],
+        const char * const names[], size_t indent)
+{
+    uint8_t **copies = new uint8_t *[count];
+    size_t *avails = new size_t[count];
+    size_t *firsts = new size_t[count];
+    size_t maxEntries = 0;
+    for (size_t log = 0; log < count; ++log) {
+        size_t lost;
+        time_t maxSec;
+        copies[log] = readers[log]->readEntries(avails[log], firsts[log], lost, maxSec);
+        if (copies[log] == NULL) {
+            continue;
+        }
+        if (firsts[log] > 0) {
+            if (fd >= 0) {
+                fdprintf(fd, "%*s%s: warning: lost %u bytes worth of events\n", indent, "",
+                        names[log], lost);
+            } else {
+                ALOGI("%*s%s: warning: lost %u bytes worth of events", indent, "", names[log],
+                        lost);
+            }
+        }
+        // each entry is at least 3 bytes
+        maxEntries += (avails[log] - firsts[log]) / 3;
+    }
+    MergedEntry *entries = new MergedEntry[maxEntries];
+    size_t n = 0;
+    for (size_t log = 0; log < count; ++log) {
+        if (copies[log] == NULL) {
+            continue;
+        }
+        const uint8_t *copy = copies[log];
+        int64_t ns = -1;    // time of the most recent timestamp, for strings
+        size_t sequence = 0;
+        for (size_t i = firsts[log]; i < avails[log]; i += copy[i + 1] + 3) {
+            Event event = (Event) copy[i];
+            if (event == EVENT_TIMESTAMP) {
+                // already checked that length == sizeof(struct timespec)
+                struct timespec ts;
+                memcpy(&ts, &copy[i + 2], sizeof(struct timespec));
+                ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+                continue;
+            }
+            MergedEntry *entry = &entries[n++];
+            entry->mNs = ns;
+            if (event == EVENT_TYPED) {
+                memcpy(&entry->mNs, &copy[i + 2], sizeof(entry->mNs));
+            }
+            entry->mLog = log;
+            entry->mSequence = sequence++;
+            entry->mEntry = &copy[i];
+        }
+    }
+    qsort(entries, n, sizeof(MergedEntry), compareMergedEntries);
+    for (size_t j = 0; j < n; ++j) {
+        const MergedEntry *entry = &entries[j];
+        Event event = (Event) entry->mEntry[0];
+        size_t length = entry->mEntry[1];
+        const uint8_t *data = &entry->mEntry[2];
+        char line[256];
+        switch (event) {
+        case EVENT_STRING:
+            snprintf(line, sizeof(line), "%.*s", (int) length, (const char *) data);
+            break;
+        case EVENT_TYPED:
+            (void) formatTypedEvent(data, length, line, sizeof(line));
+            break;
+        case EVENT_RESERVED:
+        default:
+            snprintf(line, sizeof(line), "warning: unknown event %d", event);
+            break;
+        }
+        char time[32];
+        if (entry->mNs >= 0) {
+            snprintf(time, sizeof(time), "%d.%06d", (int) (entry->mNs / 1000000000),
+                    (int) (entry->mNs % 1000000000 / 1000));
+        } else {
+            strcpy(time, "?");
+        }
+        if (fd >= 0) {
+            fdprintf(fd, "%*s[%s] %s: %s\n", indent, "", time, names[entry->mLog], line);
+        } else {
+            ALOGI("%*s[%s] %s: %s", indent, "", time, names[entry->mLog], line);
+        }
+    }
+    delete[] entries;
+    for (size_t log = 0; log < count; ++log) {
+        delete[] copies[log];
+    }
+    delete[] firsts;
+    delete[] avails;
+    delete[] copies;
+}
+
 }   // namespace android
@@ -109,6 +109,9 @@ LOCAL_SHARED_LIBRARIES := \
     libutils \
     liblog
 
+LOCAL_STATIC_LIBRARIES := \
+    libcpustats
+
 LOCAL_MODULE:= test-resample
 
 LOCAL_MODULE_TAGS := optional
@@ -117,4 +120,94 @@ LOCAL_CFLAGS += -fno-strict-aliasing
 
 include $(BUILD_EXECUTABLE)
 
+#
+# build audio mixer benchmark tool
+#
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    test-mixer.cpp              \
+    AudioMixer.cpp.arm          \
+    AudioResampler.cpp.arm      \
+    AudioResamplerCubic.cpp.arm \
+    AudioResamplerSinc.cpp.arm
+
+LOCAL_C_INCLUDES := \
+    $(call include-path-for, audio-effects) \
+    $(call include-path-for, audio-utils)
+
+LOCAL_SHARED_LIBRARIES := \
+    libaudioutils \
+    libcommon_time_client \
+    libeffects \
+    libnbaio \
+    libdl \
+    libcutils \
+    libutils \
+    liblog
+
+LOCAL_STATIC_LIBRARIES := \
+    libcpustats
+
+LOCAL_MODULE:= test-mixer
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -fno-strict-aliasing
+
+include $(BUILD_EXECUTABLE)
+
+#
+# build fast mixer harness, which mixes sound files without a HAL
+# libsndfile license is incompatible, so this is only built for local use,
+# when LIBSNDFILE_PATH points to the libsndfile sources
+# This is a device executable, not a host one: the mixer needs libcommon_time_client
+# (binder and the local time HAL), libeffects and libnbaio, which are only built for the
+# target.  Push it and its input files to the device and run it from adb shell.
+#
+ifneq ($(LIBSNDFILE_PATH),)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    test-fast-mixer.cpp         \
+    FastMixer.cpp               \
+    FastMixerState.cpp          \
+    StateQueue.cpp              \
+    AudioMixer.cpp.arm          \
+    AudioResampler.cpp.arm      \
+    AudioResamplerCubic.cpp.arm \
+    AudioResamplerSinc.cpp.arm  \
+    ../../media/libnbaio/LibsndfileSink.cpp \
+    ../../media/libnbaio/LibsndfileSource.cpp
+
+LOCAL_C_INCLUDES := \
+    $(call include-path-for, audio-effects) \
+    $(call include-path-for, audio-utils) \
+    $(LIBSNDFILE_PATH)/src
+
+LOCAL_SHARED_LIBRARIES := \
+    libaudioutils \
+    libcommon_time_client \
+    libeffects \
+    libnbaio \
+    libdl \
+    libcutils \
+    libutils \
+    liblog
+
+LOCAL_STATIC_LIBRARIES := \
+    libcpustats \
+    libsndfile
+
+LOCAL_MODULE:= test-fast-mixer
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -DSTATE_QUEUE_INSTANTIATIONS='"StateQueueInstantiations.cpp"' -fno-strict-aliasing
+
+include $(BUILD_EXECUTABLE)
+
+endif
+
 include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -124,6 +124,10 @@ size_t AudioFlinger::mTeeSinkTrackFrames = kTeeSinkTrackFramesDefault;
 // we define a minimum time during which a global effect is considered enabled.
 static const nsecs_t kMinGlobalEffectEnabletimeNs = seconds(7200);
 
+// Set to 1 to mix multichannel outputs in a MixerThread.  Such a thread has no fast mixer and
+// no NBAIO sink, and some effects assume stereo, so it is off by default.
+#define AF_MULTICHANNEL_MIXER_PROPERTY "ro.audio.multichannel_mixer"
+
 // ----------------------------------------------------------------------------
 
 static int load_audio_interface(const char *if_name, audio_hw_device_t **dev)
@@ -183,6 +187,8 @@ AudioFlinger::AudioFlinger()
     if (doLog) {
         mLogMemoryDealer = new MemoryDealer(kLogMemorySize, "LogWriters");
     }
+    mMultichannelMixer = (property_get(AF_MULTICHANNEL_MIXER_PROPERTY, value, "0") > 0) &&
+            (atoi(value) == 1);
 #ifdef TEE_SINK
     (void) property_get("ro.debuggable", value, "0");
     int debuggable = atoi(value);
@@ -1897,7 +1903,9 @@ audio_io_handle_t AudioFlinger::openOutput(audio_module_handle_t module,
 #endif
         } else if ((flags & AUDIO_OUTPUT_FLAG_DIRECT) ||
             (config.format != AUDIO_FORMAT_PCM_16_BIT) ||
-            (config.channel_mask != AUDIO_CHANNEL_OUT_STEREO)) {
+            ((config.channel_mask != AUDIO_CHANNEL_OUT_STEREO) &&
+             !(mMultichannelMixer &&
+               AudioMixer::isValidMixerChannelMask(config.channel_mask)))) {
             thread = new DirectOutputThread(this, output, id, *pDevices);
             ALOGV("openOutput() created direct output: ID %d thread %p", id, thread);
         } else {
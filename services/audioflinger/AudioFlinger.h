@@ -56,6 +56,8 @@
 #include <media/ExtendedAudioBufferProvider.h>
 #include "FastMixer.h"
 #include <media/nbaio/NBAIO.h>
+#include <media/nbaio/Pipe.h>
+#include <media/nbaio/PipeReader.h>
 #include "AudioWatchdog.h"
 
 #include <powermanager/IPowerManager.h>
@@ -821,6 +823,9 @@ private:
     bool    mIsLowRamDevice;
     bool    mIsDeviceTypeKnown;
     nsecs_t mGlobalEffectEnableTime;  // when a global effect was last enabled
+    // PCM 16 bit outputs with a multichannel mask AudioMixer accepts get a MixerThread rather
+    // than a DirectOutputThread, see AF_MULTICHANNEL_MIXER_PROPERTY
+    bool    mMultichannelMixer;
 };
 
 #undef INCLUDING_FROM_AUDIOFLINGER_H
@@ -19,9 +19,11 @@
 //#define LOG_NDEBUG 0
 
 #include "Configuration.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include <sys/types.h>
 
 #include <utils/Errors.h>
@@ -29,6 +31,7 @@
 
 #include <cutils/bitops.h>
 #include <cutils/compiler.h>
+#include <cutils/properties.h>
 #include <utils/Debug.h>
 
 #include <system/audio.h>
@@ -41,8 +44,315 @@
 
 #include "AudioMixer.h"
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON (true)
+#else
+#define USE_NEON (false)
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2 (true)
+#else
+#define USE_SSE2 (false)
+#endif
+
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
 namespace android {
 
+// ----------------------------------------------------------------------------
+// Vectorized mixing kernels used by the *SIMD track hooks.
+// Each kernel handles the largest multiple of 4 frames that fits in frameCount, and returns
+// the number of frames it consumed; the caller mixes the remaining frames with scalar code.
+// All kernels are bit-exact with the scalar loops they replace, including the wrap-around
+// behavior of the 32-bit accumulators.
+
+#if USE_SSE2
+// low 32 bits of a signed 32x32 multiply; identical to the low 32 bits of the unsigned product
+static inline __m128i mullo_epi32(__m128i a, __m128i b)
+{
+#if defined(__SSE4_1__)
+    return _mm_mullo_epi32(a, b);
+#else
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+#endif
+
+// out[] += in[] * {vl, vr} for interleaved stereo int16_t input
+static inline size_t mixStereo16(int32_t* out, const int16_t* in, size_t frameCount,
+        uint32_t vrl)
+{
+    const size_t count = frameCount & ~3;
+#if USE_NEON
+    const int16x4_t vol = vreinterpret_s16_u32(vdup_n_u32(vrl));
+    for (size_t i = 0; i < count; i += 4) {
+        int16x8_t s = vld1q_s16(in);
+        vst1q_s32(out, vmlal_s16(vld1q_s32(out), vget_low_s16(s), vol));
+        vst1q_s32(out + 4, vmlal_s16(vld1q_s32(out + 4), vget_high_s16(s), vol));
+        in += 8;
+        out += 8;
+    }
+#elif USE_SSE2
+    const __m128i vol = _mm_set1_epi32(vrl);
+    for (size_t i = 0; i < count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        __m128i lo = _mm_mullo_epi16(s, vol);
+        __m128i hi = _mm_mulhi_epi16(s, vol);
+        __m128i* o = reinterpret_cast<__m128i *>(out);
+        _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o), _mm_unpacklo_epi16(lo, hi)));
+        _mm_storeu_si128(o + 1,
+                _mm_add_epi32(_mm_loadu_si128(o + 1), _mm_unpackhi_epi16(lo, hi)));
+        in += 8;
+        out += 8;
+    }
+#else
+    return 0;
+#endif
+    return count;
+}
+
+// out[] += in[] * {vl, vr} for mono int16_t input, up-channeled to stereo
+static inline size_t mixMono16(int32_t* out, const int16_t* in, size_t frameCount,
+        uint32_t vrl)
+{
+    const size_t count = frameCount & ~3;
+#if USE_NEON
+    const int16x4_t vol = vreinterpret_s16_u32(vdup_n_u32(vrl));
+    for (size_t i = 0; i < count; i += 4) {
+        int16x4_t s = vld1_s16(in);
+        int16x4x2_t s2 = vzip_s16(s, s);
+        vst1q_s32(out, vmlal_s16(vld1q_s32(out), s2.val[0], vol));
+        vst1q_s32(out + 4, vmlal_s16(vld1q_s32(out + 4), s2.val[1], vol));
+        in += 4;
+        out += 8;
+    }
+#elif USE_SSE2
+    const __m128i vol = _mm_set1_epi32(vrl);
+    for (size_t i = 0; i < count; i += 4) {
+        __m128i s = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in));
+        s = _mm_unpacklo_epi16(s, s);
+        __m128i lo = _mm_mullo_epi16(s, vol);
+        __m128i hi = _mm_mulhi_epi16(s, vol);
+        __m128i* o = reinterpret_cast<__m128i *>(out);
+        _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o), _mm_unpacklo_epi16(lo, hi)));
+        _mm_storeu_si128(o + 1,
+                _mm_add_epi32(_mm_loadu_si128(o + 1), _mm_unpackhi_epi16(lo, hi)));
+        in += 4;
+        out += 8;
+    }
+#else
+    return 0;
+#endif
+    return count;
+}
+
+// out[] += in[] * ({vl, vr} >> 16), with vl and vr advancing by their increment on each frame.
+// 'in' is interleaved stereo, or mono when MONO is true.
+template <bool MONO>
+static inline size_t rampStereo16(int32_t* out, const int16_t* in, size_t frameCount,
+        int32_t& vl, int32_t& vr, int32_t vlInc, int32_t vrInc)
+{
+    const size_t count = frameCount & ~3;
+    if (count == 0) {
+        return 0;
+    }
+#if USE_NEON
+    const int32_t v[4] = { vl, vr, vl + vlInc, vr + vrInc };
+    int32x4_t v0 = vld1q_s32(v);
+    int32x2_t inc = vset_lane_s32(vrInc * 2, vdup_n_s32(vlInc * 2), 1);
+    const int32x4_t inc2 = vcombine_s32(inc, inc);
+    for (size_t i = 0; i < count; i += 4) {
+        int16x8_t s;
+        if (MONO) {
+            int16x4_t m = vld1_s16(in);
+            int16x4x2_t m2 = vzip_s16(m, m);
+            s = vcombine_s16(m2.val[0], m2.val[1]);
+            in += 4;
+        } else {
+            s = vld1q_s16(in);
+            in += 8;
+        }
+        int32x4_t v1 = vaddq_s32(v0, inc2);
+        vst1q_s32(out, vmlaq_s32(vld1q_s32(out),
+                vshrq_n_s32(v0, 16), vmovl_s16(vget_low_s16(s))));
+        vst1q_s32(out + 4, vmlaq_s32(vld1q_s32(out + 4),
+                vshrq_n_s32(v1, 16), vmovl_s16(vget_high_s16(s))));
+        v0 = vaddq_s32(v1, inc2);
+        out += 8;
+    }
+#elif USE_SSE2
+    __m128i v0 = _mm_set_epi32(vr + vrInc, vl + vlInc, vr, vl);
+    const __m128i inc2 = _mm_set_epi32(vrInc * 2, vlInc * 2, vrInc * 2, vlInc * 2);
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < count; i += 4) {
+        __m128i s;
+        if (MONO) {
+            s = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in));
+            s = _mm_unpacklo_epi16(s, s);
+            in += 4;
+        } else {
+            s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+            in += 8;
+        }
+        __m128i v1 = _mm_add_epi32(v0, inc2);
+        // the high half of each volume and a zero-extended sample fit the 16x16 multiply-add
+        __m128i* o = reinterpret_cast<__m128i *>(out);
+        _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o),
+                _mm_madd_epi16(_mm_srli_epi32(v0, 16), _mm_unpacklo_epi16(s, zero))));
+        _mm_storeu_si128(o + 1, _mm_add_epi32(_mm_loadu_si128(o + 1),
+                _mm_madd_epi16(_mm_srli_epi32(v1, 16), _mm_unpackhi_epi16(s, zero))));
+        v0 = _mm_add_epi32(v1, inc2);
+        out += 8;
+    }
+#else
+    return 0;
+#endif
+    vl += vlInc * int32_t(count);
+    vr += vrInc * int32_t(count);
+    return count;
+}
+
+// out[] += int16_t(temp[] >> 12) * {vl, vr}, and if aux is not NULL,
+// aux[] += int16_t((l + r) >> 1) * va
+static inline size_t volumeStereo32(int32_t* out, const int32_t* temp, size_t frameCount,
+        int16_t vl, int16_t vr, int32_t* aux, int16_t va)
+{
+    const size_t count = frameCount & ~1;
+#if USE_NEON
+    const int16_t v[4] = { vl, vr, vl, vr };
+    const int16x4_t vol = vld1_s16(v);
+    const int32x2_t vola = vdup_n_s32(va);
+    for (size_t i = 0; i < count; i += 2) {
+        int16x4_t s = vmovn_s32(vshrq_n_s32(vld1q_s32(temp), 12));
+        vst1q_s32(out, vmlal_s16(vld1q_s32(out), s, vol));
+        if (aux != NULL) {
+            int32x4_t s32 = vmovl_s16(s);
+            int32x2_t a = vshr_n_s32(vpadd_s32(vget_low_s32(s32), vget_high_s32(s32)), 1);
+            // truncate to int16_t
+            a = vshr_n_s32(vshl_n_s32(a, 16), 16);
+            vst1_s32(aux, vmla_s32(vld1_s32(aux), a, vola));
+            aux += 2;
+        }
+        temp += 4;
+        out += 4;
+    }
+#elif USE_SSE2
+    const __m128i vol = _mm_set_epi32(uint16_t(vr), uint16_t(vl), uint16_t(vr), uint16_t(vl));
+    const __m128i vola = _mm_set1_epi32(uint16_t(va));
+    const __m128i mask = _mm_set1_epi32(0xFFFF);
+    for (size_t i = 0; i < count; i += 2) {
+        __m128i s = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(temp)), 12);
+        __m128i* o = reinterpret_cast<__m128i *>(out);
+        _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o),
+                _mm_madd_epi16(_mm_and_si128(s, mask), vol)));
+        if (aux != NULL) {
+            // sign-extend the truncated samples, then sum each frame's pair in lanes 0 and 2
+            s = _mm_srai_epi32(_mm_slli_epi32(s, 16), 16);
+            __m128i a = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+            a = _mm_and_si128(_mm_srai_epi32(a, 1), mask);
+            a = _mm_shuffle_epi32(_mm_madd_epi16(a, vola), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i* x = reinterpret_cast<__m128i *>(aux);
+            _mm_storel_epi64(x, _mm_add_epi32(_mm_loadl_epi64(x), a));
+            aux += 2;
+        }
+        temp += 4;
+        out += 4;
+    }
+#else
+    return 0;
+#endif
+    return count;
+}
+
+// out[] += (temp[] >> 12) * ({vl, vr} >> 16), with vl and vr ramping on each frame
+static inline size_t volumeRampStereo32(int32_t* out, const int32_t* temp, size_t frameCount,
+        int32_t& vl, int32_t& vr, int32_t vlInc, int32_t vrInc)
+{
+    const size_t count = frameCount & ~1;
+    if (count == 0) {
+        return 0;
+    }
+#if USE_NEON
+    const int32_t v[4] = { vl, vr, vl + vlInc, vr + vrInc };
+    int32x4_t v0 = vld1q_s32(v);
+    int32x2_t inc = vset_lane_s32(vrInc * 2, vdup_n_s32(vlInc * 2), 1);
+    const int32x4_t inc2 = vcombine_s32(inc, inc);
+    for (size_t i = 0; i < count; i += 2) {
+        vst1q_s32(out, vmlaq_s32(vld1q_s32(out),
+                vshrq_n_s32(v0, 16), vshrq_n_s32(vld1q_s32(temp), 12)));
+        v0 = vaddq_s32(v0, inc2);
+        temp += 4;
+        out += 4;
+    }
+#elif USE_SSE2
+    __m128i v0 = _mm_set_epi32(vr + vrInc, vl + vlInc, vr, vl);
+    const __m128i inc2 = _mm_set_epi32(vrInc * 2, vlInc * 2, vrInc * 2, vlInc * 2);
+    for (size_t i = 0; i < count; i += 2) {
+        // temp >> 12 can exceed 16 bits, so a full 32-bit multiply is needed here
+        __m128i s = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(temp)), 12);
+        __m128i* o = reinterpret_cast<__m128i *>(out);
+        _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o),
+                mullo_epi32(_mm_srai_epi32(v0, 16), s)));
+        v0 = _mm_add_epi32(v0, inc2);
+        temp += 4;
+        out += 4;
+    }
+#else
+    return 0;
+#endif
+    vl += vlInc * int32_t(count);
+    vr += vrInc * int32_t(count);
+    return count;
+}
+
+// Returns true if the 'count' samples at 'in' are all zero.  Returns at the first group of
+// 16 samples that is not, so the check is cheap on buffers with signal.
+static inline bool isSilent16(const int16_t* in, size_t count)
+{
+#if USE_NEON
+    for (; count >= 16; count -= 16) {
+        uint64x2_t s = vreinterpretq_u64_s16(vorrq_s16(vld1q_s16(in), vld1q_s16(in + 8)));
+        if (vgetq_lane_u64(s, 0) | vgetq_lane_u64(s, 1)) {
+            return false;
+        }
+        in += 16;
+    }
+#elif USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; count >= 16; count -= 16) {
+        const __m128i* p = reinterpret_cast<const __m128i *>(in);
+        __m128i s = _mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(s, zero)) != 0xFFFF) {
+            return false;
+        }
+        in += 16;
+    }
+#endif
+    int16_t s = 0;
+    while (count--) {
+        s |= *in++;
+    }
+    return s == 0;
+}
+
+static inline bool isSilentFloat(const float* in, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (in[i] != 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // ----------------------------------------------------------------------------
 AudioMixer::DownmixerBufferProvider::DownmixerBufferProvider() : AudioBufferProvider(),
         mTrackBufferProvider(NULL), mDownmixHandle(NULL)
@@ -88,6 +398,55 @@ void AudioMixer::DownmixerBufferProvider::releaseBuffer(AudioBufferProvider::Buf
     }
 }
 
+AudioMixer::ReformatBufferProvider::ReformatBufferProvider(size_t frameCount) :
+        AudioBufferProvider(), mTrackBufferProvider(NULL), mChannelCount(0),
+        mFrameCount(frameCount), mConverted(new int16_t[frameCount * MAX_NUM_CHANNELS])
+{
+    mBuffer.frameCount = 0;
+    mBuffer.raw = NULL;
+}
+
+AudioMixer::ReformatBufferProvider::~ReformatBufferProvider()
+{
+    delete [] mConverted;
+}
+
+status_t AudioMixer::ReformatBufferProvider::getNextBuffer(AudioBufferProvider::Buffer *pBuffer,
+        int64_t pts) {
+    if (mTrackBufferProvider == NULL) {
+        ALOGE("ReformatBufferProvider::getNextBuffer() error: NULL track buffer provider");
+        return NO_INIT;
+    }
+    // the track buffer is shared with the client, and must not be modified: the frames not
+    // released by releaseBuffer() are returned again, still in float, by the next call
+    mBuffer.frameCount = pBuffer->frameCount < mFrameCount ? pBuffer->frameCount : mFrameCount;
+    status_t res = mTrackBufferProvider->getNextBuffer(&mBuffer, pts);
+    if (res == OK && mBuffer.raw != NULL) {
+        const float *src = static_cast<const float *>(mBuffer.raw);
+        int16_t *dst = mConverted;
+        for (size_t i = mBuffer.frameCount * mChannelCount; i > 0; --i) {
+            *dst++ = clamp16(lrintf(*src++ * 32768.0f));
+        }
+        pBuffer->frameCount = mBuffer.frameCount;
+        pBuffer->i16 = mConverted;
+    } else {
+        pBuffer->frameCount = 0;
+        pBuffer->raw = NULL;
+    }
+    return res;
+}
+
+void AudioMixer::ReformatBufferProvider::releaseBuffer(AudioBufferProvider::Buffer *pBuffer) {
+    if (mTrackBufferProvider != NULL) {
+        // release as many frames of the track buffer as were consumed of the converted copy
+        mBuffer.frameCount = pBuffer->frameCount;
+        mTrackBufferProvider->releaseBuffer(&mBuffer);
+        pBuffer->frameCount = 0;
+        pBuffer->raw = NULL;
+    } else {
+        ALOGE("ReformatBufferProvider::releaseBuffer() error: NULL track buffer provider");
+    }
+}
 
 // ----------------------------------------------------------------------------
 bool AudioMixer::isMultichannelCapable = false;
@@ -97,13 +456,34 @@ effect_descriptor_t AudioMixer::dwnmFxDesc;
 // Ensure mConfiguredNames bitmask is initialized properly on all architectures.
 // The value of 1 << x is undefined in C when x >= 32.
 
+void* AudioMixer::operator new(size_t size)
+{
+    void* ptr;
+    int err = posix_memalign(&ptr, 64, size);
+    LOG_ALWAYS_FATAL_IF(err != 0, "AudioMixer allocation of %zu bytes failed: %d", size, err);
+    return ptr;
+}
+
+void AudioMixer::operator delete(void* ptr)
+{
+    free(ptr);
+}
+
 AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTracks)
     :   mTrackNames(0), mConfiguredNames((maxNumTracks >= 32 ? 0 : 1 << maxNumTracks) - 1),
-        mSampleRate(sampleRate)
+        mSampleRate(sampleRate), mLoad(0), mReportedLoad(0), mFramesSinceQualityCheck(0),
+        mLowLoadChecks(0)
 {
-    // AudioMixer is not yet capable of multi-channel beyond stereo
+    // AudioMixer is not yet capable of multi-channel beyond stereo, except in the float mix
     COMPILE_TIME_ASSERT_FUNCTION_SCOPE(2 == MAX_NUM_CHANNELS);
 
+#if !defined(__LP64__)
+    // hot fields in the first cache line, cold fields in the second, see track_t
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(sizeof(track_t) == 128);
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(offsetof(track_t, auxInc) == 64);
+#endif
+    ALOG_ASSERT(((uintptr_t) mState.tracks & 63) == 0, "tracks not aligned on a cache line");
+
     ALOG_ASSERT(maxNumTracks <= MAX_NUM_TRACKS, "maxNumTracks %u > MAX_NUM_TRACKS %u",
             maxNumTracks, MAX_NUM_TRACKS);
 
@@ -124,6 +504,11 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTr
     mState.outputTemp   = NULL;
     mState.resampleTemp = NULL;
     mState.mLog         = &mDummyLog;
+    mState.outputTempFloat = NULL;
+    mState.outputTempFloatChannels = 0;
+    mState.ditherSeed   = 1;
+    mState.numWorkers   = 0;
+    mState.measureLoad  = false;
     // mState.reserved
 
     // FIXME Most of the following initialization is probably redundant since
@@ -133,6 +518,7 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTr
     for (unsigned i=0 ; i < MAX_NUM_TRACKS ; i++) {
         t->resampler = NULL;
         t->downmixerBufferProvider = NULL;
+        t->reformatBufferProvider = NULL;
         t++;
     }
 
@@ -161,14 +547,18 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTr
 
 AudioMixer::~AudioMixer()
 {
+    setWorkerThreads(0);
+    AudioResampler::addLoad(-mReportedLoad);
     track_t* t = mState.tracks;
     for (unsigned i=0 ; i < MAX_NUM_TRACKS ; i++) {
         delete t->resampler;
         delete t->downmixerBufferProvider;
+        delete t->reformatBufferProvider;
         t++;
     }
     delete [] mState.outputTemp;
     delete [] mState.resampleTemp;
+    delete [] mState.outputTempFloat;
 }
 
 void AudioMixer::setLog(NBLog::Writer *log)
@@ -176,7 +566,43 @@ void AudioMixer::setLog(NBLog::Writer *log)
     mState.mLog = log;
 }
 
-int AudioMixer::getTrackName(audio_channel_mask_t channelMask, int sessionId)
+void AudioMixer::setAdaptiveQuality(bool enabled)
+{
+    enabled = enabled && sAdaptiveQuality;
+    if (!enabled && mState.measureLoad) {
+        AudioResampler::addLoad(-mReportedLoad);
+        mReportedLoad = 0;
+        mLoad = 0;
+    }
+    mState.measureLoad = enabled;
+}
+
+void AudioMixer::setWorkerThreads(uint32_t count)
+{
+    if (count > MAX_NUM_WORKERS) {
+        ALOGW("setWorkerThreads(%u) limited to %u workers", count, MAX_NUM_WORKERS);
+        count = MAX_NUM_WORKERS;
+    }
+    if (count == mState.numWorkers) {
+        return;
+    }
+    for (uint32_t i = count; i < mState.numWorkers; i++) {
+        mWorkers[i]->exit();
+        mWorkers[i].clear();
+        mState.workers[i] = NULL;
+    }
+    for (uint32_t i = mState.numWorkers; i < count; i++) {
+        mWorkers[i] = new MixerWorker(mState.frameCount);
+        mWorkers[i]->run("AudioMixer worker", PRIORITY_URGENT_AUDIO);
+        mState.workers[i] = mWorkers[i].get();
+    }
+    mState.numWorkers = count;
+    // re-select the process hook
+    invalidateState(mTrackNames);
+}
+
+int AudioMixer::getTrackName(audio_channel_mask_t channelMask, int sessionId,
+        audio_channel_mask_t mixerChannelMask)
 {
     uint32_t names = (~mTrackNames) & mConfiguredNames;
     if (names != 0) {
@@ -211,14 +637,23 @@ int AudioMixer::getTrackName(audio_channel_mask_t channelMask, int sessionId)
         t->hook = NULL;
         t->in = NULL;
         t->resampler = NULL;
+        t->resamplerQuality = AudioResampler::DEFAULT_QUALITY;
         t->sampleRate = mSampleRate;
         // setParameter(name, TRACK, MAIN_BUFFER, mixBuffer) is required before enable(name)
         t->mainBuffer = NULL;
         t->auxBuffer = NULL;
         t->downmixerBufferProvider = NULL;
+        t->inputFormat = AUDIO_FORMAT_PCM_16_BIT;
+        t->mixerFormat = AUDIO_FORMAT_PCM_16_BIT;
+        t->reformatBufferProvider = NULL;
+        ALOG_ASSERT(isValidMixerChannelMask(mixerChannelMask), "bad mixer channel mask %#x",
+                mixerChannelMask);
+        t->mixerChannelMask = mixerChannelMask;
+        t->mixerChannelCount = popcount(mixerChannelMask);
 
         status_t status = initTrackDownmix(&mState.tracks[n], n, channelMask);
         if (status == OK) {
+            t->updateChannelMap();
             return TRACK0 + n;
         }
         ALOGE("AudioMixer::getTrackName(0x%x) failed, error preparing track for downmix",
@@ -243,6 +678,14 @@ status_t AudioMixer::initTrackDownmix(track_t* pTrack, int trackNum, audio_chann
     if (channelCount > MAX_NUM_CHANNELS) {
         pTrack->channelMask = mask;
         pTrack->channelCount = channelCount;
+        // a multichannel output mixes the track natively, unless the track is resampled,
+        // as the resamplers only take up to 2 channels
+        if (pTrack->mixerChannelCount > MAX_NUM_CHANNELS && pTrack->resampler == NULL) {
+            ALOGV("initTrackDownmix(track=%d, mask=0x%x) mixes natively into mask 0x%x",
+                    trackNum, mask, pTrack->mixerChannelMask);
+            unprepareTrackForDownmix(pTrack, trackNum);
+            return status;
+        }
         ALOGV("initTrackDownmix(track=%d, mask=0x%x) calls prepareTrackForDownmix()",
                 trackNum, mask);
         status = prepareTrackForDownmix(pTrack, trackNum);
@@ -385,6 +828,9 @@ void AudioMixer::deleteTrackName(int name)
     track.resampler = NULL;
     // delete the downmixer
     unprepareTrackForDownmix(&mState.tracks[name], name);
+    // delete the float to 16-bit converter
+    delete track.reformatBufferProvider;
+    track.reformatBufferProvider = NULL;
 
     mTrackNames &= ~(1<<name);
 }
@@ -433,10 +879,15 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
             if (track.channelMask != mask) {
                 uint32_t channelCount = popcount(mask);
                 ALOG_ASSERT((channelCount <= MAX_NUM_CHANNELS_TO_DOWNMIX) && channelCount);
+                // the downmix effect only accepts 16-bit
+                ALOGE_IF(track.inputFormat == FORMAT_PCM_FLOAT && channelCount > MAX_NUM_CHANNELS,
+                        "setParameter(TRACK, CHANNEL_MASK, %x) not supported for float tracks",
+                        mask);
                 track.channelMask = mask;
                 track.channelCount = channelCount;
                 // the mask has changed, does this track need a downmixer?
                 initTrackDownmix(&mState.tracks[name], name, mask);
+                track.updateChannelMap();
                 ALOGV("setParameter(TRACK, CHANNEL_MASK, %x)", mask);
                 invalidateState(1 << name);
             }
@@ -455,9 +906,50 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
                 invalidateState(1 << name);
             }
             break;
-        case FORMAT:
-            ALOG_ASSERT(valueInt == AUDIO_FORMAT_PCM_16_BIT);
-            break;
+        case FORMAT: {
+            audio_format_t format = (audio_format_t) valueInt;
+            ALOG_ASSERT(format == AUDIO_FORMAT_PCM_16_BIT || format == FORMAT_PCM_FLOAT,
+                    "bad format %#x", format);
+            if (track.inputFormat != format) {
+                if (format == FORMAT_PCM_FLOAT && track.channelCount > MAX_NUM_CHANNELS) {
+                    ALOGE("setParameter(TRACK, FORMAT, %#x) not supported with %u channels",
+                            format, track.channelCount);
+                    break;
+                }
+                track.inputFormat = format;
+                if (format == FORMAT_PCM_FLOAT && track.reformatBufferProvider == NULL) {
+                    track.reformatBufferProvider = new ReformatBufferProvider(mState.frameCount);
+                }
+                ALOGV("setParameter(TRACK, FORMAT, %#x)", format);
+                invalidateState(1 << name);
+            }
+            } break;
+        case MIXER_FORMAT: {
+            audio_format_t format = (audio_format_t) valueInt;
+            ALOG_ASSERT(format == AUDIO_FORMAT_PCM_16_BIT || format == FORMAT_PCM_FLOAT,
+                    "bad mixer format %#x", format);
+            if (track.mixerFormat != format) {
+                track.mixerFormat = format;
+                ALOGV("setParameter(TRACK, MIXER_FORMAT, %#x)", format);
+                invalidateState(1 << name);
+            }
+            } break;
+        case MIXER_CHANNEL_MASK: {
+            audio_channel_mask_t mask = (audio_channel_mask_t) valueInt;
+            if (track.mixerChannelMask != mask) {
+                uint32_t channelCount = popcount(mask);
+                ALOG_ASSERT(isValidMixerChannelMask(mask), "bad mixer channel mask %#x", mask);
+                track.mixerChannelMask = mask;
+                track.mixerChannelCount = channelCount;
+                // the track may now be mixed natively, or need the downmixer again
+                if (track.channelCount > MAX_NUM_CHANNELS) {
+                    initTrackDownmix(&mState.tracks[name], name, track.channelMask);
+                }
+                track.updateChannelMap();
+                ALOGV("setParameter(TRACK, MIXER_CHANNEL_MASK, %#x)", mask);
+                invalidateState(1 << name);
+            }
+            } break;
         // FIXME do we want to support setting the downmix type from AudioFlinger?
         //         for a specific track? or per mixer?
         /* case DOWNMIX_TYPE:
@@ -471,6 +963,11 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
         switch (param) {
         case SAMPLE_RATE:
             ALOG_ASSERT(valueInt > 0, "bad sample rate %d", valueInt);
+            // a track mixed natively is downmixed to stereo before it can be resampled
+            if (track.mixesMultichannel() && uint32_t(valueInt) != mSampleRate &&
+                    track.resampler == NULL) {
+                prepareTrackForDownmix(&mState.tracks[name], name);
+            }
             if (track.setResampler(uint32_t(valueInt), mSampleRate)) {
                 ALOGV("setParameter(RESAMPLE, SAMPLE_RATE, %u)",
                         uint32_t(valueInt));
@@ -485,6 +982,9 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
             delete track.resampler;
             track.resampler = NULL;
             track.sampleRate = mSampleRate;
+            if (track.channelCount > MAX_NUM_CHANNELS) {
+                initTrackDownmix(&mState.tracks[name], name, track.channelMask);
+            }
             invalidateState(1 << name);
             break;
         default:
@@ -567,6 +1067,7 @@ bool AudioMixer::track_t::setResampler(uint32_t value, uint32_t devSampleRate)
                     quality = AudioResampler::DEFAULT_QUALITY;
 #endif
                 }
+                resamplerQuality = quality;
                 resampler = AudioResampler::create(
                         format,
                         // the resampler sees the number of channels after the downmixer, if any
@@ -580,6 +1081,24 @@ bool AudioMixer::track_t::setResampler(uint32_t value, uint32_t devSampleRate)
     return false;
 }
 
+void AudioMixer::track_t::changeResamplerQuality(AudioResampler::src_quality quality,
+        uint32_t devSampleRate)
+{
+    AudioResampler* newResampler = AudioResampler::create(
+            format,
+            downmixerBufferProvider != NULL ? MAX_NUM_CHANNELS : channelCount,
+            devSampleRate, quality);
+    newResampler->setLocalTimeFreq(sLocalTimeFreq);
+    newResampler->setSampleRate(sampleRate);
+    // the new resampler starts from an empty filter state, so there is a short discontinuity;
+    // that is preferable to the underrun it avoids.
+    // A float track is resampled from its converted copy, so the pending buffer goes back there.
+    resampler->releaseBuffer(inputFormat == FORMAT_PCM_FLOAT && reformatBufferProvider != NULL ?
+            static_cast<AudioBufferProvider*>(reformatBufferProvider) : bufferProvider);
+    delete resampler;
+    resampler = newResampler;
+}
+
 inline
 void AudioMixer::track_t::adjustVolumeRamp(bool aux)
 {
@@ -599,6 +1118,86 @@ void AudioMixer::track_t::adjustVolumeRamp(bool aux)
     }
 }
 
+// For a track mixed natively, a channel missing from the output takes the place of its side or
+// back counterpart if there is one, or else is folded at -3 dB into the front left or right,
+// or both for the center channels; a missing LFE is dropped.
+void AudioMixer::track_t::updateChannelMap()
+{
+    foldChannels = 0;
+    rightChannels = 0;
+    centerChannels = 0;
+    uint32_t bits = channelMask;
+    for (uint32_t i = 0; bits != 0 && i < MAX_NUM_CHANNELS_TO_DOWNMIX; i++) {
+        const uint32_t bit = bits & -bits;
+        bits &= ~bit;
+        switch (bit) {
+        case AUDIO_CHANNEL_OUT_FRONT_RIGHT:
+        case AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER:
+        case AUDIO_CHANNEL_OUT_BACK_RIGHT:
+        case AUDIO_CHANNEL_OUT_SIDE_RIGHT:
+        case AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT:
+        case AUDIO_CHANNEL_OUT_TOP_BACK_RIGHT:
+            rightChannels |= 1 << i;
+            break;
+        case AUDIO_CHANNEL_OUT_FRONT_CENTER:
+        case AUDIO_CHANNEL_OUT_LOW_FREQUENCY:
+        case AUDIO_CHANNEL_OUT_BACK_CENTER:
+        case AUDIO_CHANNEL_OUT_TOP_CENTER:
+        case AUDIO_CHANNEL_OUT_TOP_FRONT_CENTER:
+        case AUDIO_CHANNEL_OUT_TOP_BACK_CENTER:
+            centerChannels |= 1 << i;
+            break;
+        default:
+            break;
+        }
+
+        uint32_t target = bit;
+        if ((mixerChannelMask & target) == 0) {
+            switch (bit) {
+            case AUDIO_CHANNEL_OUT_BACK_LEFT:   target = AUDIO_CHANNEL_OUT_SIDE_LEFT;   break;
+            case AUDIO_CHANNEL_OUT_SIDE_LEFT:   target = AUDIO_CHANNEL_OUT_BACK_LEFT;   break;
+            case AUDIO_CHANNEL_OUT_BACK_RIGHT:  target = AUDIO_CHANNEL_OUT_SIDE_RIGHT;  break;
+            case AUDIO_CHANNEL_OUT_SIDE_RIGHT:  target = AUDIO_CHANNEL_OUT_BACK_RIGHT;  break;
+            default:                            target = 0;                             break;
+            }
+            if ((mixerChannelMask & target) == 0) {
+                target = 0;
+            }
+        }
+        if (target != 0) {
+            // output channels are interleaved in the order of the mask bits
+            channelMap[i] = popcount(mixerChannelMask & (target - 1));
+        } else if (bit == AUDIO_CHANNEL_OUT_LOW_FREQUENCY) {
+            channelMap[i] = kChannelDropped;
+        } else {
+            foldChannels |= 1 << i;
+            if (centerChannels & (1 << i)) {
+                channelMap[i] = kChannelFrontLeftRight;
+            } else {
+                // front left and right are always the first two output channels
+                channelMap[i] = (rightChannels & (1 << i)) ? 1 : 0;
+            }
+        }
+    }
+}
+
+// Tracks that are not ramping contribute nothing to the mix, nor to the aux send, for a buffer
+// of zeros, so such a buffer is consumed without the multiply-accumulate.
+inline
+bool AudioMixer::track_t::isSilentBuffer() const
+{
+    if (volumeInc[0] | volumeInc[1] | auxInc) {
+        return false;
+    }
+    // the downmixer, when present, has already reduced the buffer to stereo
+    const size_t count = buffer.frameCount *
+            (downmixerBufferProvider != NULL ? MAX_NUM_CHANNELS : channelCount);
+    if (inputFormat == FORMAT_PCM_FLOAT) {
+        return isSilentFloat(static_cast<const float *>(buffer.raw), count);
+    }
+    return isSilent16(buffer.i16, count);
+}
+
 size_t AudioMixer::getUnreleasedFrames(int name) const
 {
     name -= TRACK0;
@@ -633,7 +1232,91 @@ void AudioMixer::setBufferProvider(int name, AudioBufferProvider* bufferProvider
 
 void AudioMixer::process(int64_t pts)
 {
+    if (!mState.measureLoad) {
+        mState.hook(&mState, pts);
+        return;
+    }
+    double ns;
+    // discard the time spent outside of the mixer since the previous call
+    mCpuUsage.sampleAndEnable(ns);
     mState.hook(&mState, pts);
+    const bool sampled = mCpuUsage.sampleAndEnable(ns);
+    // the workers have completed their mixes, if any, before the hook returned
+    for (uint32_t i = 0; i < mState.numWorkers; i++) {
+        ns += mState.workers[i]->takeCpuNs();
+    }
+    if (sampled) {
+        updateLoad(ns);
+    }
+}
+
+void AudioMixer::updateLoad(double ns)
+{
+    const double periodNs = mState.frameCount * 1e9 / mSampleRate;
+    // exponential moving average over about 8 buffers
+    mLoad += (float(ns * 1000.0 / periodNs) - mLoad) * 0.125f;
+    const int32_t load = int32_t(mLoad);
+    if (load != mReportedLoad) {
+        AudioResampler::addLoad(load - mReportedLoad);
+        mReportedLoad = load;
+    }
+
+    mFramesSinceQualityCheck += mState.frameCount;
+    if (mFramesSinceQualityCheck >= mSampleRate / kQualityChecksPerSecond) {
+        mFramesSinceQualityCheck = 0;
+        adaptResamplerQuality();
+    }
+}
+
+// Move at most one track per check: under load, downgrade the most expensive resampler
+// right away; when lightly loaded, upgrade the cheapest one, but only once the load has
+// stayed low for kUpgradeChecks consecutive checks.
+void AudioMixer::adaptResamplerQuality()
+{
+    track_t* downgrade = NULL;
+    track_t* upgrade = NULL;
+    AudioResampler::src_quality downgradeTo = AudioResampler::DEFAULT_QUALITY;
+    AudioResampler::src_quality upgradeTo = AudioResampler::DEFAULT_QUALITY;
+
+    uint32_t en = mState.enabledTracks;
+    while (en) {
+        const int i = 31 - __builtin_clz(en);
+        en &= ~(1<<i);
+        track_t& t = mState.tracks[i];
+        if ((t.needs & NEEDS_RESAMPLE__MASK) != NEEDS_RESAMPLE_ENABLED) {
+            continue;
+        }
+        const AudioResampler::src_quality current = t.resampler->getQuality();
+        const AudioResampler::src_quality wanted =
+                AudioResampler::adaptQuality(current, t.resamplerQuality);
+        if (wanted < current) {
+            if (downgrade == NULL || current > downgrade->resampler->getQuality()) {
+                downgrade = &t;
+                downgradeTo = wanted;
+            }
+        } else if (wanted > current) {
+            if (upgrade == NULL || current < upgrade->resampler->getQuality()) {
+                upgrade = &t;
+                upgradeTo = wanted;
+            }
+        }
+    }
+
+    if (downgrade != NULL) {
+        mLowLoadChecks = 0;
+        ALOGV("load %d: resampler quality %d -> %d", mReportedLoad,
+                downgrade->resampler->getQuality(), downgradeTo);
+        downgrade->changeResamplerQuality(downgradeTo, mSampleRate);
+    } else if (upgrade != NULL) {
+        if (++mLowLoadChecks >= kUpgradeChecks) {
+            mLowLoadChecks = 0;
+            ALOGV("load %d: resampler quality %d -> %d", mReportedLoad,
+                    upgrade->resampler->getQuality(), upgradeTo);
+            upgrade->changeResamplerQuality(upgradeTo, mSampleRate);
+        }
+    } else {
+        mLowLoadChecks = 0;
+    }
 }
 
 
@@ -663,6 +1346,8 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
     bool all16BitsStereoNoResample = true;
     bool resampling = false;
     bool volumeRamp = false;
+    bool floatMix = sFloatMix;
+    uint32_t mixerChannels = MAX_NUM_CHANNELS;
     uint32_t en = state->enabledTracks;
     while (en) {
         const int i = 31 - __builtin_clz(en);
@@ -672,7 +1357,22 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
         track_t& t = state->tracks[i];
         uint32_t n = 0;
         n |= NEEDS_CHANNEL_1 + t.channelCount - 1;
-        n |= NEEDS_FORMAT_16;
+        if (t.inputFormat == FORMAT_PCM_FLOAT) {
+            n |= NEEDS_FORMAT_FLOAT;
+            floatMix = true;
+        } else {
+            n |= NEEDS_FORMAT_16;
+        }
+        if (t.mixerFormat == FORMAT_PCM_FLOAT) {
+            floatMix = true;
+        }
+        // multichannel outputs and tracks mixed natively are only handled by the float mix
+        if (t.mixerChannelCount > MAX_NUM_CHANNELS || t.mixesMultichannel()) {
+            floatMix = true;
+        }
+        if (t.mixerChannelCount > mixerChannels) {
+            mixerChannels = t.mixerChannelCount;
+        }
         n |= t.doesResample() ? NEEDS_RESAMPLE_ENABLED : NEEDS_RESAMPLE_DISABLED;
         if (t.auxLevel != 0 && t.auxBuffer != NULL) {
             n |= NEEDS_AUX_ENABLED;
@@ -699,11 +1399,11 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
                         "Track %d needs downmix + resample", i);
             } else {
                 if ((n & NEEDS_CHANNEL_COUNT__MASK) == NEEDS_CHANNEL_1){
-                    t.hook = track__16BitsMono;
+                    t.hook = sUseSIMD ? track__16BitsMonoSIMD : track__16BitsMono;
                     all16BitsStereoNoResample = false;
                 }
                 if ((n & NEEDS_CHANNEL_COUNT__MASK) >= NEEDS_CHANNEL_2){
-                    t.hook = track__16BitsStereo;
+                    t.hook = sUseSIMD ? track__16BitsStereoSIMD : track__16BitsStereo;
                     ALOGV_IF((n & NEEDS_CHANNEL_COUNT__MASK) > NEEDS_CHANNEL_2,
                             "Track %d needs downmix", i);
                 }
@@ -713,15 +1413,29 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
 
     // select the processing hooks
     state->hook = process__nop;
-    if (countActiveTracks) {
-        if (resampling) {
+    if (countActiveTracks && floatMix) {
+        // the float mix ignores the track hooks, and only needs the resampler temp buffer
+        if (state->outputTempFloatChannels < mixerChannels) {
+            delete [] state->outputTempFloat;
+            state->outputTempFloat = new float[mixerChannels * state->frameCount];
+            state->outputTempFloatChannels = mixerChannels;
+        }
+        if (resampling && !state->resampleTemp) {
+            state->resampleTemp = new int32_t[MAX_NUM_CHANNELS * state->frameCount];
+        }
+        state->hook = process__genericFloat;
+    } else if (countActiveTracks) {
+        // shard the tracks across the workers when there are enough of them
+        const bool parallel = state->numWorkers > 0 &&
+                countActiveTracks >= int(PARALLEL_MIN_TRACKS);
+        if (resampling || parallel) {
             if (!state->outputTemp) {
                 state->outputTemp = new int32_t[MAX_NUM_CHANNELS * state->frameCount];
             }
             if (!state->resampleTemp) {
                 state->resampleTemp = new int32_t[MAX_NUM_CHANNELS * state->frameCount];
             }
-            state->hook = process__genericResampling;
+            state->hook = parallel ? process__genericParallel : process__genericResampling;
         } else {
             if (state->outputTemp) {
                 delete [] state->outputTemp;
@@ -741,15 +1455,16 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
     }
 
     ALOGV("mixer configuration change: %d activeTracks (%08x) "
-        "all16BitsStereoNoResample=%d, resampling=%d, volumeRamp=%d",
+        "all16BitsStereoNoResample=%d, resampling=%d, volumeRamp=%d, floatMix=%d",
         countActiveTracks, state->enabledTracks,
-        all16BitsStereoNoResample, resampling, volumeRamp);
+        all16BitsStereoNoResample, resampling, volumeRamp, floatMix);
 
    state->hook(state, pts);
 
     // Now that the volume ramp has been done, set optimal state and
-    // track hooks for subsequent mixer process
-    if (countActiveTracks) {
+    // track hooks for subsequent mixer process.
+    // The float mix handles muted tracks itself, and must keep converting its output.
+    if (countActiveTracks && !floatMix) {
         bool allMuted = true;
         uint32_t en = state->enabledTracks;
         while (en) {
@@ -790,6 +1505,8 @@ void AudioMixer::track__genericResample(track_t* t, int32_t* out, size_t outFram
         t->resampler->resample(temp, outFrameCount, t->bufferProvider);
         if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1]|t->auxInc)) {
             volumeRampStereo(t, out, outFrameCount, temp, aux);
+        } else if (sUseSIMD) {
+            volumeStereoSIMD(t, out, outFrameCount, temp, aux);
         } else {
             volumeStereo(t, out, outFrameCount, temp, aux);
         }
@@ -798,7 +1515,11 @@ void AudioMixer::track__genericResample(track_t* t, int32_t* out, size_t outFram
             t->resampler->setVolume(UNITY_GAIN, UNITY_GAIN);
             memset(temp, 0, outFrameCount * MAX_NUM_CHANNELS * sizeof(int32_t));
             t->resampler->resample(temp, outFrameCount, t->bufferProvider);
-            volumeRampStereo(t, out, outFrameCount, temp, aux);
+            if (sUseSIMD) {
+                volumeRampStereoSIMD(t, out, outFrameCount, temp, aux);
+            } else {
+                volumeRampStereo(t, out, outFrameCount, temp, aux);
+            }
         }
 
         // constant gain
@@ -1064,6 +1785,169 @@ void AudioMixer::track__16BitsMono(track_t* t, int32_t* out, size_t frameCount,
     t->in = in;
 }
 
+// The *SIMD hooks below use the vectorized kernels for the common case of no aux send,
+// and delegate to the scalar hooks otherwise, except for volumeStereoSIMD() which
+// vectorizes both the aux and the no aux case.
+
+void AudioMixer::track__16BitsStereoSIMD(track_t* t, int32_t* out, size_t frameCount,
+        int32_t* temp, int32_t* aux)
+{
+    if (CC_UNLIKELY(aux != NULL)) {
+        track__16BitsStereo(t, out, frameCount, temp, aux);
+        return;
+    }
+    const int16_t *in = static_cast<const int16_t *>(t->in);
+
+    // ramp gain
+    if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1])) {
+        int32_t vl = t->prevVolume[0];
+        int32_t vr = t->prevVolume[1];
+        const int32_t vlInc = t->volumeInc[0];
+        const int32_t vrInc = t->volumeInc[1];
+
+        size_t done = rampStereo16<false>(out, in, frameCount, vl, vr, vlInc, vrInc);
+        in += done * 2;
+        out += done * 2;
+        for (frameCount -= done; frameCount; --frameCount) {
+            *out++ += (vl >> 16) * (int32_t) *in++;
+            *out++ += (vr >> 16) * (int32_t) *in++;
+            vl += vlInc;
+            vr += vrInc;
+        }
+
+        t->prevVolume[0] = vl;
+        t->prevVolume[1] = vr;
+        t->adjustVolumeRamp(false);
+    }
+
+    // constant gain
+    else {
+        const uint32_t vrl = t->volumeRL;
+        size_t done = mixStereo16(out, in, frameCount, vrl);
+        in += done * 2;
+        out += done * 2;
+        for (frameCount -= done; frameCount; --frameCount) {
+            uint32_t rl = *reinterpret_cast<const uint32_t *>(in);
+            in += 2;
+            out[0] = mulAddRL(1, rl, vrl, out[0]);
+            out[1] = mulAddRL(0, rl, vrl, out[1]);
+            out += 2;
+        }
+    }
+    t->in = in;
+}
+
+void AudioMixer::track__16BitsMonoSIMD(track_t* t, int32_t* out, size_t frameCount,
+        int32_t* temp, int32_t* aux)
+{
+    if (CC_UNLIKELY(aux != NULL)) {
+        track__16BitsMono(t, out, frameCount, temp, aux);
+        return;
+    }
+    const int16_t *in = static_cast<int16_t const *>(t->in);
+
+    // ramp gain
+    if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1])) {
+        int32_t vl = t->prevVolume[0];
+        int32_t vr = t->prevVolume[1];
+        const int32_t vlInc = t->volumeInc[0];
+        const int32_t vrInc = t->volumeInc[1];
+
+        size_t done = rampStereo16<true>(out, in, frameCount, vl, vr, vlInc, vrInc);
+        in += done;
+        out += done * 2;
+        for (frameCount -= done; frameCount; --frameCount) {
+            int32_t l = *in++;
+            *out++ += (vl >> 16) * l;
+            *out++ += (vr >> 16) * l;
+            vl += vlInc;
+            vr += vrInc;
+        }
+
+        t->prevVolume[0] = vl;
+        t->prevVolume[1] = vr;
+        t->adjustVolumeRamp(false);
+    }
+    // constant gain
+    else {
+        const int16_t vl = t->volume[0];
+        const int16_t vr = t->volume[1];
+        size_t done = mixMono16(out, in, frameCount, t->volumeRL);
+        in += done;
+        out += done * 2;
+        for (frameCount -= done; frameCount; --frameCount) {
+            int16_t l = *in++;
+            out[0] = mulAdd(l, vl, out[0]);
+            out[1] = mulAdd(l, vr, out[1]);
+            out += 2;
+        }
+    }
+    t->in = in;
+}
+
+void AudioMixer::volumeRampStereoSIMD(track_t* t, int32_t* out, size_t frameCount,
+        int32_t* temp, int32_t* aux)
+{
+    if (CC_UNLIKELY(aux != NULL)) {
+        volumeRampStereo(t, out, frameCount, temp, aux);
+        return;
+    }
+    int32_t vl = t->prevVolume[0];
+    int32_t vr = t->prevVolume[1];
+    const int32_t vlInc = t->volumeInc[0];
+    const int32_t vrInc = t->volumeInc[1];
+
+    size_t done = volumeRampStereo32(out, temp, frameCount, vl, vr, vlInc, vrInc);
+    temp += done * 2;
+    out += done * 2;
+    for (frameCount -= done; frameCount; --frameCount) {
+        *out++ += (vl >> 16) * (*temp++ >> 12);
+        *out++ += (vr >> 16) * (*temp++ >> 12);
+        vl += vlInc;
+        vr += vrInc;
+    }
+    t->prevVolume[0] = vl;
+    t->prevVolume[1] = vr;
+    t->adjustVolumeRamp(false);
+}
+
+void AudioMixer::volumeStereoSIMD(track_t* t, int32_t* out, size_t frameCount, int32_t* temp,
+        int32_t* aux)
+{
+    const int16_t vl = t->volume[0];
+    const int16_t vr = t->volume[1];
+    const int16_t va = t->auxLevel;
+
+    size_t done = volumeStereo32(out, temp, frameCount, vl, vr, aux, va);
+    temp += done * 2;
+    out += done * 2;
+    frameCount -= done;
+    if (frameCount == 0) {
+        return;
+    }
+    if (CC_UNLIKELY(aux != NULL)) {
+        aux += done;
+        do {
+            int16_t l = (int16_t)(*temp++ >> 12);
+            int16_t r = (int16_t)(*temp++ >> 12);
+            out[0] = mulAdd(l, vl, out[0]);
+            int16_t a = (int16_t)(((int32_t)l + r) >> 1);
+            out[1] = mulAdd(r, vr, out[1]);
+            out += 2;
+            aux[0] = mulAdd(a, va, aux[0]);
+            aux++;
+        } while (--frameCount);
+    } else {
+        do {
+            int16_t l = (int16_t)(*temp++ >> 12);
+            int16_t r = (int16_t)(*temp++ >> 12);
+            out[0] = mulAdd(l, vl, out[0]);
+            out[1] = mulAdd(r, vr, out[1]);
+            out += 2;
+        } while (--frameCount);
+    }
+}
+
 // no-op case
 void AudioMixer::process__nop(state_t* state, int64_t pts)
 {
@@ -1117,6 +2001,8 @@ void AudioMixer::process__genericNoResampling(state_t* state, int64_t pts)
 
     // acquire each track's buffer
     uint32_t enabledTracks = state->enabledTracks;
+    // tracks whose current buffer is silent, see track_t::isSilentBuffer()
+    uint32_t silentTracks = 0;
     uint32_t e0 = enabledTracks;
     while (e0) {
         const int i = 31 - __builtin_clz(e0);
@@ -1128,8 +2014,11 @@ void AudioMixer::process__genericNoResampling(state_t* state, int64_t pts)
         t.in = t.buffer.raw;
         // t.in == NULL can happen if the track was flushed just after having
         // been enabled for mixing.
-        if (t.in == NULL)
+        if (t.in == NULL) {
             enabledTracks &= ~(1<<i);
+        } else if (t.hook != track__nop && t.isSilentBuffer()) {
+            silentTracks |= 1<<i;
+        }
     }
 
     e0 = enabledTracks;
@@ -1167,8 +2056,11 @@ void AudioMixer::process__genericNoResampling(state_t* state, int64_t pts)
                 while (outFrames) {
                     size_t inFrames = (t.frameCount > outFrames)?outFrames:t.frameCount;
                     if (inFrames) {
-                        t.hook(&t, outTemp + (BLOCKSIZE-outFrames)*MAX_NUM_CHANNELS, inFrames,
-                                state->resampleTemp, aux);
+                        // a silent buffer is skipped as a whole, so t.in need not advance
+                        if (!(silentTracks & (1<<i))) {
+                            t.hook(&t, outTemp + (BLOCKSIZE-outFrames)*MAX_NUM_CHANNELS,
+                                    inFrames, state->resampleTemp, aux);
+                        }
                         t.frameCount -= inFrames;
                         outFrames -= inFrames;
                         if (CC_UNLIKELY(aux != NULL)) {
@@ -1189,6 +2081,11 @@ void AudioMixer::process__genericNoResampling(state_t* state, int64_t pts)
                             break;
                         }
                         t.frameCount = t.buffer.frameCount;
+                        if (t.hook != track__nop && t.isSilentBuffer()) {
+                            silentTracks |= 1<<i;
+                        } else {
+                            silentTracks &= ~(1<<i);
+                        }
                     }
                 }
             }
@@ -1237,48 +2134,220 @@ void AudioMixer::process__genericResampling(state_t* state, int64_t pts)
         e0 &= ~(e1);
         int32_t *out = t1.mainBuffer;
         memset(outTemp, 0, size);
-        while (e1) {
-            const int i = 31 - __builtin_clz(e1);
-            e1 &= ~(1<<i);
-            track_t& t = state->tracks[i];
-            int32_t *aux = NULL;
-            if (CC_UNLIKELY((t.needs & NEEDS_AUX__MASK) == NEEDS_AUX_ENABLED)) {
-                aux = t.auxBuffer;
-            }
+        mixTracks(state, e1, outTemp, state->resampleTemp, pts);
+        ditherAndClamp(out, outTemp, numFrames);
+    }
+}
 
-            // this is a little goofy, on the resampling case we don't
-            // acquire/release the buffers because it's done by
-            // the resampler.
-            if ((t.needs & NEEDS_RESAMPLE__MASK) == NEEDS_RESAMPLE_ENABLED) {
-                t.resampler->setPTS(pts);
-                t.hook(&t, outTemp, numFrames, state->resampleTemp, aux);
-            } else {
+void AudioMixer::mixTracks(state_t* state, uint32_t tracks, int32_t* outTemp, int32_t* temp,
+        int64_t pts)
+{
+    size_t numFrames = state->frameCount;
+
+    uint32_t e1 = tracks;
+    while (e1) {
+        const int i = 31 - __builtin_clz(e1);
+        e1 &= ~(1<<i);
+        track_t& t = state->tracks[i];
+        int32_t *aux = NULL;
+        if (CC_UNLIKELY((t.needs & NEEDS_AUX__MASK) == NEEDS_AUX_ENABLED)) {
+            aux = t.auxBuffer;
+        }
 
-                size_t outFrames = 0;
+        // this is a little goofy, on the resampling case we don't
+        // acquire/release the buffers because it's done by
+        // the resampler.
+        if ((t.needs & NEEDS_RESAMPLE__MASK) == NEEDS_RESAMPLE_ENABLED) {
+            t.resampler->setPTS(pts);
+            t.hook(&t, outTemp, numFrames, temp, aux);
+        } else {
 
-                while (outFrames < numFrames) {
-                    t.buffer.frameCount = numFrames - outFrames;
-                    int64_t outputPTS = calculateOutputPTS(t, pts, outFrames);
-                    t.bufferProvider->getNextBuffer(&t.buffer, outputPTS);
-                    t.in = t.buffer.raw;
-                    // t.in == NULL can happen if the track was flushed just after having
-                    // been enabled for mixing.
-                    if (t.in == NULL) break;
+            size_t outFrames = 0;
 
-                    if (CC_UNLIKELY(aux != NULL)) {
-                        aux += outFrames;
-                    }
+            while (outFrames < numFrames) {
+                t.buffer.frameCount = numFrames - outFrames;
+                int64_t outputPTS = calculateOutputPTS(t, pts, outFrames);
+                t.bufferProvider->getNextBuffer(&t.buffer, outputPTS);
+                t.in = t.buffer.raw;
+                // t.in == NULL can happen if the track was flushed just after having
+                // been enabled for mixing.
+                if (t.in == NULL) break;
+
+                if (CC_UNLIKELY(aux != NULL)) {
+                    aux += outFrames;
+                }
+                if (t.hook != track__nop && !t.isSilentBuffer()) {
                     t.hook(&t, outTemp + outFrames*MAX_NUM_CHANNELS, t.buffer.frameCount,
-                            state->resampleTemp, aux);
-                    outFrames += t.buffer.frameCount;
-                    t.bufferProvider->releaseBuffer(&t.buffer);
+                            temp, aux);
                 }
+                outFrames += t.buffer.frameCount;
+                t.bufferProvider->releaseBuffer(&t.buffer);
             }
         }
-        ditherAndClamp(out, outTemp, numFrames);
     }
 }
 
+// generic code for many tracks, which shards each group of tracks with the same output buffer
+// across the calling thread and the workers
+void AudioMixer::process__genericParallel(state_t* state, int64_t pts)
+{
+    // this const just means that local variable outTemp doesn't change
+    int32_t* const outTemp = state->outputTemp;
+    const size_t numFrames = state->frameCount;
+    const size_t numSamples = MAX_NUM_CHANNELS * numFrames;
+
+    uint32_t e0 = state->enabledTracks;
+    while (e0) {
+        uint32_t e1 = e0, e2 = e0;
+        int j = 31 - __builtin_clz(e1);
+        track_t& t1 = state->tracks[j];
+        e2 &= ~(1<<j);
+        while (e2) {
+            j = 31 - __builtin_clz(e2);
+            e2 &= ~(1<<j);
+            track_t& t2 = state->tracks[j];
+            if (CC_UNLIKELY(t2.mainBuffer != t1.mainBuffer)) {
+                e1 &= ~(1<<j);
+            }
+        }
+        e0 &= ~(e1);
+
+        // Shard 0 is mixed by this thread, and shard n by worker n-1.
+        // Tracks with an aux send stay in shard 0, as tracks of the same session share the
+        // aux buffer.  The more expensive resampling tracks are dealt first, then the others,
+        // continuing the same rotation.
+        uint32_t shards[MAX_NUM_WORKERS + 1];
+        const uint32_t numShards = popcount(e1) < PARALLEL_MIN_TRACKS ? 1 : state->numWorkers + 1;
+        memset(shards, 0, sizeof(shards));
+        uint32_t shard = 0;
+        for (int pass = 0; pass < 2; pass++) {
+            e2 = e1;
+            while (e2) {
+                const int i = 31 - __builtin_clz(e2);
+                e2 &= ~(1<<i);
+                const track_t& t = state->tracks[i];
+                const bool resampling =
+                        (t.needs & NEEDS_RESAMPLE__MASK) == NEEDS_RESAMPLE_ENABLED;
+                if (resampling != (pass == 0)) {
+                    continue;
+                }
+                if ((t.needs & NEEDS_AUX__MASK) == NEEDS_AUX_ENABLED) {
+                    shards[0] |= 1 << i;
+                } else {
+                    shards[shard] |= 1 << i;
+                    shard = (shard + 1) % numShards;
+                }
+            }
+        }
+
+        for (uint32_t w = 1; w < numShards; w++) {
+            if (shards[w] != 0) {
+                state->workers[w - 1]->post(state, shards[w], pts);
+            }
+        }
+        memset(outTemp, 0, numSamples * sizeof(int32_t));
+        mixTracks(state, shards[0], outTemp, state->resampleTemp, pts);
+        for (uint32_t w = 1; w < numShards; w++) {
+            if (shards[w] != 0) {
+                MixerWorker* worker = state->workers[w - 1];
+                worker->wait();
+                const int32_t* partial = worker->partialMix();
+                for (size_t k = 0; k < numSamples; k++) {
+                    outTemp[k] += partial[k];
+                }
+            }
+        }
+        ditherAndClamp(t1.mainBuffer, outTemp, numFrames);
+    }
+}
+
+AudioMixer::MixerWorker::MixerWorker(size_t frameCount)
+    :   Thread(false /*canCallJava*/),
+        mFrameCount(frameCount),
+        mOut(new int32_t[MAX_NUM_CHANNELS * frameCount]),
+        mTemp(new int32_t[MAX_NUM_CHANNELS * frameCount]),
+        mPending(false), mState(NULL), mTracks(0), mPts(0), mCpuNs(0)
+{
+}
+
+AudioMixer::MixerWorker::~MixerWorker()
+{
+    delete [] mOut;
+    delete [] mTemp;
+}
+
+void AudioMixer::MixerWorker::post(state_t* state, uint32_t tracks, int64_t pts)
+{
+    Mutex::Autolock _l(mLock);
+    mState = state;
+    mTracks = tracks;
+    mPts = pts;
+    mPending = true;
+    mCond.broadcast();
+}
+
+void AudioMixer::MixerWorker::wait()
+{
+    Mutex::Autolock _l(mLock);
+    while (mPending) {
+        mCond.wait(mLock);
+    }
+}
+
+double AudioMixer::MixerWorker::takeCpuNs()
+{
+    Mutex::Autolock _l(mLock);
+    const double ns = mCpuNs;
+    mCpuNs = 0;
+    return ns;
+}
+
+void AudioMixer::MixerWorker::exit()
+{
+    requestExit();
+    {
+        Mutex::Autolock _l(mLock);
+        mCond.broadcast();
+    }
+    requestExitAndWait();
+}
+
+bool AudioMixer::MixerWorker::threadLoop()
+{
+    state_t* state;
+    uint32_t tracks;
+    int64_t pts;
+    {
+        Mutex::Autolock _l(mLock);
+        while (!mPending) {
+            if (exitPending()) {
+                return false;
+            }
+            mCond.wait(mLock);
+        }
+        state = mState;
+        tracks = mTracks;
+        pts = mPts;
+    }
+
+    double ns = 0;
+    if (state->measureLoad) {
+        // discard the time spent waiting since the previous mix
+        mCpuUsage.sampleAndEnable(ns);
+    }
+    memset(mOut, 0, sizeof(int32_t) * MAX_NUM_CHANNELS * mFrameCount);
+    mixTracks(state, tracks, mOut, mTemp, pts);
+    if (!state->measureLoad || !mCpuUsage.sampleAndEnable(ns)) {
+        ns = 0;
+    }
+
+    Mutex::Autolock _l(mLock);
+    mCpuNs += ns;
+    mPending = false;
+    mCond.broadcast();
+    return true;
+}
+
 // one track, 16 bits stereo without resampling is the most common case
 void AudioMixer::process__OneTrack16BitsStereoNoResampling(state_t* state,
                                                            int64_t pts)
@@ -1343,6 +2412,284 @@ void AudioMixer::process__OneTrack16BitsStereoNoResampling(state_t* state,
     }
 }
 
+// Conversion of each input sample format to float for volumeMixFloat()
+static inline float sampleToFloat(int16_t s)
+{
+    return s * (1.0f / (1 << 15));
+}
+
+static inline float sampleToFloat(float s)
+{
+    return s;
+}
+
+// resampler output, which is Q19.12 at unity gain
+static inline float sampleToFloat(int32_t s)
+{
+    return s * (1.0f / (1 << 27));
+}
+
+// volumes are Q3.12, and ramping volumes are Q3.12 with 16 fractional bits below
+static const float kVolumeToFloat = 1.0f / (1 << 12);
+static const float kVolumeRampToFloat = 1.0f / (1 << 28);
+// the aux buffer stays Q4.27 for the effects
+static const float kFloatToAux = 1 << 27;
+
+template <int CHANNELS, typename TI>
+void AudioMixer::volumeMixFloat(track_t* t, float* out, size_t frameCount, const TI* in,
+        int32_t* aux, uint32_t outChannels)
+{
+    if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1]|(aux != NULL ? t->auxInc : 0))) {
+        float vl = t->prevVolume[0] * kVolumeRampToFloat;
+        float vr = t->prevVolume[1] * kVolumeRampToFloat;
+        float va = t->prevAuxLevel * kVolumeRampToFloat;
+        const float vlInc = t->volumeInc[0] * kVolumeRampToFloat;
+        const float vrInc = t->volumeInc[1] * kVolumeRampToFloat;
+        const float vaInc = t->auxInc * kVolumeRampToFloat;
+        for (size_t i = 0; i < frameCount; i++) {
+            const float l = sampleToFloat(in[0]);
+            const float r = CHANNELS == 2 ? sampleToFloat(in[1]) : l;
+            in += CHANNELS;
+            out[0] += l * vl;
+            out[1] += r * vr;
+            out += outChannels;
+            if (aux != NULL) {
+                *aux++ += int32_t((l + r) * 0.5f * va * kFloatToAux);
+                va += vaInc;
+            }
+            vl += vlInc;
+            vr += vrInc;
+        }
+        // the fixed-point ramp state stays authoritative, so ramps end exactly on target
+        t->prevVolume[0] += t->volumeInc[0] * int32_t(frameCount);
+        t->prevVolume[1] += t->volumeInc[1] * int32_t(frameCount);
+        if (aux != NULL) {
+            t->prevAuxLevel += t->auxInc * int32_t(frameCount);
+        }
+        t->adjustVolumeRamp(aux != NULL);
+    } else {
+        const float vl = t->volume[0] * kVolumeToFloat;
+        const float vr = t->volume[1] * kVolumeToFloat;
+        const float va = t->auxLevel * kVolumeToFloat * kFloatToAux;
+        for (size_t i = 0; i < frameCount; i++) {
+            const float l = sampleToFloat(in[0]);
+            const float r = CHANNELS == 2 ? sampleToFloat(in[1]) : l;
+            in += CHANNELS;
+            out[0] += l * vl;
+            out[1] += r * vr;
+            out += outChannels;
+            if (aux != NULL) {
+                *aux++ += int32_t((l + r) * 0.5f * va);
+            }
+        }
+    }
+}
+
+void AudioMixer::volumeMixMultichannel(track_t* t, float* out, size_t frameCount,
+        const int16_t* in, int32_t* aux, uint32_t outChannels)
+{
+    const uint32_t channels = t->channelCount;
+    const bool ramp = t->volumeInc[0]|t->volumeInc[1]|(aux != NULL ? t->auxInc : 0);
+
+    // per track channel: which of the left, right and average volume applies, the fold gain,
+    // and the output channel
+    uint8_t side[MAX_NUM_CHANNELS_TO_DOWNMIX];
+    float gain[MAX_NUM_CHANNELS_TO_DOWNMIX];
+    int8_t dst[MAX_NUM_CHANNELS_TO_DOWNMIX];
+    for (uint32_t c = 0; c < channels; c++) {
+        const uint32_t bit = 1 << c;
+        side[c] = (t->centerChannels & bit) ? 2 : (t->rightChannels & bit) ? 1 : 0;
+        gain[c] = (t->foldChannels & bit) ? float(M_SQRT1_2) : 1.0f;
+        dst[c] = t->channelMap[c];
+    }
+
+    float v[3];
+    float va;
+    float vInc[2];
+    float vaInc;
+    if (ramp) {
+        v[0] = t->prevVolume[0] * kVolumeRampToFloat;
+        v[1] = t->prevVolume[1] * kVolumeRampToFloat;
+        va = t->prevAuxLevel * kVolumeRampToFloat;
+        vInc[0] = t->volumeInc[0] * kVolumeRampToFloat;
+        vInc[1] = t->volumeInc[1] * kVolumeRampToFloat;
+        vaInc = t->auxInc * kVolumeRampToFloat;
+    } else {
+        v[0] = t->volume[0] * kVolumeToFloat;
+        v[1] = t->volume[1] * kVolumeToFloat;
+        va = t->auxLevel * kVolumeToFloat;
+        vInc[0] = vInc[1] = vaInc = 0;
+    }
+    const float auxScale = kFloatToAux / channels;
+
+    for (size_t i = 0; i < frameCount; i++) {
+        v[2] = (v[0] + v[1]) * 0.5f;
+        float sum = 0;
+        for (uint32_t c = 0; c < channels; c++) {
+            const float x = sampleToFloat(in[c]);
+            sum += x;
+            const int d = dst[c];
+            if (d >= 0) {
+                out[d] += x * v[side[c]] * gain[c];
+            } else if (d == kChannelFrontLeftRight) {
+                const float y = x * v[2] * gain[c];
+                out[0] += y;
+                out[1] += y;
+            }
+        }
+        in += channels;
+        out += outChannels;
+        if (aux != NULL) {
+            *aux++ += int32_t(sum * va * auxScale);
+            va += vaInc;
+        }
+        v[0] += vInc[0];
+        v[1] += vInc[1];
+    }
+
+    if (ramp) {
+        // the fixed-point ramp state stays authoritative, so ramps end exactly on target
+        t->prevVolume[0] += t->volumeInc[0] * int32_t(frameCount);
+        t->prevVolume[1] += t->volumeInc[1] * int32_t(frameCount);
+        if (aux != NULL) {
+            t->prevAuxLevel += t->auxInc * int32_t(frameCount);
+        }
+        t->adjustVolumeRamp(aux != NULL);
+    }
+}
+
+void AudioMixer::convertMixerOutput(state_t* state, void* out, const float* in,
+        size_t frameCount, audio_format_t format, uint32_t channelCount)
+{
+    if (format == FORMAT_PCM_FLOAT) {
+        memcpy(out, in, frameCount * channelCount * sizeof(float));
+        return;
+    }
+
+    // 16-bit interleaved, the only other mixer format
+    int16_t *dst = static_cast<int16_t *>(out);
+    size_t count = frameCount * channelCount;
+    if (sDither) {
+        // TPDF dither of +/- 1 LSB: the sum of two uniform values of +/- 0.5 LSB each,
+        // from the high 16 bits of two steps of a 32-bit LCG, as the low bits have short periods
+        uint32_t seed = state->ditherSeed;
+        do {
+            seed = seed * 1664525 + 1013904223;
+            const uint32_t r0 = seed >> 16;
+            seed = seed * 1664525 + 1013904223;
+            const uint32_t r1 = seed >> 16;
+            const float dither = (int32_t(r0 + r1) - 0xFFFF) * (1.0f / (1 << 16));
+            *dst++ = clamp16(lrintf(*in++ * 32768.0f + dither));
+        } while (--count);
+        state->ditherSeed = seed;
+    } else {
+        do {
+            *dst++ = clamp16(lrintf(*in++ * 32768.0f));
+        } while (--count);
+    }
+}
+
+// generic code mixing into a float accumulator, for float tracks and float mixer output.
+// Tracks are converted to float once on input, and the mix is converted to the mixer format
+// once on output, so there are no intermediate shifts or clamps.
+void AudioMixer::process__genericFloat(state_t* state, int64_t pts)
+{
+    // this const just means that local variable outTemp doesn't change
+    float* const outTemp = state->outputTempFloat;
+    const size_t numFrames = state->frameCount;
+
+    uint32_t e0 = state->enabledTracks;
+    while (e0) {
+        // process by group of tracks with same output buffer
+        // to optimize cache use
+        uint32_t e1 = e0, e2 = e0;
+        int j = 31 - __builtin_clz(e1);
+        track_t& t1 = state->tracks[j];
+        e2 &= ~(1<<j);
+        while (e2) {
+            j = 31 - __builtin_clz(e2);
+            e2 &= ~(1<<j);
+            track_t& t2 = state->tracks[j];
+            if (CC_UNLIKELY(t2.mainBuffer != t1.mainBuffer)) {
+                e1 &= ~(1<<j);
+            }
+        }
+        e0 &= ~(e1);
+        // all the tracks of a group share the mainBuffer, and so its channel mask
+        const uint32_t outChannels = t1.mixerChannelCount;
+        memset(outTemp, 0, numFrames * outChannels * sizeof(float));
+        while (e1) {
+            const int i = 31 - __builtin_clz(e1);
+            e1 &= ~(1<<i);
+            track_t& t = state->tracks[i];
+            int32_t *aux = NULL;
+            if (CC_UNLIKELY((t.needs & NEEDS_AUX__MASK) == NEEDS_AUX_ENABLED)) {
+                aux = t.auxBuffer;
+            }
+            // a muted track still consumes its input, but skips the multiply-accumulate
+            const bool muted = t.volumeRL == 0 && !(t.volumeInc[0]|t.volumeInc[1]);
+
+            if ((t.needs & NEEDS_RESAMPLE__MASK) == NEEDS_RESAMPLE_ENABLED) {
+                AudioBufferProvider* provider = t.bufferProvider;
+                if (t.inputFormat == FORMAT_PCM_FLOAT) {
+                    t.reformatBufferProvider->mTrackBufferProvider = t.bufferProvider;
+                    t.reformatBufferProvider->mChannelCount = t.channelCount;
+                    provider = t.reformatBufferProvider;
+                }
+                int32_t* temp = state->resampleTemp;
+                memset(temp, 0, numFrames * MAX_NUM_CHANNELS * sizeof(int32_t));
+                t.resampler->setSampleRate(t.sampleRate);
+                t.resampler->setVolume(UNITY_GAIN, UNITY_GAIN);
+                t.resampler->setPTS(pts);
+                t.resampler->resample(temp, numFrames, provider);
+                if (!muted) {
+                    volumeMixFloat<2>(&t, outTemp, numFrames, temp, aux, outChannels);
+                }
+                continue;
+            }
+
+            size_t outFrames = 0;
+            while (outFrames < numFrames) {
+                t.buffer.frameCount = numFrames - outFrames;
+                int64_t outputPTS = calculateOutputPTS(t, pts, outFrames);
+                t.bufferProvider->getNextBuffer(&t.buffer, outputPTS);
+                // t.buffer.raw == NULL can happen if the track was flushed just after having
+                // been enabled for mixing.
+                if (t.buffer.raw == NULL) break;
+
+                if (!muted && !t.isSilentBuffer()) {
+                    float* out = outTemp + outFrames * outChannels;
+                    int32_t* auxOut = aux != NULL ? aux + outFrames : NULL;
+                    const size_t frameCount = t.buffer.frameCount;
+                    if (t.inputFormat == FORMAT_PCM_FLOAT) {
+                        const float* in = static_cast<const float *>(t.buffer.raw);
+                        if (t.channelCount == 1) {
+                            volumeMixFloat<1>(&t, out, frameCount, in, auxOut, outChannels);
+                        } else {
+                            volumeMixFloat<2>(&t, out, frameCount, in, auxOut, outChannels);
+                        }
+                    } else if (t.mixesMultichannel()) {
+                        volumeMixMultichannel(&t, out, frameCount, t.buffer.i16, auxOut,
+                                outChannels);
+                    } else {
+                        // other tracks with more than 2 channels have been downmixed to stereo
+                        if (t.channelCount == 1) {
+                            volumeMixFloat<1>(&t, out, frameCount, t.buffer.i16, auxOut,
+                                    outChannels);
+                        } else {
+                            volumeMixFloat<2>(&t, out, frameCount, t.buffer.i16, auxOut,
+                                    outChannels);
+                        }
+                    }
+                }
+                outFrames += t.buffer.frameCount;
+                t.bufferProvider->releaseBuffer(&t.buffer);
+            }
+        }
+        convertMixerOutput(state, t1.mainBuffer, outTemp, numFrames, t1.mixerFormat, outChannels);
+    }
+}
+
 #if 0
 // 2 tracks is also a common case
 // NEVER used in current implementation of process__validate()
@@ -1456,12 +2803,30 @@ int64_t AudioMixer::calculateOutputPTS(const track_t& t, int64_t basePTS,
 }
 
 /*static*/ uint64_t AudioMixer::sLocalTimeFreq;
+/*static*/ bool AudioMixer::sUseSIMD;
+/*static*/ bool AudioMixer::sFloatMix;
+/*static*/ bool AudioMixer::sDither;
+/*static*/ bool AudioMixer::sAdaptiveQuality;
 /*static*/ pthread_once_t AudioMixer::sOnceControl = PTHREAD_ONCE_INIT;
 
 /*static*/ void AudioMixer::sInitRoutine()
 {
     LocalClock lc;
     sLocalTimeFreq = lc.getLocalFreq();
+
+    // the vectorized track hooks are used whenever they were compiled in,
+    // unless disabled by property for comparison against the scalar hooks
+    sUseSIMD = USE_NEON || USE_SSE2;
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.mixer.simd", value, NULL) > 0 && !strcmp(value, "0")) {
+        sUseSIMD = false;
+    }
+
+    // mix 16-bit tracks in float too, rather than only when float tracks or outputs are present
+    sFloatMix = property_get("af.mixer.float", value, NULL) > 0 && !strcmp(value, "1");
+    sDither = property_get("af.mixer.dither", value, NULL) > 0 && !strcmp(value, "1");
+    sAdaptiveQuality = AudioResampler::isAdaptive();
+    ALOGV("mixer SIMD hooks %s", sUseSIMD ? "enabled" : "disabled");
 }
 
 // ----------------------------------------------------------------------------
@@ -23,6 +23,8 @@
 
 #include <utils/threads.h>
 
+#include <cutils/bitops.h>
+#include <cpustats/ThreadCpuUsage.h>
 #include <media/AudioBufferProvider.h>
 #include "AudioResampler.h"
 
@@ -42,21 +44,37 @@ public:
 
     /*virtual*/             ~AudioMixer();  // non-virtual saves a v-table, restore if sub-classed
 
+    // mState is aligned on a cache line, which the default operator new does not guarantee
+    static void*            operator new(size_t size);
+    static void             operator delete(void* ptr);
+
 
     // This mixer has a hard-coded upper limit of 32 active track inputs.
     // Adding support for > 32 tracks would require more than simply changing this value.
     static const uint32_t MAX_NUM_TRACKS = 32;
     // maximum number of channels supported by the mixer
 
-    // This mixer has a hard-coded upper limit of 2 channels for output.
+    // This mixer has a hard-coded upper limit of 2 channels for output, except for the float
+    // mix which accepts up to MAX_NUM_CHANNELS_TO_DOWNMIX output channels, see MIXER_CHANNEL_MASK.
     // There is support for > 2 channel tracks down-mixed to 2 channel output via a down-mix effect.
     // Adding support for > 2 channel output would require more than simply changing this value.
     static const uint32_t MAX_NUM_CHANNELS = 2;
-    // maximum number of channels supported for the content
+    // maximum number of channels supported for the content, and for a multichannel output
     static const uint32_t MAX_NUM_CHANNELS_TO_DOWNMIX = 8;
 
+    // true if 'mask' is accepted by MIXER_CHANNEL_MASK
+    static bool isValidMixerChannelMask(audio_channel_mask_t mask) {
+        return (mask & AUDIO_CHANNEL_OUT_STEREO) == AUDIO_CHANNEL_OUT_STEREO &&
+                popcount(mask) <= MAX_NUM_CHANNELS_TO_DOWNMIX;
+    }
+
     static const uint16_t UNITY_GAIN = 0x1000;
 
+    // Float PCM, accepted by the FORMAT and MIXER_FORMAT parameters in addition to
+    // AUDIO_FORMAT_PCM_16_BIT.  Samples are nominally in [-1.0, 1.0].
+    // system/audio.h does not define a float format yet, so the mixer defines its own.
+    static const audio_format_t FORMAT_PCM_FLOAT = (audio_format_t) (AUDIO_FORMAT_PCM | 0x5);
+
     enum { // names
 
         // track names (MAX_NUM_TRACKS units)
@@ -77,6 +95,13 @@ public:
         MAIN_BUFFER     = 0x4002,
         AUX_BUFFER      = 0x4003,
         DOWNMIX_TYPE    = 0X4004,
+        MIXER_FORMAT    = 0x4005, // format of MAIN_BUFFER: AUDIO_FORMAT_PCM_16_BIT (default),
+                                  // which is interleaved stereo int16_t, or FORMAT_PCM_FLOAT
+        MIXER_CHANNEL_MASK = 0x4006, // channel mask of MAIN_BUFFER: AUDIO_CHANNEL_OUT_STEREO
+                                  // (default), or any mask of up to 8 channels that includes
+                                  // front left and right.  Tracks of more than 2 channels that
+                                  // are not resampled are then mixed without the downmixer,
+                                  // each channel going to the same position in the output.
         // for target RESAMPLE
         SAMPLE_RATE     = 0x4100, // Configure sample rate conversion on this track name;
                                   // parameter 'value' is the new sample rate in Hz.
@@ -99,7 +124,10 @@ public:
     // For all APIs with "name": TRACK0 <= name < TRACK0 + MAX_NUM_TRACKS
 
     // Allocate a track name.  Returns new track name if successful, -1 on failure.
-    int         getTrackName(audio_channel_mask_t channelMask, int sessionId);
+    // mixerChannelMask is the initial MIXER_CHANNEL_MASK: with a multichannel output, a
+    // multichannel track is mixed natively and needs no downmix effect.
+    int         getTrackName(audio_channel_mask_t channelMask, int sessionId,
+                             audio_channel_mask_t mixerChannelMask = AUDIO_CHANNEL_OUT_STEREO);
 
     // Free an allocated track by name
     void        deleteTrackName(int name);
@@ -115,6 +143,22 @@ public:
 
     uint32_t    trackNames() const { return mTrackNames; }
 
+    // Use up to 'count' worker threads, in addition to the calling thread, to mix groups of at
+    // least PARALLEL_MIN_TRACKS tracks.  Each thread produces a partial mix of its share of the
+    // tracks, and the partial mixes are summed.  0 (default) mixes on the calling thread only.
+    // Must not be used by a mixer called from a SCHED_FIFO thread, as process() then blocks
+    // on the workers.
+    void        setWorkerThreads(uint32_t count);
+
+    // Measure the CPU load of process(), including the time spent in the worker threads, and
+    // adapt the quality of the resamplers to the total load of all the measured mixers, see
+    // AudioResampler::adaptQuality().  No effect unless af.resampler.adaptive is 1.
+    // Meant for the normal mixer threads only: the fast mixer must not pay for the measurement.
+    void        setAdaptiveQuality(bool enabled);
+
+    static const uint32_t MAX_NUM_WORKERS = 3;
+    static const uint32_t PARALLEL_MIN_TRACKS = 8;
+
     size_t      getUnreleasedFrames(int name) const;
 
 private:
@@ -132,6 +176,7 @@ private:
         NEEDS_CHANNEL_2             = 0x00000001,
 
         NEEDS_FORMAT_16             = 0x00000010,
+        NEEDS_FORMAT_FLOAT          = 0x00000020,
 
         NEEDS_MUTE_DISABLED         = 0x00000000,
         NEEDS_MUTE_ENABLED          = 0x00000100,
@@ -146,12 +191,25 @@ private:
     struct state_t;
     struct track_t;
     class DownmixerBufferProvider;
+    class ReformatBufferProvider;
+    class MixerWorker;
 
     typedef void (*hook_t)(track_t* t, int32_t* output, size_t numOutFrames, int32_t* temp,
                            int32_t* aux);
     static const int BLOCKSIZE = 16; // 4 cache lines
 
+    // special values of track_t::channelMap
+    static const int8_t kChannelDropped = -1;           // not mixed
+    static const int8_t kChannelFrontLeftRight = -2;    // mixed into both front left and right
+
+    // The fields are split in two 64-byte halves, assuming the 32-bit ABI:
+    // the first cache line holds everything the process__* hooks and the track hooks touch
+    // on every buffer, and the second line holds the aux send state and the configuration
+    // that is only read by setParameter() and process__validate().
+    // Keep sizeof(track_t) == 128 so that consecutive tracks do not share cache lines.
     struct track_t {
+        // hot, first cache line
+
         uint32_t    needs;
 
         union {
@@ -164,51 +222,87 @@ private:
         // 16-byte boundary
 
         int32_t     volumeInc[MAX_NUM_CHANNELS];
-        int32_t     auxInc;
-        int32_t     prevAuxLevel;
-
-        // 16-byte boundary
 
-        int16_t     auxLevel;       // 0 <= auxLevel <= MAX_GAIN_INT, but signed for mul performance
         uint16_t    frameCount;
+        int16_t     auxLevel;       // 0 <= auxLevel <= MAX_GAIN_INT, but signed for mul performance
 
-        uint8_t     channelCount;   // 1 or 2, redundant with (needs & NEEDS_CHANNEL_COUNT__MASK)
-        uint8_t     format;         // always 16
-        uint16_t    enabled;        // actually bool
-        audio_channel_mask_t channelMask;
+        uint32_t    sampleRate;
+
+        // 16-byte boundary
+
+        hook_t      hook;
+        const void* in;             // current location in buffer
 
         // actual buffer provider used by the track hooks, see DownmixerBufferProvider below
         //  for how the Track buffer provider is wrapped by another one when dowmixing is required
         AudioBufferProvider*                bufferProvider;
 
+        AudioResampler*     resampler;
+
         // 16-byte boundary
 
         mutable AudioBufferProvider::Buffer buffer; // 8 bytes
 
-        hook_t      hook;
-        const void* in;             // current location in buffer
-
-        // 16-byte boundary
-
-        AudioResampler*     resampler;
-        uint32_t            sampleRate;
         int32_t*           mainBuffer;
         int32_t*           auxBuffer;
 
+        // 64-byte boundary, cold
+
+        int32_t     auxInc;
+        int32_t     prevAuxLevel;
+
+        uint8_t     channelCount;   // 1 or 2, redundant with (needs & NEEDS_CHANNEL_COUNT__MASK)
+        uint8_t     format;         // always 16
+        uint16_t    enabled;        // actually bool
+
+        audio_format_t inputFormat; // AUDIO_FORMAT_PCM_16_BIT or FORMAT_PCM_FLOAT
+
         // 16-byte boundary
 
+        audio_format_t mixerFormat; // format of mainBuffer, see MIXER_FORMAT
+        audio_channel_mask_t channelMask;
+        int32_t     sessionId;
+
         DownmixerBufferProvider* downmixerBufferProvider; // 4 bytes
 
-        int32_t     sessionId;
+        // 16-byte boundary
 
-        int32_t     padding[2];
+        // converts a float track to 16-bit for the resampler, NULL for 16-bit tracks
+        ReformatBufferProvider* reformatBufferProvider;
+
+        // quality requested when the resampler was created, the limit for adaptive upgrades
+        AudioResampler::src_quality resamplerQuality;
+
+        audio_channel_mask_t mixerChannelMask; // channel mask of mainBuffer
+        uint8_t     mixerChannelCount;
+
+        // for tracks mixed natively, bitmasks of the track channels that are folded at -3 dB,
+        // and of those that take the right and the average volume instead of the left one
+        uint8_t     foldChannels;
+        uint8_t     rightChannels;
+        uint8_t     centerChannels;
 
         // 16-byte boundary
 
+        // output channel of each track channel, or kChannelDropped or kChannelFrontLeftRight
+        int8_t      channelMap[MAX_NUM_CHANNELS_TO_DOWNMIX];
+
+        int32_t     padding[2];
+
+        // 64-byte boundary
+
         bool        setResampler(uint32_t sampleRate, uint32_t devSampleRate);
+        void        changeResamplerQuality(AudioResampler::src_quality quality,
+                                           uint32_t devSampleRate);
         bool        doesResample() const { return resampler != NULL; }
         void        resetResampler() { if (resampler != NULL) resampler->reset(); }
         void        adjustVolumeRamp(bool aux);
+        void        updateChannelMap();
+        bool        isSilentBuffer() const;
+        // true if the track has more channels than the resampler and track hooks handle,
+        // and no downmixer, so only process__genericFloat() can mix it
+        bool        mixesMultichannel() const { return channelCount > MAX_NUM_CHANNELS &&
+                                                    downmixerBufferProvider == NULL; }
         size_t      getUnreleasedFrames() const { return resampler != NULL ?
                                                     resampler->getUnreleasedFrames() : 0; };
     };
@@ -222,9 +316,14 @@ private:
         int32_t         *outputTemp;
         int32_t         *resampleTemp;
         NBLog::Writer*  mLog;
-        int32_t         reserved[1];
+        float           *outputTempFloat;   // float accumulator, see process__genericFloat()
+        uint32_t        outputTempFloatChannels; // channels per frame allocated in outputTempFloat
+        uint32_t        ditherSeed;         // TPDF dither generator state
+        uint32_t        numWorkers;         // see process__genericParallel()
+        bool            measureLoad;        // the workers time their mixes, see process()
+        MixerWorker*    workers[MAX_NUM_WORKERS];
         // FIXME allocate dynamically to save some memory when maxNumTracks < MAX_NUM_TRACKS
-        track_t         tracks[MAX_NUM_TRACKS]; __attribute__((aligned(32)));
+        track_t         tracks[MAX_NUM_TRACKS] __attribute__((aligned(64)));
     };
 
     // AudioBufferProvider that wraps a track AudioBufferProvider by a call to a downmix effect
@@ -240,6 +339,60 @@ private:
         effect_config_t    mDownmixConfig;
     };
 
+    // AudioBufferProvider that wraps a float track AudioBufferProvider, and converts each buffer
+    // to 16-bit for the resamplers, which only accept 16-bit input.  The conversion goes to a
+    // private buffer of up to frameCount frames, never to the track buffer.
+    class ReformatBufferProvider : public AudioBufferProvider {
+    public:
+        virtual status_t getNextBuffer(Buffer* buffer, int64_t pts);
+        virtual void releaseBuffer(Buffer* buffer);
+        ReformatBufferProvider(size_t frameCount);
+        virtual ~ReformatBufferProvider();
+
+        AudioBufferProvider* mTrackBufferProvider;
+        uint32_t             mChannelCount;
+    private:
+        const size_t         mFrameCount;
+        int16_t* const       mConverted;    // mFrameCount frames of up to MAX_NUM_CHANNELS
+        Buffer               mBuffer;       // the track buffer mConverted was converted from
+    };
+
+    // Thread that mixes a subset of the tracks into its own partial mix,
+    // on behalf of process__genericParallel()
+    class MixerWorker : public Thread {
+    public:
+        MixerWorker(size_t frameCount);
+        virtual ~MixerWorker();
+
+        // start mixing 'tracks' into partialMix()
+        void        post(state_t* state, uint32_t tracks, int64_t pts);
+        // wait for the mix started by post() to complete
+        void        wait();
+        // ask threadLoop() to return, then wait for it
+        void        exit();
+
+        int32_t*    partialMix() const { return mOut; }
+        // CPU time spent in the mixes since the previous call, if state->measureLoad;
+        // call between wait() and the next post()
+        double      takeCpuNs();
+
+    private:
+        virtual bool threadLoop();
+
+        const size_t    mFrameCount;
+        int32_t*        mOut;   // partial mix, MAX_NUM_CHANNELS * mFrameCount
+        int32_t*        mTemp;  // resampler temp buffer, MAX_NUM_CHANNELS * mFrameCount
+        Mutex           mLock;
+        Condition       mCond;
+        // protected by mLock
+        bool            mPending;
+        state_t*        mState;
+        uint32_t        mTracks;
+        int64_t         mPts;
+        ThreadCpuUsage  mCpuUsage;  // only used by threadLoop()
+        double          mCpuNs;
+    };
+
     // bitmask of allocated track names, where bit 0 corresponds to TRACK0 etc.
     uint32_t        mTrackNames;
 
@@ -250,10 +403,25 @@ private:
     const uint32_t  mSampleRate;
 
     NBLog::Writer   mDummyLog;
+
+    // strong references to the workers in mState.workers
+    sp<MixerWorker> mWorkers[MAX_NUM_WORKERS];
+
+    // load-adaptive resampler quality, see AudioResampler::adaptQuality()
+    static const uint32_t kQualityChecksPerSecond = 4;
+    static const uint32_t kUpgradeChecks = 8;
+    ThreadCpuUsage  mCpuUsage;          // CPU time spent in process()
+    float           mLoad;              // smoothed load of process(), in permille of real time
+    int32_t         mReportedLoad;      // value of mLoad last reported to AudioResampler
+    size_t          mFramesSinceQualityCheck;
+    uint32_t        mLowLoadChecks;     // consecutive checks that would allow an upgrade
+
+    void updateLoad(double ns);
+    void adaptResamplerQuality();
 public:
     void            setLog(NBLog::Writer* log);
 private:
-    state_t         mState __attribute__((aligned(32)));
+    state_t         mState __attribute__((aligned(64)));
 
     // effect descriptor for the downmixer used by the mixer
     static effect_descriptor_t dwnmFxDesc;
@@ -280,12 +448,40 @@ private:
     static void volumeStereo(track_t* t, int32_t* out, size_t frameCount, int32_t* temp,
             int32_t* aux);
 
+    // vectorized variants of the hooks above, selected by process__validate() when sUseSIMD
+    static void track__16BitsStereoSIMD(track_t* t, int32_t* out, size_t numFrames,
+            int32_t* temp, int32_t* aux);
+    static void track__16BitsMonoSIMD(track_t* t, int32_t* out, size_t numFrames,
+            int32_t* temp, int32_t* aux);
+    static void volumeRampStereoSIMD(track_t* t, int32_t* out, size_t frameCount,
+            int32_t* temp, int32_t* aux);
+    static void volumeStereoSIMD(track_t* t, int32_t* out, size_t frameCount, int32_t* temp,
+            int32_t* aux);
+
     static void process__validate(state_t* state, int64_t pts);
     static void process__nop(state_t* state, int64_t pts);
     static void process__genericNoResampling(state_t* state, int64_t pts);
     static void process__genericResampling(state_t* state, int64_t pts);
     static void process__OneTrack16BitsStereoNoResampling(state_t* state,
                                                           int64_t pts);
+    static void process__genericFloat(state_t* state, int64_t pts);
+    static void process__genericParallel(state_t* state, int64_t pts);
+
+    // accumulate the tracks of bitmask 'tracks' into 'out', using 'temp' for resampling
+    static void mixTracks(state_t* state, uint32_t tracks, int32_t* out, int32_t* temp,
+            int64_t pts);
+
+    // accumulate frameCount frames of 'in' into the front left and right of the float buffer
+    // 'out' of outChannels channels with the track's volume, and send to the aux buffer if not NULL
+    template <int CHANNELS, typename TI>
+    static void volumeMixFloat(track_t* t, float* out, size_t frameCount, const TI* in,
+            int32_t* aux, uint32_t outChannels);
+    // same for a track mixed natively, with each channel placed according to t->channelMap
+    static void volumeMixMultichannel(track_t* t, float* out, size_t frameCount,
+            const int16_t* in, int32_t* aux, uint32_t outChannels);
+    // convert the float accumulator to the mixer output format, with optional dither
+    static void convertMixerOutput(state_t* state, void* out, const float* in,
+            size_t frameCount, audio_format_t format, uint32_t channelCount);
 #if 0
     static void process__TwoTracks16BitsStereoNoResampling(state_t* state,
                                                            int64_t pts);
@@ -295,6 +491,14 @@ private:
                                       int outputFrameIndex);
 
     static uint64_t         sLocalTimeFreq;
+    // true if the NEON or SSE2 track hooks are available and enabled (property af.mixer.simd)
+    static bool             sUseSIMD;
+    // true to mix all tracks through process__genericFloat() (property af.mixer.float)
+    static bool             sFloatMix;
+    // true to add TPDF dither when converting float mixes to 16-bit (property af.mixer.dither)
+    static bool             sDither;
+    // true to allow setAdaptiveQuality() (property af.resampler.adaptive)
+    static bool             sAdaptiveQuality;
     static pthread_once_t   sOnceControl;
     static void             sInitRoutine();
 };
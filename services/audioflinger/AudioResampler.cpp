@@ -19,7 +19,9 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
 #include "AudioResampler.h"
@@ -97,9 +99,19 @@ bool AudioResampler::qualityIsSupported(src_quality quality)
 static pthread_once_t once_control = PTHREAD_ONCE_INIT;
 static AudioResampler::src_quality defaultQuality = AudioResampler::DEFAULT_QUALITY;
 
+// Load-adaptive quality thresholds, in permille of real time summed over all mixers.
+// The gap between them keeps an upgrade from immediately triggering a downgrade.
+static const int32_t kHighLoadPermille = 400;
+static const int32_t kLowLoadPermille = 150;
+static bool adaptive = false;
+static volatile int32_t loadPermille = 0;
+
 void AudioResampler::init_routine()
 {
     char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.resampler.adaptive", value, NULL) > 0) {
+        adaptive = strcmp(value, "1") == 0;
+    }
     if (property_get("af.resampler.quality", value, NULL) > 0) {
         char *endptr;
         unsigned long l = strtoul(value, &endptr, 0);
@@ -133,6 +145,63 @@ static const uint32_t maxMHz = 130; // an arbitrary number that permits 3 VHQ, s
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 static uint32_t currentMHz = 0;
 
+static AudioResampler::src_quality lowerQuality(AudioResampler::src_quality quality)
+{
+    switch (quality) {
+    case AudioResampler::VERY_HIGH_QUALITY:
+        return AudioResampler::HIGH_QUALITY;
+    case AudioResampler::HIGH_QUALITY:
+        return AudioResampler::MED_QUALITY;
+    default:
+        return AudioResampler::LOW_QUALITY;
+    }
+}
+
+bool AudioResampler::isAdaptive()
+{
+    int ok = pthread_once(&once_control, init_routine);
+    if (ok != 0) {
+        ALOGE("%s pthread_once failed: %d", __func__, ok);
+    }
+    return adaptive;
+}
+
+void AudioResampler::setAdaptive(bool enabled)
+{
+    // initialize first, so that init_routine() cannot override the value later
+    (void) isAdaptive();
+    adaptive = enabled;
+}
+
+void AudioResampler::addLoad(int32_t deltaPermille)
+{
+    android_atomic_add(deltaPermille, &loadPermille);
+}
+
+AudioResampler::src_quality AudioResampler::adaptQuality(src_quality current, src_quality limit)
+{
+    if (!isAdaptive()) {
+        return current;
+    }
+    if (limit == DEFAULT_QUALITY) {
+        limit = defaultQuality == DEFAULT_QUALITY ? LOW_QUALITY : defaultQuality;
+    }
+    const int32_t load = android_atomic_acquire_load(&loadPermille);
+    if (load > kHighLoadPermille && current > LOW_QUALITY) {
+        return lowerQuality(current);
+    }
+    if (load < kLowLoadPermille && current < limit) {
+        const src_quality next = src_quality(current + 1);
+        pthread_mutex_lock(&mutex);
+        const bool fits = currentMHz - qualityMHz(current) + qualityMHz(next) <= maxMHz;
+        pthread_mutex_unlock(&mutex);
+        if (fits) {
+            return next;
+        }
+    }
+    return current;
+}
+
 AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
         int32_t sampleRate, src_quality quality) {
 
@@ -145,6 +214,11 @@ AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
         }
         quality = defaultQuality;
         atFinalQuality = false;
+        if (adaptive && quality != DEFAULT_QUALITY &&
+                android_atomic_acquire_load(&loadPermille) > kHighLoadPermille) {
+            ALOGV("starting resampler one level below quality %d due to load", quality);
+            quality = lowerQuality(quality);
+        }
     } else {
         atFinalQuality = true;
     }
@@ -276,6 +350,15 @@ void AudioResampler::reset() {
     mBuffer.frameCount = 0;
 }
 
+void AudioResampler::releaseBuffer(AudioBufferProvider* provider) {
+    if (mBuffer.frameCount != 0) {
+        // the frames before mInputIndex have been consumed
+        mBuffer.frameCount = mInputIndex < mBuffer.frameCount ? mInputIndex : mBuffer.frameCount;
+        provider->releaseBuffer(&mBuffer);
+    }
+    reset();
+}
+
 // ----------------------------------------------------------------------------
 
 void AudioResamplerOrder1::resample(int32_t* out, size_t outFrameCount,
@@ -77,6 +77,31 @@ public:
     // called from destructor, so must not be virtual
     src_quality getQuality() const { return mQuality; }
 
+    // Return the estimated CPU load for specific resampler in MHz.
+    // The absolute number is irrelevant, it's the relative values that matter.
+    // Public so that test-resample can check the estimate against measurements.
+    static uint32_t qualityMHz(src_quality quality);
+
+    // Load-adaptive quality selection (property af.resampler.adaptive, disabled by default).
+    // Mixers measure their CPU usage and report changes with addLoad(), in permille of
+    // real time, so the total approximates the global mixing load. create() starts
+    // DEFAULT_QUALITY resamplers one level lower while the total is high, and mixers move
+    // existing resamplers between levels as suggested by adaptQuality().
+    static bool isAdaptive();
+    // Override the property, for tools that need reproducible output.
+    // Must be called before the first AudioMixer is created.
+    static void setAdaptive(bool enabled);
+    static void addLoad(int32_t deltaPermille);
+
+    // Return the level a resampler at 'current' should move to: one level lower if the load
+    // is high, one level higher if the load is low and the MHz budget allows it, but never
+    // above 'limit' (DEFAULT_QUALITY meaning the default level), otherwise 'current'.
+    static src_quality adaptQuality(src_quality current, src_quality limit);
+
+    // Hand the partially consumed input buffer, if any, back to 'provider' and reset.
+    // Call before deleting a resampler whose provider stays in use.
+    void releaseBuffer(AudioBufferProvider* provider);
+
 protected:
     // number of bits for phase fraction - 30 bits allows nearly 2x downsampling
     static constexpr int kNumPhaseBits = 30;
@@ -119,10 +144,6 @@ private:
 
     // For pthread_once()
     static void init_routine();
-
-    // Return the estimated CPU load for specific resampler in MHz.
-    // The absolute number is irrelevant, it's the relative values that matter.
-    static uint32_t qualityMHz(src_quality quality);
 };
 
 // ----------------------------------------------------------------------------
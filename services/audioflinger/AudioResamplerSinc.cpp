@@ -18,6 +18,7 @@
 //#define LOG_NDEBUG 0
 
 #include <malloc.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <dlfcn.h>
@@ -43,6 +44,20 @@
 #define USE_NEON (false)
 #endif
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define USE_AVX2 (true)
+#else
+#define USE_AVX2 (false)
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2 (true)
+#else
+#define USE_SSE2 (false)
+#endif
+
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -328,6 +343,15 @@ static const int pLerpBits = 15;
 static pthread_once_t once_control = PTHREAD_ONCE_INIT;
 static readCoefficientsFn readResampleCoefficients = NULL;
 
+// The polyphase tables trade memory for CPU: numPhases * 8 * halfNumCoefs bytes each.
+// They are shared by all resamplers and live until the process exits.
+static const uint32_t kMaxPolyphases = 160;         // covers 44.1 kHz <-> 48 kHz
+static const size_t kMaxPolyphaseTables = 8;
+static pthread_mutex_t sPolyphaseLock = PTHREAD_MUTEX_INITIALIZER;
+static size_t sNumPolyphaseTables;
+// Disabled by default on NEON builds, where the interpolating kernel is already competitive.
+static bool sPolyphaseEnabled = !USE_NEON;
+
 /*static*/ AudioResamplerSinc::Constants AudioResamplerSinc::highQualityConstants;
 /*static*/ AudioResamplerSinc::Constants AudioResamplerSinc::veryHighQualityConstants;
 
@@ -345,6 +369,11 @@ void AudioResamplerSinc::init_routine()
     // for very high quality resampler, the parameters are load-time constants
     veryHighQualityConstants = highQualityConstants;
 
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.resampler.polyphase", value, NULL) > 0) {
+        sPolyphaseEnabled = strcmp(value, "1") == 0;
+    }
+
     // Open the dll to get the coefficients for VERY_HIGH_QUALITY
     void *resampleCoeffLib = dlopen("libaudio-resampler.so", RTLD_NOW);
     ALOGV("Open libaudio-resampler library = %p", resampleCoeffLib);
@@ -452,7 +481,8 @@ int32_t mulAddRL(int left, uint32_t inRL, int32_t v, int32_t a)
 AudioResamplerSinc::AudioResamplerSinc(int bitDepth,
         int inChannelCount, int32_t sampleRate, src_quality quality)
     : AudioResampler(bitDepth, inChannelCount, sampleRate, quality),
-    mState(0), mImpulse(0), mRingFull(0), mFirCoefs(0)
+    mState(0), mImpulse(0), mRingFull(0), mFirCoefs(0),
+    mPolyphase(NULL), mPolyphaseRate(0), mPolyphaseStep(0), mPolyphaseIndex(0)
 {
     /*
      * Layout of the state buffer for 32 tap:
@@ -500,6 +530,7 @@ void AudioResamplerSinc::init() {
 void AudioResamplerSinc::reset(){
     mInputIndex = 0;
     mPhaseFraction = 0;
+    mPolyphaseIndex = 0;
     mBuffer.frameCount = 0;
     const Constants& c(*mConstants);
     const size_t stateSize = (2*c.halfNumCoefs) * mChannelCount * 2;
@@ -512,16 +543,136 @@ void AudioResamplerSinc::setVolume(int16_t left, int16_t right) {
     mVolumeSIMD[1] = int32_t(right)<<16;
 }
 
+const int32_t* AudioResamplerSinc::getCoefficients() const
+{
+    if (mConstants == &veryHighQualityConstants && readResampleCoefficients) {
+        return readResampleCoefficients( mInSampleRate <= mSampleRate );
+    }
+    return (const int32_t *) ((mInSampleRate <= mSampleRate) ? mFirCoefsUp : mFirCoefsDown);
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+void AudioResamplerSinc::setSampleRate(int32_t inSampleRate)
+{
+    // called for every buffer by AudioMixer, so only do the work when the rate changes
+    if (inSampleRate == mPolyphaseRate) {
+        return;
+    }
+    AudioResampler::setSampleRate(inSampleRate);
+    mPolyphaseRate = inSampleRate;
+
+    const PolyphaseTable* table = NULL;
+    const uint32_t g = gcd(inSampleRate, mSampleRate);
+    const uint32_t numPhases = mSampleRate / g;
+    const uint32_t step = inSampleRate / g;
+    // beyond 2x downsampling the pending frame count no longer fits in mPhaseFraction
+    if (sPolyphaseEnabled && inSampleRate > 0 && numPhases <= kMaxPolyphases &&
+            step <= 2 * numPhases && (mConstants->halfNumCoefs % 8) == 0) {
+        table = getPolyphaseTable(getCoefficients(), *mConstants, numPhases);
+    }
+    if (table != NULL) {
+        // carry the current position over, rounding down to the nearest phase
+        mPolyphaseStep = step;
+        mPolyphaseIndex = (mPhaseFraction >> kNumPhaseBits) * numPhases +
+                uint32_t((uint64_t(mPhaseFraction & kPhaseMask) * numPhases) >> kNumPhaseBits);
+    }
+    ALOGV("setSampleRate %d -> %d: %s %u/%u", inSampleRate, mSampleRate,
+            table != NULL ? "polyphase" : "interpolated", step, numPhases);
+    mPolyphase = table;
+}
+
+/*static*/ const AudioResamplerSinc::PolyphaseTable* AudioResamplerSinc::getPolyphaseTable(
+        const int32_t* firCoefs, const Constants& c, uint32_t numPhases)
+{
+    static PolyphaseTable sTables[kMaxPolyphaseTables];
+
+    pthread_mutex_lock(&sPolyphaseLock);
+    PolyphaseTable* table = NULL;
+    for (size_t i = 0; i < sNumPolyphaseTables; i++) {
+        if (sTables[i].firCoefs == firCoefs && sTables[i].halfNumCoefs == c.halfNumCoefs &&
+                sTables[i].numPhases == numPhases) {
+            table = &sTables[i];
+            break;
+        }
+    }
+    if (table == NULL && sNumPolyphaseTables < kMaxPolyphaseTables) {
+        const size_t halfNumCoefs = c.halfNumCoefs;
+        const size_t numCoefs = 2 * halfNumCoefs;
+        int16_t* coefs = (int16_t*) memalign(32, numPhases * 2 * numCoefs * sizeof(int16_t));
+        if (coefs != NULL) {
+            const uint32_t ONE = c.cMask | c.pMask;
+            for (uint32_t p = 0; p < numPhases; p++) {
+                // same derivation as filterCoefficient(), evaluated once per phase
+                const uint32_t phase = uint32_t((uint64_t(p) << kNumPhaseBits) / numPhases);
+                const uint32_t indexP = ( phase & c.cMask) >> c.cShift;
+                const uint32_t lerpP  = ( phase & c.pMask) >> c.pShift;
+                const uint32_t indexN = ((ONE-phase) & c.cMask) >> c.cShift;
+                const uint32_t lerpN  = ((ONE-phase) & c.pMask) >> c.pShift;
+                const int32_t* coefsP = firCoefs + indexP * halfNumCoefs;
+                const int32_t* coefsN = firCoefs + indexN * halfNumCoefs;
+                int16_t* hi = coefs + p * 2 * numCoefs;
+                int16_t* lo = hi + numCoefs;
+                for (size_t i = 0; i < numCoefs; i++) {
+                    // the positive side is applied to past samples, newest first
+                    const int32_t* coef = i < halfNumCoefs ?
+                            coefsP + (halfNumCoefs - 1 - i) : coefsN + (i - halfNumCoefs);
+                    const int32_t lerp = i < halfNumCoefs ? lerpP : lerpN;
+                    const int32_t sinc = mulAdd(lerp, (coef[halfNumCoefs] - coef[0]) << 1,
+                            coef[0]);
+                    int32_t h = int32_t((int64_t(sinc) + 0x8000) >> 16);
+                    if (h > 32767) {
+                        h = 32767;
+                    }
+                    int32_t l = int32_t(int64_t(sinc) - (int64_t(h) << 16));
+                    // keep pairs of products within int32, see filterPolyphase()
+                    if (l < -32767) {
+                        l = -32767;
+                    } else if (l > 32767) {
+                        l = 32767;
+                    }
+                    hi[i] = int16_t(h);
+                    lo[i] = int16_t(l);
+                }
+            }
+            table = &sTables[sNumPolyphaseTables++];
+            table->firCoefs = firCoefs;
+            table->halfNumCoefs = halfNumCoefs;
+            table->numPhases = numPhases;
+            table->coefs = coefs;
+            ALOGV("polyphase table %u phases x %zu taps", numPhases, numCoefs);
+        }
+    }
+    pthread_mutex_unlock(&sPolyphaseLock);
+    return table;
+}
+
 void AudioResamplerSinc::resample(int32_t* out, size_t outFrameCount,
             AudioBufferProvider* provider)
 {
     // FIXME store current state (up or down sample) and only load the coefs when the state
     // changes. Or load two pointers one for up and one for down in the init function.
     // Not critical now since the read functions are fast, but would be important if read was slow.
-    if (mConstants == &veryHighQualityConstants && readResampleCoefficients) {
-        mFirCoefs = readResampleCoefficients( mInSampleRate <= mSampleRate );
-    } else {
-        mFirCoefs = (const int32_t *) ((mInSampleRate <= mSampleRate) ? mFirCoefsUp : mFirCoefsDown);
+    mFirCoefs = getCoefficients();
+
+    if (mPolyphase != NULL) {
+        switch (mChannelCount) {
+        case 1:
+            resamplePolyphase<1>(out, outFrameCount, provider);
+            break;
+        case 2:
+            resamplePolyphase<2>(out, outFrameCount, provider);
+            break;
+        }
+        return;
     }
 
     // select the appropriate resampler
@@ -563,16 +714,19 @@ void AudioResamplerSinc::resample(int32_t* out, size_t outFrameCount,
             const uint32_t phaseIndex = phaseFraction >> kNumPhaseBits;
             if (phaseIndex == 1) {
                 // read one frame
-                read<CHANNELS>(impulse, phaseFraction, mBuffer.i16, inputIndex);
+                phaseFraction -= 1LU<<kNumPhaseBits;
+                read<CHANNELS>(impulse, mBuffer.i16, inputIndex);
             } else if (phaseIndex == 2) {
                 // read 2 frames
-                read<CHANNELS>(impulse, phaseFraction, mBuffer.i16, inputIndex);
+                phaseFraction -= 1LU<<kNumPhaseBits;
+                read<CHANNELS>(impulse, mBuffer.i16, inputIndex);
                 inputIndex++;
                 if (inputIndex >= mBuffer.frameCount) {
                     inputIndex -= mBuffer.frameCount;
                     provider->releaseBuffer(&mBuffer);
                 } else {
-                    read<CHANNELS>(impulse, phaseFraction, mBuffer.i16, inputIndex);
+                    phaseFraction -= 1LU<<kNumPhaseBits;
+                    read<CHANNELS>(impulse, mBuffer.i16, inputIndex);
                 }
             }
         }
@@ -597,7 +751,8 @@ void AudioResamplerSinc::resample(int32_t* out, size_t outFrameCount,
                 if (inputIndex >= frameCount) {
                     goto done;  // need a new buffer
                 }
-                read<CHANNELS>(impulse, phaseFraction, in, inputIndex);
+                phaseFraction -= 1LU<<kNumPhaseBits;
+                read<CHANNELS>(impulse, in, inputIndex);
             }
         }
 done:
@@ -614,6 +769,201 @@ resample_exit:
     mPhaseFraction = phaseFraction;
 }
 
+template<int CHANNELS>
+void AudioResamplerSinc::resamplePolyphase(int32_t* out, size_t outFrameCount,
+        AudioBufferProvider* provider)
+{
+    // Same structure as resample(), with the phase kept as an exact fraction of numPhases
+    const PolyphaseTable& table(*mPolyphase);
+    const size_t headOffset = table.halfNumCoefs*CHANNELS;
+    const uint32_t numPhases = table.numPhases;
+    const uint32_t step = mPolyphaseStep;
+    int16_t* impulse = mImpulse;
+    uint32_t vRL = mVolumeRL;
+    size_t inputIndex = mInputIndex;
+    uint32_t phase = mPolyphaseIndex;
+    size_t outputIndex = 0;
+    size_t outputSampleCount = outFrameCount * 2;
+    size_t inFrameCount = (outFrameCount*mInSampleRate)/mSampleRate;
+
+    while (outputIndex < outputSampleCount) {
+        // buffer is empty, fetch a new one
+        while (mBuffer.frameCount == 0) {
+            mBuffer.frameCount = inFrameCount;
+            provider->getNextBuffer(&mBuffer,
+                                    calculateOutputPTS(outputIndex / 2));
+            if (mBuffer.raw == NULL) {
+                goto resample_exit;
+            }
+            // read the frames that were pending when the previous buffer ran out
+            while (phase >= numPhases) {
+                phase -= numPhases;
+                read<CHANNELS>(impulse, mBuffer.i16, inputIndex);
+                if (phase < numPhases) {
+                    break;
+                }
+                inputIndex++;
+                if (inputIndex >= mBuffer.frameCount) {
+                    inputIndex -= mBuffer.frameCount;
+                    provider->releaseBuffer(&mBuffer);
+                    break;
+                }
+            }
+        }
+        int16_t const * const in = mBuffer.i16;
+        const size_t frameCount = mBuffer.frameCount;
+
+        // Always read-in the first samples from the input buffer
+        int16_t* head = impulse + headOffset;
+        for (size_t i=0 ; i<CHANNELS ; i++) {
+            head[i] = in[inputIndex*CHANNELS + i];
+        }
+
+        while (CC_LIKELY(outputIndex < outputSampleCount)) {
+            filterPolyphase<CHANNELS>(&out[outputIndex], phase, impulse, vRL);
+            outputIndex += 2;
+
+            phase += step;
+            while (phase >= numPhases) {
+                inputIndex++;
+                if (inputIndex >= frameCount) {
+                    goto done;  // need a new buffer
+                }
+                phase -= numPhases;
+                read<CHANNELS>(impulse, in, inputIndex);
+            }
+        }
+done:
+        // if done with buffer, save samples
+        if (inputIndex >= frameCount) {
+            inputIndex -= frameCount;
+            provider->releaseBuffer(&mBuffer);
+        }
+    }
+
+resample_exit:
+    mImpulse = impulse;
+    mInputIndex = inputIndex;
+    mPolyphaseIndex = phase;
+    // keep the interpolating state in sync in case the next rate has no table
+    mPhaseFraction = ((phase / numPhases) << kNumPhaseBits) +
+            uint32_t((uint64_t(phase % numPhases) << kNumPhaseBits) / numPhases);
+}
+
+/***
+* filterPolyphase()
+*
+* Dot product of the 2*halfNumCoefs frames around the impulse with one phase of the table.
+* Each tap c is split as (h << 16) + l, so c*s >> 16 is computed as h*s + (l*s >> 16)
+* with products summed in pairs before the shift; this is the natural granularity of
+* pmaddwd and keeps the scalar and vector kernels bit-exact with each other.
+*
+**/
+template<int CHANNELS>
+void AudioResamplerSinc::filterPolyphase(
+        int32_t* out, uint32_t phase, const int16_t *samples, uint32_t vRL)
+{
+    const PolyphaseTable& table(*mPolyphase);
+    const size_t numCoefs = 2 * table.halfNumCoefs;
+    const int16_t* hi = table.coefs + phase * 2 * numCoefs;
+    const int16_t* lo = hi + numCoefs;
+    const int16_t* s = samples - (table.halfNumCoefs - 1) * CHANNELS;
+    int32_t l, r;
+
+#if USE_AVX2
+    __m256i accHi = _mm256_setzero_si256();
+    __m256i accLo = _mm256_setzero_si256();
+    if (CHANNELS == 1) {
+        for (size_t i = 0; i < numCoefs; i += 16) {
+            const __m256i x = _mm256_loadu_si256((const __m256i*) (s + i));
+            accHi = _mm256_add_epi32(accHi,
+                    _mm256_madd_epi16(x, _mm256_load_si256((const __m256i*) (hi + i))));
+            accLo = _mm256_add_epi32(accLo, _mm256_srai_epi32(
+                    _mm256_madd_epi16(x, _mm256_load_si256((const __m256i*) (lo + i))), 16));
+        }
+    } else {
+        for (size_t i = 0; i < numCoefs; i += 8) {
+            // L0 R0 L1 R1 L2 R2 L3 R3 -> L0 L1 R0 R1 L2 L3 R2 R3, in each 128-bit lane
+            __m256i x = _mm256_loadu_si256((const __m256i*) (s + i * 2));
+            x = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(3,1,2,0)),
+                    _MM_SHUFFLE(3,1,2,0));
+            // c0 c1 c2 c3 ... -> c0 c1 c0 c1 c2 c3 c2 c3 ...
+            const __m128i h = _mm_load_si128((const __m128i*) (hi + i));
+            const __m128i m = _mm_load_si128((const __m128i*) (lo + i));
+            const __m256i h2 = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_unpacklo_epi32(h, h)), _mm_unpackhi_epi32(h, h), 1);
+            const __m256i m2 = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_unpacklo_epi32(m, m)), _mm_unpackhi_epi32(m, m), 1);
+            accHi = _mm256_add_epi32(accHi, _mm256_madd_epi16(x, h2));
+            accLo = _mm256_add_epi32(accLo, _mm256_srai_epi32(_mm256_madd_epi16(x, m2), 16));
+        }
+    }
+    const __m256i acc256 = _mm256_add_epi32(accHi, accLo);
+    __m128i acc = _mm_add_epi32(_mm256_castsi256_si128(acc256),
+            _mm256_extracti128_si256(acc256, 1));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1,0,3,2)));
+    if (CHANNELS == 1) {
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2,3,0,1)));
+        r = l = _mm_cvtsi128_si32(acc);
+    } else {
+        l = _mm_cvtsi128_si32(acc);
+        r = _mm_cvtsi128_si32(_mm_srli_si128(acc, 4));
+    }
+#elif USE_SSE2
+    __m128i accHi = _mm_setzero_si128();
+    __m128i accLo = _mm_setzero_si128();
+    if (CHANNELS == 1) {
+        for (size_t i = 0; i < numCoefs; i += 8) {
+            const __m128i x = _mm_loadu_si128((const __m128i*) (s + i));
+            accHi = _mm_add_epi32(accHi,
+                    _mm_madd_epi16(x, _mm_load_si128((const __m128i*) (hi + i))));
+            accLo = _mm_add_epi32(accLo, _mm_srai_epi32(
+                    _mm_madd_epi16(x, _mm_load_si128((const __m128i*) (lo + i))), 16));
+        }
+    } else {
+        for (size_t i = 0; i < numCoefs; i += 4) {
+            // L0 R0 L1 R1 L2 R2 L3 R3 -> L0 L1 R0 R1 L2 L3 R2 R3
+            __m128i x = _mm_loadu_si128((const __m128i*) (s + i * 2));
+            x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3,1,2,0)),
+                    _MM_SHUFFLE(3,1,2,0));
+            // c0 c1 c2 c3 -> c0 c1 c0 c1 c2 c3 c2 c3
+            const __m128i h = _mm_loadl_epi64((const __m128i*) (hi + i));
+            const __m128i m = _mm_loadl_epi64((const __m128i*) (lo + i));
+            accHi = _mm_add_epi32(accHi, _mm_madd_epi16(x, _mm_unpacklo_epi32(h, h)));
+            accLo = _mm_add_epi32(accLo,
+                    _mm_srai_epi32(_mm_madd_epi16(x, _mm_unpacklo_epi32(m, m)), 16));
+        }
+    }
+    __m128i acc = _mm_add_epi32(accHi, accLo);
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1,0,3,2)));
+    if (CHANNELS == 1) {
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2,3,0,1)));
+        r = l = _mm_cvtsi128_si32(acc);
+    } else {
+        l = _mm_cvtsi128_si32(acc);
+        r = _mm_cvtsi128_si32(_mm_srli_si128(acc, 4));
+    }
+#else
+    l = 0;
+    r = 0;
+    for (size_t i = 0; i < numCoefs; i += 2) {
+        const int16_t* s0 = s + i * CHANNELS;
+        const int16_t* s1 = s0 + CHANNELS;
+        l += hi[i] * s0[0] + hi[i+1] * s1[0];
+        l += (lo[i] * s0[0] + lo[i+1] * s1[0]) >> 16;
+        if (CHANNELS == 2) {
+            r += hi[i] * s0[1] + hi[i+1] * s1[1];
+            r += (lo[i] * s0[1] + lo[i+1] * s1[1]) >> 16;
+        }
+    }
+    if (CHANNELS == 1) {
+        r = l;
+    }
+#endif
+    out[0] += 2 * mulRL(1, l, vRL);
+    out[1] += 2 * mulRL(0, r, vRL);
+}
+
 template<int CHANNELS>
 /***
 * read()
@@ -623,11 +973,9 @@ template<int CHANNELS>
 *
 **/
 void AudioResamplerSinc::read(
-        int16_t*& impulse, uint32_t& phaseFraction,
-        const int16_t* in, size_t inputIndex)
+        int16_t*& impulse, const int16_t* in, size_t inputIndex)
 {
     impulse += CHANNELS;
-    phaseFraction -= 1LU<<kNumPhaseBits;
 
     const Constants& c(*mConstants);
     if (CC_UNLIKELY(impulse >= mRingFull)) {
@@ -41,6 +41,9 @@ public:
 
     virtual void resample(int32_t* out, size_t outFrameCount,
             AudioBufferProvider* provider);
+
+    // Also selects a precomputed polyphase table when the ratio allows it
+    virtual void setSampleRate(int32_t inSampleRate);
 private:
     void init();
 
@@ -63,8 +66,17 @@ private:
             int32_t lerp, const int16_t* samples);
 
     template<int CHANNELS>
-    inline void read(int16_t*& impulse, uint32_t& phaseFraction,
-            const int16_t* in, size_t inputIndex);
+    inline void read(int16_t*& impulse, const int16_t* in, size_t inputIndex);
+
+    template<int CHANNELS>
+    void resamplePolyphase(int32_t* out, size_t outFrameCount,
+            AudioBufferProvider* provider);
+
+    template<int CHANNELS>
+    inline void filterPolyphase(
+            int32_t* out, uint32_t phase, const int16_t *samples, uint32_t vRL);
+
+    const int32_t* getCoefficients() const;
 
     int16_t *mState;
     int16_t *mImpulse;
@@ -94,6 +106,25 @@ private:
     const Constants *mConstants;    // points to appropriate set of coefficient parameters
 
     static void init_routine();
+
+    // Coefficients for all the phases of a rational ratio in/out = step/numPhases, each
+    // interpolated once from mFirCoefs so that resampling is a plain dot product per frame.
+    // Per phase there are 2*halfNumCoefs taps in sample order (oldest first), stored as
+    // the rounded high 16 bits of every tap followed by the signed remainders.
+    struct PolyphaseTable {
+        const int32_t* firCoefs;
+        uint32_t halfNumCoefs;
+        uint32_t numPhases;
+        int16_t* coefs;
+    };
+
+    static const PolyphaseTable* getPolyphaseTable(const int32_t* firCoefs,
+            const Constants& c, uint32_t numPhases);
+
+    const PolyphaseTable* mPolyphase;   // NULL if coefficients are interpolated per frame
+    int32_t mPolyphaseRate;             // input rate mPolyphase was selected for
+    uint32_t mPolyphaseStep;            // input frames per output frame, in 1/numPhases units
+    uint32_t mPolyphaseIndex;           // current phase in 1/numPhases units
 };
 
 // ----------------------------------------------------------------------------
@@ -68,10 +68,11 @@ AudioFlinger::EffectModule::EffectModule(ThreadBase *thread,
       // mMaxDisableWaitCnt is set by configure() and not used before then
       // mDisableWaitCnt is set by process() and updateState() and not used before then
 #ifdef QCOM_DIRECTTRACK
-      mSuspended(false), mIsForLPA(false)
+      mSuspended(false), mIsForLPA(false),
 #else
-      mSuspended(false)
+      mSuspended(false),
 #endif
+      mCycleProcessNs(0), mProcessCycles(0), mTotalProcessNs(0), mMaxProcessNs(0)
 {
     ALOGV("Constructor %p", this);
     int lStatus;
@@ -210,6 +211,15 @@ size_t AudioFlinger::EffectModule::disconnect(EffectHandle *handle, bool unpinIf
 void AudioFlinger::EffectModule::updateState() {
     Mutex::Autolock _l(mLock);
 
+    if (mCycleProcessNs > 0) {
+        mProcessCycles++;
+        mTotalProcessNs += mCycleProcessNs;
+        if (mCycleProcessNs > mMaxProcessNs) {
+            mMaxProcessNs = mCycleProcessNs;
+        }
+        mCycleProcessNs = 0;
+    }
+
     switch (mState) {
     case RESTART:
         reset_l();
@@ -249,7 +259,9 @@ void AudioFlinger::EffectModule::updateState() {
     }
 }
 
-void AudioFlinger::EffectModule::process()
+// Auxiliary effects are always processed on whole buffers, as their 32 bit input is converted
+// to 16 bit in place.
+void AudioFlinger::EffectModule::process(size_t frame, size_t frameCount)
 {
     Mutex::Autolock _l(mLock);
 
@@ -259,6 +271,16 @@ void AudioFlinger::EffectModule::process()
         return;
     }
 
+    // the block of the configured buffers to process
+    audio_buffer_t inBuffer = mConfig.inputCfg.buffer;
+    audio_buffer_t outBuffer = mConfig.outputCfg.buffer;
+    if (frame != 0 || frameCount != inBuffer.frameCount) {
+        inBuffer.s16 += frame * popcount(mConfig.inputCfg.channels);
+        outBuffer.s16 += frame * popcount(mConfig.outputCfg.channels);
+        inBuffer.frameCount = frameCount;
+        outBuffer.frameCount = frameCount;
+    }
+
     if (isProcessEnabled()) {
         // do 32 bit to 16 bit conversion for auxiliary effect input buffer
         if ((mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY) {
@@ -268,9 +290,11 @@ void AudioFlinger::EffectModule::process()
         }
 
         // do the actual processing in the effect engine
+        nsecs_t startNs = systemTime();
         int ret = (*mEffectInterface)->process(mEffectInterface,
-                                               &mConfig.inputCfg.buffer,
-                                               &mConfig.outputCfg.buffer);
+                                               &inBuffer,
+                                               &outBuffer);
+        mCycleProcessNs += systemTime() - startNs;
 
         // force transition to IDLE state when engine is ready
         if (mState == STOPPED && ret == -ENODATA) {
@@ -288,9 +312,9 @@ void AudioFlinger::EffectModule::process()
         // accumulate input onto output
         sp<EffectChain> chain = mChain.promote();
         if (chain != 0 && chain->activeTrackCnt() != 0) {
-            size_t frameCnt = mConfig.inputCfg.buffer.frameCount * 2;  //always stereo here
-            int16_t *in = mConfig.inputCfg.buffer.s16;
-            int16_t *out = mConfig.outputCfg.buffer.s16;
+            size_t frameCnt = frameCount * popcount(mConfig.outputCfg.channels);
+            int16_t *in = inBuffer.s16;
+            int16_t *out = outBuffer.s16;
             for (size_t i = 0; i < frameCnt; i++) {
                 out[i] = clamp16((int32_t)out[i] + (int32_t)in[i]);
             }
@@ -298,6 +322,15 @@ void AudioFlinger::EffectModule::process()
     }
 }
 
+size_t AudioFlinger::EffectModule::blockAlignment() const
+{
+    // pre processing engines run on 10 ms frames, see audio_processing.h
+    if ((mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_PRE_PROC) {
+        return mConfig.inputCfg.samplingRate / 100;
+    }
+    return 1;
+}
+
 void AudioFlinger::EffectModule::reset_l()
 {
     if (mStatus != NO_ERROR || mEffectInterface == NULL) {
@@ -935,6 +968,12 @@ void AudioFlinger::EffectModule::dump(int fd, const Vector<String16>& args)
             mConfig.outputCfg.format);
     result.append(buffer);
 
+    if (mProcessCycles > 0) {
+        snprintf(buffer, SIZE, "\t\t- Process time: %u cycles, mean %.1f us, max %.1f us\n",
+                mProcessCycles, mTotalProcessNs * 1e-3 / mProcessCycles, mMaxProcessNs * 1e-3);
+        result.append(buffer);
+    }
+
     snprintf(buffer, SIZE, "\t\t%d Clients:\n", mHandles.size());
     result.append(buffer);
     result.append("\t\t\tPid   Priority Ctrl Locked client server\n");
@@ -1282,10 +1321,11 @@ AudioFlinger::EffectChain::EffectChain(ThreadBase *thread,
     : mThread(thread), mSessionId(sessionId), mActiveTrackCnt(0), mTrackCnt(0), mTailBufferCount(0),
       mOwnInBuffer(false), mVolumeCtrlIdx(-1), mLeftVolume(UINT_MAX), mRightVolume(UINT_MAX),
 #ifdef QCOM_DIRECTTRACK
-      mNewLeftVolume(UINT_MAX), mNewRightVolume(UINT_MAX), mIsForLPATrack(false)
+      mNewLeftVolume(UINT_MAX), mNewRightVolume(UINT_MAX), mIsForLPATrack(false),
 #else
-      mNewLeftVolume(UINT_MAX), mNewRightVolume(UINT_MAX)
+      mNewLeftVolume(UINT_MAX), mNewRightVolume(UINT_MAX),
 #endif
+      mBlockFrames(0), mBlockFrameCount(0)
 {
     mStrategy = AudioSystem::getStrategyForStream(AUDIO_STREAM_MUSIC);
     if (thread == NULL) {
@@ -1415,8 +1455,24 @@ void AudioFlinger::EffectChain::process_l()
 #else
     if (doProcess) {
 #endif
-        for (size_t i = 0; i < size; i++) {
-            mEffects[i]->process();
+        // auxiliary effects come first and accumulate whole buffers in the chain input buffer
+        size_t i = 0;
+        for (; i < size && (mEffects[i]->desc().flags & EFFECT_FLAG_TYPE_MASK) ==
+                EFFECT_FLAG_TYPE_AUXILIARY; i++) {
+            mEffects[i]->process(0, mEffects[i]->frameCount());
+        }
+        // insert effects are run one block at a time rather than one effect at a time, so the
+        // block stays in the data cache from one effect to the next
+        if (i < size) {
+            size_t frameCount = mEffects[i]->frameCount();
+            if (frameCount != mBlockFrameCount) {
+                setBlockFrames_l(frameCount);
+            }
+            for (size_t frame = 0; frame < frameCount; frame += mBlockFrames) {
+                for (size_t j = i; j < size; j++) {
+                    mEffects[j]->process(frame, mBlockFrames);
+                }
+            }
         }
     }
     for (size_t i = 0; i < size; i++) {
@@ -1424,6 +1480,46 @@ void AudioFlinger::EffectChain::process_l()
     }
 }
 
+// The block size is the largest divisor of the buffer frame count up to kMaxBlockFrames that is
+// a multiple of the alignment of every insert effect, and of 16 frames to keep the engines on
+// their vector paths.  With a single insert effect, or if there is no such divisor, the buffer
+// is processed whole as before.
+// Must be called with EffectChain::mLock locked
+void AudioFlinger::EffectChain::setBlockFrames_l(size_t frameCount)
+{
+    size_t alignment = 16;
+    size_t inserts = 0;
+    for (size_t i = 0; i < mEffects.size(); i++) {
+        if ((mEffects[i]->desc().flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY) {
+            continue;
+        }
+        inserts++;
+        // least common multiple
+        size_t a = mEffects[i]->blockAlignment();
+        size_t x = alignment, y = a;
+        while (y != 0) {
+            size_t t = x % y;
+            x = y;
+            y = t;
+        }
+        alignment = alignment / x * a;
+    }
+
+    mBlockFrames = frameCount;
+    if (inserts > 1) {
+        size_t maxBlockFrames = alignment > kMaxBlockFrames ? alignment : kMaxBlockFrames;
+        for (size_t block = alignment; block <= maxBlockFrames && block < frameCount;
+                block += alignment) {
+            if (frameCount % block == 0) {
+                mBlockFrames = block;
+            }
+        }
+    }
+    mBlockFrameCount = frameCount;
+    ALOGV("setBlockFrames_l() session %d: %u frames in blocks of %u", mSessionId, frameCount,
+            mBlockFrames);
+}
+
 // addEffect_l() must be called with PlaybackThread::mLock held
 status_t AudioFlinger::EffectChain::addEffect_l(const sp<EffectModule>& effect)
 {
@@ -1537,6 +1633,8 @@ status_t AudioFlinger::EffectChain::addEffect_l(const sp<EffectModule>& effect)
                 idx_insert);
     }
     effect->configure();
+    // choose the block size again in the next process_l()
+    mBlockFrameCount = 0;
     return NO_ERROR;
 }
 
@@ -1565,6 +1663,7 @@ size_t AudioFlinger::EffectChain::removeEffect_l(const sp<EffectModule>& effect)
                 }
             }
             mEffects.removeAt(i);
+            mBlockFrameCount = 0;
             ALOGV("removeEffect_l() effect %p, removed from chain %p at rank %d", effect.get(),
                     this, i);
             break;
@@ -1676,12 +1775,13 @@ void AudioFlinger::EffectChain::dump(int fd, const Vector<String16>& args)
         result.append("\tCould not lock mutex:\n");
     }
 
-    result.append("\tNum fx In buffer   Out buffer   Active tracks:\n");
-    snprintf(buffer, SIZE, "\t%02d     0x%08x  0x%08x   %d\n",
+    result.append("\tNum fx In buffer   Out buffer   Active tracks Block frames:\n");
+    snprintf(buffer, SIZE, "\t%02d     0x%08x  0x%08x   %d             %u\n",
             mEffects.size(),
             (uint32_t)mInBuffer,
             (uint32_t)mOutBuffer,
-            mActiveTrackCnt);
+            mActiveTrackCnt,
+            mBlockFrames);
     result.append(buffer);
     write(fd, result.string(), result.size());
 
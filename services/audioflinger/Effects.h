@@ -60,7 +60,8 @@ public:
     };
 
     int         id() const { return mId; }
-    void process();
+    // process frameCount frames starting at the given frame of the configured buffers
+    void process(size_t frame, size_t frameCount);
     void updateState();
     status_t command(uint32_t cmdCode,
                      uint32_t cmdSize,
@@ -92,6 +93,9 @@ public:
     bool isEnabled() const;
     bool isProcessEnabled() const;
 
+    size_t      frameCount() const { return mConfig.inputCfg.buffer.frameCount; }
+    // the blocks passed to process() should be a multiple of this many frames
+    size_t      blockAlignment() const;
     void        setInBuffer(int16_t *buffer) { mConfig.inputCfg.buffer.s16 = buffer; }
     int16_t     *inBuffer() { return mConfig.inputCfg.buffer.s16; }
     void        setOutBuffer(int16_t *buffer) { mConfig.outputCfg.buffer.s16 = buffer; }
@@ -168,6 +172,12 @@ mutable Mutex               mLock;      // mutex for process, commands and handl
 #ifdef QCOM_DIRECTTRACK
     bool     mIsForLPA;
 #endif
+    // time in the engine process(), summed over the blocks of one chain cycle by process()
+    // and accumulated by updateState()
+    nsecs_t  mCycleProcessNs;
+    uint32_t mProcessCycles;        // cycles in which the engine processed
+    nsecs_t  mTotalProcessNs;
+    nsecs_t  mMaxProcessNs;
 };
 
 // The EffectHandle class implements the IEffect interface. It provides resources
@@ -370,6 +380,12 @@ protected:
 
     void clearInputBuffer_l(sp<ThreadBase> thread);
 
+    // choose mBlockFrames for buffers of frameCount frames
+    void setBlockFrames_l(size_t frameCount);
+
+    // upper limit of mBlockFrames, unless an effect needs larger blocks
+    static const size_t kMaxBlockFrames = 256;
+
     wp<ThreadBase> mThread;     // parent mixer thread
     Mutex mLock;                // mutex protecting effect list
     Vector< sp<EffectModule> > mEffects; // list of effect modules
@@ -393,6 +409,9 @@ protected:
 #ifdef QCOM_DIRECTTRACK
     bool     mIsForLPATrack;
 #endif
+    size_t mBlockFrames;        // frames per block of the insert effects, see process_l()
+    size_t mBlockFrameCount;    // buffer frame count mBlockFrames was chosen for, 0 to choose
+                                // again after the effects changed
     // mSuspendedEffects lists all effects currently suspended in the chain.
     // Use effect type UUID timelow field as key. There is no real risk of identical
     // timeLow fields among effect type UUIDs.
@@ -29,6 +29,7 @@
 #include <sys/atomics.h>
 #include <time.h>
 #include <utils/Log.h>
+#include <utils/String8.h>
 #include <utils/Trace.h>
 #include <system/audio.h>
 #ifdef FAST_MIXER_STATISTICS
@@ -556,7 +557,11 @@ bool FastMixer::threadLoop()
                         // FIXME only log occasionally
                         ALOGV("underrun: time since last cycle %d.%03ld sec",
                                 (int) sec, nsec / 1000000L);
+                        dumpState->mUnderrunTs[dumpState->mUnderruns &
+                                (FastMixerDumpState::kEventN - 1)] = newTs;
                         dumpState->mUnderruns++;
+                        logWriter->logEvent(NBLog::EVENT_ID_FAST_UNDERRUN,
+                                (int32_t) (sec * 1000000 + nsec / 1000), &newTs);
                         ignoreNextOverrun = true;
                     } else if (nsec < overrunNs) {
                         if (ignoreNextOverrun) {
@@ -565,7 +570,11 @@ bool FastMixer::threadLoop()
                             // FIXME only log occasionally
                             ALOGV("overrun: time since last cycle %d.%03ld sec",
                                     (int) sec, nsec / 1000000L);
+                            dumpState->mOverrunTs[dumpState->mOverruns &
+                                    (FastMixerDumpState::kEventN - 1)] = newTs;
                             dumpState->mOverruns++;
+                            logWriter->logEvent(NBLog::EVENT_ID_FAST_OVERRUN,
+                                    (int32_t) (nsec / 1000), &newTs);
                         }
                         // This forces a minimum cycle time. It:
                         //  - compensates for an audio HAL with jitter due to sample rate conversion
@@ -632,6 +641,9 @@ bool FastMixer::threadLoop()
                     // this store #4 is not atomic with respect to stores #1, #2, #3 above, but
                     // the newest open & oldest closed halves are atomic with respect to each other
                     dumpState->mBounds = bounds;
+                    dumpState->mMonotonicHistogram[
+                            FastMixerDumpState::histogramBin(monotonicNs)]++;
+                    dumpState->mLoadHistogram[FastMixerDumpState::histogramBin(loadNs)]++;
                     ATRACE_INT("cycle_ms", monotonicNs / 1000000);
                     ATRACE_INT("load_us", loadNs / 1000);
                 }
@@ -670,7 +682,11 @@ FastMixerDumpState::FastMixerDumpState(
 {
     mMeasuredWarmupTs.tv_sec = 0;
     mMeasuredWarmupTs.tv_nsec = 0;
+    memset(mUnderrunTs, 0, sizeof(mUnderrunTs));
+    memset(mOverrunTs, 0, sizeof(mOverrunTs));
 #ifdef FAST_MIXER_STATISTICS
+    memset(mMonotonicHistogram, 0, sizeof(mMonotonicHistogram));
+    memset(mLoadHistogram, 0, sizeof(mLoadHistogram));
     increaseSamplingN(samplingN);
 #endif
 }
@@ -872,4 +888,76 @@ void FastMixerDumpState::dump(int fd) const
     }
 }
 
+// The JSON object is flat, and only has number and array of number values:
+//   "fastMixer"            format version, currently 1
+//   "output"               I/O handle of the output, unique while the device is up
+//   "nowNs"                CLOCK_MONOTONIC time of the dump
+//   "sampleRate", "frameCount", "framesWritten", "writeErrors", "underruns", "overruns",
+//   "warmupNs", "warmupCycles"
+//                          same as the text dump
+//   "underrunNs", "overrunNs"
+//                          CLOCK_MONOTONIC times of the most recent (up to kEventN) underruns
+//                          and overruns, oldest first
+// and if FAST_MIXER_STATISTICS is defined:
+//   "histogramSubBits"     kHistogramSubBits, which defines the bins as in histogramBin()
+//   "cycleNs", "loadNs"    counts of the wall clock time and CPU load per mix cycle histograms,
+//                          by bin index, without trailing zero bins
+// The counters and histograms accumulate over the life of the mixer thread, so a later dump of
+// the same output includes the earlier ones.
+static void appendEvents(String8& json, const char *name, const struct timespec *ts,
+        uint32_t count)
+{
+    uint32_t n = count < FastMixerDumpState::kEventN ? count : FastMixerDumpState::kEventN;
+    json.appendFormat(",\"%s\":[", name);
+    for (uint32_t i = count - n; i != count; ++i) {
+        const struct timespec& t = ts[i & (FastMixerDumpState::kEventN - 1)];
+        json.appendFormat(i != count - n ? ",%lld" : "%lld",
+                t.tv_sec * 1000000000LL + t.tv_nsec);
+    }
+    json.append("]");
+}
+
+#ifdef FAST_MIXER_STATISTICS
+static void appendHistogram(String8& json, const char *name, const uint32_t *histogram)
+{
+    uint32_t n = FastMixerDumpState::kHistogramBins;
+    while (n > 0 && histogram[n - 1] == 0) {
+        --n;
+    }
+    json.appendFormat(",\"%s\":[", name);
+    for (uint32_t i = 0; i < n; ++i) {
+        json.appendFormat(i != 0 ? ",%u" : "%u", histogram[i]);
+    }
+    json.append("]");
+}
+#endif
+
+void FastMixerDumpState::dumpJson(int fd, audio_io_handle_t output) const
+{
+    if (mCommand == FastMixerState::INITIAL) {
+        return;
+    }
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
+        now.tv_sec = 0;
+        now.tv_nsec = 0;
+    }
+    String8 json;
+    json.appendFormat("{\"fastMixer\":1,\"output\":%d,\"nowNs\":%lld,\"sampleRate\":%u,"
+            "\"frameCount\":%u,\"framesWritten\":%u,\"writeErrors\":%u,\"underruns\":%u,"
+            "\"overruns\":%u,\"warmupNs\":%lld,\"warmupCycles\":%u",
+            output, now.tv_sec * 1000000000LL + now.tv_nsec, mSampleRate, mFrameCount,
+            mFramesWritten, mWriteErrors, mUnderruns, mOverruns,
+            mMeasuredWarmupTs.tv_sec * 1000000000LL + mMeasuredWarmupTs.tv_nsec, mWarmupCycles);
+    appendEvents(json, "underrunNs", mUnderrunTs, mUnderruns);
+    appendEvents(json, "overrunNs", mOverrunTs, mOverruns);
+#ifdef FAST_MIXER_STATISTICS
+    json.appendFormat(",\"histogramSubBits\":%u", kHistogramSubBits);
+    appendHistogram(json, "cycleNs", mMonotonicHistogram);
+    appendHistogram(json, "loadNs", mLoadHistogram);
+#endif
+    json.append("}\n");
+    write(fd, json.string(), json.size());
+}
+
 }   // namespace android
@@ -93,6 +93,10 @@ struct FastMixerDumpState {
     /*virtual*/ ~FastMixerDumpState();
 
     void dump(int fd) const;    // should only be called on a stable copy, not the original
+    // Same restriction as dump().  Writes the counters, the full cycle time and load histograms,
+    // and the recent underrun and overrun times as one line of JSON, for offline analysis
+    // (see tools/fastmixer_stats).  The format is described at the definition.
+    void dumpJson(int fd, audio_io_handle_t output) const;
 
     FastMixerState::Command mCommand;   // current command
     uint32_t mWriteSequence;    // incremented before and after each write()
@@ -108,6 +112,13 @@ struct FastMixerDumpState {
     uint32_t mTrackMask;        // mask of active tracks
     FastTrackDump   mTracks[FastMixerState::kMaxFastTracks];
 
+    // CLOCK_MONOTONIC times of the most recent underruns and overruns, in a FIFO indexed by
+    // mUnderruns or mOverruns modulo kEventN.  Each entry is stored before its counter is
+    // incremented.  kEventN must be a power of 2.
+    static const uint32_t kEventN = 64;
+    struct timespec mUnderrunTs[kEventN];
+    struct timespec mOverrunTs[kEventN];
+
 #ifdef FAST_MIXER_STATISTICS
     // Recently collected samples of per-cycle monotonic time, thread CPU time, and CPU frequency.
     // kSamplingN is max size of sampling frame (statistics), and must be a power of 2 <= 0x8000.
@@ -132,6 +143,31 @@ struct FastMixerDumpState {
 #endif
     // Increase sampling window after construction, must be a power of 2 <= kSamplingN
     void    increaseSamplingN(uint32_t samplingN);
+
+    // Histograms of every mMonotonicNs and mLoadNs sample since construction, unlike the arrays
+    // above which only keep the most recent mSamplingN.  The bins are log-linear: values below
+    // 2^kHistogramSubBits have a bin each, and each higher octave is split into
+    // 2^kHistogramSubBits bins of equal width, so a bin is at most 12.5% of its lower bound wide.
+    static const uint32_t kHistogramSubBits = 3;
+    static const uint32_t kHistogramBins = (32 - kHistogramSubBits + 1) << kHistogramSubBits;
+    uint32_t mMonotonicHistogram[kHistogramBins];
+    uint32_t mLoadHistogram[kHistogramBins];
+    // Bin index for a sample value, and lowest value for a bin index
+    static inline uint32_t histogramBin(uint32_t ns) {
+        if (ns < (1 << kHistogramSubBits)) {
+            return ns;
+        }
+        uint32_t shift = (31 - __builtin_clz(ns)) - kHistogramSubBits;
+        return ((shift + 1) << kHistogramSubBits) +
+                ((ns >> shift) & ((1 << kHistogramSubBits) - 1));
+    }
+    static inline uint32_t histogramBinLowest(uint32_t bin) {
+        if (bin < (1 << kHistogramSubBits)) {
+            return bin;
+        }
+        uint32_t shift = (bin >> kHistogramSubBits) - 1;
+        return ((1 << kHistogramSubBits) | (bin & ((1 << kHistogramSubBits) - 1))) << shift;
+    }
 #endif
 };
 
@@ -15,6 +15,7 @@
  */
 
 #include "Configuration.h"
+#include <utils/Debug.h>
 #include "FastMixerState.h"
 
 namespace android {
@@ -40,4 +41,48 @@ FastMixerState::~FastMixerState()
 {
 }
 
+template<> void copyStateBlocks<FastMixerState>(FastMixerState& to, const FastMixerState& from,
+        uint32_t blocks)
+{
+    // The fields copied below, in declaration order.  A field added to FastMixerState changes its
+    // size, so this fails to build until the field is added here and to the copy.  On 32-bit
+    // targets the struct has no padding, so that holds for any field; with 64-bit pointers a
+    // 4-byte field could still fit in the padding after mOutputSinkGen or mColdGen.
+    struct CopiedFields {
+        FastTrack                   mFastTracks[FastMixerState::kMaxFastTracks];
+        int                         mFastTracksGen;
+        unsigned                    mTrackMask;
+        NBAIO_Sink*                 mOutputSink;
+        int                         mOutputSinkGen;
+        size_t                      mFrameCount;
+        FastMixerState::Command     mCommand;
+        int32_t*                    mColdFutexAddr;
+        unsigned                    mColdGen;
+        FastMixerDumpState*         mDumpState;
+        NBAIO_Sink*                 mTeeSink;
+        NBLog::Writer*              mNBLogWriter;
+    };
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(sizeof(FastMixerState) == sizeof(CopiedFields));
+
+    for (unsigned i = 0; i < FastMixerState::kMaxFastTracks; ++i) {
+        if (blocks & FastMixerState::trackBlock(i)) {
+            to.mFastTracks[i] = from.mFastTracks[i];
+        }
+    }
+    // keep in sync with the fields of FastMixerState
+    if (blocks & FastMixerState::kOtherFieldsBlock) {
+        to.mFastTracksGen = from.mFastTracksGen;
+        to.mTrackMask = from.mTrackMask;
+        to.mOutputSink = from.mOutputSink;
+        to.mOutputSinkGen = from.mOutputSinkGen;
+        to.mFrameCount = from.mFrameCount;
+        to.mCommand = from.mCommand;
+        to.mColdFutexAddr = from.mColdFutexAddr;
+        to.mColdGen = from.mColdGen;
+        to.mDumpState = from.mDumpState;
+        to.mTeeSink = from.mTeeSink;
+        to.mNBLogWriter = from.mNBLogWriter;
+    }
+}
+
 }   // namespace android
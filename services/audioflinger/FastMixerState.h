@@ -21,6 +21,7 @@
 #include <media/ExtendedAudioBufferProvider.h>
 #include <media/nbaio/NBAIO.h>
 #include <media/nbaio/NBLog.h>
+#include "StateQueue.h"
 
 namespace android {
 
@@ -53,7 +54,7 @@ struct FastMixerState {
                 FastMixerState();
     /*virtual*/ ~FastMixerState();
 
-    static const unsigned kMaxFastTracks = 8;   // must be between 2 and 32 inclusive
+    static const unsigned kMaxFastTracks = 8;   // must be between 2 and 31 inclusive
 
     // all pointer fields use raw pointers; objects are owned and ref-counted by the normal mixer
     FastTrack   mFastTracks[kMaxFastTracks];
@@ -79,8 +80,16 @@ struct FastMixerState {
     FastMixerDumpState* mDumpState; // if non-NULL, then update dump state periodically
     NBAIO_Sink* mTeeSink;       // if non-NULL, then duplicate write()s to this non-blocking sink
     NBLog::Writer* mNBLogWriter; // non-blocking logger
+
+    // Blocks for StateQueue<FastMixerState>::endBlocks(): bit i is mFastTracks[i],
+    // and kOtherFieldsBlock is all the other fields
+    static uint32_t trackBlock(unsigned i) { return 1 << i; }
+    static const uint32_t kOtherFieldsBlock = 1 << kMaxFastTracks;
 };  // struct FastMixerState
 
+template<> void copyStateBlocks<FastMixerState>(FastMixerState& to, const FastMixerState& from,
+        uint32_t blocks);
+
 }   // namespace android
 
 #endif  // ANDROID_AUDIO_FAST_MIXER_STATE_H
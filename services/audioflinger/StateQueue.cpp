@@ -33,8 +33,8 @@ void StateQueueObserverDump::dump(int fd)
 
 void StateQueueMutatorDump::dump(int fd)
 {
-    fdprintf(fd, "State queue mutator: pushDirty=%u pushAck=%u blockedSequence=%u\n",
-            mPushDirty, mPushAck, mBlockedSequence);
+    fdprintf(fd, "State queue mutator: pushDirty=%u pushPartial=%u pushAck=%u "
+            "blockedSequence=%u\n", mPushDirty, mPushPartial, mPushAck, mBlockedSequence);
 }
 #endif
 
@@ -43,11 +43,15 @@ void StateQueueMutatorDump::dump(int fd)
 template<typename T> StateQueue<T>::StateQueue() :
     mNext(NULL), mAck(NULL), mCurrent(NULL),
     mMutating(&mStates[0]), mExpecting(NULL),
-    mInMutation(false), mIsDirty(false), mIsInitialized(false)
+    mInMutation(false), mIsDirty(false), mIsInitialized(false), mModifiedBlocks(0)
 #ifdef STATE_QUEUE_DUMP
     , mObserverDump(&mObserverDummyDump), mMutatorDump(&mMutatorDummyDump)
 #endif
 {
+    // until each state has been pushed once, its contents are unrelated to the others
+    for (unsigned i = 0; i < kN; ++i) {
+        mPushedBlocks[i] = ~0;
+    }
 }
 
 template<typename T> StateQueue<T>::~StateQueue()
@@ -79,12 +83,19 @@ template<typename T> T* StateQueue<T>::begin()
 }
 
 template<typename T> void StateQueue<T>::end(bool didModify)
+{
+    endBlocks(didModify ? ~0 : 0);
+}
+
+template<typename T> void StateQueue<T>::endBlocks(uint32_t modifiedBlocks)
 {
     ALOG_ASSERT(mInMutation, "end() called when not in a mutation");
-    ALOG_ASSERT(mIsInitialized || didModify, "first end() must modify for initialization");
-    if (didModify) {
+    ALOG_ASSERT(mIsInitialized || modifiedBlocks != 0,
+            "first end() must modify for initialization");
+    if (modifiedBlocks != 0) {
         mIsDirty = true;
         mIsInitialized = true;
+        mModifiedBlocks |= modifiedBlocks;
     }
     mInMutation = false;
 }
@@ -142,12 +153,26 @@ template<typename T> bool StateQueue<T>::push(StateQueue<T>::block_t block)
         // publish
         android_atomic_release_store((int32_t) mMutating, (volatile int32_t *) &mNext);
         mExpecting = mMutating;
+        mPushedBlocks[mMutating - mStates] = mModifiedBlocks;
+        mModifiedBlocks = 0;
 
-        // copy with circular wraparound
+        // copy with circular wraparound; the next state was last pushed kN pushes ago,
+        // so it only lacks the blocks modified by the kN - 1 pushes since then
         if (++mMutating >= &mStates[kN]) {
             mMutating = &mStates[0];
         }
-        *mMutating = *mExpecting;
+        uint32_t staleBlocks = 0;
+        for (unsigned i = 0; i < kN; ++i) {
+            if (&mStates[i] != mMutating) {
+                staleBlocks |= mPushedBlocks[i];
+            }
+        }
+#ifdef STATE_QUEUE_DUMP
+        if (staleBlocks != (uint32_t) ~0) {
+            mMutatorDump->mPushPartial++;
+        }
+#endif
+        copyStateBlocks(*mMutating, *mExpecting, staleBlocks);
         mIsDirty = false;
 
     }
@@ -108,9 +108,10 @@ struct StateQueueObserverDump {
 };
 
 struct StateQueueMutatorDump {
-    StateQueueMutatorDump() : mPushDirty(0), mPushAck(0), mBlockedSequence(0) { }
+    StateQueueMutatorDump() : mPushDirty(0), mPushPartial(0), mPushAck(0), mBlockedSequence(0) { }
     /*virtual*/ ~StateQueueMutatorDump() { }
     unsigned    mPushDirty;       // incremented each time push() is called with a dirty state
+    unsigned    mPushPartial;     // incremented each time push() only copies some blocks
     unsigned    mPushAck;         // incremented each time push(BLOCK_UNTIL_ACKED) is called
     unsigned    mBlockedSequence; // incremented before and after each time that push()
                                   // blocks for more than one PUSH_BLOCK_ACK_NS;
@@ -119,6 +120,17 @@ struct StateQueueMutatorDump {
 };
 #endif
 
+// Copy the blocks of a state that are set in the bit mask 'blocks'.  After each push, the mutator
+// brings its next state up to date by copying only the blocks modified since that state was last
+// pushed, as reported by endBlocks().  A state type divided into blocks specializes this; the
+// default treats the whole state as one block.
+template<typename T> inline void copyStateBlocks(T& to, const T& from, uint32_t blocks)
+{
+    if (blocks != 0) {
+        to = from;
+    }
+}
+
 // manages a FIFO queue of states
 template<typename T> class StateQueue {
 
@@ -149,8 +161,15 @@ public:
     // If didModify is true, then the state is marked dirty (in need of pushing).
     // There is no rollback option because modifications are done in place.
     // Does not automatically push the new state onto the state queue.
+    // A modification is assumed to touch every block of the state, see endBlocks().
     void    end(bool didModify = true);
 
+    // Same as end(), but the caller reports which blocks of the state it modified, as a bit
+    // mask interpreted by copyStateBlocks<T>().  Zero means not modified.  A batch of mutations
+    // reported this way and then pushed once only costs a copy of the blocks they modified,
+    // instead of a copy of the whole state.
+    void    endBlocks(uint32_t modifiedBlocks);
+
     // Push a new state, if any, out to the observer via the state queue.
     // For BLOCK_NEVER, returns:
     //      true if not dirty, or dirty and pushed successfully
@@ -196,6 +215,8 @@ private:
     bool              mInMutation;      // whether we're currently in the middle of a mutation
     bool              mIsDirty;         // whether mutating state has been modified since last push
     bool              mIsInitialized;   // whether mutating state has been initialized yet
+    uint32_t          mModifiedBlocks;  // blocks of mutating state modified since last push
+    uint32_t          mPushedBlocks[kN]; // blocks modified by the push of each mStates[i]
 
 #ifdef STATE_QUEUE_DUMP
     StateQueueObserverDump  mObserverDummyDump; // default area for observer dump if not set
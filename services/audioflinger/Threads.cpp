@@ -170,6 +170,22 @@ static const int kPriorityFastMixer = 3;
 // See the client's minBufCount and mNotificationFramesAct calculations for details.
 static const int kFastTrackMultiplier = 2;
 
+// Number of worker threads the normal mixer uses to mix many tracks in parallel,
+// read from property af.mixer.workers.  0 (default) mixes on the MixerThread only.
+// The fast mixer never uses workers.
+static uint32_t getMixerWorkerCount()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.mixer.workers", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0') {
+            return ul;
+        }
+    }
+    return 0;
+}
+
 // ----------------------------------------------------------------------------
 
 #ifdef ADD_BATTERY_DATA
@@ -1713,10 +1729,15 @@ void AudioFlinger::PlaybackThread::readOutputParameters()
     if (!audio_is_output_channel(mChannelMask)) {
         LOG_FATAL("HAL channel mask %#x not valid for output", mChannelMask);
     }
-    if ((mType == MIXER || mType == DUPLICATING) && mChannelMask != AUDIO_CHANNEL_OUT_STEREO) {
-        LOG_FATAL("HAL channel mask %#x not supported for mixed output; "
+    if (mType == DUPLICATING && mChannelMask != AUDIO_CHANNEL_OUT_STEREO) {
+        LOG_FATAL("HAL channel mask %#x not supported for duplicated output; "
                 "must be AUDIO_CHANNEL_OUT_STEREO", mChannelMask);
     }
+    if (mType == MIXER && !AudioMixer::isValidMixerChannelMask(mChannelMask)) {
+        LOG_FATAL("HAL channel mask %#x not supported for mixed output; must include "
+                "AUDIO_CHANNEL_OUT_STEREO, with at most %u channels", mChannelMask,
+                AudioMixer::MAX_NUM_CHANNELS_TO_DOWNMIX);
+    }
     mChannelCount = popcount(mChannelMask);
     mFormat = mOutput->stream->common.get_format(&mOutput->stream->common);
     if (!audio_is_valid_format(mFormat)) {
@@ -1744,7 +1765,8 @@ void AudioFlinger::PlaybackThread::readOutputParameters()
 
     // Calculate size of normal mix buffer relative to the HAL output buffer size
     double multiplier = 1.0;
-    if (mType == MIXER && (kUseFastMixer == FastMixer_Static ||
+    // a multichannel output has no fast mixer, see MixerThread()
+    if (mType == MIXER && mChannelCount == FCC_2 && (kUseFastMixer == FastMixer_Static ||
             kUseFastMixer == FastMixer_Dynamic)) {
         size_t minNormalFrameCount = (kMinNormalMixBufferSizeMs * mSampleRate) / 1000;
         size_t maxNormalFrameCount = (kMaxNormalMixBufferSizeMs * mSampleRate) / 1000;
@@ -1997,7 +2019,7 @@ ssize_t AudioFlinger::PlaybackThread::threadLoop_write()
         }
     // otherwise use the HAL / AudioStreamOut directly
     } else {
-        // Direct output and offload threads
+        // Direct output and offload threads, and multichannel mixer threads
         size_t offset = (mCurrentWriteLength - mBytesRemaining) / sizeof(int16_t);
         if (mUseAsyncWrite) {
             ALOGW_IF(mWriteAckSequence & 1, "threadLoop_write(): out of sequence write request");
@@ -2273,6 +2295,10 @@ bool AudioFlinger::PlaybackThread::threadLoop()
     // So if you need to log when mutex is unlocked, set logString to a non-NULL string,
     // and then that string will be logged at the next convenient opportunity.
     const char *logString = NULL;
+    // Same for typed events
+    bool logWriteBlocked = false;
+    int32_t writeBlockedArgs[2];    // as for NBLog::EVENT_ID_WRITE_BLOCKED
+    struct timespec writeBlockedTs;
 
     checkSilentMode_l();
 
@@ -2293,6 +2319,11 @@ bool AudioFlinger::PlaybackThread::threadLoop()
                 mNBLogWriter->log(logString);
                 logString = NULL;
             }
+            if (logWriteBlocked) {
+                mNBLogWriter->logEvent(NBLog::EVENT_ID_WRITE_BLOCKED, 2, writeBlockedArgs,
+                        &writeBlockedTs);
+                logWriteBlocked = false;
+            }
 
             if (mLatchDValid) {
                 mLatchQ = mLatchD;
@@ -2471,6 +2502,11 @@ if (mType == MIXER) {
                 nsecs_t delta = now - mLastWriteTime;
                 if (!mStandby && delta > maxPeriod) {
                     mNumDelayedWrites++;
+                    writeBlockedArgs[0] = (int32_t) ns2us(delta);
+                    writeBlockedArgs[1] = mNumDelayedWrites;
+                    writeBlockedTs.tv_sec = now / 1000000000;
+                    writeBlockedTs.tv_nsec = now % 1000000000;
+                    logWriteBlocked = true;
                     if ((now - lastWarning) > kWarningThrottleNs) {
                         ATRACE_NAME("underrun");
                         ALOGW("write blocked for %llu msecs, %d delayed writes, thread %p",
@@ -2591,19 +2627,20 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
             mSampleRate, mChannelMask, mChannelCount, mFormat, mFrameSize, mFrameCount,
             mNormalFrameCount);
     mAudioMixer = new AudioMixer(mNormalFrameCount, mSampleRate);
-
-    // FIXME - Current mixer implementation only supports stereo output
-    if (mChannelCount != FCC_2) {
-        ALOGE("Invalid audio hardware channel count %d", mChannelCount);
+    mAudioMixer->setWorkerThreads(getMixerWorkerCount());
+    mAudioMixer->setAdaptiveQuality(true);
+
+    // NBAIO, and so the fast mixer, only handles mono and stereo: a multichannel output is
+    // mixed natively by AudioMixer, see MIXER_CHANNEL_MASK, and written directly to the HAL
+    if (mChannelCount == FCC_2) {
+        // create an NBAIO sink for the HAL output stream, and negotiate
+        mOutputSink = new AudioStreamOutSink(output->stream);
+        size_t numCounterOffers = 0;
+        const NBAIO_Format offers[1] = {Format_from_SR_C(mSampleRate, mChannelCount)};
+        ssize_t index = mOutputSink->negotiate(offers, 1, NULL, numCounterOffers);
+        ALOG_ASSERT(index == 0);
     }
 
-    // create an NBAIO sink for the HAL output stream, and negotiate
-    mOutputSink = new AudioStreamOutSink(output->stream);
-    size_t numCounterOffers = 0;
-    const NBAIO_Format offers[1] = {Format_from_SR_C(mSampleRate, mChannelCount)};
-    ssize_t index = mOutputSink->negotiate(offers, 1, NULL, numCounterOffers);
-    ALOG_ASSERT(index == 0);
-
     // initialize fast mixer depending on configuration
     bool initFastMixer;
     switch (kUseFastMixer) {
@@ -2618,6 +2655,9 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
         initFastMixer = mFrameCount < mNormalFrameCount;
         break;
     }
+    if (mOutputSink == 0) {
+        initFastMixer = false;
+    }
     if (initFastMixer) {
 
         // create a MonoPipe to connect our submix to FastMixer
@@ -2889,7 +2929,7 @@ void AudioFlinger::MixerThread::threadLoop_mix()
 #ifndef ICS_AUDIO_BLOB
     if (mNormalSink != 0) {
         status = mNormalSink->getNextWriteTimestamp(&pts);
-    } else {
+    } else if (mOutputSink != 0) {
         status = mOutputSink->getNextWriteTimestamp(&pts);
     }
 #endif
@@ -2974,7 +3014,7 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
     // prepare a new state to push
     FastMixerStateQueue *sq = NULL;
     FastMixerState *state = NULL;
-    bool didModify = false;
+    uint32_t modifiedBlocks = 0;    // blocks of the FastMixerState modified by this batch
     FastMixerStateQueue::block_t block = FastMixerStateQueue::BLOCK_UNTIL_PUSHED;
     if (mFastMixer != NULL) {
         sq = mFastMixer->sq();
@@ -3113,7 +3153,8 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                     fastTrack->mChannelMask = track->mChannelMask;
                     fastTrack->mGeneration++;
                     state->mTrackMask |= 1 << j;
-                    didModify = true;
+                    modifiedBlocks |= FastMixerState::trackBlock(j) |
+                            FastMixerState::kOtherFieldsBlock;
                     // no acknowledgement required for newly active tracks
                 }
                 // cache the combined master volume and stream type volume for fast mixer; this
@@ -3126,7 +3167,8 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                     fastTrack->mBufferProvider = NULL;
                     fastTrack->mGeneration++;
                     state->mTrackMask &= ~(1 << j);
-                    didModify = true;
+                    modifiedBlocks |= FastMixerState::trackBlock(j) |
+                            FastMixerState::kOtherFieldsBlock;
                     // If any fast tracks were removed, we must wait for acknowledgement
                     // because we're about to decrement the last sp<> on those tracks.
                     block = FastMixerStateQueue::BLOCK_UNTIL_ACKED;
@@ -3305,6 +3347,11 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                 name,
                 AudioMixer::TRACK,
                 AudioMixer::FORMAT, (void *)track->format());
+            // the output mask first, so that the track mask decides on the downmixer only once
+            mAudioMixer->setParameter(
+                name,
+                AudioMixer::TRACK,
+                AudioMixer::MIXER_CHANNEL_MASK, (void *)mChannelMask);
             mAudioMixer->setParameter(
                 name,
                 AudioMixer::TRACK,
@@ -3394,7 +3441,7 @@ track_is_ready: ;
 
     // Push the new FastMixer state if necessary
     bool pauseAudioWatchdog = false;
-    if (didModify) {
+    if (modifiedBlocks != 0) {
         state->mFastTracksGen++;
         // if the fast mixer was active, but now there are no fast tracks, then put it in cold idle
         if (kUseFastMixer == FastMixer_Dynamic &&
@@ -3413,7 +3460,7 @@ track_is_ready: ;
         }
     }
     if (sq != NULL) {
-        sq->end(didModify);
+        sq->endBlocks(modifiedBlocks);
         sq->push(block);
     }
 #ifdef AUDIO_WATCHDOG
@@ -3459,7 +3506,7 @@ track_is_ready: ;
 // getTrackName_l() must be called with ThreadBase::mLock held
 int AudioFlinger::MixerThread::getTrackName_l(audio_channel_mask_t channelMask, int sessionId)
 {
-    return mAudioMixer->getTrackName(channelMask, sessionId);
+    return mAudioMixer->getTrackName(channelMask, sessionId, mChannelMask);
 }
 
 // deleteTrackName_l() must be called with ThreadBase::mLock held
@@ -3509,7 +3556,8 @@ bool AudioFlinger::MixerThread::checkForNewParameters_l()
             }
         }
         if (param.getInt(String8(AudioParameter::keyChannels), value) == NO_ERROR) {
-            if ((audio_channel_mask_t) value != AUDIO_CHANNEL_OUT_STEREO) {
+            // the NBAIO sinks are set up for the channel mask the output was opened with
+            if ((audio_channel_mask_t) value != mChannelMask) {
                 status = BAD_VALUE;
             } else {
                 reconfig = true;
@@ -3573,6 +3621,8 @@ bool AudioFlinger::MixerThread::checkForNewParameters_l()
                 readOutputParameters();
                 delete mAudioMixer;
                 mAudioMixer = new AudioMixer(mNormalFrameCount, mSampleRate);
+                mAudioMixer->setWorkerThreads(getMixerWorkerCount());
+                mAudioMixer->setAdaptiveQuality(true);
                 for (size_t i = 0; i < mTracks.size() ; i++) {
                     int name = getTrackName_l(mTracks[i]->mChannelMask, mTracks[i]->mSessionId);
                     if (name < 0) {
@@ -3622,6 +3672,13 @@ void AudioFlinger::MixerThread::dumpInternals(int fd, const Vector<String16>& ar
     // Make a non-atomic copy of fast mixer dump state so it won't change underneath us
     const FastMixerDumpState copy(mFastMixerDumpState);
     copy.dump(fd);
+    // "dumpsys media.audio_flinger --json" adds the fast mixer statistics as JSON
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == String16("--json")) {
+            copy.dumpJson(fd, mId);
+            break;
+        }
+    }
 
 #ifdef STATE_QUEUE_DUMP
     // Similar for state queue
@@ -4551,6 +4608,7 @@ AudioFlinger::RecordThread::RecordThread(const sp<AudioFlinger>& audioFlinger,
 #endif
 {
     snprintf(mName, kNameLength, "AudioIn_%X", id);
+    mNBLogWriter = audioFlinger->newWriter_l(kLogSize, mName);
 
     // initilize to clean sync event
     clearSyncStartEvent();
@@ -4561,6 +4619,10 @@ AudioFlinger::RecordThread::RecordThread(const sp<AudioFlinger>& audioFlinger,
 
 AudioFlinger::RecordThread::~RecordThread()
 {
+    mAudioFlinger->unregisterWriter(mNBLogWriter);
+    // the readers must be deleted before their pipe
+    mFanOutTracks.clear();
+    mFanOutPipe.clear();
     delete[] mRsmpInBuffer;
     delete mResampler;
     delete[] mRsmpOutBuffer;
@@ -4583,6 +4645,7 @@ bool AudioFlinger::RecordThread::threadLoop()
     AudioBufferProvider::Buffer buffer;
     sp<RecordTrack> activeTrack;
     Vector< sp<EffectChain> > effectChains;
+    KeyedVector< sp<RecordTrack>, sp<PipeReader> > fanOutTracks;
 
     nsecs_t lastWarning = 0;
 
@@ -4600,6 +4663,10 @@ bool AudioFlinger::RecordThread::threadLoop()
     // used to verify we've read at least once before evaluating how many bytes were read
     bool readOnce = false;
 
+    // mNBLogWriter can only be used while mLock is held, so these are logged at the next cycle
+    int32_t overflows = 0;          // number of buffer overflow retries since last logged
+    status_t readError = NO_ERROR;  // most recent read() error since last logged
+
     // start recording
     while (!exitPending()) {
 
@@ -4607,6 +4674,14 @@ bool AudioFlinger::RecordThread::threadLoop()
 
         { // scope for mLock
             Mutex::Autolock _l(mLock);
+            if (overflows > 0) {
+                mNBLogWriter->logEvent(NBLog::EVENT_ID_RECORD_OVERFLOW, overflows);
+                overflows = 0;
+            }
+            if (readError != NO_ERROR) {
+                mNBLogWriter->logEvent(NBLog::EVENT_ID_RECORD_READ_ERROR, readError);
+                readError = NO_ERROR;
+            }
             checkForNewParameters_l();
             if (mActiveTrack != 0 && activeTrack != mActiveTrack) {
                 SortedVector<int> tmp;
@@ -4634,7 +4709,9 @@ bool AudioFlinger::RecordThread::threadLoop()
                     removeTrack_l(mActiveTrack);
                     mActiveTrack.clear();
                 } else if (mActiveTrack->mState == TrackBase::PAUSING) {
-                    standby();
+                    if (mFanOutTracks.isEmpty()) {
+                        standby();
+                    }
                     mActiveTrack.clear();
                     mStartStopCond.broadcast();
                 } else if (mActiveTrack->mState == TrackBase::RESUMING) {
@@ -4654,6 +4731,18 @@ bool AudioFlinger::RecordThread::threadLoop()
                     mStandby = false;
                 }
             }
+            for (size_t i = mFanOutTracks.size(); i > 0; ) {
+                sp<RecordTrack> track = mFanOutTracks.keyAt(--i);
+                if (track->isTerminated()) {
+                    removeTrack_l(track);
+                    mFanOutTracks.removeItemsAt(i);
+                } else if (track->mState == TrackBase::PAUSING) {
+                    mFanOutTracks.removeItemsAt(i);
+                    mStartStopCond.broadcast();
+                }
+            }
+            promoteFanOutTrack_l();
+            fanOutTracks = mFanOutTracks;
 
             lockEffectChains_l(effectChains);
         }
@@ -4748,6 +4837,7 @@ bool AudioFlinger::RecordThread::threadLoop()
                                 if ((mBytesRead < 0) && (mActiveTrack->mState == TrackBase::ACTIVE))
                                 {
                                     ALOGE("Error reading audio input");
+                                    readError = (status_t) mBytesRead;
                                     // Force input into standby so that it tries to
                                     // recover at next read attempt
                                     inputStandBy();
@@ -4792,6 +4882,9 @@ bool AudioFlinger::RecordThread::threadLoop()
 
                 }
                 if (mFramestoDrop == 0) {
+                    if (!fanOutTracks.isEmpty() && buffer.frameCount > 0) {
+                        (void) mFanOutPipe->write(buffer.raw, buffer.frameCount);
+                    }
                     mActiveTrack->releaseBuffer(&buffer);
                 } else {
                     if (mFramestoDrop > 0) {
@@ -4815,6 +4908,7 @@ bool AudioFlinger::RecordThread::threadLoop()
             }
             // client isn't retrieving buffers fast enough
             else {
+                overflows++;
                 if (!mActiveTrack->setOverflow()) {
                     nsecs_t now = systemTime();
                     if ((now - lastWarning) > kWarningThrottleNs) {
@@ -4827,10 +4921,16 @@ bool AudioFlinger::RecordThread::threadLoop()
                 // clear the overflow.
                 usleep(kRecordThreadSleepUs);
             }
+            for (size_t i = 0; i < fanOutTracks.size(); i++) {
+                if (!readFanOutTrack(fanOutTracks.keyAt(i), fanOutTracks.valueAt(i))) {
+                    overflows++;
+                }
+            }
         }
         // enable changes in effect chain
         unlockEffectChains(effectChains);
         effectChains.clear();
+        fanOutTracks.clear();
     }
 
     standby();
@@ -4842,6 +4942,7 @@ bool AudioFlinger::RecordThread::threadLoop()
             track->invalidate();
         }
         mActiveTrack.clear();
+        mFanOutTracks.clear();
         mStartStopCond.broadcast();
     }
 
@@ -5014,7 +5115,7 @@ status_t AudioFlinger::RecordThread::start(RecordThread::RecordTrack* recordTrac
         AutoMutex lock(mLock);
         if (mActiveTrack != 0) {
             if (recordTrack != mActiveTrack.get()) {
-                status = -EBUSY;
+                status = startFanOutTrack_l(recordTrack, event);
             } else if (mActiveTrack->mState == TrackBase::PAUSING) {
                 mActiveTrack->mState = TrackBase::ACTIVE;
             }
@@ -5071,6 +5172,93 @@ void AudioFlinger::RecordThread::clearSyncStartEvent()
     mFramestoDrop = 0;
 }
 
+// A track started while mActiveTrack is capturing can share its frames if it wants the
+// same format, instead of failing with -EBUSY.  The input is already started for mActiveTrack,
+// so there is nothing to wait for.
+status_t AudioFlinger::RecordThread::startFanOutTrack_l(RecordThread::RecordTrack* recordTrack,
+                                                        AudioSystem::sync_event_t event)
+{
+    if (mFanOutTracks.indexOfKey(recordTrack) >= 0) {
+        // restarted before threadLoop() noticed the stop
+        if (recordTrack->mState == TrackBase::PAUSING) {
+            recordTrack->mState = TrackBase::ACTIVE;
+        }
+        return NO_ERROR;
+    }
+    if (mFanOutPipe == 0 || event != AudioSystem::SYNC_EVENT_NONE ||
+            recordTrack->format() != AUDIO_FORMAT_PCM_16_BIT ||
+            recordTrack->sampleRate() != mReqSampleRate ||
+            recordTrack->channelCount() != mReqChannelCount) {
+        return -EBUSY;
+    }
+    mFanOutTracks.add(recordTrack, newFanOutReader_l());
+    recordTrack->mState = TrackBase::ACTIVE;
+    ALOGV("RecordThread::start fan-out track %p, %u fan-out tracks", recordTrack,
+            mFanOutTracks.size());
+    return NO_ERROR;
+}
+
+void AudioFlinger::RecordThread::promoteFanOutTrack_l()
+{
+    if (mActiveTrack == 0 && !mFanOutTracks.isEmpty()) {
+        // frames still in the pipe for this track are lost
+        mActiveTrack = mFanOutTracks.keyAt(0);
+        mFanOutTracks.removeItemsAt(0);
+    }
+}
+
+sp<PipeReader> AudioFlinger::RecordThread::newFanOutReader_l()
+{
+    sp<PipeReader> reader = new PipeReader(*mFanOutPipe);
+    size_t numCounterOffers = 0;
+    const NBAIO_Format offers[1] = {mFanOutPipe->format()};
+    ssize_t index = reader->negotiate(offers, 1, NULL, numCounterOffers);
+    ALOG_ASSERT(index == 0);
+    return reader;
+}
+
+bool AudioFlinger::RecordThread::readFanOutTrack(const sp<RecordTrack>& track,
+                                                 const sp<PipeReader>& reader)
+{
+    if (track->mState != TrackBase::ACTIVE) {
+        return true;
+    }
+    bool overflow = false;
+    for (;;) {
+        ssize_t avail = reader->availableToRead();
+        if (avail == OVERRUN) {
+            // the client did not keep up and the pipe dropped the oldest frames
+            overflow = true;
+            continue;
+        }
+        if (avail <= 0) {
+            break;
+        }
+        AudioBufferProvider::Buffer buffer;
+        buffer.frameCount = avail;
+        if (track->getNextBuffer(&buffer) != NO_ERROR) {
+            // the frames stay in the pipe until the client catches up or the pipe overruns
+            overflow = true;
+            break;
+        }
+        ssize_t framesRead = reader->read(buffer.raw, buffer.frameCount,
+                AudioBufferProvider::kInvalidPTS);
+        buffer.frameCount = framesRead > 0 ? framesRead : 0;
+        track->releaseBuffer(&buffer);
+        if (framesRead <= 0) {
+            break;
+        }
+    }
+    if (overflow) {
+        if (!track->setOverflow()) {
+            ALOGW("RecordThread: fan-out buffer overflow, session %d", track->sessionId());
+        }
+    } else {
+        track->clearOverflow();
+    }
+    return !overflow;
+}
+
 void AudioFlinger::RecordThread::syncStartEventCallback(const wp<SyncEvent>& event)
 {
     sp<SyncEvent> strongEvent = event.promote();
@@ -5093,6 +5281,17 @@ void AudioFlinger::RecordThread::handleSyncStartEvent(const sp<SyncEvent>& event
 bool AudioFlinger::RecordThread::stop(RecordThread::RecordTrack* recordTrack) {
     ALOGV("RecordThread::stop");
     AutoMutex _l(mLock);
+    if (mFanOutTracks.indexOfKey(recordTrack) >= 0) {
+        // the input keeps running for mActiveTrack, so the caller must not stop it
+        if (recordTrack->mState != TrackBase::PAUSING) {
+            recordTrack->mState = TrackBase::PAUSING;
+            while (!exitPending() && recordTrack->mState == TrackBase::PAUSING &&
+                    mFanOutTracks.indexOfKey(recordTrack) >= 0) {
+                mStartStopCond.wait(mLock);
+            }
+        }
+        return false;
+    }
     if (recordTrack != mActiveTrack.get() || recordTrack->mState == TrackBase::PAUSING) {
         return false;
     }
@@ -5101,12 +5300,36 @@ bool AudioFlinger::RecordThread::stop(RecordThread::RecordTrack* recordTrack) {
     if (exitPending()) {
         return true;
     }
-    mStartStopCond.wait(mLock);
+    // mStartStopCond is also broadcast for fan-out tracks
+    do {
+        mStartStopCond.wait(mLock);
+    } while (!exitPending() && recordTrack == mActiveTrack.get() &&
+            recordTrack->mState == TrackBase::PAUSING);
     // if we have been restarted, recordTrack == mActiveTrack.get() here
     if (exitPending() || recordTrack != mActiveTrack.get()) {
         ALOGV("Record stopped OK");
+        // unless a fan-out track has taken over the input
+        return exitPending() || mActiveTrack == 0;
+    }
+    return false;
+}
+
+// A destroyed track stays in mActiveTrack or mFanOutTracks until threadLoop() removes it, but
+// no longer holds the input.  Neither does a fan-out track being stopped, whereas the active
+// track being stopped does until its stop() returns, and then stops the input itself.
+bool AudioFlinger::RecordThread::hasOtherActiveTracks_l(RecordThread::RecordTrack* recordTrack)
+        const
+{
+    if (mActiveTrack != 0 && mActiveTrack.get() != recordTrack && !mActiveTrack->isTerminated()) {
         return true;
     }
+    for (size_t i = 0; i < mFanOutTracks.size(); ++i) {
+        const sp<RecordTrack>& track = mFanOutTracks.keyAt(i);
+        if (track.get() != recordTrack && !track->isTerminated() &&
+                track->mState != TrackBase::PAUSING) {
+            return true;
+        }
+    }
     return false;
 }
 
@@ -5146,7 +5369,7 @@ void AudioFlinger::RecordThread::destroyTrack_l(const sp<RecordTrack>& track)
     track->terminate();
     track->mState = TrackBase::STOPPED;
     // active tracks are removed by threadLoop()
-    if (mActiveTrack != track) {
+    if (mActiveTrack != track && mFanOutTracks.indexOfKey(track) < 0) {
         removeTrack_l(track);
     }
 }
@@ -5184,6 +5407,8 @@ void AudioFlinger::RecordThread::dumpInternals(int fd, const Vector<String16>& a
         result.append(buffer);
         snprintf(buffer, SIZE, "Out sample rate: %u\n", mReqSampleRate);
         result.append(buffer);
+        snprintf(buffer, SIZE, "Fan-out clients: %u\n", mFanOutTracks.size());
+        result.append(buffer);
     } else {
         result.append("No active record client\n");
     }
@@ -5216,6 +5441,10 @@ void AudioFlinger::RecordThread::dumpTracks(int fd, const Vector<String16>& args
         RecordTrack::appendDumpHeader(result);
         mActiveTrack->dump(buffer, SIZE);
         result.append(buffer);
+        for (size_t i = 0; i < mFanOutTracks.size(); ++i) {
+            mFanOutTracks.keyAt(i)->dump(buffer, SIZE);
+            result.append(buffer);
+        }
 
     }
     write(fd, result.string(), result.size());
@@ -5424,6 +5653,11 @@ void AudioFlinger::RecordThread::audioConfigChanged_l(int event, int param) {
 
 void AudioFlinger::RecordThread::readInputParameters()
 {
+    // the fan-out readers must be deleted before their pipe, and are re-created below
+    for (size_t i = 0; i < mFanOutTracks.size(); i++) {
+        mFanOutTracks.replaceValueAt(i, 0);
+    }
+    mFanOutPipe.clear();
     delete[] mRsmpInBuffer;
     // mRsmpInBuffer is always assigned a new[] below
     delete[] mRsmpOutBuffer;
@@ -5474,6 +5708,28 @@ void AudioFlinger::RecordThread::readInputParameters()
 
     }
     mRsmpInIndex = mFrameCount;
+
+    // The fan-out pipe holds the frames delivered to the active track, in its format.
+    // A few periods allow the other clients to read a little late without losing data.
+    NBAIO_Format format = mFormat == AUDIO_FORMAT_PCM_16_BIT ?
+            Format_from_SR_C(mReqSampleRate, mReqChannelCount) : Format_Invalid;
+    if (format != Format_Invalid) {
+        mFanOutPipe = new Pipe(mFrameCount * 8, format);
+        size_t numCounterOffers = 0;
+        const NBAIO_Format offers[1] = {format};
+        ssize_t index = mFanOutPipe->negotiate(offers, 1, NULL, numCounterOffers);
+        ALOG_ASSERT(index == 0);
+    }
+    for (size_t i = mFanOutTracks.size(); i > 0; ) {
+        --i;
+        if (mFanOutPipe != 0) {
+            mFanOutTracks.replaceValueAt(i, newFanOutReader_l());
+        } else {
+            // the client will re-create its track
+            mFanOutTracks.keyAt(i)->invalidate();
+            mFanOutTracks.removeItemsAt(i);
+        }
+    }
 }
 
 unsigned int AudioFlinger::RecordThread::getInputFramesLost()
@@ -616,7 +616,8 @@ private:
     sp<AsyncCallbackThread>         mCallbackThread;
 
 private:
-    // The HAL output sink is treated as non-blocking, but current implementation is blocking
+    // The HAL output sink is treated as non-blocking, but current implementation is blocking.
+    // Clear for a multichannel output, which the normal mixer writes directly to the HAL.
     sp<NBAIO_Sink>          mOutputSink;
     // If a fast mixer is present, the blocking pipe sink, otherwise clear
     sp<NBAIO_Sink>          mPipeSink;
@@ -902,6 +903,9 @@ public:
             // return true if the caller should then do it's part of the stopping process
             bool        stop(RecordTrack* recordTrack);
 
+            // return true if a track other than the specified one still holds the started input
+            bool        hasOtherActiveTracks_l(RecordTrack* recordTrack) const;
+
             void        dump(int fd, const Vector<String16>& args);
             AudioStreamIn* clearInput();
             virtual audio_stream_t* stream() const;
@@ -937,6 +941,16 @@ public:
 private:
             void clearSyncStartEvent();
 
+            // Start a track while mActiveTrack is capturing, see mFanOutTracks
+            status_t startFanOutTrack_l(RecordTrack* recordTrack,
+                                        AudioSystem::sync_event_t event);
+            // Make the first fan-out track the active track if there is none
+            void promoteFanOutTrack_l();
+            sp<PipeReader> newFanOutReader_l();
+            // Copy the frames written to mFanOutPipe since the last call to a fan-out track,
+            // and return false if they did not all fit in its buffer
+            bool readFanOutTrack(const sp<RecordTrack>& track, const sp<PipeReader>& reader);
+
             // Enter standby if not already in standby, and set mStandby flag
             void standby();
 
@@ -970,4 +984,13 @@ private:
 
             // For dumpsys
             const sp<NBAIO_Sink>                mTeeSink;
+
+            // Tracks started while mActiveTrack was capturing, in the same format.  The frames
+            // delivered to mActiveTrack are also written to mFanOutPipe, and each of these
+            // tracks reads them back through its own PipeReader, so that the input is read and
+            // converted once for all of them.  Modified with mLock held; the readers are only
+            // used by threadLoop().
+            KeyedVector< sp<RecordTrack>, sp<PipeReader> >  mFanOutTracks;
+            // 0 if the HAL format can not be shared; updated by readInputParameters()
+            sp<Pipe>                            mFanOutPipe;
 };
@@ -494,7 +494,7 @@ void AudioFlinger::PlaybackThread::Track::destroy()
 /*static*/ void AudioFlinger::PlaybackThread::Track::appendDumpHeader(String8& result)
 {
     result.append("   Name Client Type      Fmt Chn mask Session fCount S F SRate  "
-                  "L dB  R dB    Server Main buf  Aux Buf Flags UndFrmCnt\n");
+                  "L dB  R dB    Server Main buf  Aux Buf Flags UndFrmCnt Wake/s Coalesced\n");
 }
 
 void AudioFlinger::PlaybackThread::Track::dump(char* buffer, size_t size)
@@ -559,7 +559,7 @@ void AudioFlinger::PlaybackThread::Track::dump(char* buffer, size_t size)
         break;
     }
     snprintf(&buffer[7], size-7, " %6u %4u %08X %08X %7u %6u %1c %1d %5u %5.2g %5.2g  "
-                                 "%08X %08X %08X 0x%03X %9u%c\n",
+                                 "%08X %08X %08X 0x%03X %9u%c %6.1f %9u\n",
             (mClient == 0) ? getpid_cached : mClient->pid(),
             mStreamType,
             mFormat,
@@ -576,7 +576,9 @@ void AudioFlinger::PlaybackThread::Track::dump(char* buffer, size_t size)
             (int)mAuxBuffer,
             mCblk->mFlags,
             mAudioTrackServerProxy->getUnderrunFrames(),
-            nowInUnderrun);
+            nowInUnderrun,
+            mServerProxy->getWakeupsPerSecond(),
+            mServerProxy->getCoalescedWakeups());
 }
 
 uint32_t AudioFlinger::PlaybackThread::Track::sampleRate() const {
@@ -1903,13 +1905,22 @@ void AudioFlinger::RecordThread::RecordTrack::destroy()
     {
         sp<ThreadBase> thread = mThread.promote();
         if (thread != 0) {
-            if (mState == ACTIVE || mState == RESUMING) {
+            RecordThread *recordThread = (RecordThread *) thread.get();
+            bool stopInput;
+            {
+                Mutex::Autolock _l(thread->mLock);
+                // The input keeps running while it is shared with another track.  The check
+                // and the removal are atomic, so that of two tracks destroyed at the same time
+                // the second one sees the first as gone and stops the input.
+                stopInput = (mState == ACTIVE || mState == RESUMING) &&
+                        !recordThread->hasOtherActiveTracks_l(this);
+                recordThread->destroyTrack_l(this);
+            }
+            // AudioSystem calls must not be made with the thread lock held
+            if (stopInput) {
                 AudioSystem::stopInput(thread->id());
             }
             AudioSystem::releaseInput(thread->id());
-            Mutex::Autolock _l(thread->mLock);
-            RecordThread *recordThread = (RecordThread *) thread.get();
-            recordThread->destroyTrack_l(this);
         }
     }
 }
@@ -1927,19 +1938,21 @@ void AudioFlinger::RecordThread::RecordTrack::invalidate()
 
 /*static*/ void AudioFlinger::RecordThread::RecordTrack::appendDumpHeader(String8& result)
 {
-    result.append("Client Fmt Chn mask Session S   Server fCount\n");
+    result.append("Client Fmt Chn mask Session S   Server fCount Wake/s Coalesced\n");
 }
 
 void AudioFlinger::RecordThread::RecordTrack::dump(char* buffer, size_t size)
 {
-    snprintf(buffer, size, "%6u %3u %08X %7u %1d %08X %6u\n",
+    snprintf(buffer, size, "%6u %3u %08X %7u %1d %08X %6u %6.1f %9u\n",
             (mClient == 0) ? getpid_cached : mClient->pid(),
             mFormat,
             mChannelMask,
             mSessionId,
             mState,
             mCblk->mServer,
-            mFrameCount);
+            mFrameCount,
+            mServerProxy->getWakeupsPerSecond(),
+            mServerProxy->getCoalescedWakeups());
 }
 
 }; // namespace android
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Device harness for the fast mixer: runs the FastMixer thread, and so AudioMixer and
+// AudioResampler, on fast tracks read from sound files, and writes the mix to a sound file
+// instead of a HAL.  It reports the CPU cost of each mix cycle, and a checksum of the output
+// that only depends on the inputs and the mixer, for comparing builds bit-exactly.  It needs
+// no HAL or audioflinger, but it is a device executable, as the mixer's libraries are.
+
+#include "Configuration.h"
+#include <media/nbaio/LibsndfileSink.h>
+#include <media/nbaio/LibsndfileSource.h>
+#include <media/nbaio/SourceAudioBufferProvider.h>
+#include <cpustats/ThreadCpuUsage.h>
+#include <utils/threads.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "AudioResampler.h"
+#include "FastMixer.h"
+
+using namespace android;
+
+static int usage(const char* name) {
+    fprintf(stderr,"Usage: %s [-f frame-count] [-r sample-rate] [-n buffers] [-o output-file] "
+                   "input-file ...\n", name);
+    fprintf(stderr,"    -f    fast mixer frame count (default 256)\n");
+    fprintf(stderr,"    -r    mixer sample rate (default 48000)\n");
+    fprintf(stderr,"    -n    number of buffers to mix (default 1000)\n");
+    fprintf(stderr,"    -o    write the mix to this 16-bit stereo WAV file\n");
+    fprintf(stderr,"    Each input file is a mono or stereo fast track, looped as needed, up to %u.\n",
+            FastMixerState::kMaxFastTracks);
+    return -1;
+}
+
+// Stands in for the HAL output.  Called on the fast mixer thread, it measures the CPU time of
+// each cycle, checksums and saves the mix, and tells the main thread when enough buffers have
+// been mixed.  The fast mixer writes silence until it is warm, without pulling from the tracks;
+// those buffers depend on timing, so they are skipped.
+class BenchmarkSink : public NBAIO_Sink {
+public:
+    BenchmarkSink(uint32_t sampleRate, size_t numBuffers, LibsndfileSink* fileSink,
+            SourceAudioBufferProvider* const* providers, size_t numProviders)
+        : NBAIO_Sink(Format_from_SR_C(sampleRate, 2)), mNumBuffers(numBuffers),
+          mFileSink(fileSink), mProviders(providers), mNumProviders(numProviders),
+          mBuffers(0), mChecksum(2166136261u), mTotalNs(0), mMinNs(0), mMaxNs(0), mCpukHz(0),
+          mDone(false) { }
+
+    virtual ssize_t write(const void *buffer, size_t count) {
+        if (!mNegotiated) {
+            return (ssize_t) NEGOTIATE;
+        }
+        double ns;
+        const bool measured = mCpuUsage.sampleAndEnable(ns);
+        if (mBuffers >= mNumBuffers || !mixing()) {
+            return count;
+        }
+        // the first mixed cycle includes the creation of the mixer and is not representative
+        if (measured && mBuffers > 0) {
+            mTotalNs += ns;
+            if (mBuffers == 1 || ns < mMinNs) {
+                mMinNs = ns;
+            }
+            if (ns > mMaxNs) {
+                mMaxNs = ns;
+            }
+        }
+        if (mCpukHz == 0) {
+            mCpukHz = mCpuUsage.getCpukHz(sched_getcpu());
+        }
+        // FNV-1a over the 16-bit samples
+        const int16_t* samples = (const int16_t*) buffer;
+        for (size_t i = 0; i < count * 2; i++) {
+            mChecksum = (mChecksum ^ (uint16_t) samples[i]) * 16777619u;
+        }
+        if (mFileSink != NULL) {
+            (void) mFileSink->write(buffer, count);
+        }
+        mFramesWritten += count;
+        if (++mBuffers == mNumBuffers) {
+            Mutex::Autolock _l(mLock);
+            mDone = true;
+            mCond.signal();
+        }
+        return count;
+    }
+
+    void waitUntilDone() {
+        Mutex::Autolock _l(mLock);
+        while (!mDone) {
+            mCond.wait(mLock);
+        }
+    }
+
+    uint32_t checksum() const { return mChecksum; }
+    double meanNs() const { return mBuffers > 1 ? mTotalNs / (mBuffers - 1) : 0; }
+    double minNs() const { return mMinNs; }
+    double maxNs() const { return mMaxNs; }
+    uint32_t cpukHz() const { return mCpukHz; }
+
+private:
+    bool mixing() const {
+        for (size_t i = 0; i < mNumProviders; i++) {
+            if (mProviders[i]->framesReleased() > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const size_t mNumBuffers;
+    LibsndfileSink* const mFileSink;
+    SourceAudioBufferProvider* const* const mProviders;
+    const size_t mNumProviders;
+
+    // only used on the fast mixer thread until mDone is set
+    size_t mBuffers;
+    uint32_t mChecksum;
+    ThreadCpuUsage mCpuUsage;
+    double mTotalNs;
+    double mMinNs;
+    double mMaxNs;
+    uint32_t mCpukHz;
+
+    Mutex mLock;
+    Condition mCond;
+    bool mDone;
+};
+
+int main(int argc, char* argv[]) {
+
+    const char* const progname = argv[0];
+    size_t frameCount = 256;
+    uint32_t sampleRate = 48000;
+    size_t numBuffers = 1000;
+    const char* outputFile = NULL;
+
+    int ch;
+    while ((ch = getopt(argc, argv, "f:r:n:o:")) != -1) {
+        switch (ch) {
+        case 'f':
+            frameCount = atoi(optarg);
+            break;
+        case 'r':
+            sampleRate = atoi(optarg);
+            break;
+        case 'n':
+            numBuffers = atoi(optarg);
+            break;
+        case 'o':
+            outputFile = optarg;
+            break;
+        case '?':
+        default:
+            usage(progname);
+            return -1;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc < 1 || argc > (int) FastMixerState::kMaxFastTracks || frameCount == 0 ||
+            numBuffers == 0 || Format_from_SR_C(sampleRate, 2) == Format_Invalid) {
+        usage(progname);
+        return -1;
+    }
+
+    // the resampler quality must not depend on the load of the machine
+    AudioResampler::setAdaptive(false);
+
+    // ----------------------------------------------------------
+
+    SNDFILE* inputs[FastMixerState::kMaxFastTracks];
+    SourceAudioBufferProvider* providers[FastMixerState::kMaxFastTracks];
+    SF_INFO infos[FastMixerState::kMaxFastTracks];
+    for (int i = 0; i < argc; i++) {
+        memset(&infos[i], 0, sizeof(infos[i]));
+        inputs[i] = sf_open(argv[i], SFM_READ, &infos[i]);
+        if (inputs[i] == NULL) {
+            fprintf(stderr, "%s: %s\n", argv[i], sf_strerror(NULL));
+            return -1;
+        }
+        if (infos[i].channels != 1 && infos[i].channels != 2) {
+            fprintf(stderr, "%s: %d channels not supported\n", argv[i], infos[i].channels);
+            return -1;
+        }
+        sp<LibsndfileSource> source = new LibsndfileSource(inputs[i], infos[i], true /*loop*/);
+        NBAIO_Format offers[1] = {source->format()};
+        size_t numCounterOffers = 0;
+        if (source->format() == Format_Invalid ||
+                source->negotiate(offers, 1, NULL, numCounterOffers) != 0) {
+            fprintf(stderr, "%s: %d Hz not supported\n", argv[i], infos[i].samplerate);
+            return -1;
+        }
+        providers[i] = new SourceAudioBufferProvider(source);
+    }
+
+    SNDFILE* output = NULL;
+    LibsndfileSink* fileSink = NULL;
+    if (outputFile != NULL) {
+        SF_INFO info;
+        memset(&info, 0, sizeof(info));
+        info.samplerate = sampleRate;
+        info.channels = 2;
+        info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+        output = sf_open(outputFile, SFM_WRITE, &info);
+        if (output == NULL) {
+            fprintf(stderr, "%s: %s\n", outputFile, sf_strerror(NULL));
+            return -1;
+        }
+        fileSink = new LibsndfileSink(output, info);
+    }
+
+    sp<BenchmarkSink> sink = new BenchmarkSink(sampleRate, numBuffers, fileSink, providers, argc);
+    NBAIO_Format offers[1] = {sink->format()};
+    size_t numCounterOffers = 0;
+    (void) sink->negotiate(offers, 1, NULL, numCounterOffers);
+    if (fileSink != NULL) {
+        (void) fileSink->negotiate(offers, 1, NULL, numCounterOffers);
+    }
+
+    // ----------------------------------------------------------
+
+    // configure the fast mixer as MixerThread does, but with all tracks from the start
+    FastMixerDumpState* dumpState = new FastMixerDumpState();
+    sp<FastMixer> fastMixer = new FastMixer();
+    FastMixerStateQueue* sq = fastMixer->sq();
+    FastMixerState* state = sq->begin();
+    for (int i = 0; i < argc; i++) {
+        FastTrack* fastTrack = &state->mFastTracks[i];
+        fastTrack->mBufferProvider = providers[i];
+        fastTrack->mVolumeProvider = NULL;
+        fastTrack->mSampleRate = infos[i].samplerate;
+        fastTrack->mChannelMask = infos[i].channels == 1 ?
+                AUDIO_CHANNEL_OUT_MONO : AUDIO_CHANNEL_OUT_STEREO;
+        fastTrack->mGeneration++;
+        state->mTrackMask |= 1 << i;
+    }
+    state->mFastTracksGen++;
+    state->mOutputSink = sink.get();
+    state->mOutputSinkGen++;
+    state->mFrameCount = frameCount;
+    state->mCommand = FastMixerState::MIX_WRITE;
+    state->mDumpState = dumpState;
+    sq->end();
+    sq->push(FastMixerStateQueue::BLOCK_UNTIL_PUSHED);
+    fastMixer->run("FastMixer", PRIORITY_URGENT_AUDIO);
+
+    sink->waitUntilDone();
+
+    state = sq->begin();
+    state->mCommand = FastMixerState::EXIT;
+    sq->end();
+    sq->push(FastMixerStateQueue::BLOCK_UNTIL_PUSHED);
+    fastMixer->join();
+
+    // ----------------------------------------------------------
+
+    printf("%d tracks, %u Hz, %zu frames, %zu buffers\n", argc, sampleRate, frameCount,
+            numBuffers);
+    printf("CPU per buffer: mean %.0f ns, min %.0f ns, max %.0f ns\n",
+            sink->meanNs(), sink->minNs(), sink->maxNs());
+    const uint32_t kHz = sink->cpukHz();
+    if (kHz != 0 && kHz != (uint32_t) ~0) {
+        // kHz * ns / 1e6 = cycles
+        printf("cycles per buffer: %.0f, per frame: %.2f (at %u kHz)\n",
+                sink->meanNs() * kHz / 1e6, sink->meanNs() * kHz / 1e6 / frameCount, kHz);
+    } else {
+        printf("CPU frequency unknown, cycles not reported\n");
+    }
+    printf("underruns %u, overruns %u\n", dumpState->mUnderruns, dumpState->mOverruns);
+    printf("checksum %08x\n", sink->checksum());
+
+    if (output != NULL) {
+        sf_close(output);
+        delete fileSink;
+    }
+    for (int i = 0; i < argc; i++) {
+        delete providers[i];
+        sf_close(inputs[i]);
+    }
+    delete dumpState;
+    return 0;
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Micro-benchmark for AudioMixer::process(), reporting the CPU cost per track per buffer.
+
+#include "AudioMixer.h"
+#include "test-utils.h"
+#include <media/AudioBufferProvider.h>
+#include <cpustats/ThreadCpuUsage.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <math.h>
+
+using namespace android;
+
+static int usage(const char* name) {
+    fprintf(stderr,"Usage: %s [-t tracks] [-f frame-count] [-o output-sample-rate] "
+                   "[-i input-sample-rate] [-n buffers] [-w workers] [-m] [-r] [-a] [-c]\n", name);
+    fprintf(stderr,"    -t    number of tracks (default 8)\n");
+    fprintf(stderr,"    -f    mixer frame count (default 960)\n");
+    fprintf(stderr,"    -o    mixer sample rate (default 48000)\n");
+    fprintf(stderr,"    -i    track sample rate (default output sample rate)\n");
+    fprintf(stderr,"    -n    number of buffers to mix (default 1000)\n");
+    fprintf(stderr,"    -w    number of mixer worker threads (default 0)\n");
+    fprintf(stderr,"    -m    mono tracks\n");
+    fprintf(stderr,"    -r    ramp volume on every buffer\n");
+    fprintf(stderr,"    -a    send to an aux buffer\n");
+    fprintf(stderr,"    -c    check the channel remapping of multichannel outputs, and exit\n");
+    return -1;
+}
+
+// Serves frames whose channel c is the constant 1000 * (c + 1)
+class ChannelIndexProvider : public AudioBufferProvider {
+public:
+    ChannelIndexProvider(uint32_t channels, size_t frameCount) {
+        mData = new int16_t[frameCount * channels];
+        mFrameCount = frameCount;
+        for (size_t i = 0; i < frameCount; i++) {
+            for (uint32_t c = 0; c < channels; c++) {
+                mData[i * channels + c] = 1000 * (c + 1);
+            }
+        }
+    }
+    virtual ~ChannelIndexProvider() {
+        delete [] mData;
+    }
+    virtual status_t getNextBuffer(Buffer* buffer, int64_t pts = kInvalidPTS) {
+        if (buffer->frameCount > mFrameCount) {
+            buffer->frameCount = mFrameCount;
+        }
+        buffer->i16 = mData;
+        return NO_ERROR;
+    }
+    virtual void releaseBuffer(Buffer* buffer) {
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+    }
+private:
+    int16_t* mData;
+    size_t mFrameCount;
+};
+
+// Mixes one track of each mask at unity gain into an output of each mask, and compares the
+// last output frame with the expected remapping, see AudioMixer::MIXER_CHANNEL_MASK.
+static int checkChannelMap() {
+    // 1000 * (1 + sqrt(1/2) * 3), the front left with the folded front center at -3 dB
+    static const int16_t kFoldLeft = 3121;
+    static const int16_t kFoldRight = 4121;
+    static const audio_channel_mask_t k5Point1Side = (audio_channel_mask_t) (
+            AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
+            AUDIO_CHANNEL_OUT_FRONT_CENTER | AUDIO_CHANNEL_OUT_LOW_FREQUENCY |
+            AUDIO_CHANNEL_OUT_SIDE_LEFT | AUDIO_CHANNEL_OUT_SIDE_RIGHT);
+    static const struct {
+        audio_channel_mask_t trackMask;
+        audio_channel_mask_t outputMask;
+        int16_t expected[AudioMixer::MAX_NUM_CHANNELS_TO_DOWNMIX];
+    } kCases[] = {
+        // same positions, the outputs missing from the track stay silent
+        { AUDIO_CHANNEL_OUT_5POINT1, AUDIO_CHANNEL_OUT_7POINT1,
+                { 1000, 2000, 3000, 4000, 5000, 6000, 0, 0 } },
+        { AUDIO_CHANNEL_OUT_STEREO, AUDIO_CHANNEL_OUT_5POINT1,
+                { 1000, 2000, 0, 0, 0, 0 } },
+        // back to side
+        { AUDIO_CHANNEL_OUT_5POINT1, k5Point1Side,
+                { 1000, 2000, 3000, 4000, 5000, 6000 } },
+        // side added to back
+        { AUDIO_CHANNEL_OUT_7POINT1, AUDIO_CHANNEL_OUT_5POINT1,
+                { 1000, 2000, 3000, 4000, 12000, 14000 } },
+        // center folded into front left and right, LFE dropped
+        { AUDIO_CHANNEL_OUT_5POINT1, AUDIO_CHANNEL_OUT_QUAD,
+                { kFoldLeft, kFoldRight, 5000, 6000 } },
+    };
+    static const size_t kFrameCount = 64;
+
+    int failures = 0;
+    for (size_t k = 0; k < sizeof(kCases) / sizeof(kCases[0]); k++) {
+        const audio_channel_mask_t trackMask = kCases[k].trackMask;
+        const audio_channel_mask_t outputMask = kCases[k].outputMask;
+        const uint32_t outChannels = popcount(outputMask);
+        AudioMixer* mixer = new AudioMixer(kFrameCount, 48000);
+        int16_t* mainBuffer = new int16_t[kFrameCount * outChannels];
+        ChannelIndexProvider provider(popcount(trackMask), kFrameCount);
+        const int name = mixer->getTrackName(trackMask, 0 /*sessionId*/, outputMask);
+        if (name < 0) {
+            fprintf(stderr, "getTrackName failed for mask %#x\n", trackMask);
+            return -1;
+        }
+        mixer->setBufferProvider(name, &provider);
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::MAIN_BUFFER, mainBuffer);
+        mixer->setParameter(name, AudioMixer::VOLUME, AudioMixer::VOLUME0,
+                (void *) AudioMixer::UNITY_GAIN);
+        mixer->setParameter(name, AudioMixer::VOLUME, AudioMixer::VOLUME1,
+                (void *) AudioMixer::UNITY_GAIN);
+        mixer->enable(name);
+        // past the initial volume ramp
+        for (int n = 0; n < 4; n++) {
+            mixer->process(AudioBufferProvider::kInvalidPTS);
+        }
+
+        const int16_t* frame = mainBuffer + (kFrameCount - 1) * outChannels;
+        bool ok = true;
+        for (uint32_t c = 0; c < outChannels; c++) {
+            if (abs(frame[c] - kCases[k].expected[c]) > 1) {
+                ok = false;
+            }
+        }
+        printf("%s: track %#x -> output %#x:", ok ? "ok" : "FAILED", trackMask, outputMask);
+        for (uint32_t c = 0; c < outChannels; c++) {
+            printf(" %d", frame[c]);
+        }
+        printf("\n");
+        failures += ok ? 0 : 1;
+
+        mixer->deleteTrackName(name);
+        delete mixer;
+        delete [] mainBuffer;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+
+    const char* const progname = argv[0];
+    int numTracks = 8;
+    size_t frameCount = 960;
+    uint32_t outputRate = 48000;
+    uint32_t inputRate = 0;
+    int numBuffers = 1000;
+    int workers = 0;
+    int channels = 2;
+    bool ramp = false;
+    bool aux = false;
+
+    int ch;
+    while ((ch = getopt(argc, argv, "t:f:o:i:n:w:mrac")) != -1) {
+        switch (ch) {
+        case 't':
+            numTracks = atoi(optarg);
+            break;
+        case 'f':
+            frameCount = atoi(optarg);
+            break;
+        case 'o':
+            outputRate = atoi(optarg);
+            break;
+        case 'i':
+            inputRate = atoi(optarg);
+            break;
+        case 'n':
+            numBuffers = atoi(optarg);
+            break;
+        case 'w':
+            workers = atoi(optarg);
+            break;
+        case 'm':
+            channels = 1;
+            break;
+        case 'r':
+            ramp = true;
+            break;
+        case 'a':
+            aux = true;
+            break;
+        case 'c':
+            return checkChannelMap();
+        case '?':
+        default:
+            usage(progname);
+            return -1;
+        }
+    }
+    if (numTracks <= 0 || numTracks > (int) AudioMixer::MAX_NUM_TRACKS || frameCount == 0 ||
+            numBuffers <= 0) {
+        usage(progname);
+        return -1;
+    }
+    if (inputRate == 0) {
+        inputRate = outputRate;
+    }
+
+    // ----------------------------------------------------------
+
+    AudioMixer* mixer = new AudioMixer(frameCount, outputRate);
+    mixer->setWorkerThreads(workers);
+    int32_t* mainBuffer = new int32_t[frameCount * AudioMixer::MAX_NUM_CHANNELS];
+    int32_t* auxBuffer = new int32_t[frameCount];
+    SineProvider** providers = new SineProvider*[numTracks];
+    int* names = new int[numTracks];
+
+    const audio_channel_mask_t mask =
+            channels == 1 ? AUDIO_CHANNEL_OUT_MONO : AUDIO_CHANNEL_OUT_STEREO;
+    for (int i = 0; i < numTracks; i++) {
+        providers[i] = new SineProvider(channels, inputRate, 440.0 * (i + 1), 0.5,
+                inputRate /*numFrames*/, true /*loop*/, inputRate /*maxFrames*/);
+        names[i] = mixer->getTrackName(mask, 0 /*sessionId*/);
+        if (names[i] < 0) {
+            fprintf(stderr, "getTrackName failed for track %d\n", i);
+            return -1;
+        }
+        mixer->setBufferProvider(names[i], providers[i]);
+        mixer->setParameter(names[i], AudioMixer::TRACK, AudioMixer::MAIN_BUFFER, mainBuffer);
+        if (aux) {
+            mixer->setParameter(names[i], AudioMixer::TRACK, AudioMixer::AUX_BUFFER, auxBuffer);
+            mixer->setParameter(names[i], AudioMixer::VOLUME, AudioMixer::AUXLEVEL,
+                    (void *) (AudioMixer::UNITY_GAIN / 2));
+        }
+        mixer->setParameter(names[i], AudioMixer::RESAMPLE, AudioMixer::SAMPLE_RATE,
+                (void *) inputRate);
+        mixer->setParameter(names[i], AudioMixer::VOLUME, AudioMixer::VOLUME0,
+                (void *) (AudioMixer::UNITY_GAIN / numTracks));
+        mixer->setParameter(names[i], AudioMixer::VOLUME, AudioMixer::VOLUME1,
+                (void *) (AudioMixer::UNITY_GAIN / numTracks));
+        mixer->enable(names[i]);
+    }
+
+    // ----------------------------------------------------------
+
+    ThreadCpuUsage tcu;
+    double ns;
+    double totalNs = 0;
+    double minNs = 0;
+    double maxNs = 0;
+    uint32_t kHz = 0;
+    tcu.sampleAndEnable(ns);
+    for (int n = 0; n < numBuffers; n++) {
+        if (ramp) {
+            const int volume = (n & 1) ? AudioMixer::UNITY_GAIN / numTracks : 0;
+            for (int i = 0; i < numTracks; i++) {
+                mixer->setParameter(names[i], AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME0,
+                        (void *) volume);
+                mixer->setParameter(names[i], AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME1,
+                        (void *) volume);
+            }
+        }
+        if (aux) {
+            memset(auxBuffer, 0, frameCount * sizeof(int32_t));
+        }
+        // the first buffer includes process__validate() and is not representative
+        tcu.sampleAndEnable(ns);
+        mixer->process(AudioBufferProvider::kInvalidPTS);
+        if (tcu.sampleAndEnable(ns) && n > 0) {
+            totalNs += ns;
+            if (n == 1 || ns < minNs) {
+                minNs = ns;
+            }
+            if (ns > maxNs) {
+                maxNs = ns;
+            }
+        }
+        if (kHz == 0) {
+            kHz = tcu.getCpukHz(sched_getcpu());
+        }
+    }
+
+    const double meanNs = totalNs / (numBuffers > 1 ? numBuffers - 1 : 1);
+    printf("%d %s tracks, %u Hz -> %u Hz, %zu frames, %d workers%s%s\n",
+            numTracks, channels == 1 ? "mono" : "stereo", inputRate, outputRate, frameCount,
+            workers, ramp ? ", ramp" : "", aux ? ", aux" : "");
+    printf("CPU per buffer: mean %.0f ns, min %.0f ns, max %.0f ns\n", meanNs, minNs, maxNs);
+    printf("CPU per track per buffer: %.0f ns, %.0f ns/frame\n",
+            meanNs / numTracks, meanNs / numTracks / frameCount);
+    if (kHz != 0 && kHz != (uint32_t) ~0) {
+        // kHz * ns / 1e6 = cycles
+        const double cycles = meanNs * kHz / 1e6;
+        printf("cycles per buffer: %.0f, per track per buffer: %.0f, per track per frame: %.2f "
+                "(at %u kHz)\n", cycles, cycles / numTracks, cycles / numTracks / frameCount, kHz);
+    } else {
+        printf("CPU frequency unknown, cycles not reported\n");
+    }
+
+    for (int i = 0; i < numTracks; i++) {
+        mixer->deleteTrackName(names[i]);
+        delete providers[i];
+    }
+    delete mixer;
+    delete [] providers;
+    delete [] names;
+    delete [] mainBuffer;
+    delete [] auxBuffer;
+    return 0;
+}
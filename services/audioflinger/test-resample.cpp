@@ -15,7 +15,9 @@
  */
 
 #include "AudioResampler.h"
+#include "test-utils.h"
 #include <media/AudioBufferProvider.h>
+#include <cpustats/ThreadCpuUsage.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,6 +26,7 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <sched.h>
 #include <time.h>
 #include <math.h>
 
@@ -64,6 +67,12 @@ struct HeaderWav {
 static int usage(const char* name) {
     fprintf(stderr,"Usage: %s [-p] [-h] [-s] [-q {dq|lq|mq|hq|vhq}] [-i input-sample-rate] "
                    "[-o output-sample-rate] [<input-file>] <output-file>\n", name);
+    fprintf(stderr,"       %s -b [-q {dq|lq|mq|hq|vhq}] [-i input-sample-rate] "
+                   "[-o output-sample-rate] [-c cpu-MHz] [-r repeat]\n", name);
+    fprintf(stderr,"    -b    run the benchmark and quality suite instead of writing a file\n");
+    fprintf(stderr,"          (all qualities, channel counts and common ratios by default)\n");
+    fprintf(stderr,"    -c    CPU clock used to convert time to MHz (default: current cpufreq)\n");
+    fprintf(stderr,"    -r    number of timed runs per combination, best is kept (default 3)\n");
     fprintf(stderr,"    -p    enable profiling\n");
     fprintf(stderr,"    -h    create wav file\n");
     fprintf(stderr,"    -s    stereo\n");
@@ -78,19 +87,251 @@ static int usage(const char* name) {
     return -1;
 }
 
+// ----------------------------------------------------------------------------
+// Benchmark and quality suite
+
+static const struct {
+    int input;
+    int output;
+} kRatios[] = {
+    { 44100, 48000 },
+    { 48000, 44100 },
+    {  8000, 48000 },
+    { 16000, 48000 },
+    { 22050, 48000 },
+    { 32000, 48000 },
+    { 11025, 44100 },
+};
+
+static const AudioResampler::src_quality kQualities[] = {
+    AudioResampler::DEFAULT_QUALITY,
+    AudioResampler::LOW_QUALITY,
+    AudioResampler::MED_QUALITY,
+    AudioResampler::HIGH_QUALITY,
+    AudioResampler::VERY_HIGH_QUALITY,
+};
+
+static const char* qualityName(AudioResampler::src_quality quality) {
+    switch (quality) {
+    case AudioResampler::DEFAULT_QUALITY:   return "dq";
+    case AudioResampler::LOW_QUALITY:       return "lq";
+    case AudioResampler::MED_QUALITY:       return "mq";
+    case AudioResampler::HIGH_QUALITY:      return "hq";
+    case AudioResampler::VERY_HIGH_QUALITY: return "vhq";
+    default:                                return "?";
+    }
+}
+
+// same size as a typical normal mixer buffer
+static const size_t kBenchmarkFrames = 1024;
+
+// Resample a sine of the given frequency and fit a sine of the same frequency to the
+// left output channel by least squares. Returns the gain in dB, and optionally the
+// THD+N in dB, i.e. the power of the fit residual relative to the fitted sine.
+static double measureTone(AudioResampler::src_quality quality, int channels,
+        int inputRate, int outputRate, double frequency, double* thdn) {
+    static const double kAmplitude = 0.5;
+    const size_t skipFrames = 1024;     // filter transient
+    const size_t outFrames = skipFrames + outputRate / 4;
+    const size_t inFrames = size_t((int64_t) outFrames * inputRate / outputRate) + 256;
+
+    SineProvider provider(channels, inputRate, frequency, kAmplitude, inFrames, false,
+            kBenchmarkFrames);
+    AudioResampler* resampler = AudioResampler::create(16, channels, outputRate, quality);
+    resampler->setSampleRate(inputRate);
+    resampler->setVolume(0x1000, 0x1000);
+    int32_t* out = (int32_t*) calloc(outFrames * 2, sizeof(int32_t));
+    for (size_t i = 0; i < outFrames; i += kBenchmarkFrames) {
+        size_t frames = outFrames - i < kBenchmarkFrames ? outFrames - i : kBenchmarkFrames;
+        resampler->resample(out + i * 2, frames, &provider);
+    }
+    delete resampler;
+
+    // normal equations for y = a cos(wn) + b sin(wn) + c
+    const double w = 2 * M_PI * frequency / outputRate;
+    double m[3][4];
+    memset(m, 0, sizeof(m));
+    for (size_t n = skipFrames; n < outFrames; n++) {
+        const double y = out[n * 2] / (4096.0 * 32767.0);
+        const double x[3] = { cos(w * n), sin(w * n), 1.0 };
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                m[i][j] += x[i] * x[j];
+            }
+            m[i][3] += x[i] * y;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int k = i + 1; k < 3; k++) {
+            const double f = m[k][i] / m[i][i];
+            for (int j = i; j < 4; j++) {
+                m[k][j] -= f * m[i][j];
+            }
+        }
+    }
+    double coef[3];
+    for (int i = 2; i >= 0; i--) {
+        double v = m[i][3];
+        for (int j = i + 1; j < 3; j++) {
+            v -= m[i][j] * coef[j];
+        }
+        coef[i] = v / m[i][i];
+    }
+
+    if (thdn != NULL) {
+        double signal = 0;
+        double residual = 0;
+        for (size_t n = skipFrames; n < outFrames; n++) {
+            const double y = out[n * 2] / (4096.0 * 32767.0);
+            const double fit = coef[0] * cos(w * n) + coef[1] * sin(w * n);
+            signal += fit * fit;
+            residual += (y - fit) * (y - fit);
+        }
+        *thdn = 10 * log10(residual / signal);
+    }
+    free(out);
+    return 20 * log10(sqrt(coef[0] * coef[0] + coef[1] * coef[1]) / kAmplitude);
+}
+
+// Returns the best output frames per second over the given number of runs of one second
+static double measureSpeed(AudioResampler::src_quality quality, int channels,
+        int inputRate, int outputRate, int repeat) {
+    SineProvider provider(channels, inputRate, 1000.0, 0.5, inputRate, true, kBenchmarkFrames);
+    AudioResampler* resampler = AudioResampler::create(16, channels, outputRate, quality);
+    resampler->setSampleRate(inputRate);
+    resampler->setVolume(0x1000, 0x1000);
+    int32_t* out = (int32_t*) calloc(kBenchmarkFrames * 2, sizeof(int32_t));
+
+    ThreadCpuUsage tcu;
+    double best = 0;
+    double ns;
+    for (int r = 0; r <= repeat; r++) {
+        tcu.sampleAndEnable(ns);
+        for (int i = 0; i < outputRate; i += kBenchmarkFrames) {
+            resampler->resample(out, kBenchmarkFrames, &provider);
+        }
+        // the first run warms up caches and the coefficient tables, and is not counted
+        if (tcu.sampleAndEnable(ns) && r > 0 && ns > 0 && (best == 0 || ns < best)) {
+            best = ns;
+        }
+    }
+    free(out);
+    delete resampler;
+    const size_t frames = ((outputRate + kBenchmarkFrames - 1) / kBenchmarkFrames) *
+            kBenchmarkFrames;
+    return best > 0 ? frames / (best / 1e9) : 0;
+}
+
+static int benchmark(bool allQualities, AudioResampler::src_quality quality,
+        int inputRate, int outputRate, double cpuMHz, int repeat) {
+    if (cpuMHz <= 0) {
+        ThreadCpuUsage tcu;
+        uint32_t kHz = tcu.getCpukHz(sched_getcpu());
+        if (kHz != 0 && kHz != (uint32_t) ~0) {
+            cpuMHz = kHz / 1000.0;
+        }
+    }
+    if (cpuMHz > 0) {
+        printf("CPU clock %.0f MHz\n", cpuMHz);
+    } else {
+        printf("CPU clock unknown, use -c to report MHz\n");
+    }
+    // THD+N is for a 1 kHz tone at -6 dBFS, ripple is the peak to peak gain in dB up to
+    // half the lower Nyquist frequency, and rolloff is the gain at 90% of that frequency.
+    printf("%-6s %2s %11s %10s %8s %7s %7s %7s %7s %7s\n", "qual", "ch", "ratio", "frames/s",
+            "RT", "MHz", "budget", "THD+N", "ripple", "rolloff");
+
+    const size_t numRatios = inputRate > 0 && outputRate > 0 ?
+            1 : sizeof(kRatios) / sizeof(kRatios[0]);
+    const size_t numQualities = allQualities ? sizeof(kQualities) / sizeof(kQualities[0]) : 1;
+    for (size_t q = 0; q < numQualities; q++) {
+        const AudioResampler::src_quality requested = allQualities ? kQualities[q] : quality;
+        for (int channels = 1; channels <= 2; channels++) {
+            for (size_t r = 0; r < numRatios; r++) {
+                const int in = numRatios == 1 ? inputRate : kRatios[r].input;
+                const int out = numRatios == 1 ? outputRate : kRatios[r].output;
+
+                // the default quality may be forced by af.resampler.quality
+                AudioResampler* resampler = AudioResampler::create(16, channels, out,
+                        requested);
+                const AudioResampler::src_quality actual = resampler->getQuality();
+                delete resampler;
+
+                const double framesPerSecond = measureSpeed(requested, channels, in, out,
+                        repeat);
+                const double rt = framesPerSecond / out;
+
+                double thdn;
+                measureTone(requested, channels, in, out, 1000.0, &thdn);
+
+                const double nyquist = (in < out ? in : out) / 2.0;
+                const double rolloff = measureTone(requested, channels, in, out,
+                        nyquist * 0.9, NULL);
+                const double edge = nyquist * 0.5;
+                static const int kRippleTones = 16;
+                double minGain = 0;
+                double maxGain = 0;
+                for (int i = 1; i <= kRippleTones; i++) {
+                    double gain = measureTone(requested, channels, in, out,
+                            edge * i / kRippleTones, NULL);
+                    if (i == 1 || gain < minGain) {
+                        minGain = gain;
+                    }
+                    if (i == 1 || gain > maxGain) {
+                        maxGain = gain;
+                    }
+                }
+
+                char name[16];
+                if (actual != requested) {
+                    snprintf(name, sizeof(name), "%s/%s", qualityName(requested),
+                            qualityName(actual));
+                } else {
+                    snprintf(name, sizeof(name), "%s", qualityName(actual));
+                }
+                char ratio[16];
+                snprintf(ratio, sizeof(ratio), "%d>%d", in, out);
+                char mhz[16];
+                if (cpuMHz > 0 && rt > 0) {
+                    snprintf(mhz, sizeof(mhz), "%.2f", cpuMHz / rt);
+                } else {
+                    snprintf(mhz, sizeof(mhz), "-");
+                }
+                printf("%-6s %2d %11s %10.0f %8.1f %7s %7u %7.1f %7.2f %7.1f\n",
+                        name, channels, ratio, framesPerSecond, rt, mhz,
+                        AudioResampler::qualityMHz(actual), thdn, maxGain - minGain, rolloff);
+            }
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
 
     const char* const progname = argv[0];
     bool profiling = false;
     bool writeHeader = false;
+    bool runBenchmark = false;
+    bool allQualities = true;
+    double cpuMHz = 0;
+    int repeat = 3;
     int channels = 1;
     int input_freq = 0;
     int output_freq = 0;
     AudioResampler::src_quality quality = AudioResampler::DEFAULT_QUALITY;
 
     int ch;
-    while ((ch = getopt(argc, argv, "phsq:i:o:")) != -1) {
+    while ((ch = getopt(argc, argv, "phsq:i:o:bc:r:")) != -1) {
         switch (ch) {
+        case 'b':
+            runBenchmark = true;
+            break;
+        case 'c':
+            cpuMHz = atof(optarg);
+            break;
+        case 'r':
+            repeat = atoi(optarg);
+            break;
         case 'p':
             profiling = true;
             break;
@@ -101,6 +342,7 @@ int main(int argc, char* argv[]) {
             channels = 2;
             break;
         case 'q':
+            allQualities = false;
             if (!strcmp(optarg, "dq"))
                 quality = AudioResampler::DEFAULT_QUALITY;
             else if (!strcmp(optarg, "lq"))
@@ -131,6 +373,14 @@ int main(int argc, char* argv[]) {
     argc -= optind;
     argv += optind;
 
+    if (runBenchmark) {
+        if (repeat < 1) {
+            usage(progname);
+            return -1;
+        }
+        return benchmark(allQualities, quality, input_freq, output_freq, cpuMHz, repeat);
+    }
+
     const char* file_in = NULL;
     const char* file_out = NULL;
     if (argc == 1) {
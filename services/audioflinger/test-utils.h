@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Test fixtures shared by test-mixer and test-resample.
+
+#ifndef ANDROID_AUDIOFLINGER_TEST_UTILS_H
+#define ANDROID_AUDIOFLINGER_TEST_UTILS_H
+
+#include <media/AudioBufferProvider.h>
+#include <math.h>
+
+namespace android {
+
+// Serves a precomputed 16-bit sine wave of numFrames frames, in chunks of at most maxFrames,
+// optionally looping.  The amplitude is relative to full scale.  When not looping,
+// getNextBuffer() returns NOT_ENOUGH_DATA once the wave has been consumed.
+class SineProvider : public AudioBufferProvider {
+public:
+    SineProvider(int channels, uint32_t sampleRate, double frequency, double amplitude,
+            size_t numFrames, bool loop, size_t maxFrames)
+        : mChannels(channels), mNumFrames(numFrames), mMaxFrames(maxFrames), mPosition(0),
+          mLoop(loop) {
+        mData = new int16_t[numFrames * channels];
+        for (size_t i = 0; i < numFrames; i++) {
+            double y = amplitude * sin(2 * M_PI * frequency * i / sampleRate);
+            int16_t yi = int16_t(floor(y * 32767.0 + 0.5));
+            for (int j = 0; j < channels; j++) {
+                mData[i * channels + j] = yi;
+            }
+        }
+    }
+    virtual ~SineProvider() {
+        delete [] mData;
+    }
+    virtual status_t getNextBuffer(Buffer* buffer, int64_t pts = kInvalidPTS) {
+        size_t frames = mNumFrames - mPosition;
+        if (frames == 0) {
+            buffer->raw = NULL;
+            buffer->frameCount = 0;
+            return NOT_ENOUGH_DATA;
+        }
+        if (frames > mMaxFrames) {
+            frames = mMaxFrames;
+        }
+        if (buffer->frameCount > frames) {
+            buffer->frameCount = frames;
+        }
+        buffer->i16 = mData + mPosition * mChannels;
+        return NO_ERROR;
+    }
+    virtual void releaseBuffer(Buffer* buffer) {
+        mPosition += buffer->frameCount;
+        if (mLoop && mPosition >= mNumFrames) {
+            mPosition = 0;
+        }
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+    }
+private:
+    const int mChannels;
+    const size_t mNumFrames;
+    const size_t mMaxFrames;
+    size_t mPosition;
+    const bool mLoop;
+    int16_t* mData;
+};
+
+}   // namespace android
+
+#endif // ANDROID_AUDIOFLINGER_TEST_UTILS_H
@@ -71,6 +71,22 @@ status_t MediaLogService::dump(int fd, const Vector<String16>& args)
         Mutex::Autolock _l(mLock);
         namedReaders = mNamedReaders;
     }
+    // "dumpsys media.log --merge" interleaves the logs of all writers in timestamp order
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == String16("--merge")) {
+            size_t count = namedReaders.size();
+            sp<NBLog::Reader> *readers = new sp<NBLog::Reader>[count];
+            const char **names = new const char *[count];
+            for (size_t j = 0; j < count; j++) {
+                readers[j] = namedReaders[j].reader();
+                names[j] = namedReaders[j].name();
+            }
+            NBLog::Reader::dumpMerged(fd, count, readers, names);
+            delete[] names;
+            delete[] readers;
+            return NO_ERROR;
+        }
+    }
     for (size_t i = 0; i < namedReaders.size(); i++) {
         const NamedReader& namedReader = namedReaders[i];
         if (fd >= 0) {
@@ -0,0 +1,16 @@
+# Copyright 2013 The Android Open Source Project
+#
+# Android.mk for fastmixer_stats
+#
+
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	fastmixer_stats.cpp
+
+LOCAL_MODULE := fastmixer_stats
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Offline analyzer for the fast mixer statistics written by "dumpsys media.audio_flinger --json"
+// (FastMixerDumpState::dumpJson).  Input files may contain other text, such as a full dumpsys
+// or a bugreport; every fast mixer JSON line in them is a snapshot.  Prints the intervals of
+// the recent underruns and overruns, and the cycle time and CPU load distributions including
+// the tails, of each snapshot and of the runs with the same mix period merged.
+//
+// The counters of a snapshot accumulate over the life of its mixer thread, so a later snapshot
+// of the same run, that is the same output with no counter gone down, includes the earlier
+// one.  Such a snapshot is also printed as the difference from the previous one, and only the
+// last snapshot of each run is merged.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <vector>
+
+static const char kSnapshotTag[] = "{\"fastMixer\":";
+
+struct Snapshot {
+    Snapshot() : version(0), output(-1), nowNs(0), sampleRate(0), frameCount(0), underruns(0),
+            overruns(0), writeErrors(0), histogramSubBits(0) { }
+    long long version;
+    long long output;       // -1 if the dump predates the field
+    long long nowNs;
+    long long sampleRate;
+    long long frameCount;
+    long long underruns;
+    long long overruns;
+    long long writeErrors;
+    long long histogramSubBits;
+    std::vector<long long> underrunNs;
+    std::vector<long long> overrunNs;
+    std::vector<long long> cycleNs;
+    std::vector<long long> loadNs;
+};
+
+// Finds "name": within [json, end) and parses the number that follows
+static bool parseNumber(const char *json, const char *end, const char *name, long long *value)
+{
+    char key[64];
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    size_t keyLen = strlen(key);
+    for (const char *p = json; p + keyLen <= end; ++p) {
+        if (!memcmp(p, key, keyLen)) {
+            *value = strtoll(p + keyLen, NULL, 10);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Same for an array of numbers
+static bool parseArray(const char *json, const char *end, const char *name,
+        std::vector<long long> *values)
+{
+    char key[64];
+    snprintf(key, sizeof(key), "\"%s\":[", name);
+    size_t keyLen = strlen(key);
+    for (const char *p = json; p + keyLen <= end; ++p) {
+        if (!memcmp(p, key, keyLen)) {
+            p += keyLen;
+            values->clear();
+            while (p < end && *p != ']') {
+                char *next;
+                values->push_back(strtoll(p, &next, 10));
+                if (next == p) {
+                    return false;
+                }
+                p = *next == ',' ? next + 1 : next;
+            }
+            return p < end;
+        }
+    }
+    return false;
+}
+
+static bool parseSnapshot(const char *json, const char *end, Snapshot *s)
+{
+    if (!parseNumber(json, end, "fastMixer", &s->version) || s->version != 1 ||
+            !parseNumber(json, end, "sampleRate", &s->sampleRate) || s->sampleRate <= 0 ||
+            !parseNumber(json, end, "frameCount", &s->frameCount) ||
+            !parseNumber(json, end, "nowNs", &s->nowNs) ||
+            !parseNumber(json, end, "underruns", &s->underruns) ||
+            !parseNumber(json, end, "overruns", &s->overruns) ||
+            !parseNumber(json, end, "writeErrors", &s->writeErrors) ||
+            !parseArray(json, end, "underrunNs", &s->underrunNs) ||
+            !parseArray(json, end, "overrunNs", &s->overrunNs)) {
+        return false;
+    }
+    parseNumber(json, end, "output", &s->output);
+    // histograms are absent if the fast mixer was built without FAST_MIXER_STATISTICS
+    if (parseNumber(json, end, "histogramSubBits", &s->histogramSubBits)) {
+        if (s->histogramSubBits < 0 || s->histogramSubBits > 8 ||
+                !parseArray(json, end, "cycleNs", &s->cycleNs) ||
+                !parseArray(json, end, "loadNs", &s->loadNs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Lowest value of a histogram bin, see FastMixerDumpState::histogramBinLowest()
+static double binLowest(size_t bin, unsigned subBits)
+{
+    if (bin < (1u << subBits)) {
+        return bin;
+    }
+    unsigned shift = (bin >> subBits) - 1;
+    return (double) ((1u << subBits) | (bin & ((1u << subBits) - 1))) * (double) (1ULL << shift);
+}
+
+static long long histogramTotal(const std::vector<long long>& histogram)
+{
+    long long total = 0;
+    for (size_t i = 0; i < histogram.size(); ++i) {
+        total += histogram[i];
+    }
+    return total;
+}
+
+// Upper bound of the bin that holds the given fraction of the samples, so tails are not
+// under-estimated
+static double percentile(const std::vector<long long>& histogram, unsigned subBits,
+        double fraction)
+{
+    long long total = histogramTotal(histogram);
+    long long rank = (long long) (fraction * total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    long long count = 0;
+    for (size_t i = 0; i < histogram.size(); ++i) {
+        count += histogram[i];
+        if (count >= rank) {
+            return binLowest(i + 1, subBits);
+        }
+    }
+    return 0;
+}
+
+// Fraction of the samples at or above a value, rounded to bins
+static double fractionAbove(const std::vector<long long>& histogram, unsigned subBits,
+        double value)
+{
+    long long total = histogramTotal(histogram);
+    long long count = 0;
+    for (size_t i = 0; i < histogram.size(); ++i) {
+        if (binLowest(i, subBits) >= value) {
+            count += histogram[i];
+        }
+    }
+    return total > 0 ? (double) count / total : 0;
+}
+
+// Fraction of the samples below a value, rounded to bins
+static double fractionBelow(const std::vector<long long>& histogram, unsigned subBits,
+        double value)
+{
+    long long total = histogramTotal(histogram);
+    long long count = 0;
+    for (size_t i = 0; i < histogram.size(); ++i) {
+        if (binLowest(i + 1, subBits) <= value) {
+            count += histogram[i];
+        }
+    }
+    return total > 0 ? (double) count / total : 0;
+}
+
+static void printDistribution(const char *name, const std::vector<long long>& histogram,
+        unsigned subBits, double scale, const char *unit)
+{
+    static const double kFractions[] = {0.5, 0.9, 0.99, 0.999, 0.9999, 1.0};
+    printf("  %s in %s (%lld samples):\n   ", name, unit, histogramTotal(histogram));
+    for (size_t i = 0; i < sizeof(kFractions) / sizeof(kFractions[0]); ++i) {
+        if (kFractions[i] < 1.0) {
+            printf(" p%g<=%.3f", kFractions[i] * 100, percentile(histogram, subBits,
+                    kFractions[i]) * scale);
+        } else {
+            printf(" max<%.3f", percentile(histogram, subBits, kFractions[i]) * scale);
+        }
+    }
+    printf("\n");
+}
+
+// Intervals between the recent events of one kind, and the time since the most recent one
+static void printEvents(const char *name, const std::vector<long long>& eventNs, long long nowNs)
+{
+    if (eventNs.size() > 1) {
+        long long minGap = -1;
+        for (size_t i = 1; i < eventNs.size(); ++i) {
+            long long gap = eventNs[i] - eventNs[i - 1];
+            if (minGap < 0 || gap < minGap) {
+                minGap = gap;
+            }
+        }
+        printf("  last %zu %ss: mean interval %.3f s, min interval %.3f s\n", eventNs.size(),
+                name, (eventNs.back() - eventNs.front()) * 1e-9 / (eventNs.size() - 1),
+                minGap * 1e-9);
+    }
+    if (!eventNs.empty()) {
+        printf("  most recent %s %.3f s before the dump\n", name,
+                (nowNs - eventNs.back()) * 1e-9);
+    }
+}
+
+static void printSnapshot(const Snapshot& s)
+{
+    double periodNs = s.frameCount * 1e9 / s.sampleRate;
+    printf("  sampleRate=%lld frameCount=%lld mixPeriod=%.2f ms\n", s.sampleRate, s.frameCount,
+            periodNs * 1e-6);
+    printf("  underruns=%lld overruns=%lld writeErrors=%lld\n", s.underruns, s.overruns,
+            s.writeErrors);
+    printEvents("underrun", s.underrunNs, s.nowNs);
+    printEvents("overrun", s.overrunNs, s.nowNs);
+    if (s.histogramSubBits == 0) {
+        printf("  no histograms (FAST_MIXER_STATISTICS disabled)\n");
+        return;
+    }
+    printDistribution("wall clock time per mix cycle", s.cycleNs, s.histogramSubBits, 1e-6, "ms");
+    // FastMixer counts an underrun for a cycle longer than 1.75 periods
+    printf("    cycles >= 1.75 periods: %.4f%%\n",
+            fractionAbove(s.cycleNs, s.histogramSubBits, periodNs * 1.75) * 100);
+    // and an overrun for a cycle shorter than 0.50 periods
+    printf("    cycles < 0.50 periods: %.4f%%\n",
+            fractionBelow(s.cycleNs, s.histogramSubBits, periodNs * 0.50) * 100);
+    printDistribution("CPU load per mix cycle", s.loadNs, s.histogramSubBits, 1e-3, "us");
+    printf("    load >= 1 period: %.4f%%\n",
+            fractionAbove(s.loadNs, s.histogramSubBits, periodNs) * 100);
+}
+
+static void merge(std::vector<long long> *to, const std::vector<long long>& from)
+{
+    if (to->size() < from.size()) {
+        to->resize(from.size(), 0);
+    }
+    for (size_t i = 0; i < from.size(); ++i) {
+        (*to)[i] += from[i];
+    }
+}
+
+// Whether every bin of later is at least the same bin of earlier
+static bool histogramIncludes(const std::vector<long long>& later,
+        const std::vector<long long>& earlier)
+{
+    for (size_t i = 0; i < earlier.size(); ++i) {
+        if ((i < later.size() ? later[i] : 0) < earlier[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether later is a snapshot of the same run as earlier, taken after it
+static bool sameRun(const Snapshot& later, const Snapshot& earlier)
+{
+    return later.output == earlier.output && later.sampleRate == earlier.sampleRate &&
+            later.frameCount == earlier.frameCount &&
+            later.histogramSubBits == earlier.histogramSubBits && later.nowNs > earlier.nowNs &&
+            later.underruns >= earlier.underruns && later.overruns >= earlier.overruns &&
+            later.writeErrors >= earlier.writeErrors &&
+            histogramIncludes(later.cycleNs, earlier.cycleNs) &&
+            histogramIncludes(later.loadNs, earlier.loadNs);
+}
+
+// What happened between two snapshots of the same run
+static Snapshot difference(const Snapshot& later, const Snapshot& earlier)
+{
+    Snapshot d = later;
+    d.underruns -= earlier.underruns;
+    d.overruns -= earlier.overruns;
+    d.writeErrors -= earlier.writeErrors;
+    for (size_t i = 0; i < earlier.cycleNs.size(); ++i) {
+        d.cycleNs[i] -= earlier.cycleNs[i];
+    }
+    for (size_t i = 0; i < earlier.loadNs.size(); ++i) {
+        d.loadNs[i] -= earlier.loadNs[i];
+    }
+    d.underrunNs.clear();
+    for (size_t i = 0; i < later.underrunNs.size(); ++i) {
+        if (later.underrunNs[i] > earlier.nowNs) {
+            d.underrunNs.push_back(later.underrunNs[i]);
+        }
+    }
+    d.overrunNs.clear();
+    for (size_t i = 0; i < later.overrunNs.size(); ++i) {
+        if (later.overrunNs[i] > earlier.nowNs) {
+            d.overrunNs.push_back(later.overrunNs[i]);
+        }
+    }
+    return d;
+}
+
+static bool readAll(FILE *f, std::vector<char> *data)
+{
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        data->insert(data->end(), buffer, buffer + n);
+    }
+    return !ferror(f);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [file ...]\n", name);
+    fprintf(stderr, "    Reads the output of \"dumpsys media.audio_flinger --json\" from the files,\n"
+                    "    or from stdin if there are none.  Only the last snapshot of each run is\n"
+                    "    merged, with the runs of the same mix period.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *progname = argv[0];
+    int ch;
+    while ((ch = getopt(argc, argv, "h")) != -1) {
+        usage(progname);
+        return ch == 'h' ? 0 : 1;
+    }
+    argc -= optind;
+    argv += optind;
+
+    std::vector<Snapshot> snapshots;
+    for (int i = 0; i == 0 || i < argc; ++i) {
+        FILE *f = argc > 0 ? fopen(argv[i], "r") : stdin;
+        if (f == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        std::vector<char> data;
+        bool ok = readAll(f, &data);
+        if (f != stdin) {
+            fclose(f);
+        }
+        if (!ok) {
+            fprintf(stderr, "%s: read error\n", argc > 0 ? argv[i] : "stdin");
+            return 1;
+        }
+        data.push_back('\0');
+        for (const char *p = strstr(&data[0], kSnapshotTag); p != NULL;
+                p = strstr(p + 1, kSnapshotTag)) {
+            const char *close = strchr(p, '}');
+            Snapshot s;
+            if (close == NULL || !parseSnapshot(p, close, &s)) {
+                fprintf(stderr, "%s: ignoring malformed snapshot at offset %zu\n",
+                        argc > 0 ? argv[i] : "stdin", (size_t) (p - &data[0]));
+                continue;
+            }
+            snapshots.push_back(s);
+        }
+    }
+    if (snapshots.empty()) {
+        fprintf(stderr, "no fast mixer snapshots found\n");
+        return 1;
+    }
+
+    // A snapshot continues the run of the latest earlier snapshot of its output, if none of
+    // the counters went down since; otherwise the mixer thread was restarted.  Without an
+    // output in the dump, any earlier snapshot that it includes is taken as the same run.
+    std::vector<bool> superseded(snapshots.size(), false);
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        printf("Snapshot %zu:\n", i);
+        if (snapshots[i].output >= 0) {
+            printf("  output=%lld\n", snapshots[i].output);
+        }
+        printSnapshot(snapshots[i]);
+        for (size_t j = i; j-- > 0; ) {
+            if (superseded[j] || snapshots[j].output != snapshots[i].output) {
+                continue;
+            }
+            if (sameRun(snapshots[i], snapshots[j])) {
+                superseded[j] = true;
+                printf("Snapshot %zu since snapshot %zu, %.3f s before:\n", i, j,
+                        (snapshots[i].nowNs - snapshots[j].nowNs) * 1e-9);
+                printSnapshot(difference(snapshots[i], snapshots[j]));
+                break;
+            }
+            if (snapshots[i].output >= 0) {
+                break;
+            }
+        }
+    }
+
+    // merge the runs of each mix period, as the cycle times are only comparable for those
+    std::vector<bool> merged(superseded);
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        if (merged[i]) {
+            continue;
+        }
+        Snapshot total = snapshots[i];
+        size_t count = 1;
+        for (size_t j = i + 1; j < snapshots.size(); ++j) {
+            const Snapshot& s = snapshots[j];
+            if (merged[j] || s.sampleRate != total.sampleRate ||
+                    s.frameCount != total.frameCount ||
+                    s.histogramSubBits != total.histogramSubBits) {
+                continue;
+            }
+            merged[j] = true;
+            ++count;
+            total.underruns += s.underruns;
+            total.overruns += s.overruns;
+            total.writeErrors += s.writeErrors;
+            merge(&total.cycleNs, s.cycleNs);
+            merge(&total.loadNs, s.loadNs);
+        }
+        if (count == 1) {
+            continue;
+        }
+        // underrun and overrun intervals are only meaningful within a snapshot
+        total.underrunNs.clear();
+        total.overrunNs.clear();
+        printf("Merged %zu runs:\n", count);
+        printSnapshot(total);
+    }
+    return 0;
+}